@@ -0,0 +1,319 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ================================================================================
+// MpscQueue: 複数生産者・1消費者の固定長キュー (ロックなし)
+//   - セルごとの番号で空き/使用中を判定する有界キュー (Vyukov 方式)
+//   - push() は満杯なら false を返す (待たない)。成功時は 1 始まりの通し番号を ticket に返す
+//   - 取り出しは push した順 (通し番号の順)
+// ================================================================================
+template <class T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity)
+        : capacity_(std::bit_ceil(std::max<size_t>(capacity, 2))), mask_(capacity_ - 1), cells_(std::make_unique<Cell[]>(capacity_)) {
+        for (size_t i = 0; i < capacity_; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // どのスレッドからも呼べる
+    bool push(const T& value, uint64_t& ticket) noexcept {
+        uint64_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[pos & mask_];
+            const int64_t diff = static_cast<int64_t>(cell.seq.load(std::memory_order_acquire) - pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false; // 満杯
+            }
+            else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        Cell& cell = cells_[pos & mask_];
+        cell.value = value;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        ticket = pos + 1;
+        return true;
+    }
+
+    // 消費者スレッドから呼ぶ
+    bool pop(T& out) noexcept {
+        const uint64_t pos = tail_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[pos & mask_];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1) return false;
+        out = cell.value;
+        cell.seq.store(pos + capacity_, std::memory_order_release);
+        tail_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 取り出し済みの個数 (= 処理が済んだ最後の通し番号)
+    [[nodiscard]] uint64_t popped() const noexcept { return tail_.load(std::memory_order_acquire); }
+    [[nodiscard]] size_t size() const noexcept { return static_cast<size_t>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire)); }
+    [[nodiscard]] size_t capacity() const noexcept { return capacity_; }
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> seq;
+        T value;
+    };
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<uint64_t> head_{ 0 }; // 生産者が進める
+    alignas(64) std::atomic<uint64_t> tail_{ 0 }; // 消費者が進める
+};
+
+// 測定状態を変える操作 (GUI・パイプ・ソケットから積み、測定スレッドがフレーム境界で適用する)
+struct ControlCommand {
+    enum class Op : uint8_t {
+        AwgApply,    // 現在の awg 設定で AWG を再設定する
+        AwgFreq,     // awg.ch[ch].freq = value
+        AwgAmp,
+        AwgPhase,
+        AwgFunc,
+        ScopeRange,  // scope.ch[ch].range = value (スコープを開き直す)
+        ScopeRate,   // サンプリング周波数 value Hz でスコープを開き直す
+        HpfFreq,
+        LpfFreq,
+        ChEnable,    // scope.ch[ch].enable = (value != 0)
+        OffsetPhase, // post.offset[ch].phase = value
+        OffsetClear, // 全チャンネルのオフセット x, y を 0 にする (phase は残す)
+        Reset,
+    };
+    Op op = Op::AwgApply;
+    int ch = 0;
+    double value = 0.0;
+    std::chrono::steady_clock::time_point queued{};
+};
+
+// ================================================================================
+// ControlQueue: ControlCommand の MPSC キューと適用遅延 (積んでから適用し終えるまで) の統計
+//   - submit() はどのスレッドからも呼べる。満杯なら 0 を返して rejected を数える
+//   - drain() は一度に1スレッドだけが実行する (同時に呼ばれた側は何もせず戻る)
+// ================================================================================
+class ControlQueue {
+public:
+    static constexpr size_t CAPACITY = 256;
+    static constexpr size_t MAX_BATCH = 64; // 1フレームで適用する上限
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t applied = 0;
+        uint64_t rejected = 0;  // キューが満杯で受け付けなかった数
+        size_t queued = 0;
+        double lastUs = 0.0;
+        double meanUs = 0.0;
+        double maxUs = 0.0;
+    };
+
+    ControlQueue() : queue_(CAPACITY) {}
+
+    // 積んだコマンドの通し番号 (applied() がこれ以上になれば適用済み)。満杯なら 0
+    uint64_t submit(ControlCommand cmd) noexcept {
+        cmd.queued = Clock::now();
+        uint64_t ticket = 0;
+        if (!queue_.push(cmd, ticket)) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        return ticket;
+    }
+
+    // 積まれたコマンドを順に apply(cmd) し、最後に finish() を呼ぶ。適用した数を返す
+    //   apply / finish が例外を投げても、取り出した分は適用済みに数えて draining_ を戻す
+    //   (待っている側が期限まで待ち続けたり、以後の drain が何もしなくなったりしないように)
+    template <class Apply, class Finish>
+    size_t drain(Apply&& apply, Finish&& finish) {
+        if (draining_.test_and_set(std::memory_order_acquire)) return 0;
+        struct Batch {
+            ControlQueue& q;
+            size_t n = 0;
+            ~Batch() {
+                q.applied_.fetch_add(n, std::memory_order_release);
+                q.draining_.clear(std::memory_order_release);
+            }
+        } batch{ *this };
+        Clock::time_point queued[MAX_BATCH];
+        ControlCommand cmd;
+        while (batch.n < MAX_BATCH && queue_.pop(cmd)) {
+            queued[batch.n++] = cmd.queued;
+            apply(cmd);
+        }
+        if (batch.n > 0) {
+            finish();
+            const auto now = Clock::now();
+            for (size_t i = 0; i < batch.n; ++i) {
+                const uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - queued[i]).count());
+                totalNs_.fetch_add(ns, std::memory_order_relaxed);
+                lastNs_.store(ns, std::memory_order_relaxed);
+                if (ns > maxNs_.load(std::memory_order_relaxed)) maxNs_.store(ns, std::memory_order_relaxed);
+            }
+        }
+        return batch.n;
+    }
+
+    [[nodiscard]] uint64_t applied() const noexcept { return applied_.load(std::memory_order_acquire); }
+
+    [[nodiscard]] Stats stats() const {
+        Stats s;
+        s.applied = applied_.load(std::memory_order_acquire);
+        s.queued = queue_.size();
+        s.submitted = s.applied + s.queued;
+        s.rejected = rejected_.load(std::memory_order_relaxed);
+        s.lastUs = lastNs_.load(std::memory_order_relaxed) * 1e-3;
+        s.maxUs = maxNs_.load(std::memory_order_relaxed) * 1e-3;
+        s.meanUs = (s.applied > 0) ? totalNs_.load(std::memory_order_relaxed) * 1e-3 / static_cast<double>(s.applied) : 0.0;
+        return s;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    MpscQueue<ControlCommand> queue_;
+    std::atomic_flag draining_;
+    std::atomic<uint64_t> applied_{ 0 };
+    std::atomic<uint64_t> rejected_{ 0 };
+    std::atomic<uint64_t> totalNs_{ 0 };
+    std::atomic<uint64_t> lastNs_{ 0 };
+    std::atomic<uint64_t> maxNs_{ 0 };
+};
+
+// ================================================================================
+// UnsentControls: キューが満杯で受け付けられなかった設定変更を覚えておき、後で積み直す (GUI 用)
+//   - 積み残しがあれば、新しいコマンドもその後ろに並べる (積んだ順に適用する)
+//   - 続けて同じ op / ch を積むと最後の値だけを残す (ウィジェットを動かし続けても溜まらない)
+//   - 1つのスレッドだけが使う
+// ================================================================================
+class UnsentControls {
+public:
+    // submit(cmd) は ControlQueue::submit と同じく通し番号 (満杯なら 0) を返す
+    template <class Submit>
+    void send(Submit&& submit, const ControlCommand& cmd) {
+        if (pending_.empty() && submit(cmd) != 0) return;
+        if (!pending_.empty() && pending_.back().op == cmd.op && pending_.back().ch == cmd.ch) pending_.back() = cmd;
+        else pending_.push_back(cmd);
+    }
+
+    // 積み残しを古い順に積み直す (また満杯になったらそこでやめる)。残った数を返す
+    template <class Submit>
+    size_t retry(Submit&& submit) {
+        while (!pending_.empty() && submit(pending_.front()) != 0) pending_.pop_front();
+        return pending_.size();
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return pending_.size(); }
+
+private:
+    std::deque<ControlCommand> pending_;
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_controlQueue() {
+    std::cout << "--- ControlQueue Test Start ---" << std::endl;
+
+    {
+        MpscQueue<int> q(3);
+        uint64_t ticket = 0;
+        assert(q.capacity() == 4);
+        for (int i = 0; i < 4; ++i) assert(q.push(i, ticket) && ticket == static_cast<uint64_t>(i + 1));
+        assert(!q.push(4, ticket));
+        int v;
+        assert(q.pop(v) && v == 0 && q.popped() == 1);
+        assert(q.push(4, ticket) && ticket == 5);
+        for (int i = 1; i <= 4; ++i) assert(q.pop(v) && v == i);
+        assert(!q.pop(v) && q.size() == 0);
+    }
+    std::cout << "  bounded push/pop, tickets: OK" << std::endl;
+
+    // 複数の生産者から積み、1つの消費者が「フレーム」ごとに取り出す
+    {
+        ControlQueue controls;
+        constexpr int PRODUCERS = 4, PER_PRODUCER = 20000;
+        std::vector<int> lastSeen(PRODUCERS, -1);
+        std::atomic<bool> done{ false };
+        int finishes = 0;
+        std::jthread consumer([&] {
+            while (true) {
+                const bool last = done.load(std::memory_order_acquire);
+                controls.drain([&](const ControlCommand& c) {
+                    assert(static_cast<int>(c.value) == lastSeen[c.ch] + 1); // 生産者ごとの順序を保つ
+                    lastSeen[c.ch] = static_cast<int>(c.value);
+                    }, [&] { ++finishes; });
+                if (last && controls.stats().queued == 0) break;
+                std::this_thread::yield();
+            }
+            });
+        {
+            std::vector<std::jthread> producers;
+            for (int p = 0; p < PRODUCERS; ++p) {
+                producers.emplace_back([&controls, p] {
+                    for (int i = 0; i < PER_PRODUCER; ) {
+                        if (controls.submit({ ControlCommand::Op::AwgAmp, p, static_cast<double>(i) }) != 0) ++i;
+                        else std::this_thread::yield(); // 満杯なら待って積み直す
+                    }
+                    });
+            }
+        }
+        done = true;
+        consumer.join();
+        const auto s = controls.stats();
+        assert(s.applied == PRODUCERS * PER_PRODUCER && s.queued == 0);
+        for (int v : lastSeen) assert(v == PER_PRODUCER - 1);
+        assert(finishes > 0 && finishes <= static_cast<int>(s.applied));
+        std::cout << "  " << PRODUCERS << " producers x " << PER_PRODUCER << ": in order, " << s.rejected
+            << " retried when full, apply latency mean " << s.meanUs << " us, max " << s.maxUs << " us" << std::endl;
+    }
+
+    // apply が例外を投げても、取り出した分は適用済みになり、次の drain は動く
+    {
+        ControlQueue controls;
+        const uint64_t first = controls.submit({ ControlCommand::Op::AwgAmp, 0, 1.0 });
+        const uint64_t second = controls.submit({ ControlCommand::Op::AwgAmp, 0, 2.0 });
+        bool thrown = false;
+        try {
+            controls.drain([](const ControlCommand& c) { if (c.value == 2.0) throw std::runtime_error("device"); }, [] {});
+        }
+        catch (const std::runtime_error&) { thrown = true; }
+        assert(thrown && controls.applied() >= second && controls.stats().queued == 0);
+        const uint64_t third = controls.submit({ ControlCommand::Op::AwgAmp, 0, 3.0 });
+        assert(first == 1 && controls.drain([](const ControlCommand&) {}, [] {}) == 1 && controls.applied() == third);
+    }
+    std::cout << "  exception in apply: OK" << std::endl;
+
+    // 満杯で受け付けられなかった変更は積み残し、空いたら順に積み直す (続けて同じ op / ch は最後の値だけ)
+    {
+        ControlQueue controls;
+        const auto submit = [&controls](const ControlCommand& c) { return controls.submit(c); };
+        while (controls.submit({ ControlCommand::Op::AwgApply }) != 0) {}
+        UnsentControls unsent;
+        unsent.send(submit, { ControlCommand::Op::AwgAmp, 1, 0.1 });
+        unsent.send(submit, { ControlCommand::Op::AwgAmp, 1, 0.2 });
+        unsent.send(submit, { ControlCommand::Op::ChEnable, 1, 1.0 });
+        assert(unsent.size() == 2 && unsent.retry(submit) == 2);
+        controls.drain([](const ControlCommand&) {}, [] {});
+        assert(unsent.retry(submit) == 0);
+        std::vector<ControlCommand> applied;
+        while (controls.drain([&](const ControlCommand& c) { if (c.op != ControlCommand::Op::AwgApply) applied.push_back(c); }, [] {}) > 0) {}
+        assert(applied.size() == 2 && applied[0].op == ControlCommand::Op::AwgAmp && applied[0].value == 0.2);
+        assert(applied[1].op == ControlCommand::Op::ChEnable);
+    }
+    std::cout << "  unsent controls retried in order: OK" << std::endl;
+
+    std::cout << "ControlQueue Test Passed!" << std::endl;
+}
@@ -41,6 +41,7 @@ class ControlWindow : public ImGuiWindowBase
 {
 private:
     LiaConfig& cfg;
+    UnsentControls unsent; // キューが満杯で積めなかった設定変更
     void drawContent();
 
 public:
@@ -51,14 +52,21 @@ public:
         this->windowSize = ImVec2(445 * cfg.window.monitorScale, 923 * cfg.window.monitorScale);
     }
 
+    // 設定変更を積む。キューが満杯なら覚えておき、retryUnsent() (毎フレーム) で積み直す (操作を捨てない)
+    void submit(const ControlCommand& cmd)
+    {
+        unsent.send([this](const ControlCommand& c) { return cfg.submit(c); }, cmd);
+    }
+
+    void retryUnsent()
+    {
+        unsent.retry([this](const ControlCommand& c) { return cfg.submit(c); });
+    }
+
     // ボタンイベント（時刻、ボタンID、値）をコマンド履歴に記録
     void buttonPressed(const ButtonType button, const float value)
     {
-        cfg.cmds.push_back({
-            static_cast<float>(cfg.timer.elapsedSec()),
-            static_cast<float>(button),
-            value
-            });
+        cfg.recordCmd(button, value);
     }
 
     void awg(const float nextItemWidth);
@@ -71,10 +79,11 @@ public:
 
 inline void ControlWindow::awg(const float nextItemWidth)
 {
+    using Op = ControlCommand::Op;
     ButtonType button = ButtonType::NON;
     float value = 0;
-    bool configChanged = false;
 
+    // ウィジェットは設定のコピーを編集し、変更は測定スレッドがフレーム境界で適用する
     if (ImGui::BeginTabBar("Awg")) {
         // ===== W1（チャネル0）の設定 =====
         if (ImGui::BeginTabItem("W1")) {
@@ -85,28 +94,25 @@ inline void ControlWindow::awg(const float nextItemWidth)
                 freqkHz = clampFrequency(freqkHz, cfg);
                 const float newFreqHz = freqkHz * 1e3f;
                 if (cfg.awg.ch[0].freq != newFreqHz) {
-                    cfg.awg.ch[0].freq = newFreqHz;
-                    cfg.awg.ch[1].freq = newFreqHz; // W2も同期
-                    configChanged = true;
+                    submit({ Op::AwgFreq, 0, newFreqHz });
+                    submit({ Op::AwgFreq, 1, newFreqHz }); // W2も同期
                 }
             }
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Freq, cfg.awg.ch[0].freq);
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Freq, freqkHz * 1e3f);
 
             ImGui::SetNextItemWidth(nextItemWidth);
-            static float oldCh0Amp = cfg.awg.ch[0].amp;
-            if (ImGui::InputFloat("Amp. (V)", &cfg.awg.ch[0].amp, 0.1f, 0.1f, "%4.1f")) {
-                cfg.awg.ch[0].amp = clampAmplitude(cfg.awg.ch[0].amp, cfg);
-                if (oldCh0Amp != cfg.awg.ch[0].amp) {
-                    oldCh0Amp = cfg.awg.ch[0].amp;
-                    configChanged = true;
-                }
+            float amp = cfg.awg.ch[0].amp;
+            if (ImGui::InputFloat("Amp. (V)", &amp, 0.1f, 0.1f, "%4.1f")) {
+                amp = clampAmplitude(amp, cfg);
+                if (cfg.awg.ch[0].amp != amp) submit({ Op::AwgAmp, 0, amp });
             }
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Amp, cfg.awg.ch[0].amp);
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Amp, amp);
 
             ImGui::SetNextItemWidth(nextItemWidth);
             ImGui::BeginDisabled();
-            ImGui::InputFloat((const char*)u8"θ (Deg.)", &cfg.awg.ch[0].phase, 1.0f, 1.0f, "%3.0f");
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Phase, cfg.awg.ch[0].phase);
+            float phase = cfg.awg.ch[0].phase;
+            ImGui::InputFloat((const char*)u8"θ (Deg.)", &phase, 1.0f, 1.0f, "%3.0f");
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Phase, phase);
             ImGui::EndDisabled();
 			
             ImGui::EndTabItem();
@@ -123,21 +129,19 @@ inline void ControlWindow::awg(const float nextItemWidth)
             ImGui::EndDisabled();
 
             ImGui::SetNextItemWidth(nextItemWidth);
-            static float oldCh1Amp = cfg.awg.ch[1].amp;
-            if (ImGui::InputFloat("Amp. (V)", &cfg.awg.ch[1].amp, 0.01f, 0.1f, "%4.2f")) {
-                cfg.awg.ch[1].amp = std::clamp(cfg.awg.ch[1].amp, 0.0f, cfg.awg.AWG_AMP_MAX);
-                if (oldCh1Amp != cfg.awg.ch[1].amp) {
-                    oldCh1Amp = cfg.awg.ch[1].amp;
-                    configChanged = true;
-                }
+            float amp = cfg.awg.ch[1].amp;
+            if (ImGui::InputFloat("Amp. (V)", &amp, 0.01f, 0.1f, "%4.2f")) {
+                amp = std::clamp(amp, 0.0f, cfg.awg.AWG_AMP_MAX);
+                if (cfg.awg.ch[1].amp != amp) submit({ Op::AwgAmp, 1, amp });
             }
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW2Amp, cfg.awg.ch[1].amp);
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW2Amp, amp);
 
             ImGui::SetNextItemWidth(nextItemWidth);
-            if (ImGui::InputFloat((const char*)u8"θ (Deg.)", &cfg.awg.ch[1].phase, 1.0f, 1.0f, "%3.0f")) {
-                configChanged = true;
+            float phase = cfg.awg.ch[1].phase;
+            if (ImGui::InputFloat((const char*)u8"θ (Deg.)", &phase, 1.0f, 1.0f, "%3.0f")) {
+                submit({ Op::AwgPhase, 1, phase });
             }
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW2Phase, cfg.awg.ch[1].phase);
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW2Phase, phase);
 
             ImGui::SetNextItemWidth(nextItemWidth);
             if (cfg.flagAutoSetupW2) {
@@ -166,18 +170,14 @@ inline void ControlWindow::awg(const float nextItemWidth)
             static const char* funcNames[] = { "Sine", "Square", "Triangle" };
             int oldFunc = cfg.awg.ch[0].func - 1;
             if (ImGui::ListBox("Func", &oldFunc, funcNames, IM_ARRAYSIZE(funcNames), 3)) {
-                cfg.awg.ch[0].func = oldFunc + 1;
-                cfg.awg.ch[1].func = oldFunc + 1;
-                configChanged = true;
+                submit({ Op::AwgFunc, 0, static_cast<double>(oldFunc + 1) });
+                submit({ Op::AwgFunc, 1, static_cast<double>(oldFunc + 1) });
             }
-            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Func, (float)cfg.awg.ch[0].func);
+            markButtonIfItemDeactivated(button, value, ButtonType::AwgW1Func, (float)(oldFunc + 1));
             ImGui::EndTabItem();
         }
         ImGui::EndTabBar();
 
-        if (configChanged) {
-            cfg.awgStart();
-        }
         if (button != ButtonType::NON) {
             buttonPressed(button, value);
         }
@@ -207,14 +207,20 @@ inline void ControlWindow::plot(const float nextItemWidth)
             ImGui::SetNextItemWidth(nextItemWidth);
             if (cfg.pause.flag) ImGui::BeginDisabled();
 
-            ImGui::InputDouble((const char*)u8"Ch1 θ (Deg.)", &cfg.post.offset[0].phase, 1.0, 10.0, "%3.0f");
-            markButtonIfItemDeactivated(button, value, ButtonType::PostOffset1Phase, (float)cfg.post.offset[0].phase);
+            double phase1 = cfg.post.offset[0].phase;
+            if (ImGui::InputDouble((const char*)u8"Ch1 θ (Deg.)", &phase1, 1.0, 10.0, "%3.0f")) {
+                submit({ ControlCommand::Op::OffsetPhase, 0, phase1 });
+            }
+            markButtonIfItemDeactivated(button, value, ButtonType::PostOffset1Phase, (float)phase1);
 
             if (!cfg.scope.ch[1].enable) ImGui::BeginDisabled();
 
             ImGui::SetNextItemWidth(nextItemWidth);
-            ImGui::InputDouble((const char*)u8"Ch2 θ (Deg.)", &cfg.post.offset[1].phase, 1.0, 10.0, "%3.0f");
-            markButtonIfItemDeactivated(button, value, ButtonType::PostOffset2Phase, (float)cfg.post.offset[1].phase);
+            double phase2 = cfg.post.offset[1].phase;
+            if (ImGui::InputDouble((const char*)u8"Ch2 θ (Deg.)", &phase2, 1.0, 10.0, "%3.0f")) {
+                submit({ ControlCommand::Op::OffsetPhase, 1, phase2 });
+            }
+            markButtonIfItemDeactivated(button, value, ButtonType::PostOffset2Phase, (float)phase2);
 
             if (!cfg.scope.ch[1].enable) ImGui::EndDisabled();
             if (cfg.pause.flag) ImGui::EndDisabled();
@@ -228,6 +234,37 @@ inline void ControlWindow::plot(const float nextItemWidth)
             if (ImGui::InputFloat("History (s)", &historySec, 1.0f, 10.0f, "%3.0f")) {
                 cfg.plot.historySec = std::clamp(historySec, 1.0f, (float)cfg.ringBuffer.sec);
             }
+
+            // リングバッファの周期と長さ (Apply で測定を止めずに再配置する)
+            static float bufferDtMs = (float)(cfg.ringBuffer.getDt() * 1e3);
+            static float bufferSec = (float)cfg.ringBuffer.sec;
+            ImGui::SetNextItemWidth(nextItemWidth);
+            ImGui::InputFloat("Buffer dt (ms)", &bufferDtMs, 1.0f, 10.0f, "%4.0f");
+            bufferDtMs = std::clamp(bufferDtMs, (float)(LiaConfigDefaultConsts::RINGBUFFER_DT_MIN * 1e3), (float)(LiaConfigDefaultConsts::RINGBUFFER_DT_MAX * 1e3));
+            ImGui::SetNextItemWidth(nextItemWidth);
+            ImGui::InputFloat("Buffer (s)", &bufferSec, 10.0f, 60.0f, "%5.0f");
+            bufferSec = std::clamp(bufferSec, (float)LiaConfigDefaultConsts::RINGBUFFER_SEC_MIN, (float)LiaConfigDefaultConsts::RINGBUFFER_SEC_MAX);
+
+            const bool busy = cfg.relayout.busy;
+            if (busy) ImGui::BeginDisabled();
+            if (ImGui::Button(busy ? "Applying..." : "Apply")) {
+                cfg.requestRingBufferRelayout(bufferDtMs * 1e-3, bufferSec);
+            }
+            if (busy) ImGui::EndDisabled();
+            ImGui::SameLine();
+            ImGui::Text("%d pts", cfg.ringBuffer.getMeasurementSize());
+
+            // Save ボタンの保存形式
+            static const char* formatNames[] = { "csv", "liab", "npy", "npz" };
+            int format = static_cast<int>(std::find(std::begin(formatNames), std::end(formatNames), cfg.save.format) - std::begin(formatNames));
+            ImGui::SetNextItemWidth(nextItemWidth);
+            if (ImGui::Combo("Save format", &format, formatNames, IM_ARRAYSIZE(formatNames))) {
+                cfg.setSaveFormat(formatNames[format]);
+            }
+            if (format == 1) {
+                ImGui::SameLine();
+                ImGui::Checkbox("Raw frames", &cfg.save.rawFrames);
+            }
             ImGui::Dummy(ImVec2(0.0f * cfg.window.monitorScale, 80.0f * cfg.window.monitorScale));
             ImGui::EndTabItem();
         }
@@ -237,16 +274,12 @@ inline void ControlWindow::plot(const float nextItemWidth)
             static const char* rangeNames[] = { (const char*)u8"±2.5V", (const char*)u8"±25V" };
             int oldRange1 = ((int)(cfg.scope.ch[0].range / 25.0f));
             if (ImGui::ListBox("Ch1", &oldRange1, rangeNames, IM_ARRAYSIZE(rangeNames), 2)) {
-                if (oldRange1 == 0) { cfg.scope.ch[0].range = 2.5f; }
-                else { cfg.scope.ch[0].range = 25.0f; }
-                configChanged = true;
+                submit({ ControlCommand::Op::ScopeRange, 0, (oldRange1 == 0) ? 2.5 : 25.0 });
             }
 			ImGui::SameLine(); ImGui::SetNextItemWidth(nextItemWidth*0.7f);
             int oldRange2 = ((int)(cfg.scope.ch[1].range / 25.0f));
             if (ImGui::ListBox("Ch2", &oldRange2, rangeNames, IM_ARRAYSIZE(rangeNames), 2)) {
-                if (oldRange2 == 0) { cfg.scope.ch[1].range = 2.5f; }
-                else { cfg.scope.ch[1].range = 25.0f; }
-                configChanged = true;
+                submit({ ControlCommand::Op::ScopeRange, 1, (oldRange2 == 0) ? 2.5 : 25.0 });
             }
             
 			
@@ -267,16 +300,7 @@ inline void ControlWindow::plot(const float nextItemWidth)
             //ImGui::Dummy(ImVec2(0.0f * cfg.window.monitorScale, 1.0f * cfg.window.monitorScale));
 
             if (configChanged) {
-                static double rateOld = cfg.pDaq->scope.SamplingRate;
-                cfg.scope.setMaxRange();
-                cfg.pDaq->scope.open(cfg.scope.ch[0].range, cfg.scope.ch[1].range, cfg.scope.bufferSize, samplingRate * 1e6);
-                cfg.pDaq->scope.trigger();
-                cfg.pDaq->scope.start();
-                double rate = cfg.pDaq->scope.SamplingRate;
-                if (rateOld != rate) {
-                    rateOld = rate;
-                    cfg.scope.update(cfg.scope.bufferSize, 1.0 / rateOld);
-                }
+                submit({ ControlCommand::Op::ScopeRate, 0, samplingRate * 1e6 });
             }
             if (button != ButtonType::NON) {
                 buttonPressed(button, value);
@@ -311,8 +335,7 @@ inline void ControlWindow::post(const float nextItemWidth)
     // オフセットリセットボタン
     if (!offsetIsValid) ImGui::BeginDisabled();
     if (ImGui::Button("Off", buttonSize)) {
-        cfg.post.offset[0] = { 0.0f, 0.0f, cfg.post.offset[0].phase };
-        cfg.post.offset[1] = { 0.0f, 0.0f, cfg.post.offset[1].phase };
+        submit({ ControlCommand::Op::OffsetClear });
     }
     markButtonIfItemDeactivated(button, value, ButtonType::PostOffsetOff, 0);
     if (!offsetIsValid) ImGui::EndDisabled();
@@ -385,13 +408,17 @@ inline void ControlWindow::functionButtons(const float nextItemWidth)
     ImGui::Checkbox("Beep", &cfg.plot.beep);
     markButtonIfItemDeactivated(button, value, ButtonType::PlotBeep, cfg.plot.beep);
 
-    // ACFM有効時はCh2を強制有効化
+    // ACFM有効時はCh2を強制有効化 (適用待ちの間は積み直さない)
+    static uint64_t ch2Ticket = 0;
     if (cfg.window.acfmWindow) {
-        cfg.scope.ch[1].enable = true;
+        if (!cfg.scope.ch[1].enable && cfg.controls.applied() >= ch2Ticket) ch2Ticket = cfg.submit({ ControlCommand::Op::ChEnable, 1, 1.0 });
         ImGui::BeginDisabled();
     }
-    ImGui::Checkbox("Ch2", &cfg.scope.ch[1].enable);
-    markButtonIfItemDeactivated(button, value, ButtonType::DispCh2, cfg.scope.ch[1].enable);
+    bool ch2 = cfg.scope.ch[1].enable || cfg.window.acfmWindow;
+    if (ImGui::Checkbox("Ch2", &ch2)) {
+        submit({ ControlCommand::Op::ChEnable, 1, ch2 ? 1.0 : 0.0 });
+    }
+    markButtonIfItemDeactivated(button, value, ButtonType::DispCh2, ch2);
     if (cfg.window.acfmWindow) ImGui::EndDisabled();
 
     ImGui::SameLine();
@@ -399,18 +426,20 @@ inline void ControlWindow::functionButtons(const float nextItemWidth)
     markButtonIfItemDeactivated(button, value, ButtonType::PlotACFM, cfg.window.acfmWindow);
     // フィルタ設定
     ImGui::SetNextItemWidth(nextItemWidth);
-    if (ImGui::InputFloat("HPF (Hz)", &cfg.post.hpFreq, 0.1f, 1.0f, "%.1f")) {
-        cfg.post.hpFreq = std::clamp(cfg.post.hpFreq, LiaConfigDefaultConsts::POST_HPF_MIN, LiaConfigDefaultConsts::POST_HPF_MAX);
-        cfg.setHPFrequency(cfg.post.hpFreq);
+    float hpFreq = cfg.post.hpFreq;
+    if (ImGui::InputFloat("HPF (Hz)", &hpFreq, 0.1f, 1.0f, "%.1f")) {
+        hpFreq = std::clamp(hpFreq, LiaConfigDefaultConsts::POST_HPF_MIN, LiaConfigDefaultConsts::POST_HPF_MAX);
+        submit({ ControlCommand::Op::HpfFreq, 0, hpFreq });
     }
-    markButtonIfItemDeactivated(button, value, ButtonType::PostHpFreq, cfg.post.hpFreq);
+    markButtonIfItemDeactivated(button, value, ButtonType::PostHpFreq, hpFreq);
 
     ImGui::SetNextItemWidth(nextItemWidth);
-    if (ImGui::InputFloat("LPF (Hz)", &cfg.post.lpFreq, 1.0f, 10.0f, "%.0f")) {
-        cfg.post.lpFreq = std::clamp(cfg.post.lpFreq, LiaConfigDefaultConsts::POST_LPF_MIN, LiaConfigDefaultConsts::POST_LPF_MAX);
-        cfg.setLPFrequency(cfg.post.lpFreq);
+    float lpFreq = cfg.post.lpFreq;
+    if (ImGui::InputFloat("LPF (Hz)", &lpFreq, 1.0f, 10.0f, "%.0f")) {
+        lpFreq = std::clamp(lpFreq, LiaConfigDefaultConsts::POST_LPF_MIN, LiaConfigDefaultConsts::POST_LPF_MAX);
+        submit({ ControlCommand::Op::LpfFreq, 0, lpFreq });
     }
-    markButtonIfItemDeactivated(button, value, ButtonType::PostLpFreq, cfg.post.lpFreq);
+    markButtonIfItemDeactivated(button, value, ButtonType::PostLpFreq, lpFreq);
 
     if (button != ButtonType::NON) {
         buttonPressed(button, value);
@@ -428,7 +457,7 @@ inline void ControlWindow::drawContent()
     ImGui::Text("%s", cfg.device_sn.data());
     ImGui::SameLine();
     if (ImGui::Button("Close")) {
-        cfg.statusMeasurement = false;
+        cfg.setStatus(cfg.statusMeasurement, false);
     }
     markButtonIfItemDeactivated(button, value, ButtonType::Close, 0);
 
@@ -1,9 +1,15 @@
 ﻿#pragma once
 
+#ifdef LIA_FAKE_DWF
+#include "DwfFake.h" // 実機なしのテスト用 (API 呼び出し回数を数える)
+#else
 #pragma comment(lib, "DAQ/lib/dwf.lib")
 #include <dwf.h>
+#endif
+#include <cassert>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <stdexcept> // std::runtime_error のため
 
 // --- 1. DWF API呼び出し用のカスタム例外 ---
@@ -102,7 +108,19 @@ public:
         double phaseDeg[NUM_CHANNELS] = { 0.0, 0.0 };
         double rgdData[NUM_CHANNELS][CUSTOM_DATA_SIZE] = { 0 };
 
+        // 装置に最後に設定した値 (apply() で差分だけを送るため)
+        struct Applied {
+            bool valid = false;
+            FUNC func = funcSine;
+            double frequency = 0.0;
+            double amplitude = 0.0;
+            double phaseDeg = 0.0;
+        } applied[NUM_CHANNELS];
+
         // --- メソッド ---
+        /**
+         * @brief 全ノードを設定して両チャンネルを (再) 始動する
+         */
         void start()
         {
             for (int i = 0; i < NUM_CHANNELS; i++)
@@ -121,6 +139,77 @@ public:
                 DWF_CALL(FDwfAnalogOutTriggerSourceSet(getHdwf(), i, trigsrc[i]));
             }
             DWF_CALL(FDwfAnalogOutConfigure(getHdwf(), -1, true));
+            for (int i = 0; i < NUM_CHANNELS; i++) applied[i] = { true, func[i], frequency[i], amplitude[i], phaseDeg[i] };
+        }
+
+        /**
+         * @brief 前回から変わったノードだけを設定する
+         * 振幅・位相だけの変更は止めずに反映する (FDwfAnalogOutConfigure の fStart = 3: apply)。
+         * 周波数・波形の変更は W1/W2 の位相関係を保つため両チャンネルを同時に再始動する。
+         * 未始動なら start() と同じ
+         */
+        void apply()
+        {
+            for (int i = 0; i < NUM_CHANNELS; i++)
+            {
+                if (!applied[i].valid) { start(); return; }
+            }
+            bool restart = false;
+            bool changed[NUM_CHANNELS] = {};
+            for (int i = 0; i < NUM_CHANNELS; i++)
+            {
+                Applied& a = applied[i];
+                if (func[i] != a.func || func[i] == funcCustom) // カスタム波形はデータの変化を追わない
+                {
+                    DWF_CALL(FDwfAnalogOutNodeFunctionSet(getHdwf(), i, AnalogOutNodeCarrier, func[i]));
+                    if (func[i] == funcCustom)
+                    {
+                        DWF_CALL(FDwfAnalogOutNodeDataSet(getHdwf(), i, AnalogOutNodeCarrier, rgdData[i], CUSTOM_DATA_SIZE));
+                    }
+                    restart = true;
+                }
+                if (frequency[i] != a.frequency)
+                {
+                    DWF_CALL(FDwfAnalogOutNodeFrequencySet(getHdwf(), i, AnalogOutNodeCarrier, frequency[i]));
+                    restart = true;
+                }
+                if (amplitude[i] != a.amplitude)
+                {
+                    DWF_CALL(FDwfAnalogOutNodeAmplitudeSet(getHdwf(), i, AnalogOutNodeCarrier, amplitude[i]));
+                    changed[i] = true;
+                }
+                if (phaseDeg[i] != a.phaseDeg)
+                {
+                    DWF_CALL(FDwfAnalogOutNodePhaseSet(getHdwf(), i, AnalogOutNodeCarrier, phaseDeg[i]));
+                    changed[i] = true;
+                }
+                a = { true, func[i], frequency[i], amplitude[i], phaseDeg[i] };
+            }
+            if (restart)
+            {
+                DWF_CALL(FDwfAnalogOutConfigure(getHdwf(), -1, true));
+                return;
+            }
+            for (int i = 0; i < NUM_CHANNELS; i++)
+            {
+                if (changed[i]) DWF_CALL(FDwfAnalogOutConfigure(getHdwf(), i, 3));
+            }
+        }
+
+        void apply(
+            const double frequency1, const double amplitude1, const double phaseDeg1, const FUNC func1,
+            const double frequency2, const double amplitude2, const double phaseDeg2, const FUNC func2
+        )
+        {
+            this->frequency[0] = frequency1;
+            this->amplitude[0] = amplitude1;
+            this->phaseDeg[0] = phaseDeg1;
+            this->func[0] = func1;
+            this->frequency[1] = frequency2;
+            this->amplitude[1] = amplitude2;
+            this->phaseDeg[1] = phaseDeg2;
+            this->func[1] = func2;
+            apply();
         }
 
         void start(const double frequency, const double amplitude1, const double phaseDeg1)
@@ -156,6 +245,7 @@ public:
         void off()
         {
             DWF_CALL(FDwfAnalogOutNodeEnableSet(getHdwf(), -1, AnalogOutNodeCarrier, false));
+            for (auto& a : applied) a.valid = false; // 次の apply() は start() から
         }
     }; // --- End class Awg ---
 
@@ -188,6 +278,16 @@ public:
         TRIGTYPE trigType = trigtypeEdge;
         double trigVoltLevel = 0.0;
         DwfTriggerSlope trigSlope = DwfTriggerSlopeRise;
+
+        // 装置に最後に設定した値 (reconfigure() で差分だけを送るため)
+        struct Applied {
+            bool valid = false;
+            double voltsRange1 = 0.0;
+            double voltsRange2 = 0.0;
+            int bufferSize = 0;
+            double SamplingRate = 0.0;
+        } applied;
+
         void init() {
 			int numChannels;
             DWF_CALL(FDwfAnalogInChannelCount(getHdwf(), &numChannels));
@@ -207,6 +307,7 @@ public:
             DWF_CALL(FDwfAnalogInFrequencySet(getHdwf(), SamplingRate));
             DWF_CALL(FDwfAnalogInFrequencyGet(getHdwf(), &SamplingRate));
             DWF_CALL(FDwfAnalogInChannelFilterSet(getHdwf(), -1, filterAverageFit));
+            applied = { true, voltsRange1, voltsRange2, bufferSize, SamplingRate };
         }
 
         void open(const double voltsRange1, const double voltsRange2, const int bufferSize, const double SamplingRate)
@@ -218,6 +319,53 @@ public:
             open();
         }
 
+        /**
+         * @brief 前回から変わったレンジ・バッファサイズ・サンプリング周波数だけを設定し、取り込みを再開する
+         * トリガーとフィルタはそのまま。未設定なら open() + trigger() + start() と同じ
+         * @return 何か変更したら true (SamplingRate / bufferSize は装置が選んだ値に更新される)
+         */
+        bool reconfigure(const double voltsRange1, const double voltsRange2, const int bufferSize, const double SamplingRate)
+        {
+            if (!applied.valid)
+            {
+                open(voltsRange1, voltsRange2, bufferSize, SamplingRate);
+                trigger();
+                start();
+                return true;
+            }
+            bool changed = false;
+            if (voltsRange1 != applied.voltsRange1)
+            {
+                this->voltsRange1 = voltsRange1;
+                DWF_CALL(FDwfAnalogInChannelRangeSet(getHdwf(), 0, voltsRange1 * 2));
+                changed = true;
+            }
+            if (voltsRange2 != applied.voltsRange2)
+            {
+                this->voltsRange2 = voltsRange2;
+                DWF_CALL(FDwfAnalogInChannelRangeSet(getHdwf(), 1, voltsRange2 * 2));
+                changed = true;
+            }
+            if (bufferSize != applied.bufferSize)
+            {
+                this->bufferSize = bufferSize;
+                DWF_CALL(FDwfAnalogInBufferSizeSet(getHdwf(), bufferSize));
+                DWF_CALL(FDwfAnalogInBufferSizeGet(getHdwf(), &this->bufferSize));
+                changed = true;
+            }
+            if (SamplingRate != applied.SamplingRate)
+            {
+                this->SamplingRate = SamplingRate;
+                DWF_CALL(FDwfAnalogInFrequencySet(getHdwf(), SamplingRate));
+                DWF_CALL(FDwfAnalogInFrequencyGet(getHdwf(), &this->SamplingRate));
+                changed = true;
+            }
+            // 要求値を覚える (装置が丸めた値と比べると、同じ要求でも毎回変更と見なしてしまう)
+            applied = { true, voltsRange1, voltsRange2, bufferSize, SamplingRate };
+            if (changed) start();
+            return changed;
+        }
+
         void trigger()
         {
             DWF_CALL(FDwfAnalogInTriggerAutoTimeoutSet(getHdwf(), secTimeout));
@@ -321,6 +469,7 @@ public:
             throw DwfException("No AD with SN '" + sn + "' is connected.");
         }
         init(idx);
+        scope.init();
     }
 
     /**
@@ -395,6 +544,26 @@ public:
         return -1;
     }
         
+    /**
+     * @brief 接続されているデバイスのシリアルナンバーを列挙する
+     * @param onlyAvailable true なら開かれていないデバイスだけ
+     */
+    static std::vector<std::string> getSerialNumbers(bool onlyAvailable = true)
+    {
+        std::vector<std::string> sns;
+        int pcDevice = getPcDevice();
+        for (int i = 0; i < pcDevice; i++)
+        {
+            int opened = 0;
+            if (onlyAvailable) DWF_CALL(FDwfEnumDeviceIsOpened(i, &opened));
+            if (opened) continue;
+            char szSN[32] = { "" };
+            DWF_CALL(FDwfEnumSN(i, szSN));
+            sns.emplace_back(szSN);
+        }
+        return sns;
+    }
+
     /**
      * @brief 現在使用可能（開かれていない）最初のデバイスインデックスを取得する
      * @return 見つかった場合はインデックス [0..N], すべて使用中の場合は -1
@@ -410,4 +579,54 @@ public:
         }
         return -1;
     }
-};
\ No newline at end of file
+};
+
+#ifdef LIA_FAKE_DWF
+// ============================================================
+// テストコード: 設定変更1回あたりの API 呼び出し回数 (偽の DWF で数える)
+// ============================================================
+inline void test_daqReconfigure()
+{
+    std::cout << "--- Daq_dwf Reconfigure Test Start ---" << std::endl;
+
+    Daq_dwf daq;
+    daq.awg.start(100e3, 1.0, 0.0, funcSine, 100e3, 0.0, 0.0, funcSine);
+    daq.scope.open(2.5, 2.5, 10000, 100e6);
+    daq.scope.trigger();
+    daq.scope.start();
+
+    auto cost = [](auto&& change) {
+        dwf_fake::resetCounts();
+        change();
+        return dwf_fake::total();
+        };
+
+    // 従来の再設定 (全ノード + 両チャンネル再始動 / スコープを開き直す)
+    const int awgFull = cost([&] { daq.awg.start(100e3, 1.0, 0.0, funcSine, 100e3, 0.0, 90.0, funcSine); });
+    const int scopeFull = cost([&] { daq.scope.open(25.0, 2.5, 10000, 100e6); daq.scope.trigger(); daq.scope.start(); });
+    assert(awgFull == 15 && scopeFull == 12);
+
+    // W2 の位相だけ: 位相ノード + 止めずに反映 (W1 は触らない)
+    const int awgPhase = cost([&] { daq.awg.apply(100e3, 1.0, 0.0, funcSine, 100e3, 0.0, 45.0, funcSine); });
+    assert(awgPhase == 2 && dwf_fake::count("FDwfAnalogOutConfigure") == 1 && dwf_fake::count("FDwfAnalogOutNodePhaseSet") == 1);
+    // 振幅 2ch
+    const int awgAmp = cost([&] { daq.awg.apply(100e3, 0.5, 0.0, funcSine, 100e3, 0.2, 45.0, funcSine); });
+    assert(awgAmp == 4);
+    // 周波数は両チャンネルを同時に再始動する
+    const int awgFreq = cost([&] { daq.awg.apply(50e3, 0.5, 0.0, funcSine, 50e3, 0.2, 45.0, funcSine); });
+    assert(awgFreq == 3 && dwf_fake::count("FDwfAnalogOutConfigure") == 1);
+    // 変更なしなら装置と通信しない
+    assert(cost([&] { daq.awg.apply(50e3, 0.5, 0.0, funcSine, 50e3, 0.2, 45.0, funcSine); }) == 0);
+
+    // chan1:range: レンジ1つ + 取り込み再開
+    const int scopeRange = cost([&] { daq.scope.reconfigure(2.5, 2.5, 10000, 100e6); });
+    assert(scopeRange == 2 && dwf_fake::count("FDwfAnalogInChannelRangeSet") == 1);
+    assert(cost([&] { daq.scope.reconfigure(2.5, 2.5, 10000, 100e6); }) == 0);
+    const int scopeRate = cost([&] { daq.scope.reconfigure(2.5, 2.5, 10000, 50e6); });
+    assert(scopeRate == 3 && daq.scope.SamplingRate == 50e6);
+
+    std::cout << "  DWF calls per change: awg full " << awgFull << " -> W2 phase " << awgPhase << ", amplitude " << awgAmp
+        << ", frequency " << awgFreq << "; scope full " << scopeFull << " -> range " << scopeRange << ", rate " << scopeRate << std::endl;
+    std::cout << "Daq_dwf Reconfigure Test Passed!" << std::endl;
+}
+#endif // LIA_FAKE_DWF
@@ -0,0 +1,97 @@
+﻿#pragma once
+
+// ================================================================================
+// DwfFake.h: WaveForms SDK (dwf.dll) の代わりに使う偽の実装 (LIA_FAKE_DWF を定義したときに Daq_wf.h が読む)
+//   - 実機や dwf.lib なしで Daq_dwf を動かし、API ごとの呼び出し回数を数える
+//     (設定変更1回あたりの装置との往復回数をテストで確かめる)
+//   - 装置は1台・スコープ2ch。バッファサイズとサンプリング周波数は Set した値を Get で返す
+//   - 取り込みは常に完了済みで、データは 0
+// ================================================================================
+#ifndef DWFAPI
+#define DWFAPI extern "C"
+#endif
+#include <dwf.h>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace dwf_fake {
+    struct State {
+        std::mutex mtx;
+        std::map<std::string, int> calls;
+        int total = 0;
+        int bufferSize = 8192;
+        double frequency = 100e6;
+    };
+    inline State state;
+
+    inline int record(const char* name) {
+        std::lock_guard<std::mutex> lock(state.mtx);
+        ++state.calls[name];
+        ++state.total;
+        return 1;
+    }
+    inline void resetCounts() {
+        std::lock_guard<std::mutex> lock(state.mtx);
+        state.calls.clear();
+        state.total = 0;
+    }
+    inline int count(const std::string& name) {
+        std::lock_guard<std::mutex> lock(state.mtx);
+        const auto it = state.calls.find(name);
+        return (it == state.calls.end()) ? 0 : it->second;
+    }
+    inline int total() {
+        std::lock_guard<std::mutex> lock(state.mtx);
+        return state.total;
+    }
+}
+
+// --- 装置の列挙・接続 ---
+inline int FDwfGetLastErrorMsg(char szError[512]) { szError[0] = '\0'; return 1; }
+inline int FDwfGetVersion(char szVersion[32]) { std::strcpy(szVersion, "fake"); return dwf_fake::record(__func__); }
+inline int FDwfEnum(ENUMFILTER, int* pcDevice) { *pcDevice = 1; return dwf_fake::record(__func__); }
+inline int FDwfEnumDeviceIsOpened(int, int* pfIsUsed) { *pfIsUsed = 0; return dwf_fake::record(__func__); }
+inline int FDwfEnumDeviceName(int, char szDeviceName[32]) { std::strcpy(szDeviceName, "FakeDiscovery"); return dwf_fake::record(__func__); }
+inline int FDwfEnumSN(int, char szSN[32]) { std::strcpy(szSN, "SN:FAKE"); return dwf_fake::record(__func__); }
+inline int FDwfDeviceOpen(int, HDWF* phdwf) { *phdwf = 1; return dwf_fake::record(__func__); }
+inline int FDwfDeviceClose(HDWF) { return dwf_fake::record(__func__); }
+
+// --- 電源 ---
+inline int FDwfAnalogIOChannelNodeSet(HDWF, int, int, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogIOEnableSet(HDWF, int) { return dwf_fake::record(__func__); }
+
+// --- スコープ ---
+inline int FDwfAnalogInChannelCount(HDWF, int* pcChannel) { *pcChannel = 2; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInChannelEnableSet(HDWF, int, int) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInChannelOffsetSet(HDWF, int, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInChannelRangeSet(HDWF, int, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInChannelFilterSet(HDWF, int, FILTER) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInBufferSizeSet(HDWF, int nSize) { dwf_fake::state.bufferSize = nSize; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInBufferSizeGet(HDWF, int* pnSize) { *pnSize = dwf_fake::state.bufferSize; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInFrequencySet(HDWF, double hzFrequency) { dwf_fake::state.frequency = hzFrequency; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInFrequencyGet(HDWF, double* phzFrequency) { *phzFrequency = dwf_fake::state.frequency; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerAutoTimeoutSet(HDWF, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerSourceSet(HDWF, TRIGSRC) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerChannelSet(HDWF, int) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerTypeSet(HDWF, TRIGTYPE) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerLevelSet(HDWF, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInTriggerConditionSet(HDWF, DwfTriggerSlope) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInConfigure(HDWF, int, int) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogInStatus(HDWF, int, DwfState* psts) { *psts = stsDone; return dwf_fake::record(__func__); }
+inline int FDwfAnalogInStatusData(HDWF, int, double* rgdVoltData, int cdData) {
+    std::memset(rgdVoltData, 0, sizeof(double) * cdData);
+    return dwf_fake::record(__func__);
+}
+
+// --- AWG ---
+inline int FDwfAnalogOutNodeEnableSet(HDWF, int, AnalogOutNode, int) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodeFunctionSet(HDWF, int, AnalogOutNode, FUNC) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodeDataSet(HDWF, int, AnalogOutNode, double*, int) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodeFrequencySet(HDWF, int, AnalogOutNode, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodeAmplitudeSet(HDWF, int, AnalogOutNode, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodeOffsetSet(HDWF, int, AnalogOutNode, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutNodePhaseSet(HDWF, int, AnalogOutNode, double) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutTriggerSourceSet(HDWF, int, TRIGSRC) { return dwf_fake::record(__func__); }
+inline int FDwfAnalogOutConfigure(HDWF, int, int) { return dwf_fake::record(__func__); }
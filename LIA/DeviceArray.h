@@ -0,0 +1,347 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numbers>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DataSource.h"
+
+// ================================================================================
+// DeviceArray: 1プロセスで複数の装置 (Analog Discovery・シミュレーション) を並列に測る (多プローブのアレイ用)
+//   - 装置ごとに LiaConfig (設定・リングバッファ・フィルタ・Timer・保存先) と測定スレッドを持つ。装置間で共有する状態はない
+//     生波形履歴とトレンドは装置の数だけ確保するので、大きさは lia.ini の [Array] で決める (既定は履歴なし・トレンド短め)
+//   - すべての Timer を同じ原点 (epoch) から数えるので、測定点の時刻は共通の時間軸に乗り、
+//     dt が同じなら周期も同じ格子にそろう (仮想時計の装置はどれも 0 が原点)
+//   - 測定スレッド (処理と取り込み) は装置ごとに任意の CPU コアへ固定できる
+//   - collect() は各装置の PointStream から点を受け取り、時間軸の格子 (先頭の装置の dt) ごとに1行へまとめる
+//     点の時刻は周期待ちから起きた時刻で、処理が重いと格子より遅れる。装置ごとに1点ずつ次の格子へ進め、
+//     時刻が先へ飛んだとき (一時停止など) だけ時刻の格子に合わせ直す (同じ装置の点が1つの行で重ならない)
+//   - collect() は購読キューが溢れる前 (PointStream::QUEUE_CAPACITY 点ぶんより短い間隔) に呼ぶ
+// ================================================================================
+class DeviceArray {
+public:
+    static constexpr int MAX_DEVICES = 8;
+
+    // 共通の時間軸の1行
+    struct Row {
+        double t = 0.0;
+        uint32_t mask = 0; // 点がある装置 (ビット i が装置 i)
+        std::array<std::array<float, 4>, MAX_DEVICES> xy{}; // 装置ごとの x1, y1, x2, y2
+    };
+
+    struct DeviceStats {
+        FramePipeline::Stats pipeline;
+        uint64_t dropped = 0; // 購読キューが溢れて失った点
+        bool ended = false;
+    };
+
+    DeviceArray() = default;
+    DeviceArray(const DeviceArray&) = delete;
+    DeviceArray& operator=(const DeviceArray&) = delete;
+    ~DeviceArray() { stop(); }
+
+    // 装置を加える (start() の前)。name は LiaConfig の instance (設定ファイル lia_<name>.ini・保存先の名前)
+    //   cores: 測定スレッドを固定するコアのビットマスク (0 で固定しない)
+    //   行の格子は共通の dt で切るので、先に加えた装置と dt (ringBuffer) が違う装置は加えない (invalid_argument)
+    LiaConfig& add(const std::string& name, std::unique_ptr<IDataSource> source, uint64_t cores = 0) {
+        if (devices_.size() >= MAX_DEVICES) throw std::length_error("DeviceArray: too many devices");
+        auto d = std::make_unique<Device>();
+        d->cfg = std::make_unique<LiaConfig>(name);
+        if (!devices_.empty()) {
+            const double dt0 = devices_.front()->cfg->ringBuffer.getDt();
+            const double dt = d->cfg->ringBuffer.getDt();
+            if (std::abs(dt - dt0) > 1e-9 * dt0) {
+                d->cfg->persistSettings = false;
+                throw std::invalid_argument(std::format("DeviceArray: {} has dt = {} s, but the array uses {} s", name, dt, dt0));
+            }
+        }
+        d->cfg->pause.flag = false;
+        d->source = std::move(source);
+        d->cores = cores;
+        d->subscriber = d->cfg->pointStream.subscribe();
+        devices_.push_back(std::move(d));
+        return *devices_.back()->cfg;
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return devices_.size(); }
+    [[nodiscard]] LiaConfig& config(size_t i) { return *devices_[i]->cfg; }
+    [[nodiscard]] const IDataSource& source(size_t i) const { return *devices_[i]->source; }
+    [[nodiscard]] double dt() const noexcept { return dt_; }
+
+    // 共通の epoch で全装置の測定を始め、各装置が測定を始めるか (開けずに) 終わるまで待つ。始めた装置の数を返す
+    size_t start() {
+        if (devices_.empty()) return 0;
+        dt_ = devices_.front()->cfg->ringBuffer.getDt();
+        latest_.assign(devices_.size(), INT64_MIN);
+        pending_.clear();
+        const int64_t epoch = Timer::now();
+        for (auto& dp : devices_) {
+            Device& d = *dp;
+            d.ended = false;
+            d.thread = std::jthread([&d, epoch](std::stop_token st) {
+#ifdef _WIN32
+                SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+#endif
+                d.cfg->pipeline.setAffinity(d.cores);
+                runMeasurement(st, *d.cfg, *d.source, epoch);
+                d.ended = true;
+                d.cfg->events.notifyAll();
+                });
+        }
+        size_t started = 0;
+        for (auto& d : devices_) {
+            d->cfg->events.wait([&] { return d->cfg->statusMeasurement.load() || d->ended.load(); });
+            if (d->cfg->statusMeasurement || d->cfg->pipeline.stats().frames > 0) ++started;
+        }
+        return started;
+    }
+
+    void stop() {
+        for (auto& d : devices_) {
+            d->cfg->events.interrupt();
+            d->thread.request_stop();
+        }
+        for (auto& d : devices_) {
+            if (d->thread.joinable()) d->thread.join();
+        }
+    }
+
+    // いずれかの装置が測定中
+    [[nodiscard]] bool running() const {
+        return std::any_of(devices_.begin(), devices_.end(), [](const auto& d) { return !d->ended.load(); });
+    }
+
+    // 全装置の測定が終わるまで待つ (source が尽きる装置だけのとき)
+    void join() {
+        for (auto& d : devices_) {
+            if (d->thread.joinable()) d->thread.join();
+        }
+    }
+
+    // 消費者スレッドから呼ぶ。届いた点を行にまとめ、まだ点が届き得ない行 (測定中の全装置がその先まで進んだ行) を
+    // 時刻順に out へ追加して数を返す。flush なら残りの行もすべて出す
+    size_t collect(std::vector<Row>& out, bool flush = false) {
+        const size_t before = out.size();
+        int64_t ready = INT64_MAX;
+        for (size_t i = 0; i < devices_.size(); ++i) {
+            Device& d = *devices_[i];
+            const bool ended = d.ended.load(); // 終わったと見てから読むので、その装置の点はこれで全部
+            size_t n = 0;
+            while ((n = d.cfg->pointStream.poll(d.subscriber, buffer_.data(), buffer_.size())) > 0) {
+                for (size_t k = 0; k < n; ++k) add(i, buffer_[k]);
+            }
+            if (!ended) ready = std::min(ready, latest_[i]);
+        }
+        for (auto it = pending_.begin(); it != pending_.end() && (flush || it->first < ready); it = pending_.erase(it)) {
+            out.push_back(it->second);
+        }
+        return out.size() - before;
+    }
+
+    [[nodiscard]] DeviceStats stats(size_t i) const {
+        const Device& d = *devices_[i];
+        return { d.cfg->pipeline.stats(), d.cfg->pointStream.stats(d.subscriber).dropped, d.ended.load() };
+    }
+
+private:
+    struct Device {
+        std::unique_ptr<LiaConfig> cfg;
+        std::unique_ptr<IDataSource> source;
+        uint64_t cores = 0;
+        int subscriber = -1;
+        std::atomic<bool> ended{ true };
+        std::jthread thread;
+    };
+
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::array<StreamPoint, 1024> buffer_{};
+    std::map<int64_t, Row> pending_;  // 格子番号 → まとめている行
+    std::vector<int64_t> latest_;     // 装置ごとに最後の点を入れた格子番号
+    double dt_ = 0.0;
+
+    void add(size_t i, const StreamPoint& p) {
+        const int64_t nearest = static_cast<int64_t>(std::floor(p.t / dt_ + 0.5));
+        const int64_t slot = (latest_[i] == INT64_MIN) ? nearest : std::max(latest_[i] + 1, nearest);
+        Row& row = pending_[slot];
+        row.t = slot * dt_;
+        row.mask |= 1u << i;
+        std::copy(std::begin(p.xy), std::end(p.xy), row.xy[i].begin());
+        latest_[i] = slot;
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+namespace device_array_test {
+    // 装置ごとの設定ファイル (sleepOnly なら周期待ちで回らない: 1コアでも遅れない)
+    //   [RawHistory] は array では使わない (lia.ini の [Array] に従い、既定では生波形の履歴を持たない)
+    inline void writeSettings(const std::string& name, bool sleepOnly) {
+        std::ofstream ofs(std::format("lia_{}.ini", name));
+        ofs << "[RawHistory]\nmegaBytes=64\n";
+        if (sleepOnly) ofs << "[Timing]\nspinMarginUs=0\n";
+    }
+
+    // lia_<prefix>*.ini をすべて消す (装置の数にかかわらず、テストが書いた設定ファイルを残さない)
+    inline void removeSettings(const std::string& prefix) {
+        const std::string head = std::format("lia_{}", prefix);
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(".", ec)) {
+            const std::string file = entry.path().filename().string();
+            if (file.starts_with(head) && file.ends_with(".ini")) std::filesystem::remove(entry.path(), ec);
+        }
+    }
+
+    // スコープを抜けるとき (途中で例外が出ても) lia_<prefix>*.ini を消す。DeviceArray より先に作れば、その保存の後に消える
+    struct SettingsCleanup {
+        std::string prefix;
+        ~SettingsCleanup() { removeSettings(prefix); }
+    };
+
+    inline std::unique_ptr<SimulatedSource> makeSource(int k, bool virtualClock, uint64_t frames) {
+        auto params = SimulatedSource::defaultParams();
+        params.ch[0].phaseDriftDegPerSec = 0.0;
+        params.ch[0].phaseDeg = 30.0 * k; // 装置ごとに位相をずらして、行の中で取り違えていないことを確かめる
+        params.seed = k + 1;
+        auto sim = std::make_unique<SimulatedSource>(params);
+        sim->setVirtualClock(virtualClock);
+        sim->setFrameLimit(frames);
+        return sim;
+    }
+}
+
+void test_deviceArray() {
+    std::cout << "--- DeviceArray Test Start ---" << std::endl;
+    using namespace device_array_test;
+    constexpr int DEVICES = 3;
+    const SettingsCleanup cleanup{ "test_array" };
+
+    // [1] 実時間: 装置ごとのスレッドで測り、共通の時間軸の格子で1行にそろう
+    {
+        size_t rows = 0, complete = 0;
+        {
+            DeviceArray array;
+            for (int k = 0; k < DEVICES; ++k) {
+                const std::string name = std::format("test_array{}", k);
+                writeSettings(name, true);
+                const LiaConfig& cfg = array.add(name, makeSource(k, false, 0));
+                assert(cfg.frameHistory.capacity() == 0 && cfg.trend.hours1s == cfg.deviceArray.trend.hours1s);
+            }
+            assert(array.start() == DEVICES);
+            std::vector<DeviceArray::Row> out;
+            const double dt = array.dt();
+            const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(400);
+            while (std::chrono::steady_clock::now() < until) {
+                array.collect(out);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            array.stop();
+            array.collect(out, true);
+            assert(!array.running());
+            for (size_t r = 0; r < out.size(); ++r) {
+                const auto& row = out[r];
+                if (r > 0) assert(row.t > out[r - 1].t);
+                assert(std::abs(row.t / dt - std::round(row.t / dt)) < 1e-6);
+                if (row.mask != (1u << DEVICES) - 1) continue;
+                ++complete;
+                // 装置 k の位相は装置 0 から 30k 度ずれている (符号は復調の向きによる)
+                const double phase0 = std::atan2(row.xy[0][1], row.xy[0][0]);
+                for (int k = 1; k < DEVICES; ++k) {
+                    double diff = std::abs(std::atan2(row.xy[k][1], row.xy[k][0]) - phase0) * 180.0 / std::numbers::pi;
+                    if (diff > 180.0) diff = 360.0 - diff;
+                    assert(std::abs(diff - 30.0 * k) < 1.0);
+                }
+            }
+            rows = out.size();
+            for (int k = 0; k < DEVICES; ++k) assert(array.stats(k).dropped == 0);
+        }
+        removeSettings("test_array");
+        assert(rows > 50 && complete >= rows * 9 / 10);
+        std::cout << "  real time: " << DEVICES << " devices, " << rows << " rows (" << complete << " complete)" << std::endl;
+    }
+
+    // [2] 仮想時計: すべての装置が同じフレーム数で終わり、すべての行がそろう
+    {
+        constexpr uint64_t FRAMES = 300;
+        std::vector<DeviceArray::Row> out;
+        {
+            DeviceArray array;
+            for (int k = 0; k < DEVICES; ++k) {
+                const std::string name = std::format("test_array{}", k);
+                writeSettings(name, false);
+                array.add(name, makeSource(k, true, FRAMES));
+            }
+            array.start();
+            array.join();
+            array.collect(out, true);
+        }
+        removeSettings("test_array");
+        assert(out.size() == FRAMES);
+        for (const auto& row : out) assert(row.mask == (1u << DEVICES) - 1);
+        std::cout << "  virtual clock: " << out.size() << " rows, all complete" << std::endl;
+    }
+
+    // [3] dt の違う装置は加えない
+    {
+        {
+            DeviceArray array;
+            writeSettings("test_array0", false);
+            const double dt = array.add("test_array0", makeSource(0, true, 1)).ringBuffer.getDt();
+            std::ofstream("lia_test_array1.ini") << std::format("[RingBuffer]\ndt={}\n", dt * 2.0);
+            bool rejected = false;
+            try { array.add("test_array1", makeSource(1, true, 1)); }
+            catch (const std::invalid_argument&) { rejected = true; }
+            assert(rejected && array.size() == 1);
+        }
+        removeSettings("test_array");
+        std::cout << "  mixed dt: rejected" << std::endl;
+    }
+
+    std::cout << "DeviceArray Test Passed!" << std::endl;
+}
+
+// シミュレーションの装置を 1, 2, 4 台にしたときの合計スループット (仮想時計。コアが足りれば装置ごとに2コアへ固定)
+void bench_deviceArray() {
+    using namespace device_array_test;
+    constexpr uint64_t FRAMES = 1000;
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "--- DeviceArray Benchmark (" << cores << " cores, " << FRAMES << " frames per device) ---" << std::endl;
+    const SettingsCleanup cleanup{ "bench_array" };
+    double single = 0.0;
+    for (const int devices : { 1, 2, 4 }) {
+        const bool pin = cores >= 2u * devices;
+        double wallSec = 0.0;
+        {
+            DeviceArray array;
+            for (int k = 0; k < devices; ++k) {
+                const std::string name = std::format("bench_array{}", k);
+                writeSettings(name, false);
+                array.add(name, makeSource(k, true, FRAMES), pin ? (uint64_t{ 3 } << (2 * k)) : 0);
+            }
+            const auto t0 = std::chrono::steady_clock::now();
+            array.start();
+            array.join();
+            wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+        removeSettings("bench_array");
+        const double fps = devices * FRAMES / wallSec;
+        if (devices == 1) single = fps;
+        std::cout << "  " << devices << " device(s)" << (pin ? " pinned" : "") << ": " << fps << " frames/s in total ("
+            << fps / single << "x of 1 device)" << std::endl;
+    }
+}
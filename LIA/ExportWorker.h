@@ -0,0 +1,156 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// ================================================================================
+// ExportWorker: ファイル保存を1本のバックグラウンドスレッドで順に実行する
+//   - GUI / pipe スレッドは submit() でジョブを積むだけで、書式化・書き込みを待たない
+//   - ジョブは進捗 (done/total) を更新し、結果メッセージを返す
+//   - 破棄時は積まれているジョブを全て処理してから終了する
+// ================================================================================
+class ExportWorker {
+public:
+    struct Progress {
+        std::atomic<int> done{ 0 };
+        std::atomic<int> total{ 0 };
+    };
+    // 成功なら true。message に結果 (保存した行数や失敗理由) を入れる
+    using Job = std::function<bool(Progress&, std::string& message)>;
+
+    struct Status {
+        bool running = false;
+        int queued = 0;          // 未着手のジョブ数
+        int done = 0, total = 0; // 実行中ジョブの進捗
+        int completed = 0;       // 完了したジョブ数 (失敗を含む)
+        std::string current;     // 実行中のジョブ名
+        std::string last;        // 直近に完了したジョブ名
+        std::string message;     // 直近の結果
+        bool lastOk = true;
+    };
+
+    ExportWorker() : worker_([this](std::stop_token st) { run(st); }) {}
+
+    void submit(std::string name, Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            queue_.push_back({ std::move(name), std::move(job) });
+        }
+        cv_.notify_one();
+    }
+
+    [[nodiscard]] Status status() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Status s = status_;
+        s.queued = static_cast<int>(queue_.size());
+        s.done = progress_.done;
+        s.total = progress_.total;
+        return s;
+    }
+
+    [[nodiscard]] bool busy() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return status_.running || !queue_.empty();
+    }
+
+    // 積まれたジョブが全て終わるまで待つ
+    void waitIdle() const {
+        std::unique_lock<std::mutex> lock(mtx_);
+        idleCv_.wait(lock, [this] { return !status_.running && queue_.empty(); });
+    }
+
+private:
+    struct Entry { std::string name; Job job; };
+
+    mutable std::mutex mtx_;
+    std::condition_variable_any cv_;
+    mutable std::condition_variable_any idleCv_;
+    std::deque<Entry> queue_;
+    Status status_;
+    Progress progress_;
+    std::jthread worker_; // 他のメンバーより後に構築・先に破棄する
+
+    void run(std::stop_token st) {
+        while (true) {
+            Entry entry;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, st, [this] { return !queue_.empty(); });
+                if (queue_.empty()) return; // 停止要求かつ残りなし
+                entry = std::move(queue_.front());
+                queue_.pop_front();
+                status_.running = true;
+                status_.current = entry.name;
+                progress_.done = 0;
+                progress_.total = 0;
+            }
+
+            std::string message;
+            bool ok = false;
+            try {
+                ok = entry.job(progress_, message);
+            }
+            catch (const std::exception& e) {
+                message = e.what();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                status_.running = false;
+                status_.last = entry.name;
+                status_.current.clear();
+                status_.message = message;
+                status_.lastOk = ok;
+                status_.completed++;
+            }
+            idleCv_.notify_all();
+        }
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_exportWorker() {
+    std::cout << "--- ExportWorker Test Start ---" << std::endl;
+
+    std::atomic<int> order{ 0 };
+    int first = -1, second = -1;
+    {
+        ExportWorker worker;
+        worker.submit("a", [&](ExportWorker::Progress& p, std::string& msg) {
+            p.total = 10;
+            for (int i = 0; i < 10; ++i) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); p.done = i + 1; }
+            first = order++;
+            msg = "10 rows";
+            return true;
+            });
+        worker.submit("b", [&](ExportWorker::Progress&, std::string& msg) {
+            second = order++;
+            msg = "failed";
+            return false;
+            });
+        assert(worker.busy());
+        worker.waitIdle();
+
+        const auto s = worker.status();
+        assert(!s.running && s.queued == 0 && s.completed == 2);
+        assert(s.last == "b" && !s.lastOk && s.message == "failed");
+        std::cout << "  sequential jobs / status: OK" << std::endl;
+
+        // 破棄時に残りのジョブを処理すること
+        worker.submit("c", [&](ExportWorker::Progress&, std::string&) { order++; return true; });
+    }
+    assert(first == 0 && second == 1 && order == 3);
+    std::cout << "  drain on destruction: OK" << std::endl;
+
+    std::cout << "ExportWorker Test Passed!" << std::endl;
+}
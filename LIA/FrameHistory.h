@@ -0,0 +1,401 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "Psd.h"
+
+// ================================================================================
+// FrameHistory: 直近 N フレームの生波形を保持するアリーナ
+//   - 起動時に指定 MB 分を一括確保し、以後は確保しない
+//   - 各サンプルはチャンネルレンジを満量程とした int16 で保存 (double の 1/4)
+//   - 書き込みは測定スレッドのみ。読み出しはスロットごとのシーケンス番号で
+//     書き込み中/上書き済みを検出する (seqlock)
+//   - バッファサイズが変わったら allocate し直す (push と同じスレッドか、測定していないときに呼ぶ)。
+//     フレーム番号は確保し直しても続きから振るので、それより前の番号は読めなくなるだけで別のフレームにはならない。
+//     読み出しは共有ロックを持つので、確保し直しの最中に配列が消えることはない
+// ================================================================================
+class FrameHistory {
+public:
+    static constexpr int MAX_CHANNELS = 2;
+
+    struct FrameInfo {
+        double t = 0.0;            // 取得時刻 (s)
+        double samplingDt = 0.0;   // サンプリング間隔 (s)
+        float freq = 0.0f;         // 取得時の参照周波数 (Hz)
+        float scale[MAX_CHANNELS] = { 0.0f, 0.0f }; // int16 -> V の係数
+        int size = 0;              // サンプル数
+        int numChannels = 0;
+    };
+
+    // megaBytes 分のフレームを確保する。保存していたフレームは捨てる
+    void allocate(double megaBytes, int frameSize) {
+        std::unique_lock<std::shared_mutex> lock(mtx_);
+        frameSize_ = std::max(0, frameSize);
+        const size_t frameBytes = static_cast<size_t>(frameSize_) * MAX_CHANNELS * sizeof(int16_t);
+        capacity_ = (frameBytes == 0 || megaBytes <= 0) ? 0
+            : static_cast<int>(megaBytes * 1024.0 * 1024.0 / static_cast<double>(frameBytes));
+        samples_.assign(static_cast<size_t>(capacity_) * frameSize_ * MAX_CHANNELS, 0);
+        infos_.assign(capacity_, FrameInfo());
+        seqs_ = std::vector<std::atomic<uint64_t>>(capacity_);
+        for (auto& s : seqs_) s.store(0, std::memory_order_relaxed); // どのフレーム番号とも一致しない
+        base_.store(count_.load(std::memory_order_relaxed), std::memory_order_release);
+        rejected_.store(0, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] int capacity() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return capacity_;
+    }
+    [[nodiscard]] int frameSize() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return frameSize_;
+    }
+    [[nodiscard]] double megaBytes() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        return static_cast<double>(samples_.size() * sizeof(int16_t)) / (1024.0 * 1024.0);
+    }
+    // これまでに保存したフレーム総数 (単調増加。確保し直しても戻らない)
+    [[nodiscard]] uint64_t totalFrames() const noexcept { return count_.load(std::memory_order_acquire); }
+    // 現在読み出し可能なフレーム数
+    [[nodiscard]] int size() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        const uint64_t total = totalFrames();
+        return static_cast<int>(total - oldestFrame(total));
+    }
+    // frameSize() より大きくて保存できなかったフレーム数 (allocate し直すまで増え続ける)
+    [[nodiscard]] uint64_t rejectedFrames() const noexcept { return rejected_.load(std::memory_order_relaxed); }
+
+    // 測定スレッドから毎フレーム呼ぶ。ch2 が nullptr なら1チャンネルとして保存する
+    void push(double t, double samplingDt, float freq, const double* ch1, const double* ch2,
+        int size, float range1, float range2) noexcept
+    {
+        if (capacity_ == 0) return;
+        if (size > frameSize_) {
+            // 測定スレッド上では読み手がいるので確保し直さない。初回だけ知らせて数える
+            if (rejected_.fetch_add(1, std::memory_order_relaxed) == 0) {
+                std::cerr << "[Warning] FrameHistory: frame size " << size << " exceeds " << frameSize_
+                    << " (allocate again before measuring)\n";
+            }
+            return;
+        }
+
+        const uint64_t frameNo = count_.load(std::memory_order_relaxed);
+        const int slot = static_cast<int>(frameNo % capacity_);
+        auto& seq = seqs_[slot];
+        seq.store(2 * frameNo + 1, std::memory_order_relaxed); // 書き込み中 (奇数)
+        std::atomic_thread_fence(std::memory_order_release);
+
+        FrameInfo& info = infos_[slot];
+        info.t = t;
+        info.samplingDt = samplingDt;
+        info.freq = freq;
+        info.size = size;
+        info.numChannels = (ch2 != nullptr) ? 2 : 1;
+        encode(ch1, size, range1, slotData(slot, 0), info.scale[0]);
+        if (ch2 != nullptr) encode(ch2, size, range2, slotData(slot, 1), info.scale[1]);
+
+        seq.store(2 * frameNo + 2, std::memory_order_release); // 完了 (偶数)
+        count_.store(frameNo + 1, std::memory_order_release);
+    }
+
+    // フレーム番号 frameNo を復元する。上書きされていれば false
+    bool read(uint64_t frameNo, FrameInfo& info, std::vector<double>& ch1, std::vector<double>& ch2) const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        if (capacity_ == 0 || frameNo >= totalFrames()) return false;
+        const int slot = static_cast<int>(frameNo % capacity_);
+        const uint64_t expected = 2 * frameNo + 2;
+        if (seqs_[slot].load(std::memory_order_acquire) != expected) return false;
+
+        info = infos_[slot];
+        ch1.resize(info.size);
+        decode(slotData(slot, 0), info.size, info.scale[0], ch1.data());
+        if (info.numChannels > 1) {
+            ch2.resize(info.size);
+            decode(slotData(slot, 1), info.size, info.scale[1], ch2.data());
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seqs_[slot].load(std::memory_order_relaxed) == expected;
+    }
+
+    // 変換せずに int16 のまま frameSize 要素ずつ ch1/ch2 にコピーする (V = 値 x info.scale)
+    //   frameSize が今の frameSize() と違えば (確保し直された) 読まずに false
+    bool readRaw(uint64_t frameNo, FrameInfo& info, int16_t* ch1, int16_t* ch2, int frameSize) const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        if (capacity_ == 0 || frameSize != frameSize_ || frameNo >= totalFrames()) return false;
+        const int slot = static_cast<int>(frameNo % capacity_);
+        const uint64_t expected = 2 * frameNo + 2;
+        if (seqs_[slot].load(std::memory_order_acquire) != expected) return false;
+
+        info = infos_[slot];
+        std::copy_n(slotData(slot, 0), frameSize_, ch1);
+        std::copy_n(slotData(slot, 1), frameSize_, ch2);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seqs_[slot].load(std::memory_order_relaxed) == expected;
+    }
+
+    // 保存中のフレームのうち時刻 t 以降の最初のフレーム番号 (二分探索)
+    //   探索中に上書きされたフレームは保存中のどれよりも古いので「t より前」として扱う
+    [[nodiscard]] uint64_t lowerBound(double t) const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        const uint64_t total = totalFrames(); // 1回だけ読む (途中で増えた分は探さない)
+        uint64_t lo = oldestFrame(total), hi = total;
+        while (lo < hi) {
+            const uint64_t mid = lo + (hi - lo) / 2;
+            double tMid = 0.0;
+            if (!frameTime(mid, tMid) || tMid < t) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    [[nodiscard]] double oldestTime() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        double t = 0.0;
+        const uint64_t total = totalFrames();
+        for (uint64_t n = oldestFrame(total); n < total; ++n) {
+            if (frameTime(n, t)) return t; // 読む間に上書きされたら次のフレーム
+        }
+        return 0.0;
+    }
+    [[nodiscard]] double latestTime() const {
+        std::shared_lock<std::shared_mutex> lock(mtx_);
+        double t = 0.0;
+        const uint64_t total = totalFrames();
+        return (oldestFrame(total) < total && frameTime(total - 1, t)) ? t : 0.0;
+    }
+
+private:
+    mutable std::shared_mutex mtx_; // allocate (排他) と読み出し (共有)。push は取らない
+    int capacity_ = 0;
+    int frameSize_ = 0;
+    std::vector<int16_t> samples_;
+    std::vector<FrameInfo> infos_;
+    std::vector<std::atomic<uint64_t>> seqs_;
+    std::atomic<uint64_t> count_{ 0 };
+    std::atomic<uint64_t> base_{ 0 };   // 今の確保で最初に保存したフレームの番号
+    std::atomic<uint64_t> rejected_{ 0 };
+
+    // 読み出せる最古のフレーム番号 (total は呼び出し側で1回だけ読んだ totalFrames())
+    [[nodiscard]] uint64_t oldestFrame(uint64_t total) const noexcept {
+        const uint64_t base = base_.load(std::memory_order_acquire);
+        return std::max(base, total - std::min<uint64_t>(total, static_cast<uint64_t>(capacity_)));
+    }
+
+    // フレーム番号 frameNo の時刻を seqlock の確認つきで読む。上書きされていれば false
+    bool frameTime(uint64_t frameNo, double& t) const noexcept {
+        const int slot = static_cast<int>(frameNo % capacity_);
+        const uint64_t expected = 2 * frameNo + 2;
+        if (seqs_[slot].load(std::memory_order_acquire) != expected) return false;
+        t = infos_[slot].t;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seqs_[slot].load(std::memory_order_relaxed) == expected;
+    }
+
+    int16_t* slotData(int slot, int ch) noexcept {
+        return samples_.data() + (static_cast<size_t>(slot) * MAX_CHANNELS + ch) * frameSize_;
+    }
+    const int16_t* slotData(int slot, int ch) const noexcept {
+        return samples_.data() + (static_cast<size_t>(slot) * MAX_CHANNELS + ch) * frameSize_;
+    }
+
+    static void encode(const double* src, int size, float range, int16_t* dst, float& scale) noexcept {
+        const double fullScale = (range > 0.0f) ? range : 1.0;
+        const double toInt = 32767.0 / fullScale;
+        scale = static_cast<float>(fullScale / 32767.0);
+        for (int i = 0; i < size; ++i) {
+            const double v = std::clamp(src[i] * toInt, -32767.0, 32767.0);
+            dst[i] = static_cast<int16_t>(std::lround(v));
+        }
+    }
+
+    static void decode(const int16_t* src, int size, float scale, double* dst) noexcept {
+        for (int i = 0; i < size; ++i) dst[i] = src[i] * static_cast<double>(scale);
+    }
+};
+
+// ================================================================================
+// Redemodulator: FrameHistory の区間を別パラメータで再復調する (バックグラウンド)
+// ================================================================================
+class Redemodulator {
+public:
+    struct Params {
+        double t0 = 0.0, t1 = 0.0;  // 対象時刻区間 (s)
+        int harmonic = 1;           // 参照周波数の倍数
+        double phaseDeg[FrameHistory::MAX_CHANNELS] = { 0.0, 0.0 }; // 復調後の位相回転 (度)
+        double freq = 0.0;          // 0 のときは取得時の周波数を使う
+        Psd::Window window = Psd::Window::Rect;
+    };
+
+    struct Result {
+        std::vector<double> t;
+        std::vector<double> x[FrameHistory::MAX_CHANNELS], y[FrameHistory::MAX_CHANNELS];
+        int numChannels = 1;
+        int lostFrames = 0;         // 処理中に上書きされたフレーム数
+        double elapsedSec = 0.0;
+        double framesPerSec = 0.0;
+    };
+
+    ~Redemodulator() { worker_ = std::jthread(); }
+
+    // 再復調を開始する。実行中なら false
+    bool start(const FrameHistory& history, const Params& params) {
+        if (running_.exchange(true)) return false;
+        worker_ = std::jthread(); // 前回のスレッドを join
+        processed_ = 0;
+        total_ = 0;
+        worker_ = std::jthread([this, &history, params](std::stop_token st) { run(st, history, params); });
+        return true;
+    }
+
+    void cancel() { worker_.request_stop(); }
+
+    [[nodiscard]] bool isRunning() const noexcept { return running_; }
+    [[nodiscard]] int processedFrames() const noexcept { return processed_; }
+    [[nodiscard]] int totalFrames() const noexcept { return total_; }
+
+    // 直近の結果のコピーを返す
+    Result result() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return result_;
+    }
+
+private:
+    std::jthread worker_;
+    std::atomic<bool> running_{ false };
+    std::atomic<int> processed_{ 0 };
+    std::atomic<int> total_{ 0 };
+    mutable std::mutex mtx_;
+    Result result_;
+
+    void run(std::stop_token st, const FrameHistory& history, const Params params) {
+        const auto start = std::chrono::steady_clock::now();
+        Result res;
+        Psd psd;
+        FrameHistory::FrameInfo info;
+        std::vector<double> ch1, ch2;
+        double psdFreq = 0.0, psdDt = 0.0;
+        int psdSize = 0;
+
+        const uint64_t first = history.lowerBound(params.t0);
+        const uint64_t last = history.lowerBound(std::nextafter(params.t1, params.t1 + 1.0));
+        total_ = static_cast<int>(last > first ? last - first : 0);
+
+        for (uint64_t n = first; n < last && !st.stop_requested(); ++n) {
+            if (!history.read(n, info, ch1, ch2)) {
+                ++res.lostFrames;
+                continue;
+            }
+            const double freq = (params.freq > 0.0 ? params.freq : info.freq) * std::max(1, params.harmonic);
+            if (freq != psdFreq || info.samplingDt != psdDt || info.size != psdSize) { // 周波数が変わったときだけ作り直す
+                psd.initialize(freq, info.samplingDt, info.size, params.window);
+                psdFreq = freq;
+                psdDt = info.samplingDt;
+                psdSize = info.size;
+            }
+
+            res.numChannels = std::max(res.numChannels, info.numChannels);
+            res.t.push_back(info.t);
+            for (int c = 0; c < FrameHistory::MAX_CHANNELS; ++c) {
+                double x = 0.0, y = 0.0;
+                if (c < info.numChannels) {
+                    std::tie(x, y) = psd.calculate(c == 0 ? ch1.data() : ch2.data());
+                    std::tie(x, y) = psd.rotate_phase(x, y, params.phaseDeg[c]);
+                }
+                res.x[c].push_back(x);
+                res.y[c].push_back(y);
+            }
+            ++processed_;
+        }
+
+        res.elapsedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        res.framesPerSec = res.elapsedSec > 0.0 ? res.t.size() / res.elapsedSec : 0.0;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            result_ = std::move(res);
+        }
+        running_ = false;
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_frameHistory() {
+    std::cout << "--- FrameHistory Test Start ---" << std::endl;
+
+    const int frameSize = 1000;
+    const double dt = 1e-6, freq = 10e3, amp = 0.5, range = 2.5;
+    std::vector<double> wave(frameSize);
+    for (int i = 0; i < frameSize; ++i) wave[i] = amp * std::sin(2.0 * std::numbers::pi * freq * i * dt);
+
+    FrameHistory history;
+    history.allocate(0.1, frameSize); // 0.1MB = 26 フレーム
+    const int capacity = history.capacity();
+    assert(capacity == static_cast<int>(0.1 * 1024 * 1024 / (frameSize * 2 * sizeof(int16_t))));
+
+    // 容量の2倍書き込み、古いフレームが上書きされることを確認
+    for (int n = 0; n < 2 * capacity; ++n) {
+        history.push(n * 1e-3, dt, static_cast<float>(freq), wave.data(), nullptr, frameSize, static_cast<float>(range), 0.0f);
+    }
+    FrameHistory::FrameInfo info;
+    std::vector<double> ch1, ch2;
+    assert(history.size() == capacity);
+    assert(!history.read(0, info, ch1, ch2));
+    assert(history.read(2 * capacity - 1, info, ch1, ch2));
+    for (int i = 0; i < frameSize; ++i) assert(std::abs(ch1[i] - wave[i]) <= range / 32767.0);
+    assert(history.lowerBound(capacity * 1.5e-3) == static_cast<uint64_t>(std::ceil(capacity * 1.5)));
+    std::cout << "  ring overwrite / int16 round trip: OK" << std::endl;
+
+    // 確保より大きいフレームは保存せずに数える
+    std::vector<double> big(frameSize + 1, 0.0);
+    history.push(1.0, dt, static_cast<float>(freq), big.data(), nullptr, frameSize + 1, static_cast<float>(range), 0.0f);
+    assert(history.rejectedFrames() == 1 && history.totalFrames() == static_cast<uint64_t>(2 * capacity));
+
+    // 再復調: sin 入力なので X = amp, Y = 0
+    Redemodulator redemod;
+    Redemodulator::Params params;
+    params.t0 = history.oldestTime();
+    params.t1 = history.latestTime();
+    assert(redemod.start(history, params));
+    while (redemod.isRunning()) std::this_thread::yield();
+    const auto res = redemod.result();
+    assert(static_cast<int>(res.t.size()) == capacity && res.lostFrames == 0);
+    assert(std::abs(res.x[0][0] - amp) < 1e-3 && std::abs(res.y[0][0]) < 1e-3);
+    std::cout << "  redemodulation: OK (" << res.framesPerSec << " frames/s)" << std::endl;
+
+    // 窓関数を掛けても振幅・位相は同じ
+    for (const auto window : { Psd::Window::Hann, Psd::Window::Blackman }) {
+        params.window = window;
+        assert(redemod.start(history, params));
+        while (redemod.isRunning()) std::this_thread::yield();
+        const auto windowed = redemod.result();
+        assert(windowed.t.size() == res.t.size());
+        assert(std::abs(windowed.x[0][0] - amp) < 1e-3 && std::abs(windowed.y[0][0]) < 1e-3);
+    }
+    std::cout << "  redemodulation with hann / blackman windows: OK" << std::endl;
+
+    // バッファサイズが変わって確保し直すと、前のフレームは読めなくなり、番号は続きから振る
+    const uint64_t before = history.totalFrames();
+    history.allocate(0.1, frameSize / 2);
+    assert(history.size() == 0 && history.lowerBound(0.0) == before && !history.read(before - 1, info, ch1, ch2));
+    history.push(10.0, dt, static_cast<float>(freq), wave.data(), nullptr, frameSize / 2, static_cast<float>(range), 0.0f);
+    std::vector<int16_t> raw1(frameSize), raw2(frameSize);
+    assert(history.size() == 1 && history.read(before, info, ch1, ch2) && info.t == 10.0 && ch1.size() == frameSize / 2);
+    assert(!history.readRaw(before, info, raw1.data(), raw2.data(), frameSize) && history.readRaw(before, info, raw1.data(), raw2.data(), frameSize / 2));
+    assert(history.oldestTime() == 10.0 && history.latestTime() == 10.0);
+    std::cout << "  re-allocation keeps frame numbers: OK" << std::endl;
+
+    std::cout << "FrameHistory Test Passed!" << std::endl;
+}
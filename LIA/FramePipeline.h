@@ -0,0 +1,296 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 呼んだスレッドを mask のビットの CPU コアに固定する (mask = 0 なら何もしない)
+inline bool pinThisThread(uint64_t mask) {
+    if (mask == 0) return true;
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(mask)) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < 64; ++c) {
+        if (mask & (uint64_t{ 1 } << c)) CPU_SET(c, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// ================================================================================
+// FramePipeline: 取り込み (装置待ち) と処理 (復調・フィルタ・リングバッファ) を別スレッドで重ねる
+//   - 取り込みスレッドがスロット A に次のフレームを取り込む間に、処理スレッドがスロット B を処理する
+//   - スロットは2つで、受け渡しは head_ / tail_ の atomic だけで行う (ロックなし・コピーなし)
+//   - 処理が追いつかないときは取り込みが空きスロットを待つ (stalls に数える。フレームは捨てない)
+//   - 取り込まなかったフレーム (一時停止中など) も処理側へ渡し、フレーム境界の処理を続けさせる
+//   - acquire が last を立てたフレームで終わる (それまでのフレームはすべて処理してから戻る)
+// ================================================================================
+class FramePipeline {
+public:
+    static constexpr size_t SLOTS = 2;
+
+    struct Frame {
+        double t = 0.0;
+        bool valid = false;   // false: 取り込んでいない (フレーム境界の処理だけ行う)
+        bool ch2 = false;
+        bool last = false;    // true: これで終わり (source が尽きた)
+        int size = 0;
+        uint64_t tag = 0;     // 取り込み時の状態 (LiaConfig は適用済みの設定変更の数を入れる)
+        std::vector<double> ch[2];
+
+        void resize(int n, bool withCh2) {
+            size = n;
+            ch2 = withCh2;
+            ch[0].resize(n);
+            if (withCh2) ch[1].resize(n);
+        }
+    };
+
+    struct Stats {
+        bool running = false;
+        uint64_t frames = 0;       // 処理したフレーム数
+        uint64_t stalls = 0;       // 取り込みが空きスロットを待った回数 (処理が周期に間に合っていない)
+        double acquireLoad = 0.0;  // 取り込みスレッドが取り込みに使った時間の割合 (周期待ちを除く)
+        double processLoad = 0.0;  // 処理スレッドが処理に使った時間の割合
+        double acquireUs = 0.0;    // 1フレームあたりの平均
+        double processUs = 0.0;
+    };
+
+    // 取り込みの周期 (処理スレッドが設定し、取り込みスレッドが読む)
+    [[nodiscard]] double period() const noexcept { return period_.load(std::memory_order_relaxed); }
+    void setPeriod(double sec) noexcept { period_.store(sec, std::memory_order_relaxed); }
+
+    // run() の処理スレッド (呼んだスレッド) と取り込みスレッドを固定するコア (ビットマスク。0 で固定しない)
+    void setAffinity(uint64_t mask) noexcept { affinity_ = mask; }
+
+    // 呼んだスレッドで処理し、取り込みは内部のスレッドで行う。st が停止するか last のフレームを処理するまで戻らない
+    //   pace()            : 取り込みスレッドで次の周期まで待ち、フレームの時刻を返す
+    //   acquire(Frame&)   : 取り込みスレッドでフレームを埋める。取り込まなければ false (last を立てると終わり)
+    //   process(Frame&)   : 処理スレッドでフレームを処理する (valid == false でも呼ぶ)
+    template <class Pace, class Acquire, class Process>
+    void run(std::stop_token st, Pace&& pace, Acquire&& acquire, Process&& process) {
+        resetStats();
+        head_.store(0);
+        tail_.store(0);
+        std::stop_callback wake(st, [this] {
+            notify(frameSignal_);
+            notify(slotSignal_);
+            });
+
+#ifdef _WIN32
+        const int priority = GetThreadPriority(GetCurrentThread()); // 取り込みも処理と同じ優先度で動かす
+#endif
+        pinThisThread(affinity_);
+        std::jthread acquisition([&, this] {
+#ifdef _WIN32
+            SetThreadPriority(GetCurrentThread(), priority);
+#endif
+            pinThisThread(affinity_);
+            while (!st.stop_requested()) {
+                const double t = pace();
+                const uint64_t head = head_.load(std::memory_order_relaxed);
+                if (head - tail_.load(std::memory_order_acquire) == SLOTS) {
+                    stalls_.fetch_add(1, std::memory_order_relaxed);
+                    if (!waitFor(slotSignal_, st, [&] { return head - tail_.load(std::memory_order_acquire) < SLOTS; })) break;
+                }
+                Frame& f = slots_[head % SLOTS];
+                f.t = t;
+                f.last = false;
+                const auto t0 = Clock::now();
+                f.valid = acquire(f);
+                acquireNs_.fetch_add(elapsedNs(t0), std::memory_order_relaxed);
+                const bool last = f.last;
+                head_.store(head + 1, std::memory_order_release);
+                notify(frameSignal_);
+                if (last) break;
+            }
+            });
+
+        while (!st.stop_requested()) {
+            const uint64_t tail = tail_.load(std::memory_order_relaxed);
+            if (!waitFor(frameSignal_, st, [&] { return head_.load(std::memory_order_acquire) != tail; })) break;
+            Frame& f = slots_[tail % SLOTS];
+            const auto t0 = Clock::now();
+            process(f);
+            processNs_.fetch_add(elapsedNs(t0), std::memory_order_relaxed);
+            frames_.fetch_add(1, std::memory_order_relaxed);
+            const bool last = f.last;
+            tail_.store(tail + 1, std::memory_order_release);
+            notify(slotSignal_);
+            if (last) break;
+        }
+        acquisition.join();
+        running_.store(false);
+    }
+
+    [[nodiscard]] Stats stats() const {
+        Stats s;
+        s.running = running_.load();
+        s.frames = frames_.load(std::memory_order_relaxed);
+        s.stalls = stalls_.load(std::memory_order_relaxed);
+        const double wallNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started_.load()).count());
+        const double acquireNs = static_cast<double>(acquireNs_.load(std::memory_order_relaxed));
+        const double processNs = static_cast<double>(processNs_.load(std::memory_order_relaxed));
+        if (wallNs > 0.0) {
+            s.acquireLoad = std::min(1.0, acquireNs / wallNs);
+            s.processLoad = std::min(1.0, processNs / wallNs);
+        }
+        if (s.frames > 0) {
+            s.acquireUs = acquireNs * 1e-3 / static_cast<double>(s.frames);
+            s.processUs = processNs * 1e-3 / static_cast<double>(s.frames);
+        }
+        return s;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::array<Frame, SLOTS> slots_;
+    alignas(64) std::atomic<uint64_t> head_{ 0 };       // 取り込み済みのフレーム数 (取り込みスレッドが進める)
+    alignas(64) std::atomic<uint64_t> tail_{ 0 };       // 処理済みのフレーム数 (処理スレッドが進める)
+    std::atomic<uint32_t> frameSignal_{ 0 };            // 取り込み → 処理
+    std::atomic<uint32_t> slotSignal_{ 0 };             // 処理 → 取り込み
+    std::atomic<double> period_{ 2e-3 };
+    uint64_t affinity_ = 0;
+
+    std::atomic<bool> running_{ false };
+    std::atomic<Clock::time_point> started_{ Clock::now() };
+    std::atomic<uint64_t> frames_{ 0 };
+    std::atomic<uint64_t> stalls_{ 0 };
+    std::atomic<uint64_t> acquireNs_{ 0 };
+    std::atomic<uint64_t> processNs_{ 0 };
+
+    static uint64_t elapsedNs(Clock::time_point t0) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    }
+
+    static void notify(std::atomic<uint32_t>& signal) {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+    }
+
+    // ready() が true になるまで signal で眠る。停止要求なら false
+    template <class Ready>
+    static bool waitFor(std::atomic<uint32_t>& signal, const std::stop_token& st, Ready&& ready) {
+        while (true) {
+            const uint32_t s = signal.load(std::memory_order_acquire);
+            if (ready()) return true;
+            if (st.stop_requested()) return false;
+            signal.wait(s, std::memory_order_acquire);
+        }
+    }
+
+    void resetStats() {
+        frames_.store(0);
+        stalls_.store(0);
+        acquireNs_.store(0);
+        processNs_.store(0);
+        started_.store(Clock::now());
+        running_.store(true);
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_framePipeline() {
+    std::cout << "--- FramePipeline Test Start ---" << std::endl;
+    using Frame = FramePipeline::Frame;
+
+    // [1] 処理が遅くても、フレームは取り込んだ順に1つずつ処理される (取り込みが待つ)
+    {
+        FramePipeline pipeline;
+        std::stop_source stop;
+        constexpr int FRAMES = 200;
+        int acquired = 0, processed = 0;
+        pipeline.run(stop.get_token(),
+            [&] { return static_cast<double>(acquired); },
+            [&](Frame& f) {
+                f.resize(16, false);
+                f.ch[0][0] = acquired++;
+                return (acquired % 10) != 0; // 10 フレームごとに取り込まない (一時停止の代わり)
+            },
+            [&](Frame& f) {
+                assert(f.t == processed);
+                if (f.valid) assert(f.ch[0][0] == processed);
+                else assert((processed + 1) % 10 == 0);
+                if (++processed == FRAMES) stop.request_stop();
+                if (processed % 8 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            });
+        const auto s = pipeline.stats();
+        assert(!s.running && s.frames == FRAMES && s.stalls > 0);
+        std::cout << "  in order: " << s.frames << " frames, " << s.stalls << " stalls" << std::endl;
+    }
+
+    // [2] 取り込み (装置待ち) と処理が同じくらいかかるとき、直列の合計より短い時間で終わる
+    {
+        FramePipeline pipeline;
+        std::stop_source stop;
+        constexpr int FRAMES = 100;
+        constexpr auto STAGE = std::chrono::milliseconds(2);
+        int processed = 0;
+        const auto t0 = std::chrono::steady_clock::now();
+        pipeline.run(stop.get_token(),
+            [] { return 0.0; },
+            [&](Frame& f) {
+                f.resize(1024, true);
+                std::this_thread::sleep_for(STAGE); // FDwfAnalogInStatus の完了待ちの代わり
+                return true;
+            },
+            [&](Frame& f) {
+                double sum = 0.0;
+                const auto until = std::chrono::steady_clock::now() + STAGE;
+                while (std::chrono::steady_clock::now() < until) {
+                    for (double v : f.ch[0]) sum += v; // 復調の代わり
+                }
+                f.ch[1][0] = sum;
+                if (++processed == FRAMES) stop.request_stop();
+            });
+        const double wallUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        const auto s = pipeline.stats();
+        const double serialUs = (s.acquireUs + s.processUs) * s.frames;
+        assert(s.frames == FRAMES && s.acquireLoad > 0.0 && s.processLoad > 0.0);
+        assert(wallUs < 0.85 * serialUs);
+        std::cout << "  overlap: " << wallUs / s.frames << " us/frame (serial " << serialUs / s.frames << " us/frame), acquire "
+            << s.acquireUs << " us (" << 100.0 * s.acquireLoad << " %), process " << s.processUs << " us (" << 100.0 * s.processLoad << " %)" << std::endl;
+    }
+
+    // [3] last を立てたフレームまで取りこぼさずに処理して戻る (取り込みが処理より速くても)
+    {
+        FramePipeline pipeline;
+        constexpr int FRAMES = 50;
+        int acquired = 0, processed = 0;
+        pipeline.run(std::stop_token{},
+            [] { return 0.0; },
+            [&](Frame& f) {
+                f.last = (++acquired == FRAMES);
+                return true;
+            },
+            [&](Frame& f) {
+                ++processed;
+                assert(f.last == (processed == FRAMES));
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            });
+        assert(acquired == FRAMES && processed == FRAMES && pipeline.stats().frames == FRAMES);
+        std::cout << "  last frame: " << processed << " of " << FRAMES << " frames processed" << std::endl;
+    }
+
+    std::cout << "FramePipeline Test Passed!" << std::endl;
+}
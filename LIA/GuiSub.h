@@ -59,11 +59,13 @@ public:
 				ImGui::EndMenu();
 			}
 			if (ImGui::BeginMenu("Tools")) {
-				ImGui::MenuItem("Ch2", NULL, &cfg.scope.ch[1].enable);
+				if (bool ch2 = cfg.scope.ch[1].enable; ImGui::MenuItem("Ch2", NULL, &ch2)) {
+					controlWindow.submit({ ControlCommand::Op::ChEnable, 1, ch2 ? 1.0 : 0.0 });
+				}
 				ImGui::MenuItem("Beep", NULL, &cfg.plot.beep);
 				ImGui::MenuItem("Surface mode", NULL, &cfg.plot.surfaceMode);
 				if (ImGui::MenuItem("Reset")) {
-					cfg.reset();
+					controlWindow.submit({ ControlCommand::Op::Reset });
 				}
 				ImGui::EndMenu();
 			}
@@ -75,6 +77,13 @@ public:
 		}
 	}
 	void show(void) {
+		// リングバッファを読むウィンドウの間だけ共有ロックを持つ (ウィンドウごとに取り直すので、
+		// その合間に測定スレッドがフレーム境界で再配置を入れ替えられる)
+		const auto withRing = [this](auto&& draw) {
+			const auto ringLock = cfg.lockRingBuffer();
+			draw();
+			};
+		controlWindow.retryUnsent(); // 前のフレームでキューが満杯だった設定変更
 		const float nextItemWidth = 150 * cfg.window.monitorScale;
 		static int theme = 0;
 		if (theme != cfg.window.theme)
@@ -82,22 +91,22 @@ public:
 			theme = cfg.window.theme;
 			Gui::SetTheme(static_cast<GuiTheme>(theme));
 		}
-		beep.update(cfg.plot.beep, cfg.ringBuffer.ch[0].x[cfg.ringBuffer.latestIdx], cfg.ringBuffer.ch[0].y[cfg.ringBuffer.latestIdx]);
+		withRing([this] { beep.update(cfg.plot.beep, cfg.ringBuffer.ch[0].x[cfg.ringBuffer.latestIdx], cfg.ringBuffer.ch[0].y[cfg.ringBuffer.latestIdx]); });
 		ImGuiStyle& style = ImGui::GetStyle();
 		ImVec4& col = style.Colors[ImGuiCol_WindowBg];
 		col.w = 0.4f; // RGBはそのまま、alphaのみ置き換え
 		ShowMainMenuBar();
 
-		deltaTimeChartWindow.show();
-		controlWindow.show();
-		xyPlotWindow.show();
-		rawPlotWindow.show();
-		timeChartWindow.show();
-		acfmPlotWindow.show();
+		withRing([this] { deltaTimeChartWindow.show(); });
+		withRing([this] { controlWindow.show(); });
+		withRing([this] { xyPlotWindow.show(); });
+		rawPlotWindow.show(); // 生波形だけ (リングバッファは読まない)
+		withRing([this] { timeChartWindow.show(); });
+		withRing([this] { acfmPlotWindow.show(); });
 		if (cfg.pause.flag) {
 			col.w = 1.0f;
-			timeChartZoomWindow.show();
-			if (cfg.window.acfmWindow) acfmVhVvPlotWindow.show();
+			withRing([this] { timeChartZoomWindow.show(); });
+			if (cfg.window.acfmWindow) withRing([this] { acfmVhVvPlotWindow.show(); });
 		}
 	}
 };
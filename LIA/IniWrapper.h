@@ -56,6 +56,12 @@ public:
         }
     }
 
+    // ̎擾 (lŜ̂܂ܕԂ)
+    std::string get(std::string_view section, std::string_view key, const std::string& def) const {
+        auto it = data.find(std::string(section) + "." + std::string(key));
+        return (it == data.end()) ? def : it->second;
+    }
+
     template <typename T>
     void set(std::string_view section, std::string_view key, const T& value) {
         std::ostringstream oss;
@@ -71,7 +77,19 @@ public:
     bool save(const std::string& filename) const {
         std::ofstream file(filename);
         if (!file) return false;
+        write(file);
+        return true;
+    }
+
+    // ini `̕ƂĎ擾 (.liab ̃wb_p)
+    std::string toString() const {
+        std::ostringstream oss;
+        write(oss);
+        return oss.str();
+    }
 
+private:
+    void write(std::ostream& file) const {
         // \[g\ vector ɕϊ
         std::vector<std::pair<std::string, std::string>> sorted_data(data.begin(), data.end());
 
@@ -93,8 +111,7 @@ public:
             }
             file << key << "=" << value << "\n";
         }
-        return true;
     }
-private:
+
     std::unordered_map<std::string, std::string> data;
 };
@@ -0,0 +1,340 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "Timer.h"
+
+// ================================================================================
+// JournalWriter: 追記専用の記録ファイル群を1本のバックグラウンドスレッドで書く
+//   - append() は呼び出し元のバッファに文字列を足すだけ (ファイル I/O をしない・例外を投げない)
+//     書き込みが追いつかずバッファが maxPendingBytes に達したら、足さずに droppedBytes に数える
+//   - ワーカーは flushSec ごと、またはバッファが batchBytes を超えたときにまとめて書く
+//   - syncSec ごとに fsync (_commit) してクラッシュ・停電時の損失を直近数秒に抑える
+//   - flushSec / syncSec / rotateSec は options.timer の時刻で測る (なければ実時間。仮想時計で試験できる)
+//   - ファイルは rotateBytes / rotateSec を超えると <stem>_<n><ext> に切り替える (0 で無効)
+//   - 破棄時は残りを書いて fsync する
+// ================================================================================
+class JournalWriter {
+public:
+    struct Options {
+        size_t batchBytes = 64 * 1024;
+        double flushSec = 1.0;
+        double syncSec = 5.0;
+        uint64_t rotateBytes = 0;
+        double rotateSec = 0.0;
+        size_t maxPendingBytes = 64 * 1024 * 1024; // ファイルごとの未書き込みの上限
+        const Timer* timer = nullptr;
+    };
+
+    struct Stats {
+        uint64_t bytes = 0;      // 書き込んだバイト数
+        uint64_t batches = 0;    // fwrite の回数
+        uint64_t syncs = 0;
+        uint64_t rotations = 0;
+        uint64_t droppedBytes = 0; // バッファが上限に達して捨てたバイト数
+    };
+
+    JournalWriter() : JournalWriter(Options()) {}
+    explicit JournalWriter(Options options) : options_(options),
+        worker_([this](std::stop_token st) { run(st); }) {}
+
+    ~JournalWriter() {
+        worker_.request_stop();
+        cv_.notify_all();
+        worker_ = std::jthread(); // join
+        writeAll(true);
+        for (auto& s : streams_) closeFile(*s);
+    }
+
+    // path への追記を開始する。新しいファイル (ローテーション後を含む) の先頭には header を書く
+    int open(const std::string& path, std::string header) {
+        auto s = std::make_unique<Stream>();
+        s->path = path;
+        s->header = std::move(header);
+        std::lock_guard<std::mutex> lock(fileMtx_);
+        openFile(*s);
+        std::lock_guard<std::mutex> lock2(mtx_);
+        streams_.push_back(std::move(s));
+        return static_cast<int>(streams_.size() - 1);
+    }
+
+    // 測定スレッドからも呼ぶので例外を投げない (確保できなければ捨てて数える)
+    void append(int id, std::string_view text) noexcept {
+        bool full = false;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            std::string& pending = streams_[id]->pending;
+            if (pending.size() + text.size() > options_.maxPendingBytes) {
+                dropped_.fetch_add(text.size(), std::memory_order_relaxed);
+            }
+            else {
+                try {
+                    pending += text;
+                }
+                catch (const std::bad_alloc&) {
+                    dropped_.fetch_add(text.size(), std::memory_order_relaxed);
+                }
+            }
+            full = pending.size() >= options_.batchBytes;
+        }
+        if (full) cv_.notify_one();
+    }
+
+    // 残りを書いて fsync する (呼び出し元で完了を待つ)
+    void flush() { writeAll(true); }
+
+    // 前回から flushSec 経っていれば書き、syncSec 経っていれば fsync する (ワーカーが flushSec ごとに呼ぶ)
+    void writeDue() { writeAll(false, true); }
+
+    [[nodiscard]] Stats stats() const {
+        std::lock_guard<std::mutex> lock(fileMtx_);
+        Stats s = stats_;
+        s.droppedBytes = dropped_.load(std::memory_order_relaxed);
+        return s;
+    }
+    // 現在書き込み中のファイル
+    [[nodiscard]] std::string currentPath(int id) const {
+        std::lock_guard<std::mutex> lock(fileMtx_);
+        return streams_[id]->currentPath;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Stream {
+        std::string path, header, currentPath;
+        std::string pending;     // append() で積まれた未書き込みの文字列 (mtx_)
+        std::string writing;     // ワーカーが書き込み中の文字列 (fileMtx_)
+        FILE* fp = nullptr;
+        uint64_t fileBytes = 0;
+        double openedSec = 0.0;
+        int rotation = 0;
+    };
+
+    Options options_;
+    mutable std::mutex mtx_;      // streams_ の追加と pending
+    mutable std::mutex fileMtx_;  // ファイル操作と stats_
+    std::condition_variable_any cv_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    Stats stats_;
+    std::atomic<uint64_t> dropped_{ 0 };
+    uint64_t droppedReported_ = 0; // fileMtx_
+    const Clock::time_point start_ = Clock::now();
+    double lastFlushSec_ = 0.0;    // fileMtx_
+    double lastSyncSec_ = 0.0;     // fileMtx_
+    std::jthread worker_; // 他のメンバーより後に構築・先に破棄する
+
+    [[nodiscard]] double nowSec() const {
+        return options_.timer ? options_.timer->elapsedSec() : std::chrono::duration<double>(Clock::now() - start_).count();
+    }
+
+    void run(std::stop_token st) {
+        const auto period = std::chrono::duration<double>(options_.flushSec);
+        while (!st.stop_requested()) {
+            bool full;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                full = cv_.wait_for(lock, st, std::chrono::duration_cast<Clock::duration>(period), [this] {
+                    return std::any_of(streams_.begin(), streams_.end(), [this](const auto& s) { return s->pending.size() >= options_.batchBytes; });
+                    });
+            }
+            writeAll(false, !full);
+        }
+    }
+
+    // ifDue なら前回の書き込みから flushSec 経っていなければ何もしない
+    // forceSync でなければ前回の fsync から syncSec 経過したときだけ fsync する
+    void writeAll(bool forceSync, bool ifDue = false) {
+        std::lock_guard<std::mutex> fileLock(fileMtx_);
+        const double now = nowSec();
+        if (ifDue && now - lastFlushSec_ < options_.flushSec) return;
+        lastFlushSec_ = now;
+        const bool sync = forceSync || now - lastSyncSec_ >= options_.syncSec;
+        std::vector<Stream*> streams;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto& s : streams_) {
+                s->writing.swap(s->pending); // 呼び出し元はすぐに次を積める
+                streams.push_back(s.get());
+            }
+        }
+        for (Stream* s : streams) {
+            if (!s->writing.empty() && s->fp != nullptr) writeStream(*s);
+            s->writing.clear();
+            if (sync && s->fp != nullptr) syncFile(s->fp);
+        }
+        if (sync) {
+            lastSyncSec_ = now;
+            stats_.syncs++;
+        }
+        if (const uint64_t dropped = dropped_.load(std::memory_order_relaxed); dropped != droppedReported_) {
+            std::cerr << std::format("Journal: {} bytes were dropped (writer fell behind)", dropped - droppedReported_) << std::endl;
+            droppedReported_ = dropped;
+        }
+    }
+
+    // writing を書く。rotateBytes を超える分は行単位で次のファイルに回す
+    void writeStream(Stream& s) {
+        if (options_.rotateSec > 0 && nowSec() - s.openedSec >= options_.rotateSec) rotate(s);
+        std::string_view rest = s.writing;
+        while (!rest.empty() && s.fp != nullptr) {
+            size_t n = rest.size();
+            if (options_.rotateBytes > 0 && s.fileBytes + n > options_.rotateBytes) {
+                const size_t room = (options_.rotateBytes > s.fileBytes) ? static_cast<size_t>(options_.rotateBytes - s.fileBytes) : 0;
+                const size_t cut = rest.substr(0, room).rfind('\n');
+                if (cut != std::string_view::npos) {
+                    n = cut + 1;
+                }
+                else if (s.fileBytes > s.header.size()) {
+                    rotate(s);
+                    continue;
+                }
+                else {
+                    // 1行が上限を超える場合はそのまま書く
+                    const size_t eol = rest.find('\n');
+                    n = (eol == std::string_view::npos) ? rest.size() : eol + 1;
+                }
+            }
+            std::fwrite(rest.data(), 1, n, s.fp);
+            s.fileBytes += n;
+            stats_.bytes += n;
+            stats_.batches++;
+            rest.remove_prefix(n);
+        }
+        if (s.fp != nullptr) std::fflush(s.fp);
+    }
+
+    void rotate(Stream& s) {
+        syncFile(s.fp);
+        closeFile(s);
+        s.rotation++;
+        stats_.rotations++;
+        openFile(s);
+    }
+
+    void openFile(Stream& s) {
+        if (s.rotation == 0) {
+            s.currentPath = s.path;
+        }
+        else {
+            const std::filesystem::path p(s.path);
+            s.currentPath = (p.parent_path() / std::format("{}_{}{}", p.stem().string(), s.rotation, p.extension().string())).string();
+        }
+        s.fp = std::fopen(s.currentPath.c_str(), "ab");
+        s.openedSec = nowSec();
+        s.fileBytes = 0;
+        if (s.fp == nullptr) {
+            std::cerr << "Error: Could not open file " << s.currentPath << "\n";
+            return;
+        }
+        std::fwrite(s.header.data(), 1, s.header.size(), s.fp);
+        s.fileBytes = s.header.size();
+    }
+
+    static void closeFile(Stream& s) {
+        if (s.fp != nullptr) std::fclose(s.fp);
+        s.fp = nullptr;
+    }
+
+    static void syncFile(FILE* fp) {
+        std::fflush(fp);
+#ifdef _WIN32
+        _commit(_fileno(fp));
+#else
+        fsync(fileno(fp));
+#endif
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_journal() {
+    std::cout << "--- Journal Test Start ---" << std::endl;
+
+    const std::string dir = "journal_test";
+    std::filesystem::remove_all(dir); // 追記モードなので前回の残りを消す
+    std::filesystem::create_directory(dir);
+    auto readAll = [](const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        };
+
+    {
+        JournalWriter journal({ .batchBytes = 1024, .flushSec = 0.01, .syncSec = 0.05, .rotateBytes = 4096 });
+        const int a = journal.open(dir + "/a.csv", "# a\n");
+        const int b = journal.open(dir + "/b.csv", "# b\n");
+        for (int i = 0; i < 1000; ++i) journal.append(a, std::format("{}\n", 1000 + i)); // 5000B -> 2ファイル
+        journal.append(b, "x\n");
+        journal.flush();
+        assert(readAll(dir + "/b.csv") == "# b\nx\n");
+        journal.append(b, "y\n");
+        const auto s = journal.stats();
+        assert(s.rotations == 1 && s.syncs > 0);
+        assert(journal.currentPath(a) == (std::filesystem::path(dir) / "a_1.csv").string());
+    }
+    assert(readAll(dir + "/b.csv") == "# b\nx\ny\n"); // 破棄時に残りを書く
+
+    // 全ファイルを繋ぐと欠落・重複なく元の順序になること
+    std::string joined;
+    for (const char* name : { "/a.csv", "/a_1.csv" }) {
+        const std::string text = readAll(dir + name);
+        assert(text.starts_with("# a\n") && text.size() <= 4096 + 5);
+        joined += text.substr(4);
+    }
+    std::string expected;
+    for (int i = 0; i < 1000; ++i) expected += std::format("{}\n", 1000 + i);
+    assert(joined == expected);
+    std::filesystem::remove_all(dir);
+    std::cout << "  batched append / rotation / drain: OK" << std::endl;
+
+    // 定期書き込みと fsync は時計で決まる (仮想時計を進めて確かめる。ワーカーが同時に writeDue しても結果は同じ)
+    {
+        std::filesystem::create_directory(dir);
+        Timer timer;
+        timer.setVirtual(true);
+        timer.start();
+        JournalWriter journal({ .batchBytes = 1024, .flushSec = 0.01, .syncSec = 0.05, .maxPendingBytes = 8, .timer = &timer });
+        const int c = journal.open(dir + "/c.csv", "# c\n");
+        journal.append(c, "x\n");
+        timer.sleepUntil(0.005);
+        journal.writeDue();
+        assert(readAll(dir + "/c.csv").find('x') == std::string::npos && journal.stats().syncs == 0);
+        timer.sleepUntil(0.01);
+        journal.writeDue();
+        assert(readAll(dir + "/c.csv") == "# c\nx\n" && journal.stats().syncs == 0);
+        timer.sleepUntil(0.05);
+        journal.writeDue();
+        assert(journal.stats().syncs == 1);
+
+        // 書き込まれない間はバッファの上限を超える分を捨てる
+        journal.append(c, "1234\n");
+        journal.append(c, "5678\n");
+        assert(journal.stats().droppedBytes == 5);
+        journal.flush();
+        assert(readAll(dir + "/c.csv") == "# c\nx\n1234\n");
+    }
+    std::filesystem::remove_all(dir);
+    std::cout << "  flush / sync on the timer, bounded buffer: OK" << std::endl;
+
+    std::cout << "Journal Test Passed!" << std::endl;
+}
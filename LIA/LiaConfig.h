@@ -12,16 +12,36 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <numbers>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 //#include "WF_SDK/WF_SDK.h"
 #include "Daq_wf.h"
 #include "IniWrapper.h"
+#include "Journal.h"
 #include "Psd.h"
 #include "Timer.h"
+#include "ControlQueue.h"
+#include "CsvWriter.h"
+#include "ExportWorker.h"
 #include "Filter.h"
+#include "FrameHistory.h"
+#include "FramePipeline.h"
+#include "LiabFile.h"
+#include "NpyFile.h"
+#include "PointStream.h"
+#include "RangeIndex.h"
+#include "RingColumns.h"
+#include "SeqNotifier.h"
+#include "SharedMirror.h"
+#include "TrendStore.h"
 #include "pocketfft_hdronly.h"
 
 // ================================================================================
@@ -35,6 +55,29 @@ namespace LiaConfigDefaultConsts {
 	constexpr int SCOPE_BUFFER_SIZE = 10000; // 0.1ms分のデータを保存
     constexpr double RINGBUFFER_DT = 2e-3;
 	constexpr int RINGBUFFER_SEC = 60 * 10; // 10 minutes
+    constexpr double RINGBUFFER_DT_MIN = 1e-3;
+    constexpr double RINGBUFFER_DT_MAX = 1.0;
+    constexpr double RINGBUFFER_SEC_MIN = 10.0;
+    constexpr double RINGBUFFER_SEC_MAX = 60.0 * 60 * 12; // 12 hours
+    constexpr double RINGBUFFER_MB_MAX = 1024.0; // dt と sec の組み合わせの上限 (double 格納で約2000万点)
+    constexpr float RAW_HISTORY_MB = 16.0f; // 生波形履歴 (10000点x2ch で約400フレーム)。長く残すときは lia.ini で増やす
+    constexpr float TREND_1S_HOURS = 24.0f;   // トレンド保持期間 (1ビン 200B: 1s x 24h で約17MB)
+    constexpr float TREND_10S_DAYS = 7.0f;
+    constexpr float TREND_1MIN_DAYS = 30.0f;
+    // array の装置ごと (装置の数だけ確保されるので単独の測定より小さく: トレンドは1台あたり約4.5MB、生波形履歴は無効)
+    constexpr float ARRAY_RAW_HISTORY_MB = 0.0f;
+    constexpr float ARRAY_TREND_1S_HOURS = 1.0f;
+    constexpr float ARRAY_TREND_10S_DAYS = 1.0f;
+    constexpr float ARRAY_TREND_1MIN_DAYS = 7.0f;
+    constexpr auto SAVE_FORMAT = "csv";      // 保存形式 (csv / liab / npy / npz)
+    constexpr float JOURNAL_SYNC_SEC = 5.0f;     // 追記記録の fsync 間隔
+    constexpr float JOURNAL_ROTATE_MB = 256.0f;  // ect.csv は約35KB/s (2ms周期) なので約2時間で切り替え
+    constexpr float JOURNAL_ROTATE_HOURS = 0.0f; // 0 で時間による切り替えなし
+    constexpr int SHARED_MIRROR_POINTS = 65536;  // 共有メモリの点数 (2 ms 周期で約2分、2.6 MB)
+    constexpr auto SHARED_MIRROR_NAME = "LIA_live";
+    constexpr int SERVER_PORT = 5025;            // SCPI over TCP の慣例のポート
+    constexpr auto SERVER_BIND_ADDRESS = "127.0.0.1"; // 認証がないので既定はローカルのみ
+    constexpr float TIMER_SPIN_MARGIN_US = 500.0f; // 周期待ちで期限のこれだけ前に起きて回る (負で回るだけ)
 
     constexpr float POST_HPF_MIN = 0.0f;
     constexpr float POST_HPF_MAX = 50.0f; 
@@ -45,9 +88,13 @@ namespace LiaConfigDefaultConsts {
     constexpr auto ACFM_SETTINGS_FILE = "acfm.ini";
     constexpr auto RESULTS_FILE = "ect.csv";
     constexpr auto CMDS_FILE = "commands.csv";
+    constexpr auto RECS_FILE = "rec.csv";
 
     constexpr auto CH_VERTICAL = 0;
     constexpr auto CH_HORIZONTAL = 1;
+
+    constexpr auto COMPONENT_X = 0;
+    constexpr auto COMPONENT_Y = 1;
 }
 
 // ================================================================================
@@ -237,7 +284,7 @@ public:
 
         // FFT計算ロジック
         void calculateFFT(bool flagCh2, float targetFreq) {
-            static pocketfft::detail::shape_t shape{ (size_t)bufferSize };
+            const pocketfft::detail::shape_t shape{ (size_t)bufferSize }; // インスタンスごと・バッファサイズ変更後も正しい長さ
             static const pocketfft::detail::stride_t stride_in{ sizeof(double) };
             static const pocketfft::detail::stride_t stride_out{ sizeof(std::complex<double>) };
 
@@ -300,6 +347,50 @@ public:
 		}
     } plot;
 
+    struct TrendCfg {
+        float hours1s = LiaConfigDefaultConsts::TREND_1S_HOURS;
+        float days10s = LiaConfigDefaultConsts::TREND_10S_DAYS;
+        float days1min = LiaConfigDefaultConsts::TREND_1MIN_DAYS;
+    } trend;
+
+    struct RawHistoryCfg {
+        float megaBytes = LiaConfigDefaultConsts::RAW_HISTORY_MB; // 0 で無効
+    } rawHistory;
+
+    // array (DeviceArray) の各装置の生波形履歴とトレンド。lia.ini の [Array] で全装置共通に決める
+    // (装置ごとの lia_<instance>.ini の [RawHistory] / [Trend] は使わない)
+    struct ArrayCfg {
+        float rawHistoryMB = LiaConfigDefaultConsts::ARRAY_RAW_HISTORY_MB;
+        TrendCfg trend{ LiaConfigDefaultConsts::ARRAY_TREND_1S_HOURS, LiaConfigDefaultConsts::ARRAY_TREND_10S_DAYS, LiaConfigDefaultConsts::ARRAY_TREND_1MIN_DAYS };
+    } deviceArray;
+
+    struct SaveCfg {
+        std::string format = LiaConfigDefaultConsts::SAVE_FORMAT;
+        bool rawFrames = false; // .liab の時系列に生波形フレームを含める (大きくなるので既定は無効)
+        [[nodiscard]] std::string fileName(std::string_view stem) const { return std::format("{}.{}", stem, format); }
+    } save;
+
+    struct JournalCfg {
+        float syncSec = LiaConfigDefaultConsts::JOURNAL_SYNC_SEC;
+        float rotateMB = LiaConfigDefaultConsts::JOURNAL_ROTATE_MB;
+        float rotateHours = LiaConfigDefaultConsts::JOURNAL_ROTATE_HOURS;
+    } journal;
+
+    struct ServerCfg {
+        int port = 0;            // 0 で TCP サーバーなし (起動引数 server で SERVER_PORT)
+        std::string unixSocket;  // 空なら Unix ドメインソケットなし
+        std::string bindAddress = LiaConfigDefaultConsts::SERVER_BIND_ADDRESS;
+    } server;
+
+    struct SharedMemoryCfg {
+        std::string name;        // 空なら共有メモリへ書かない (起動引数 shm で SHARED_MIRROR_NAME)
+        int points = LiaConfigDefaultConsts::SHARED_MIRROR_POINTS;
+    } sharedMemory;
+
+    struct TimingCfg {
+        float spinMarginUs = LiaConfigDefaultConsts::TIMER_SPIN_MARGIN_US; // timer:stats? の遅れと CPU を見て調整する
+    } timing;
+
     struct PauseCfg {
         bool flag = false;
         struct SelectArea {
@@ -322,17 +413,23 @@ public:
     } xyRecs;
 
     struct RingBuffer {
-        std::vector<double> times;
-        std::vector<double> deltaTimes;
-        XYs ch[2];
-        int nofm = 0;      // 総測定回数
+        // 格納精度は RingSample (LIA_RINGBUFFER_FLOAT32 で float)。読み出しは常に double に変換される
+        TimeColumn<RingSample> times;
+        std::vector<RingSample> deltaTimes;
+        XYsT<RingSample> ch[2];
+        uint64_t nofm = 0; // 総測定回数 (点の seq。再配置で 0 に戻る)
         int latestIdx = 0; // 最新データのインデックス
         int writeIdx = 0;  // 書き込み位置のインデックス 
         int size = 0;      // 有効データ数
         double sec = LiaConfigDefaultConsts::RINGBUFFER_SEC;
+        int generation = 0; // 再配置のたびに増える (seq 範囲を固定した読み出し・カーソルの検証用)
+        RangeIndex ranges[2][2]; // [ch][COMPONENT_X/Y] の区間集計インデックス
 		RingBuffer() {
 			update(dt, sec);
 		}
+        RingBuffer(double dt_, double sec_) {
+            update(dt_, sec_);
+        }
         void update(const double dt_, const double sec_) {
             dt = dt_;
             sec = sec_;
@@ -341,14 +438,163 @@ public:
             deltaTimes.resize(bufferSize);
             ch[0].resize(bufferSize);
             ch[1].resize(bufferSize);
+            for (int c = 0; c < 2; ++c) {
+                ranges[c][0].resize(bufferSize);
+                ranges[c][0].rebuild(ch[c].x);
+                ranges[c][1].resize(bufferSize);
+                ranges[c][1].rebuild(ch[c].y);
+            }
         }
 		double getDt() const { return dt; }
 		int getMeasurementSize() const { return static_cast<int>(times.size()); }
+
+        // 書き込み位置 idx の区間集計を更新する
+        void updateRanges(int idx) noexcept {
+            for (int c = 0; c < 2; ++c) {
+                ranges[c][0].update(ch[c].x, idx);
+                ranges[c][1].update(ch[c].y, idx);
+            }
+        }
+        void rebuildRanges() {
+            for (int c = 0; c < 2; ++c) {
+                ranges[c][0].rebuild(ch[c].x);
+                ranges[c][1].rebuild(ch[c].y);
+            }
+        }
+
+        // ch[].x/y[writeIdx] 書き込み後に時刻を確定し、書き込み位置を進める
+        void commit(double t, bool updateIndex = true) noexcept {
+            times.set(writeIdx, t);
+            deltaTimes[writeIdx] = static_cast<RingSample>((nofm > 0) ? (times[writeIdx] - times[latestIdx]) * 1e3 : 0.0);
+            if (updateIndex) updateRanges(writeIdx);
+
+            latestIdx = writeIdx;
+            std::atomic_ref<uint64_t>(nofm).store(nofm + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release); // 次の点の書き込みより前に nofm を見せる (committed 参照)
+
+            if (++writeIdx >= getMeasurementSize()) writeIdx = 0;
+            size = static_cast<int>(std::min<uint64_t>(nofm, getMeasurementSize()));
+        }
+
+        // 測定スレッド以外から読む総測定回数 (commit の書き込みと対になる)
+        [[nodiscard]] uint64_t committed() const noexcept {
+            return std::atomic_ref<uint64_t>(const_cast<uint64_t&>(nofm)).load(std::memory_order_acquire);
+        }
+
+        // data:txy:since のカーソル: 上位ビットに generation、下位 CURSOR_SEQ_BITS ビットに seq (1 ms 周期で約34年)
+        //   generation が違うカーソルは再配置前のもので、seq の指す点はもうない
+        static constexpr int CURSOR_SEQ_BITS = 40;
+        static constexpr uint64_t CURSOR_SEQ_MASK = (uint64_t{ 1 } << CURSOR_SEQ_BITS) - 1;
+        [[nodiscard]] uint64_t cursorOf(uint64_t seq) const noexcept {
+            return (static_cast<uint64_t>(generation) << CURSOR_SEQ_BITS) | (seq & CURSOR_SEQ_MASK);
+        }
+
+        // 1点あたりのおおよそのメモリ (時刻・時間差・2ch の X/Y と区間集計インデックス)
+        static constexpr double BYTES_PER_POINT = 6.0 * sizeof(RingSample)
+            + 4.0 * 2.0 * sizeof(RangeStats) / RangeIndex::BLOCK_SIZE;
+        [[nodiscard]] static double megaBytesFor(double dt_, double sec_) noexcept {
+            return (sec_ / dt_ + 1.0) * BYTES_PER_POINT / (1024.0 * 1024.0);
+        }
+
+        // 再配置で旧バッファの点を新しい dt の1周期ごとに平均する (時刻は周期の最初の点)
+        struct Decimator {
+            double t = 0.0;
+            double sum[2][2] = {}; // [ch][x/y]
+            int count = 0;
+        };
+        // 点 (t, v[ch][x/y]) を集計に加える。前の周期から dt 経っていれば、その平均を末尾に追加してから始める
+        void accumulate(Decimator& d, double t, const double (&v)[2][2], double srcDt, bool updateIndex = true) noexcept {
+            if (d.count > 0 && t - d.t >= dt - 0.5 * srcDt) flush(d, updateIndex);
+            if (d.count == 0) d.t = t;
+            for (int c = 0; c < 2; ++c) {
+                d.sum[c][0] += v[c][0];
+                d.sum[c][1] += v[c][1];
+            }
+            ++d.count;
+        }
+        // 集計中の周期を平均して末尾に追加する
+        void flush(Decimator& d, bool updateIndex = true) noexcept {
+            if (d.count == 0) return;
+            for (int c = 0; c < 2; ++c) {
+                ch[c].x[writeIdx] = static_cast<RingSample>(d.sum[c][0] / d.count);
+                ch[c].y[writeIdx] = static_cast<RingSample>(d.sum[c][1] / d.count);
+            }
+            commit(d.t, updateIndex);
+            d = Decimator();
+        }
+        // 物理位置 p の点 (再配置の取り込み用)
+        void pointAt(int p, double& t, double (&v)[2][2]) const noexcept {
+            t = times[p];
+            for (int c = 0; c < 2; ++c) {
+                v[c][0] = ch[c].x[p];
+                v[c][1] = ch[c].y[p];
+            }
+        }
+
+        // 論理インデックス (0 = 最古のデータ) <-> 物理インデックスの変換
+        int toPhysical(int logical) const noexcept {
+            const int capacity = getMeasurementSize();
+            const int oldest = (size < capacity) ? 0 : writeIdx;
+            int idx = oldest + logical;
+            return (idx >= capacity) ? idx - capacity : idx;
+        }
+        int toLogical(int physical) const noexcept {
+            const int capacity = getMeasurementSize();
+            const int oldest = (size < capacity) ? 0 : writeIdx;
+            int idx = physical - oldest;
+            return (idx < 0) ? idx + capacity : idx;
+        }
+
+        // times[] >= t となる最初の論理インデックス (二分探索)
+        int lowerBound(double t) const noexcept {
+            int lo = 0, hi = size;
+            while (lo < hi) {
+                const int mid = lo + (hi - lo) / 2;
+                if (times[toPhysical(mid)] < t) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        // 時刻区間 [t0, t1] における ch[chIdx] の x または y (component = COMPONENT_X/Y) の集計 O(log n)
+        RangeStats stats(int chIdx, int component, double t0, double t1) const noexcept {
+            const int first = lowerBound(t0);
+            const int last = lowerBound(std::nextafter(t1, std::numeric_limits<double>::infinity()));
+            return statsByLogical(chIdx, component, first, last);
+        }
+
+        // 論理インデックス区間 [first, last) の集計 (折り返しを分割して問い合わせる)
+        RangeStats statsByLogical(int chIdx, int component, int first, int last) const noexcept {
+            if (first >= last) return {};
+            return statsByPhysical(chIdx, component, toPhysical(first), toPhysical(last - 1) + 1);
+        }
+
+        // seq 区間 [first, last) の集計 (seq s は物理位置 s % capacity。読み出し中に nofm が進んでもずれない)
+        //   呼び出し側は区間がバッファに残っている (nofm - capacity < first, last <= nofm) ことを確かめておく
+        RangeStats statsBySeq(int chIdx, int component, uint64_t first, uint64_t last) const noexcept {
+            if (first >= last) return {};
+            const uint64_t capacity = static_cast<uint64_t>(getMeasurementSize());
+            return statsByPhysical(chIdx, component, static_cast<int>(first % capacity), static_cast<int>((last - 1) % capacity) + 1);
+        }
+
+        // 物理インデックス区間 [pFirst, pLast) の集計。pFirst >= pLast なら折り返しを分割して問い合わせる
+        RangeStats statsByPhysical(int chIdx, int component, int pFirst, int pLast) const noexcept {
+            const auto& index = ranges[chIdx][component];
+            const auto& column = (component == LiaConfigDefaultConsts::COMPONENT_X) ? ch[chIdx].x : ch[chIdx].y;
+            if (pFirst < pLast) return index.query(column, pFirst, pLast);
+            RangeStats result = index.query(column, pFirst, getMeasurementSize());
+            result.merge(index.query(column, 0, pLast));
+            return result;
+        }
     private:
         double dt = LiaConfigDefaultConsts::RINGBUFFER_DT;
         
     } ringBuffer;
 
+    TrendStore trendStore;         // 長期トレンド (1s / 10s / 1min)
+    FrameHistory frameHistory;     // 直近の生波形 (再復調用)
+    Redemodulator redemodulator;   // frameHistory を参照するため後に宣言する
+
     struct ACFMData {
         std::vector<double> Vhs = { 0.022, 0.023, 0.025, 0.027, 0.058, 0.067 };
         std::vector<double> Vvs = { 0.102, 0.106, 0.115, 0.121, 0.212, 0.239 };
@@ -378,7 +624,52 @@ public:
     XYs autoSetupHistoryW1, autoSetupHistoryW2;
     std::vector<std::array<float, 6>> cmds;
 
+    // 実行中のリングバッファ再配置 (requestRingBufferRelayout 参照)
+    struct RingBufferRelayout {
+        std::unique_ptr<RingBuffer> next;    // 構築済みの新バッファ (反映後は旧バッファ)
+        uint64_t srcNofm = 0;                // 構築時に取り込んだ旧バッファの nofm
+        RingBuffer::Decimator decimator;     // 構築の終わりで集計途中の周期 (反映時に続きを取り込む)
+        std::atomic<bool> ready{ false };    // 測定スレッドへの引き渡し待ち
+        std::atomic<bool> busy{ false };     // 構築〜反映〜解放の間 true
+        std::jthread worker;
+    } relayout;
+
+    // 測定スレッド以外がリングバッファを読む間は共有ロックを持つ (lockRingBuffer)
+    //   測定スレッドの書き込みはロックしない。再配置の入れ替えだけが排他ロックを取り (取れなければ次のフレーム境界)、
+    //   旧バッファは入れ替え後に解放するので、ロックを持って読んでいる配列が途中で消えることはない
+    mutable std::shared_mutex ringMtx;
+    [[nodiscard]] std::shared_lock<std::shared_mutex> lockRingBuffer() const { return std::shared_lock(ringMtx); }
+
+    ExportWorker exporter; // 非同期保存 (参照するバッファより後に宣言し、先に破棄・完了させる)
+
+    // 測定中の追記記録 (ect.csv: 全測定点, commands.csv: 操作履歴, rec.csv: Rec. した点)
+    // 終了時は最後のバッチを書くだけで済み、異常終了でも直近 syncSec 秒以内の損失で済む
+    std::unique_ptr<JournalWriter> recorder;
+    struct JournalIds { int results = -1, cmds = -1, recs = -1; } journalIds;
+
+    // data:stream の購読者へ測定点を配る (測定スレッドは待たない)
+    PointStream pointStream;
+
+    // GUI・パイプ・ソケットからの設定変更 (測定スレッドがフレーム境界で適用する)
+    ControlQueue controls;
+
+    // 確定した測定点の通し番号と、それを待つスレッドへの通知 (waitForPoints / waitUntilSeq)
+    // 設定の適用や statusMeasurement / statusPipe の変化でも起こす
+    SeqNotifier events;
+    std::atomic<uint64_t> controlsSeq{ 0 }; // 最後に設定変更を適用したときの events.seq() (これ以降の点が変更後)
+
+    // 取り込みスレッドと処理スレッド (runPipeline) の受け渡しと、各段の使用率
+    FramePipeline pipeline;
+    std::mutex daqMtx; // 取り込み中は装置の再設定 (applyControls) を待たせる
+
+    // 他プロセスが読み取り専用で参照する測定点のミラー (SharedMirror.h の配置)
+    std::unique_ptr<SharedMirrorWriter> sharedMirror;
+
+    // 終了時に設定を lia.ini (settingsFile) へ書き戻すか。記録の再生は記録に合わせて設定を変えるので書き戻さない
+    bool persistSettings = true;
+
 private:
+    std::string instance_;
     Psd psd;
     struct Hpf { HighPassFilter x, y; };
     struct Lpf { LowPassFilter  x, y; };
@@ -389,16 +680,37 @@ public:
     // ---------------------------------------------------------
     // [4] Constructor & Lifecycle Methods
     // ---------------------------------------------------------
-    LiaConfig() {
+    LiaConfig() : LiaConfig(std::string{}) {}
+
+    // instance: 1プロセスで複数の装置を測るときの名前 (DeviceArray)。空でなければ
+    //   設定は lia_<instance>.ini (初回は lia.ini を元にする)、保存先は <日時>_<instance>、共有メモリ名にも _<instance> を付ける
+    explicit LiaConfig(std::string instance) : instance_(std::move(instance)) {
         initializeDirectory();
         allocateBuffers();
-        loadSettingsFromFile();
+        if (!instance_.empty() && !std::filesystem::exists(settingsFile())) loadSettingsFromFile();
+        loadSettingsFromFile(settingsFile());
+        if (!instance_.empty()) { // 装置の数だけ確保するので array 用の大きさにする
+            IniWrapper ini;
+            ini.load(LiaConfigDefaultConsts::SETTINGS_FILE);
+            loadArraySettings(ini);
+            rawHistory.megaBytes = deviceArray.rawHistoryMB;
+            trend = deviceArray.trend;
+        }
+        frameHistory.allocate(rawHistory.megaBytes, scope.bufferSize);
+        trendStore.open(dirName, { trend.hours1s * 3600.0, trend.days10s * 86400.0, trend.days1min * 86400.0 });
+        openJournals();
+        if (!sharedMemory.name.empty()) openSharedMirror(instance_.empty() ? sharedMemory.name : sharedMemory.name + "_" + instance_);
     }
 
     ~LiaConfig() {
-        saveResultsToFile();
-        saveSettingsToFile();
-        saveCmdRecordsToFile();
+        exporter.waitIdle();
+        recorder.reset(); // 残りを書いて fsync
+        if (persistSettings) saveSettingsToFile(settingsFile());
+    }
+
+    [[nodiscard]] const std::string& instance() const noexcept { return instance_; }
+    [[nodiscard]] std::string settingsFile() const {
+        return instance_.empty() ? std::string(LiaConfigDefaultConsts::SETTINGS_FILE) : std::format("lia_{}.ini", instance_);
     }
 
     void reset() {
@@ -410,11 +722,13 @@ public:
 		
         awg.reset();
 		scope.reset();
+		fitFrameHistory();
 		if (pDaq) {
             pDaq->awg.start(awg.ch[0].freq, awg.ch[0].amp, awg.ch[0].phase, awg.ch[0].func, awg.ch[1].freq, awg.ch[1].amp, awg.ch[1].phase, awg.ch[1].func);
 			pDaq->scope.open(scope.ch[0].range, scope.ch[1].range, scope.bufferSize, 1.0 / scope.samplingDt);
             pDaq->scope.trigger();
             pDaq->scope.start();
+            adoptDeviceScope();
 		}
         setHPFrequency(post.hpFreq);
         setLPFrequency(post.lpFreq);
@@ -423,9 +737,139 @@ public:
     // ---------------------------------------------------------
     // [5] Hardware & Processing Methods
     // ---------------------------------------------------------
+    // 設定変更を積む。測定中はフレーム境界で、測定していなければその場で適用する
+    // 戻り値は controls.applied() と比べる通し番号 (キューが満杯なら 0)
+    uint64_t submit(const ControlCommand& cmd) {
+        const uint64_t ticket = controls.submit(cmd);
+        if (!statusMeasurement) applyControls();
+        return ticket;
+    }
+
+    // submit() と同じだが、キューが満杯なら空くまで待って積み直す (GUI 以外のスレッド用)。timeoutSec 内に積めなければ 0
+    uint64_t submitWait(const ControlCommand& cmd, double timeoutSec = 1.0) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutSec);
+        while (true) {
+            if (const uint64_t ticket = submit(cmd)) return ticket;
+            const double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0.0) return 0;
+            const uint64_t applied = controls.applied();
+            if (!statusMeasurement) std::this_thread::yield(); // ほかのスレッドが適用している最中
+            else events.wait([&] { return controls.applied() > applied || !statusMeasurement; }, SeqNotifier::NO_TARGET, remaining);
+        }
+    }
+
+    // ticket まで適用されるのを待つ (測定スレッドが止まっていれば自分で適用する)
+    bool waitControls(uint64_t ticket, double timeoutSec = 1.0) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeoutSec);
+        while (controls.applied() < ticket) {
+            const double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            if (remaining <= 0.0) return false;
+            if (!statusMeasurement) applyControls();
+            else events.wait([&] { return controls.applied() >= ticket || !statusMeasurement; }, SeqNotifier::NO_TARGET, remaining);
+        }
+        return true;
+    }
+
+    // 測定点の seq が s に届くまで待つ (測定が止まれば false)
+    // timeoutSec < 0 なら残りの点数ぶんの時間の2倍 + 1秒 (一時停止中などで点が来なければあきらめる)
+    bool waitUntilSeq(uint64_t s, double timeoutSec = -1.0) {
+        const uint64_t now = events.seq();
+        if (timeoutSec < 0.0) timeoutSec = 2.0 * static_cast<double>((s > now) ? s - now : 0) * ringBuffer.getDt() + 1.0;
+        events.wait([&] { return events.seq() >= s || !statusMeasurement; }, s, timeoutSec);
+        return events.seq() >= s;
+    }
+
+    // 今から n 点が新たに確定するまで待つ
+    bool waitForPoints(uint64_t n, double timeoutSec = -1.0) {
+        return waitUntilSeq(events.seq() + n, timeoutSec);
+    }
+
+    // 最後に適用した設定変更の後で取り込んだ点が n 点確定するまで待つ
+    // 戻り値はその最初の点の seq (時間切れ・測定停止なら nullopt)
+    std::optional<uint64_t> waitPointsAfterControls(uint64_t n, double timeoutSec = -1.0) {
+        while (true) {
+            const uint64_t base = controlsSeq;
+            if (!waitUntilSeq(base + n, timeoutSec)) return std::nullopt;
+            if (controlsSeq == base) return base; // 変更前に取り込んだフレームの点が後から確定したら数え直す
+        }
+    }
+
+    // statusMeasurement / statusPipe を変えて、待っているスレッドを起こす
+    void setStatus(std::atomic<bool>& status, bool value) {
+        status = value;
+        events.notifyAll();
+    }
+
+    // 測定スレッドのフレーム境界で呼ぶ。AWG・スコープの再設定は1回にまとめる
+    void applyControls() {
+        using Op = ControlCommand::Op;
+        bool awgDirty = false, scopeDirty = false;
+        double rate = 0.0;
+        std::unique_lock<std::mutex> daqLock(daqMtx, std::defer_lock); // 積まれていたときだけ取る
+        const size_t applied = controls.drain([&](const ControlCommand& c) {
+            if (!daqLock.owns_lock()) daqLock.lock();
+            switch (c.op) {
+            case Op::AwgApply: awgDirty = true; break;
+            case Op::AwgFreq:  awg.ch[c.ch].freq = static_cast<float>(c.value); awgDirty = true; break;
+            case Op::AwgAmp:   awg.ch[c.ch].amp = static_cast<float>(c.value); awgDirty = true; break;
+            case Op::AwgPhase: awg.ch[c.ch].phase = static_cast<float>(c.value); awgDirty = true; break;
+            case Op::AwgFunc:  awg.ch[c.ch].func = static_cast<int>(c.value); awgDirty = true; break;
+            case Op::ScopeRange:
+                scope.ch[c.ch].range = static_cast<float>(c.value);
+                scope.setMaxRange();
+                scopeDirty = true;
+                break;
+            case Op::ScopeRate:
+                rate = c.value;
+                scope.setMaxRange();
+                scopeDirty = true;
+                break;
+            case Op::HpfFreq: setHPFrequency(c.value); break;
+            case Op::LpfFreq: setLPFrequency(c.value); break;
+            case Op::ChEnable: scope.ch[c.ch].enable = (c.value != 0.0); break;
+            case Op::OffsetPhase: post.offset[c.ch].phase = c.value; break;
+            case Op::OffsetClear:
+                for (auto& off : post.offset) off.x = off.y = 0.0;
+                break;
+            case Op::Reset:
+                reset();
+                awgDirty = scopeDirty = false; // reset() が再設定済み
+                rate = 0.0;
+                break;
+            }
+            }, [&] {
+                if (awgDirty) awgStart();
+                if (scopeDirty && pDaq != nullptr) {
+                    pDaq->scope.reconfigure(scope.ch[0].range, scope.ch[1].range, scope.bufferSize, (rate > 0.0) ? rate : 1.0 / scope.samplingDt);
+                    adoptDeviceScope();
+                }
+            });
+        if (applied > 0) {
+            controlsSeq = events.seq();
+            events.notifyAll(); // waitControls を起こす
+        }
+    }
+
+    // 装置が選んだバッファサイズとサンプリング周波数を scope に写す (open / reconfigure の後に呼ぶ)
+    //   装置は要求を丸める・制限することがあり、違ったままだと processFrame がフレームを捨て続ける
+    void adoptDeviceScope() {
+        if (pDaq == nullptr) return;
+        const int size = pDaq->scope.bufferSize;
+        const double actual = pDaq->scope.SamplingRate;
+        if (size != scope.bufferSize || std::abs(actual * scope.samplingDt - 1.0) > 1e-9) scope.update(size, 1.0 / actual);
+		fitFrameHistory();
+    }
+
+    // 生波形履歴を scope のバッファサイズで確保し直す (変わったときだけ。保存していたフレームは捨てる)
+    //   frameHistory.push と同じ処理スレッド (フレーム境界) か、測定していないときに呼ぶ
+    void fitFrameHistory() {
+        if (frameHistory.frameSize() != scope.bufferSize) frameHistory.allocate(rawHistory.megaBytes, scope.bufferSize);
+    }
+
+    // 変わったノードだけを装置へ送る (Daq_dwf::Awg::apply)
     void awgStart() {
         if (pDaq) {
-            pDaq->awg.start(
+            pDaq->awg.apply(
                 awg.ch[0].freq, awg.ch[0].amp, awg.ch[0].phase, awg.ch[0].func,
                 awg.ch[1].freq, awg.ch[1].amp, awg.ch[1].phase, awg.ch[1].func
             );
@@ -448,6 +892,96 @@ public:
         }
     }
 
+    // ---------------------------------------------------------
+    // リングバッファの再配置 (測定を止めずに dt / sec を変更する)
+    //   1. 要求側スレッドのワーカーで、旧バッファの履歴を古い順に新しい形状へ詰め直す
+    //      (dt が長くなる場合は1周期ごとに平均し、sec が短くなる場合は古い側を捨てる)
+    //      旧バッファは測定スレッドが書き続けるので、読んだ後に committed() で上書きを確かめる
+    //   2. 測定スレッドはフレーム境界で applyRingBufferRelayout() を呼び、
+    //      構築中に追加された数点を取り込んでから ringMtx の排他ロックで入れ替える (O(1))
+    //   3. 旧バッファの解放はワーカー側で行う (入れ替え後は旧バッファを読むスレッドはいない)
+    // ---------------------------------------------------------
+    bool requestRingBufferRelayout(double newDt, double newSec) {
+        using namespace LiaConfigDefaultConsts;
+        if (newDt < RINGBUFFER_DT_MIN || newDt > RINGBUFFER_DT_MAX) return false;
+        if (newSec < RINGBUFFER_SEC_MIN || newSec > RINGBUFFER_SEC_MAX) return false;
+        if (RingBuffer::megaBytesFor(newDt, newSec) > RINGBUFFER_MB_MAX) return false;
+        if (relayout.busy.exchange(true)) return false;
+
+        relayout.worker = std::jthread([this, newDt, newSec](std::stop_token st) {
+            auto next = std::make_unique<RingBuffer>(newDt, newSec);
+            RingBuffer::Decimator decimator;
+            uint64_t srcNofm = 0;
+            {
+                // 入れ替えは構築後なので、ここで読む旧バッファの配列は解放されない
+                const RingBuffer& src = ringBuffer;
+                next->generation = src.generation + 1;
+
+                // 旧バッファの状態を固定し、古い順に取り込む
+                const int capacity = src.getMeasurementSize();
+                srcNofm = src.committed();
+                const int srcSize = static_cast<int>(std::min<uint64_t>(srcNofm, capacity));
+                const int oldest = (srcSize < capacity) ? 0 : static_cast<int>(srcNofm % capacity);
+                for (int i = 0; i < srcSize; ++i) {
+                    const int p = (oldest + i) % capacity;
+                    double t, v[2][2];
+                    src.pointAt(p, t, v);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    // 満杯なら論理位置 i への書き込みは nofm が srcNofm + i になった時点で始まり得る (書き込み中も捨てる)
+                    if (src.committed() - srcNofm >= static_cast<uint64_t>(capacity - srcSize + i)) continue;
+                    next->accumulate(decimator, t, v, src.getDt(), false);
+                }
+            }
+            next->rebuildRanges();
+
+            relayout.next = std::move(next);
+            relayout.srcNofm = srcNofm;
+            relayout.decimator = decimator;
+            relayout.ready.store(true, std::memory_order_release);
+
+            while (relayout.ready.load(std::memory_order_acquire) && !st.stop_requested()) {
+                if (!statusMeasurement) applyRingBufferRelayout(); // 測定していなければここで入れ替える
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            relayout.next.reset(); // 旧バッファを解放
+            relayout.busy = false;
+            });
+        return true;
+    }
+
+    // 測定スレッドのフレーム境界で呼ぶ (再配置の要求がなければ何もしない)
+    //   他のスレッドがリングバッファを読んでいる間は入れ替えずに次の境界に回す (測定スレッドは待たない)
+    void applyRingBufferRelayout() noexcept {
+        if (!relayout.ready.load(std::memory_order_acquire)) return;
+        std::unique_lock<std::shared_mutex> lock(ringMtx, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+        if (!relayout.ready.load(std::memory_order_acquire)) return; // 測定していないときにワーカー側で反映済み
+        RingBuffer& next = *relayout.next;
+
+        // 構築中に追加された点を取り込み、最後の周期の端数も平均して追加する
+        const int capacity = ringBuffer.getMeasurementSize();
+        const int added = static_cast<int>(std::min<uint64_t>(ringBuffer.nofm - relayout.srcNofm, capacity));
+        for (int i = added - 1; i >= 0; --i) {
+            int p = ringBuffer.latestIdx - i;
+            if (p < 0) p += capacity;
+            double t, v[2][2];
+            ringBuffer.pointAt(p, t, v);
+            next.accumulate(relayout.decimator, t, v, ringBuffer.getDt());
+        }
+        next.flush(relayout.decimator);
+        std::swap(ringBuffer, next);
+
+        // dt に依存するフィルタと XYPlot 表示範囲を再設定
+        setHPFrequency(post.hpFreq);
+        setLPFrequency(post.lpFreq);
+        plot.xyLatestIdx = ringBuffer.latestIdx;
+        plot.xySize = std::min(ringBuffer.size, static_cast<int>(plot.historySec / ringBuffer.getDt()));
+        plot.xyStartIdx = ringBuffer.toPhysical(ringBuffer.size - plot.xySize);
+        plot.historySec = std::min(plot.historySec, static_cast<float>(ringBuffer.sec));
+
+        relayout.ready.store(false, std::memory_order_release);
+    }
+
     inline void AddPoint(double t, double x, double y) noexcept {
         processAndStorePoint(0, x, y);
         updateRingBuffers(t);
@@ -459,7 +993,59 @@ public:
         updateRingBuffers(t);
     }
 
-    inline void update(double t) noexcept {
+    // 測定ループ: 取り込み (acquire) を別スレッドで行い、呼んだスレッドで復調する (FramePipeline)
+    //   acquire(Frame&) は daqMtx を持った状態で呼ぶので、その間に装置の再設定は入らない。取り込まなければ false
+    //   paced が false なら周期を待たず、waitUnpaced() (daqMtx の外) で source が自分の時刻まで待つ
+    template <class Acquire>
+    void runPipeline(std::stop_token st, Acquire&& acquire, bool paced = true) {
+        runPipeline(st, std::forward<Acquire>(acquire), paced, [] {});
+    }
+
+    template <class Acquire, class WaitUnpaced>
+    void runPipeline(std::stop_token st, Acquire&& acquire, bool paced, WaitUnpaced&& waitUnpaced) {
+        // dt は実行中に変わり得るので、次の周期の時刻を積算する。最初の周期は時間軸の dt の格子にそろえる
+        // (DeviceArray で時間軸を共有する装置が、開始の遅れにかかわらず同じ時刻の点を作るように)
+        pipeline.setPeriod(ringBuffer.getDt());
+        double tNext = std::ceil(timer.elapsedSec() / ringBuffer.getDt()) * ringBuffer.getDt();
+        pipeline.run(st,
+            [&] {
+                if (!paced) {
+                    waitUnpaced();
+                    return timer.elapsedSec();
+                }
+                const double t = timer.sleepUntil(tNext);
+                tNext += pipeline.period();
+                return t;
+            },
+            [&](FramePipeline::Frame& f) {
+                if (pause.flag) {
+                    if (timer.isVirtual()) Timer::sleepFor(pipeline.period()); // 一時停止中は仮想時計でも実時間で待つ
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(daqMtx);
+                f.tag = controls.applied();
+                return acquire(f);
+            },
+            [&](FramePipeline::Frame& f) { processFrame(f); });
+    }
+
+    // 処理スレッドのフレーム境界: 再配置・設定変更を反映してから取り込んだフレームを復調する
+    void processFrame(FramePipeline::Frame& f) {
+        applyRingBufferRelayout();
+        applyControls();
+        pipeline.setPeriod(ringBuffer.getDt());
+        if (!f.valid || f.size != scope.bufferSize) return; // 一時停止中・バッファサイズ変更前のフレーム
+
+        // 取り込んだ波形と表示中の波形を入れ替える (コピーしない。古い方は次の取り込みに使う)
+        scope.ch[0].waveform.swap(f.ch[0]);
+        if (f.ch2) scope.ch[1].waveform.swap(f.ch[1]);
+        update(f.t, f.ch2); // ch2 を有効にする前に取り込んだフレームでは ch2 の波形が古いので使わない
+        if (f.tag < controls.applied()) controlsSeq = events.seq(); // 設定変更の前に取り込んだ点
+    }
+
+    //   ch2Fresh: ch2 の波形がこのフレームで取り込んだものか (false なら ch2 が有効でも ch1 だけの点にする)
+    inline void update(double t, bool ch2Fresh = true) noexcept {
+        const bool ch2 = scope.ch[1].enable && ch2Fresh;
         // PSD初期化
         if (pDaq != nullptr) {
             if (psd.getCurrentFreq() != awg.ch[0].freq || std::abs((psd.getSamplingDt() - 1.0 / pDaq->scope.SamplingRate) / psd.getSamplingDt()) > 1e-4) {
@@ -472,10 +1058,15 @@ public:
             }
         }
 
+        // 生波形を履歴に保存 (後から別パラメータで再復調できるように)
+        frameHistory.push(t, psd.getSamplingDt(), awg.ch[0].freq,
+            scope.ch[0].waveform.data(), ch2 ? scope.ch[1].waveform.data() : nullptr,
+            static_cast<int>(scope.ch[0].waveform.size()), scope.ch[0].range, scope.ch[1].range);
+
         // PSD計算
         auto [x1, y1] = psd.calculate(scope.ch[0].waveform.data());
         double x2 = 0.0, y2 = 0.0;
-        if (scope.ch[1].enable) {
+        if (ch2) {
             std::tie(x2, y2) = psd.calculate(scope.ch[1].waveform.data());
         }
 
@@ -483,11 +1074,11 @@ public:
         if (flagAutoOffset) {
             post.offset[0].x = x1;
             post.offset[0].y = y1;
-            if (scope.ch[1].enable) {
+            if (ch2) {
                 post.offset[1].x = x2;
                 post.offset[1].y = y2;
             }
-            cmds.push_back({ (float)timer.elapsedSec(), (float)ButtonType::PostAutoOffset, (float)x1, (float)y1, 0, 0 });
+            recordCmd(ButtonType::PostAutoOffset, (float)x1, (float)y1);
             flagAutoOffset = false;
         }
 
@@ -496,7 +1087,7 @@ public:
             x1 - post.offset[0].x, y1 - post.offset[0].y, post.offset[0].phase
         );
 
-        if (scope.ch[1].enable) {
+        if (ch2) {
             auto [final_x2, final_y2] = psd.rotate_phase(
                 x2 - post.offset[1].x, y2 - post.offset[1].y, post.offset[1].phase
             );
@@ -521,67 +1112,346 @@ public:
         return oss.str();
     }
 
-    bool saveRawData(const std::string& filename = "raw.csv") const {
-        std::ofstream file(std::format("./{}/{}", dirName, filename));
-        if (!file) return false;
-
-        file << (scope.ch[1].enable ? "# t(s), ch1(V), ch2(V)\n" : "# t(s), ch1(V)\n");
-        for (size_t i = 0; i < scope.ch[0].waveform.size(); ++i) {
-            file << std::format("{:e},{:e}", scope.samplingDt * i, scope.ch[0].waveform[i]);
-            if (scope.ch[1].enable) file << std::format(",{:e}", scope.ch[1].waveform[i]);
-            file << "\n";
+    // 現在の設定 (lia.ini および .liab のヘッダに書く内容)
+    IniWrapper toIni() const {
+        IniWrapper ini;
+        // Window
+        ini.set("Window", "pos.x", window.pos.x);
+        ini.set("Window", "pos.y", window.pos.y);
+        ini.set("Window", "size.x", window.size.x);
+        ini.set("Window", "size.y", window.size.y);
+        ini.set("Window", "fontSize", window.fontSize);
+        ini.set("Window", "controlWindow", window.controlWindow);
+        ini.set("Window", "rawWindow", window.rawWindow);
+        ini.set("Window", "xyWindow", window.xyWindow);
+        ini.set("Window", "timeWindow", window.timeWindow);
+        ini.set("Window", "deltaTimeWindow", window.deltaTimeWindow);
+        ini.set("Window", "acfm", window.acfmWindow);
+        ini.set("Window", "theme", window.theme);
+        ini.set("Window", "imGuiWindowFlag", window.imGuiWindowFlag);
+        ini.set("Window", "imGuiCondFlag", window.imGuiCondFlag);
+        // AWG
+        ini.set("Awg", "ch[0].freq", awg.ch[0].freq);
+        ini.set("Awg", "ch[0].amp", awg.ch[0].amp);
+        ini.set("Awg", "ch[0].func", awg.ch[0].func);
+        ini.set("Awg", "ch[1].amp", awg.ch[1].amp);
+        ini.set("Awg", "ch[1].phase", awg.ch[1].phase);
+		// Scope
+        ini.set("Scope", "flagCh2", scope.ch[1].enable);
+		for (size_t i = 0; i < scope.ch.size(); ++i) {
+			ini.set("Scope", "ch[" + std::to_string(i) + "].range", scope.ch[i].range);
+		}
+        ini.set("Scope", "bufferSize", scope.bufferSize);
+        ini.set("Scope", "samplingDt", scope.samplingDt);
+        // Post
+        ini.set("Post", "offset[0].phase", post.offset[0].phase);
+        ini.set("Post", "offset[0].x", post.offset[0].x);
+        ini.set("Post", "offset[0].y", post.offset[0].y);
+        ini.set("Post", "offset[1].phase", post.offset[1].phase);
+        ini.set("Post", "offset[1].x", post.offset[1].x);
+        ini.set("Post", "offset[1].y", post.offset[1].y);
+        ini.set("Post", "hpFreq", post.hpFreq);
+        ini.set("Post", "lpFreq", post.lpFreq);
+        // Plot
+        ini.set("Plot", "limit", plot.limit);
+        ini.set("Plot", "rawLimit", plot.rawLimit);
+        ini.set("Plot", "historySec", plot.historySec);
+        ini.set("Plot", "surfaceMode", plot.surfaceMode);
+        ini.set("Plot", "beep", plot.beep);
+        ini.set("Plot", "Vx_limt", plot.Vx_limit);
+        // RingBuffer
+        ini.set("RingBuffer", "dt", ringBuffer.getDt());
+        ini.set("RingBuffer", "sec", ringBuffer.sec);
+        if (instance_.empty()) { // array の装置は lia.ini の [Array] に従う
+            // Trend
+            ini.set("Trend", "hours1s", trend.hours1s);
+            ini.set("Trend", "days10s", trend.days10s);
+            ini.set("Trend", "days1min", trend.days1min);
+            // RawHistory
+            ini.set("RawHistory", "megaBytes", rawHistory.megaBytes);
+            // Array
+            ini.set("Array", "rawHistoryMB", deviceArray.rawHistoryMB);
+            ini.set("Array", "trendHours1s", deviceArray.trend.hours1s);
+            ini.set("Array", "trendDays10s", deviceArray.trend.days10s);
+            ini.set("Array", "trendDays1min", deviceArray.trend.days1min);
         }
+        // Journal
+        ini.set("Journal", "syncSec", journal.syncSec);
+        ini.set("Journal", "rotateMB", journal.rotateMB);
+        ini.set("Journal", "rotateHours", journal.rotateHours);
+        // Server
+        ini.set("Server", "port", server.port);
+        ini.set("Server", "unixSocket", server.unixSocket);
+        ini.set("Server", "bindAddress", server.bindAddress);
+        // SharedMemory
+        ini.set("SharedMemory", "name", sharedMemory.name);
+        ini.set("SharedMemory", "points", sharedMemory.points);
+        // Timing
+        ini.set("Timing", "spinMarginUs", timing.spinMarginUs);
+        // Save
+        ini.set("Save", "format", save.format);
+        ini.set("Save", "rawFrames", save.rawFrames);
+        // ACFM
+        ini.set("ACFM", "mmk[0]", acfmData.mmk[0]);
+        ini.set("ACFM", "mmk[1]", acfmData.mmk[1]);
+        ini.set("ACFM", "mmk[2]", acfmData.mmk[2]);
+        return ini;
+    }
+
+    // 保存形式 ("csv" / "liab" / "npy" / "npz")。未対応の形式なら false
+    bool setSaveFormat(const std::string& format) {
+        if (format != "csv" && format != "liab" && format != "npy" && format != "npz") return false;
+        save.format = format;
         return true;
     }
 
+    // 周期待ちの spin margin (us)。timer はどのスレッドから変えてもよい
+    void setSpinMargin(float us) {
+        timing.spinMarginUs = std::clamp(us, -1.0f, 100000.0f);
+        timer.setSpinMargin(timing.spinMarginUs * 1e-6);
+    }
+
+    bool saveRawData(const std::string& filename = "raw.csv") const {
+        return writeRaw(std::format("./{}/{}", dirName, filename), toIni().toString(), scope.samplingDt,
+            scope.ch[0].waveform, scope.ch[1].enable ? &scope.ch[1].waveform : nullptr);
+    }
+
     bool saveFftData(const std::string& filename = "fft.csv") const {
-        std::ofstream file(std::format("./{}/{}", dirName, filename));
-        if (!file) return false;
+        return writeFft(std::format("./{}/{}", dirName, filename), toIni().toString(), scope.freqs,
+            scope.ch[0].fft, scope.ch[1].enable ? &scope.ch[1].fft : nullptr);
+    }
 
-        file << (scope.ch[1].enable ? "# f(Hz), ch1real(V), ch1imag(V), ch2real(V), ch2imag(V)\n" : "# f(Hz), ch1real(V), ch1imag(V)\n");
-        for (size_t i = 0; i < scope.freqs.size(); ++i) {
-            file << std::format("{:e},{:e},{:e}", scope.freqs[i], scope.ch[0].fft[i].real(), scope.ch[0].fft[i].imag());
-            if (scope.ch[1].enable) file << std::format(",{:e},{:e}", scope.ch[1].fft[i].real(), scope.ch[1].fft[i].imag());
-            file << "\n";
+    // ---------------------------------------------------------
+    // 列単位の書き出し: 拡張子で形式を選ぶ
+    //   .liab: バイナリ (設定を先頭に含む) / .npy, .npz: NumPy (設定は meta 配列) / それ以外: CSV
+    // ---------------------------------------------------------
+    using ExportColumn = liab::Column; // 名前・バイナリでの格納型・値
+    static constexpr liab::Type RING_SAMPLE_TYPE = std::is_same_v<RingSample, float> ? liab::Type::F32 : liab::Type::F64;
+
+    // extra は .liab のときだけ呼ばれる (生波形フレームなど行数の異なる列の追加用)
+    static bool writeColumns(const std::string& path, std::string_view settings, const std::string& csvHeader,
+        const std::vector<ExportColumn>& columns, size_t rows, const std::function<void(LiabWriter&)>& extra = nullptr)
+    {
+        if (liab::isLiabPath(path)) {
+            LiabWriter writer(path, settings);
+            if (!writer.ok()) return false;
+            for (const auto& c : columns) writer.addColumn(c.name, c.type, rows, c.get);
+            if (extra) extra(writer);
+            return writer.close();
         }
-        return true;
+        if (npy::isNpyPath(path)) return npy::writeNpy(path, columns, rows, npy::metaFromIni(settings));
+        if (npy::isNpzPath(path)) return npy::writeNpz(path, columns, rows, npy::metaFromIni(settings));
+        CsvWriter csv(csvHeader);
+        for (const auto& c : columns) csv.column(c.get);
+        return csv.write(path, rows);
     }
 
-    bool saveResultsToFile(const std::string& filename = LiaConfigDefaultConsts::RESULTS_FILE, const double sec = 0) const {
-        std::ofstream file(std::format("./{}/{}", dirName, filename));
-        if (!file) return false;
+    static bool writeRaw(const std::string& path, std::string_view settings, double samplingDt,
+        const std::vector<double>& w1, const std::vector<double>* w2) {
+        std::vector<ExportColumn> columns{
+            { "t", liab::Type::F64, [samplingDt](size_t i) { return samplingDt * i; } },
+            { "ch1", liab::Type::F64, [&w1](size_t i) { return w1[i]; } },
+        };
+        if (w2) columns.push_back({ "ch2", liab::Type::F64, [w2](size_t i) { return (*w2)[i]; } });
+        return writeColumns(path, settings, w2 ? "# t(s), ch1(V), ch2(V)\n" : "# t(s), ch1(V)\n", columns, w1.size());
+    }
 
-        file << (scope.ch[1].enable ? "# t(s), x1(V), y1(V), x2(V), y2(V)\n" : "# t(s), x(V), y(V)\n");
+    static bool writeFft(const std::string& path, std::string_view settings, const std::vector<double>& freqs,
+        const std::vector<std::complex<double>>& f1, const std::vector<std::complex<double>>* f2) {
+        std::vector<ExportColumn> columns{
+            { "f", liab::Type::F64, [&freqs](size_t i) { return freqs[i]; } },
+            { "ch1real", liab::Type::F64, [&f1](size_t i) { return f1[i].real(); } },
+            { "ch1imag", liab::Type::F64, [&f1](size_t i) { return f1[i].imag(); } },
+        };
+        if (f2) {
+            columns.push_back({ "ch2real", liab::Type::F64, [f2](size_t i) { return (*f2)[i].real(); } });
+            columns.push_back({ "ch2imag", liab::Type::F64, [f2](size_t i) { return (*f2)[i].imag(); } });
+        }
+        return writeColumns(path, settings, f2 ? "# f(Hz), ch1real(V), ch1imag(V), ch2real(V), ch2imag(V)\n" : "# f(Hz), ch1real(V), ch1imag(V)\n",
+            columns, freqs.size());
+    }
+
+    // 時系列 (t, x1, y1[, x2, y2]) の列定義。get(k, i) は列 k の i 行目
+    static std::vector<ExportColumn> resultColumns(bool ch2, const std::function<double(int, size_t)>& get) {
+        static constexpr const char* NAMES[] = { "t", "x1", "y1", "x2", "y2" };
+        std::vector<ExportColumn> columns;
+        for (int k = 0; k < (ch2 ? 5 : 3); ++k) {
+            columns.push_back({ NAMES[k], k == 0 ? liab::Type::F64 : RING_SAMPLE_TYPE, [get, k](size_t i) { return get(k, i); } });
+        }
+        return columns;
+    }
+    static const char* resultCsvHeader(bool ch2) noexcept {
+        return ch2 ? "# t(s), x1(V), y1(V), x2(V), y2(V)\n" : "# t(s), x(V), y(V)\n";
+    }
+
+    // frameHistory のうち [t0, t1] のフレームを int16 のまま frame.* 列として追加する
+    // (frame.ch1/ch2 は1行 frameSize 要素。V = 値 x frame.scale1/2)
+    void addRawFrames(LiabWriter& writer, double t0, double t1) const {
+        const int frameSize = frameHistory.frameSize();
+        if (frameHistory.size() == 0 || frameSize == 0) return;
+        std::vector<double> times, dts, freqs, scales[2];
+        std::vector<int16_t> samples[2];
+        FrameHistory::FrameInfo info;
+        for (uint64_t n = frameHistory.lowerBound(t0); n < frameHistory.totalFrames(); ++n) {
+            const size_t row = times.size();
+            for (auto& ch : samples) ch.resize((row + 1) * frameSize);
+            if (!frameHistory.readRaw(n, info, samples[0].data() + row * frameSize, samples[1].data() + row * frameSize, frameSize)) continue;
+            if (info.t > t1) break;
+            times.push_back(info.t);
+            dts.push_back(info.samplingDt);
+            freqs.push_back(info.freq);
+            scales[0].push_back(info.scale[0]);
+            scales[1].push_back(info.numChannels > 1 ? info.scale[1] : 0.0f);
+        }
+        const size_t rows = times.size();
+        writer.addColumn("frame.t", times.data(), rows);
+        writer.addColumn("frame.samplingDt", dts.data(), rows);
+        writer.addColumn("frame.freq", liab::Type::F32, rows, [&](size_t i) { return freqs[i]; });
+        writer.addColumn("frame.scale1", liab::Type::F32, rows, [&](size_t i) { return scales[0][i]; });
+        writer.addColumn("frame.scale2", liab::Type::F32, rows, [&](size_t i) { return scales[1][i]; });
+        writer.addColumn("frame.ch1", samples[0].data(), rows, static_cast<uint32_t>(frameSize));
+        writer.addColumn("frame.ch2", samples[1].data(), rows, static_cast<uint32_t>(frameSize));
+    }
 
+    bool saveResultsToFile(const std::string& filename, const double sec = 0) const {
         int outputSize = ringBuffer.size;
         if (sec > 0) {
             int reqSize = static_cast<int>(sec / ringBuffer.getDt());
             outputSize = std::min(reqSize, ringBuffer.size);
         }
 
-        int idx = (ringBuffer.writeIdx >= outputSize)
+        const int first = (ringBuffer.writeIdx >= outputSize)
             ? (ringBuffer.writeIdx - outputSize)
             : (ringBuffer.getMeasurementSize() - (outputSize - ringBuffer.writeIdx));
+        const size_t capacity = ringBuffer.getMeasurementSize();
+        auto physical = [first, capacity](size_t i) { return (first + i) % capacity; };
+
+        const bool ch2 = scope.ch[1].enable;
+        const auto columns = resultColumns(ch2, [&](int k, size_t i) {
+            const size_t p = physical(i);
+            if (k == 0) return ringBuffer.times[p];
+            return static_cast<double>(k < 3 ? (k == 1 ? ringBuffer.ch[0].x[p] : ringBuffer.ch[0].y[p])
+                : (k == 3 ? ringBuffer.ch[1].x[p] : ringBuffer.ch[1].y[p]));
+            });
+        std::function<void(LiabWriter&)> frames;
+        if (save.rawFrames && outputSize > 0) {
+            const double t0 = ringBuffer.times[physical(0)], t1 = ringBuffer.times[physical(outputSize - 1)];
+            frames = [this, t0, t1](LiabWriter& writer) { addRawFrames(writer, t0, t1); };
+        }
+        return writeColumns(std::format("./{}/{}", dirName, filename), toIni().toString(), resultCsvHeader(ch2), columns, outputSize, frames);
+    }
 
-        for (int i = 0; i < outputSize; ++i) {
-            file << std::format("{:e},{:e},{:e}", ringBuffer.times[idx], ringBuffer.ch[0].x[idx], ringBuffer.ch[0].y[idx]);
-            if (scope.ch[1].enable) file << std::format(",{:e},{:e}", ringBuffer.ch[1].x[idx], ringBuffer.ch[1].y[idx]);
-            file << "\n";
-
-            if (++idx >= ringBuffer.getMeasurementSize()) idx = 0;
+    // ---------------------------------------------------------
+    // 非同期保存 (exporter のスレッドで書式化・書き込みを行う)
+    // ---------------------------------------------------------
+    // 生波形と FFT: 要求時に数百KB をコピーするだけ (FFT は呼び出し側で計算済みのこと)
+    void saveScopeAsync(const std::string& rawFilename, const std::string& fftFilename) {
+        struct Snapshot {
+            double samplingDt;
+            bool ch2;
+            std::vector<double> waveform[2], freqs;
+            std::vector<std::complex<double>> fft[2];
+        };
+        auto snap = std::make_shared<Snapshot>();
+        snap->samplingDt = scope.samplingDt;
+        snap->ch2 = scope.ch[1].enable;
+        snap->freqs = scope.freqs;
+        for (int c = 0; c < (snap->ch2 ? 2 : 1); ++c) {
+            snap->waveform[c] = scope.ch[c].waveform;
+            snap->fft[c] = scope.ch[c].fft;
         }
-        return true;
+        const std::string rawPath = std::format("./{}/{}", dirName, rawFilename);
+        const std::string fftPath = std::format("./{}/{}", dirName, fftFilename);
+        const std::string settings = toIni().toString();
+
+        exporter.submit(rawFilename, [snap, rawPath, fftPath, settings](ExportWorker::Progress& progress, std::string& message) {
+            progress.total = 2;
+            bool ok = writeRaw(rawPath, settings, snap->samplingDt, snap->waveform[0], snap->ch2 ? &snap->waveform[1] : nullptr);
+            progress.done = 1;
+            ok = writeFft(fftPath, settings, snap->freqs, snap->fft[0], snap->ch2 ? &snap->fft[1] : nullptr) && ok;
+            progress.done = 2;
+            message = ok ? std::format("{} + fft", snap->waveform[0].size()) : "could not write raw/fft";
+            return ok;
+            });
     }
 
-    bool saveCmdRecordsToFile(const std::string& filename = LiaConfigDefaultConsts::CMDS_FILE) const {
-        std::ofstream file(std::format("./{}/{}", dirName, filename));
-        if (!file) return false;
+    // 時系列: 要求時には seq 範囲 [first, last) を固定するだけで、コピーもワーカーで行う。
+    // seq s は物理位置 s % capacity にある (commit() が writeIdx == nofm % capacity を保つ)。
+    // 呼び出し側はリングバッファの共有ロック (lockRingBuffer) を持つこと。ワーカーはチャンクごとに
+    // 共有ロックを取り直し、再配置されていないことを確かめてからコピーする (コピー中は入れ替わらない)。
+    // 各チャンクのコピー後に、その間に上書きされ得た seq を検出して先頭から捨てる
+    void saveResultsAsync(const std::string& filename, const double sec = 0) {
+        const uint64_t last = ringBuffer.committed();
+        const int size = static_cast<int>(std::min<uint64_t>(last, ringBuffer.getMeasurementSize()));
+        int count = size;
+        if (sec > 0) count = std::min(static_cast<int>(sec / ringBuffer.getDt()), size);
+        const uint64_t first = last - count;
+        const int generation = ringBuffer.generation;
+        const bool ch2 = scope.ch[1].enable;
+        const std::string path = std::format("./{}/{}", dirName, filename);
+        const std::string settings = toIni().toString();
+        const bool rawFrames = save.rawFrames;
+
+        exporter.submit(filename, [this, first, last, generation, ch2, path, settings, rawFrames](ExportWorker::Progress& progress, std::string& message) {
+            constexpr int CHUNK = 65536;
+            const RingBuffer& rb = ringBuffer;
+            const int numColumns = ch2 ? 5 : 3;
+            std::vector<double> cols[5];
+            for (int k = 0; k < numColumns; ++k) cols[k].resize(last - first);
+
+            progress.total = static_cast<int>(last - first);
+            uint64_t validFirst = first;
+            for (uint64_t a = first; a < last; a += CHUNK) {
+                const uint64_t b = std::min<uint64_t>(last, a + CHUNK);
+                const auto ringLock = lockRingBuffer();
+                if (rb.generation != generation) {
+                    message = "ring buffer re-layout during export";
+                    return false;
+                }
+                const uint64_t capacity = static_cast<uint64_t>(rb.getMeasurementSize());
+                for (uint64_t s = a; s < b; ++s) {
+                    const size_t p = s % capacity;
+                    const size_t row = s - first;
+                    cols[0][row] = rb.times[p];
+                    cols[1][row] = rb.ch[0].x[p];
+                    cols[2][row] = rb.ch[0].y[p];
+                    if (ch2) {
+                        cols[3][row] = rb.ch[1].x[p];
+                        cols[4][row] = rb.ch[1].y[p];
+                    }
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const uint64_t committed = rb.committed();
+                const uint64_t oldestSafe = (committed >= capacity) ? committed - capacity + 1 : 0; // 次の書き込み先 (nofm - capacity) は書き込み中の可能性がある
+                if (a < oldestSafe) validFirst = std::max(validFirst, std::min(b, oldestSafe));
+                progress.done = static_cast<int>(b - first);
+            }
+
+            const size_t skip = validFirst - first;
+            const size_t rows = (last - first) - skip;
+            const auto columns = resultColumns(ch2, [&cols, skip](int k, size_t i) { return cols[k][skip + i]; });
+            std::function<void(LiabWriter&)> frames;
+            if (rawFrames && rows > 0) {
+                const double t0 = cols[0][skip], t1 = cols[0].back();
+                frames = [this, t0, t1](LiabWriter& writer) { addRawFrames(writer, t0, t1); };
+            }
+            if (!writeColumns(path, settings, resultCsvHeader(ch2), columns, rows, frames)) {
+                message = "could not open " + path;
+                return false;
+            }
+            message = std::format("{} rows", rows);
+            if (skip > 0) message += std::format(" ({} overwritten)", skip);
+            return true;
+            });
+    }
 
-        file << "# Time(s), ButtonNo, ButtonName, Value\n";
-        for (const auto& cmd : cmds) {
-            file << std::format("{:e},{:.0f},{:s},{:e}\n", cmd[0], cmd[1], cmdToString(static_cast<ButtonType>(cmd[1])), cmd[2]);
+    // 操作履歴に記録する (commands.csv にも追記)
+    void recordCmd(ButtonType button, float value = 0.0f, float value2 = 0.0f) {
+        const float t = static_cast<float>(timer.elapsedSec());
+        cmds.push_back({ t, static_cast<float>(button), value, value2, 0.0f, 0.0f });
+        if (recorder) {
+            recorder->append(journalIds.cmds, std::format("{:e},{:.0f},{:s},{:e}\n", t, static_cast<float>(button), cmdToString(button), value));
         }
-        return true;
     }
 
     // ---------------------------------------------------------
@@ -593,7 +1463,7 @@ public:
         xyRecs.ch1xys.clear();
         xyRecs.ch2xys.clear();
         flagAutoSetupW2History = false;
-        cmds.push_back({ (float)timer.elapsedSec(), (float)ButtonType::XYClear, 0, 0, 0, 0 });
+        recordCmd(ButtonType::XYClear);
     }
 
     void buttonPause() {
@@ -605,7 +1475,7 @@ public:
             buttonClear();
             window.imPlotFlag |= 4; // ImPlotFlags_NoMouseText
         }
-        cmds.push_back({ (float)timer.elapsedSec(), (float)ButtonType::TimePause, (float)pause.flag, 0, 0, 0 });
+        recordCmd(ButtonType::TimePause, (float)pause.flag);
     }
 
     void buttonAutoOffset() {
@@ -614,36 +1484,60 @@ public:
 
     void buttonAutoOffsetOff() {
         flagAutoOffset = false;
-        cmds.push_back({ (float)timer.elapsedSec(), (float)ButtonType::PostOffsetOff, 0, 0, 0, 0 });
+        recordCmd(ButtonType::PostOffsetOff);
     }
 
     void buttonRec() {
         xyRecs.ch1xys.push_back(ringBuffer.ch[0].x[ringBuffer.latestIdx], ringBuffer.ch[0].y[ringBuffer.latestIdx]);
         xyRecs.ch2xys.push_back(ringBuffer.ch[1].x[ringBuffer.latestIdx], ringBuffer.ch[1].y[ringBuffer.latestIdx]);
 
-        std::ofstream file(std::format("./{}/rec.csv", dirName));
-        if (!file) {
-            std::cerr << "Error: Could not open file rec.csv\n";
-            return;
+        // 押すたびに1行追記する (ch2 が無効でも列数は固定)
+        if (recorder) {
+            const double values[] = { xyRecs.ch1xys.x.back(), xyRecs.ch1xys.y.back(), xyRecs.ch2xys.x.back(), xyRecs.ch2xys.y.back() };
+            recorder->append(journalIds.recs, formatRecord(values));
         }
+        recordCmd(ButtonType::XYRec);
+    }
 
-        std::stringstream ss;
-        ss << (scope.ch[1].enable ? "# ch1x(V),ch1y(V),ch2x(V),ch2y(V)\n" : "# ch1x(V),ch1y(V)\n");
-        for (size_t i = 0; i < xyRecs.ch1xys.x.size(); ++i) {
-            ss << std::format("{:e},{:e}", xyRecs.ch1xys.x[i], xyRecs.ch1xys.y[i]);
-            if (scope.ch[1].enable) ss << std::format(",{:e},{:e}", xyRecs.ch2xys.x[i], xyRecs.ch2xys.y[i]);
-            ss << "\n";
-        }
-        file << ss.str();
-        cmds.push_back({ (float)timer.elapsedSec(), (float)ButtonType::XYRec, 0, 0, 0, 0 });
+    // 測定点を名前付き共有メモリへ書き始める (測定スレッドの開始前に呼ぶ)
+    bool openSharedMirror(const std::string& name) {
+        auto mirror = std::make_unique<SharedMirrorWriter>(name, static_cast<size_t>(sharedMemory.points));
+        if (!mirror->valid()) return false;
+        sharedMirror = std::move(mirror);
+        return true;
     }
 
 private:
     // ---------------------------------------------------------
     // [8] Private Helper Methods
     // ---------------------------------------------------------
+    void openJournals() {
+        JournalWriter::Options options;
+        options.syncSec = journal.syncSec;
+        options.rotateBytes = static_cast<uint64_t>(journal.rotateMB * 1024.0 * 1024.0);
+        options.rotateSec = journal.rotateHours * 3600.0;
+        recorder = std::make_unique<JournalWriter>(options);
+        using namespace LiaConfigDefaultConsts;
+        journalIds.results = recorder->open(std::format("./{}/{}", dirName, RESULTS_FILE), "# t(s), x1(V), y1(V), x2(V), y2(V)\n");
+        journalIds.cmds = recorder->open(std::format("./{}/{}", dirName, CMDS_FILE), "# Time(s), ButtonNo, ButtonName, Value\n");
+        journalIds.recs = recorder->open(std::format("./{}/{}", dirName, RECS_FILE), "# ch1x(V),ch1y(V),ch2x(V),ch2y(V)\n");
+    }
+
+    // CSV の1行 (呼び出しスレッドの再利用バッファを指す)
+    template <size_t N>
+    static std::string_view formatRecord(const double (&values)[N]) noexcept {
+        static thread_local char line[N * CsvWriter::MAX_FIELD_CHARS + 1];
+        char* p = line;
+        for (size_t k = 0; k < N; ++k) {
+            if (k > 0) *p++ = ',';
+            p = CsvWriter::appendScientific(p, values[k]);
+        }
+        *p++ = '\n';
+        return { line, static_cast<size_t>(p - line) };
+    }
+
     void initializeDirectory() {
-        dirName = getCurrentTimestamp();
+        dirName = instance_.empty() ? getCurrentTimestamp() : std::format("{}_{}", getCurrentTimestamp(), instance_);
         try { std::filesystem::create_directory(dirName); }
         catch (const std::filesystem::filesystem_error& e) { std::cerr << "Filesystem error: " << e.what() << '\n'; }
     }
@@ -658,20 +1552,21 @@ private:
         double processed_y = hpfCh[chIndex].y.process(lpfCh[chIndex].y.process(y));
 
         const size_t rTail = ringBuffer.writeIdx;
-        ringBuffer.ch[chIndex].x[rTail] = processed_x;
-        ringBuffer.ch[chIndex].y[rTail] = processed_y;
+        ringBuffer.ch[chIndex].x[rTail] = static_cast<RingSample>(processed_x);
+        ringBuffer.ch[chIndex].y[rTail] = static_cast<RingSample>(processed_y);
     }
 
     inline void updateRingBuffers(double t) noexcept {
-        ringBuffer.times[ringBuffer.writeIdx] = t;
-        ringBuffer.deltaTimes[ringBuffer.writeIdx] = (ringBuffer.nofm > 0) ?
-            (ringBuffer.times[ringBuffer.writeIdx] - ringBuffer.times[ringBuffer.latestIdx]) * 1e3 : 0.0;
-
-        ringBuffer.latestIdx = ringBuffer.writeIdx;
-        ringBuffer.nofm++;
-
-        if (++ringBuffer.writeIdx >= ringBuffer.getMeasurementSize()) ringBuffer.writeIdx = 0;
-        ringBuffer.size = std::min(ringBuffer.nofm, ringBuffer.getMeasurementSize());
+        ringBuffer.commit(t);
+        const int i = ringBuffer.latestIdx;
+        trendStore.add(t, scope.ch[1].enable ? 2 : 1, ringBuffer.ch[0].x[i], ringBuffer.ch[0].y[i], ringBuffer.ch[1].x[i], ringBuffer.ch[1].y[i]);
+        if (recorder) {
+            const double values[] = { t, ringBuffer.ch[0].x[i], ringBuffer.ch[0].y[i], ringBuffer.ch[1].x[i], ringBuffer.ch[1].y[i] };
+            recorder->append(journalIds.results, formatRecord(values));
+        }
+        pointStream.publish(t, ringBuffer.ch[0].x[i], ringBuffer.ch[0].y[i], ringBuffer.ch[1].x[i], ringBuffer.ch[1].y[i]);
+        if (sharedMirror) sharedMirror->publish(t, ringBuffer.ch[0].x[i], ringBuffer.ch[0].y[i], ringBuffer.ch[1].x[i], ringBuffer.ch[1].y[i]);
+        events.advance();
 
         // XYPlot 表示範囲の更新
         plot.xyLatestIdx = ringBuffer.latestIdx;
@@ -689,57 +1584,7 @@ private:
     }
 
     void saveSettingsToFile(const std::string& filename = LiaConfigDefaultConsts::SETTINGS_FILE) const {
-        IniWrapper ini;
-        // Window
-        ini.set("Window", "pos.x", window.pos.x);
-        ini.set("Window", "pos.y", window.pos.y);
-        ini.set("Window", "size.x", window.size.x);
-        ini.set("Window", "size.y", window.size.y);
-        ini.set("Window", "fontSize", window.fontSize);
-        ini.set("Window", "controlWindow", window.controlWindow);
-        ini.set("Window", "rawWindow", window.rawWindow);
-        ini.set("Window", "xyWindow", window.xyWindow);
-        ini.set("Window", "timeWindow", window.timeWindow);
-        ini.set("Window", "deltaTimeWindow", window.deltaTimeWindow);
-        ini.set("Window", "acfm", window.acfmWindow);
-        ini.set("Window", "theme", window.theme);
-        ini.set("Window", "imGuiWindowFlag", window.imGuiWindowFlag);
-        ini.set("Window", "imGuiCondFlag", window.imGuiCondFlag);
-        // AWG
-        ini.set("Awg", "ch[0].freq", awg.ch[0].freq);
-        ini.set("Awg", "ch[0].amp", awg.ch[0].amp);
-        ini.set("Awg", "ch[0].func", awg.ch[0].func);
-        ini.set("Awg", "ch[1].amp", awg.ch[1].amp);
-        ini.set("Awg", "ch[1].phase", awg.ch[1].phase);
-		// Scope
-        ini.set("Scope", "flagCh2", scope.ch[1].enable);
-		for (size_t i = 0; i < scope.ch.size(); ++i) {
-			ini.set("Scope", "ch[" + std::to_string(i) + "].range", scope.ch[i].range);
-		}
-        ini.set("Scope", "bufferSize", scope.bufferSize);
-        ini.set("Scope", "samplingDt", scope.samplingDt);
-        // Post
-        ini.set("Post", "offset[0].phase", post.offset[0].phase);
-        ini.set("Post", "offset[0].x", post.offset[0].x);
-        ini.set("Post", "offset[0].y", post.offset[0].y);
-        ini.set("Post", "offset[1].phase", post.offset[1].phase);
-        ini.set("Post", "offset[1].x", post.offset[1].x);
-        ini.set("Post", "offset[1].y", post.offset[1].y);
-        ini.set("Post", "hpFreq", post.hpFreq);
-        ini.set("Post", "lpFreq", post.lpFreq);
-        // Plot
-        ini.set("Plot", "limit", plot.limit);
-        ini.set("Plot", "rawLimit", plot.rawLimit);
-        ini.set("Plot", "historySec", plot.historySec);
-        ini.set("Plot", "surfaceMode", plot.surfaceMode);
-        ini.set("Plot", "beep", plot.beep);
-        ini.set("Plot", "Vx_limt", plot.Vx_limit);
-        // ACFM
-        ini.set("ACFM", "mmk[0]", acfmData.mmk[0]);
-        ini.set("ACFM", "mmk[1]", acfmData.mmk[1]);
-        ini.set("ACFM", "mmk[2]", acfmData.mmk[2]);
-
-        ini.save(filename);
+        toIni().save(filename);
     }
 
     void loadSettingsFromFile(const std::string& filename = LiaConfigDefaultConsts::SETTINGS_FILE) {
@@ -793,6 +1638,32 @@ private:
         plot.beep = ini.get("Plot", "beep", plot.beep);
         plot.Vx_limit = ini.get("Plot", "Vx_limt", plot.Vx_limit);
 
+        {
+            using namespace LiaConfigDefaultConsts;
+            const double dt = std::clamp(ini.get("RingBuffer", "dt", ringBuffer.getDt()), RINGBUFFER_DT_MIN, RINGBUFFER_DT_MAX);
+            double sec = std::clamp(ini.get("RingBuffer", "sec", ringBuffer.sec), RINGBUFFER_SEC_MIN, RINGBUFFER_SEC_MAX);
+            if (RingBuffer::megaBytesFor(dt, sec) > RINGBUFFER_MB_MAX) { // メモリの上限に収まる長さに縮める
+                sec = std::max(RINGBUFFER_SEC_MIN, std::floor(RINGBUFFER_MB_MAX * 1024.0 * 1024.0 / RingBuffer::BYTES_PER_POINT - 1.0) * dt);
+            }
+            if (dt != ringBuffer.getDt() || sec != ringBuffer.sec) ringBuffer.update(dt, sec);
+        }
+        trend.hours1s = std::max(0.0f, ini.get("Trend", "hours1s", trend.hours1s));
+        trend.days10s = std::max(0.0f, ini.get("Trend", "days10s", trend.days10s));
+        trend.days1min = std::max(0.0f, ini.get("Trend", "days1min", trend.days1min));
+        rawHistory.megaBytes = std::max(0.0f, ini.get("RawHistory", "megaBytes", rawHistory.megaBytes));
+        loadArraySettings(ini);
+        journal.syncSec = std::max(0.0f, ini.get("Journal", "syncSec", journal.syncSec));
+        journal.rotateMB = std::max(0.0f, ini.get("Journal", "rotateMB", journal.rotateMB));
+        journal.rotateHours = std::max(0.0f, ini.get("Journal", "rotateHours", journal.rotateHours));
+        server.port = std::clamp(ini.get("Server", "port", server.port), 0, 65535);
+        server.unixSocket = ini.get("Server", "unixSocket", server.unixSocket);
+        server.bindAddress = ini.get("Server", "bindAddress", server.bindAddress);
+        sharedMemory.name = ini.get("SharedMemory", "name", sharedMemory.name);
+        sharedMemory.points = std::clamp(ini.get("SharedMemory", "points", sharedMemory.points), 1024, 1 << 24);
+        setSpinMargin(ini.get("Timing", "spinMarginUs", timing.spinMarginUs));
+        setSaveFormat(ini.get("Save", "format", save.format));
+        save.rawFrames = ini.get("Save", "rawFrames", save.rawFrames);
+
         acfmData.mmk[0] = ini.get("ACFM", "mmk[0]", acfmData.mmk[0]);
         acfmData.mmk[1] = ini.get("ACFM", "mmk[1]", acfmData.mmk[1]);
         acfmData.mmk[2] = ini.get("ACFM", "mmk[2]", acfmData.mmk[2]);
@@ -808,4 +1679,11 @@ private:
         setHPFrequency(post.hpFreq);
         setLPFrequency(post.lpFreq);
     }
+
+    void loadArraySettings(const IniWrapper& ini) {
+        deviceArray.rawHistoryMB = std::max(0.0f, ini.get("Array", "rawHistoryMB", deviceArray.rawHistoryMB));
+        deviceArray.trend.hours1s = std::max(0.0f, ini.get("Array", "trendHours1s", deviceArray.trend.hours1s));
+        deviceArray.trend.days10s = std::max(0.0f, ini.get("Array", "trendDays10s", deviceArray.trend.days10s));
+        deviceArray.trend.days1min = std::max(0.0f, ini.get("Array", "trendDays1min", deviceArray.trend.days1min));
+    }
 };
\ No newline at end of file
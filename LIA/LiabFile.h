@@ -0,0 +1,440 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CsvWriter.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ================================================================================
+// .liab: LIA の記録用バイナリ形式 (リトルエンディアン)
+//
+//   [FileHeader 64B]
+//   [設定 (lia.ini と同じ ini テキスト)]
+//   [チャンク本体 ...]      各チャンクは1列の連続した行 (64B 境界に配置)
+//   [ChunkEntry 64B x numChunks]  チャンク索引 (ファイル末尾)
+//
+//   列は名前で識別する ("t", "x1", "y1", "x2", "y2", "frame.ch1" など)。
+//   1列は CHUNK_ROWS 行ごとのチャンクに分かれ、索引の firstRow で任意行へシークできる。
+//   stride > 1 の列は1レコードが stride 要素 (生波形フレームなど)。
+// ================================================================================
+namespace liab {
+    constexpr char MAGIC[4] = { 'L', 'I', 'A', 'B' };
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t CHUNK_ROWS = 65536;
+    constexpr size_t ALIGNMENT = 64;
+
+    enum class Type : uint32_t { F64 = 1, F32 = 2, I16 = 3 };
+
+    inline size_t typeSize(Type type) noexcept {
+        switch (type) {
+        case Type::F64: return 8;
+        case Type::F32: return 4;
+        case Type::I16: return 2;
+        }
+        return 0;
+    }
+
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t settingsOffset;
+        uint64_t settingsSize;
+        uint64_t indexOffset;
+        uint32_t numChunks;
+        uint32_t reserved0;
+        uint64_t reserved[3];
+    };
+    static_assert(sizeof(FileHeader) == 64);
+
+    struct ChunkEntry {
+        char column[32];    // 列名 (NUL 終端)
+        Type type;
+        uint32_t stride;    // 1行あたりの要素数
+        uint64_t firstRow;  // この列における先頭行
+        uint64_t rows;
+        uint64_t offset;    // 本体のファイル先頭からの位置
+    };
+    static_assert(sizeof(ChunkEntry) == 64);
+
+    // 書き出す列 (名前・格納型・行 i の値)
+    struct Column {
+        const char* name;
+        Type type;
+        std::function<double(size_t)> get;
+    };
+
+    // get(first) .. get(first + count - 1) を type に変換して dst に詰める
+    inline char* encode(Type type, const std::function<double(size_t)>& get, size_t first, size_t count, char* dst) {
+        for (size_t i = first; i < first + count; ++i) {
+            const double v = get(i);
+            switch (type) {
+            case Type::F64: std::memcpy(dst, &v, 8); dst += 8; break;
+            case Type::F32: { const float f = static_cast<float>(v); std::memcpy(dst, &f, 4); dst += 4; break; }
+            case Type::I16: { // 丸めて範囲内に収める (範囲外・NaN をそのままキャストすると未定義)
+                const int16_t s = static_cast<int16_t>(std::lround(std::clamp(std::isnan(v) ? 0.0 : v, -32768.0, 32767.0)));
+                std::memcpy(dst, &s, 2); dst += 2; break;
+            }
+            }
+        }
+        return dst;
+    }
+
+    inline bool isLiabPath(std::string_view path) noexcept {
+        return path.size() >= 5 && path.substr(path.size() - 5) == ".liab";
+    }
+}
+
+// ================================================================================
+// LiabWriter: 列を順に追加し、close() で索引を書いてヘッダを確定する
+// ================================================================================
+class LiabWriter {
+public:
+    LiabWriter(const std::string& path, std::string_view settings) : file_(path, std::ios::binary) {
+        if (!file_) return;
+        liab::FileHeader header{};
+        file_.write(reinterpret_cast<const char*>(&header), sizeof(header)); // close() で書き直す
+        settingsOffset_ = sizeof(header);
+        settingsSize_ = settings.size();
+        file_.write(settings.data(), static_cast<std::streamsize>(settings.size()));
+    }
+
+    [[nodiscard]] bool ok() const { return static_cast<bool>(file_); }
+
+    // rows 行 (x stride 要素) を get(i) で取り出し、type に変換して書く
+    void addColumn(std::string_view name, liab::Type type, size_t rows, const std::function<double(size_t)>& get, uint32_t stride = 1) {
+        const size_t elemSize = liab::typeSize(type);
+        for (size_t first = 0; first < rows || (rows == 0 && first == 0); first += liab::CHUNK_ROWS) {
+            const size_t count = std::min(liab::CHUNK_ROWS, rows - first);
+            buffer_.resize(count * stride * elemSize);
+            liab::encode(type, get, first * stride, count * stride, buffer_.data());
+            writeChunk(name, type, stride, first, count);
+            if (rows == 0) break;
+        }
+    }
+
+    // 既に型の揃った配列をそのまま書く
+    template <typename T>
+    void addColumn(std::string_view name, const T* data, size_t rows, uint32_t stride = 1) {
+        static_assert(std::is_same_v<T, double> || std::is_same_v<T, float> || std::is_same_v<T, int16_t>);
+        constexpr liab::Type type = std::is_same_v<T, double> ? liab::Type::F64
+            : std::is_same_v<T, float> ? liab::Type::F32 : liab::Type::I16;
+        for (size_t first = 0; first < rows; first += liab::CHUNK_ROWS) {
+            const size_t count = std::min(liab::CHUNK_ROWS, rows - first);
+            const char* src = reinterpret_cast<const char*>(data + first * stride);
+            buffer_.assign(src, src + count * stride * sizeof(T));
+            writeChunk(name, type, stride, first, count);
+        }
+    }
+
+    bool close() {
+        if (!file_) return false;
+        pad();
+        const uint64_t indexOffset = static_cast<uint64_t>(file_.tellp());
+        file_.write(reinterpret_cast<const char*>(index_.data()), static_cast<std::streamsize>(index_.size() * sizeof(liab::ChunkEntry)));
+
+        liab::FileHeader header{};
+        std::memcpy(header.magic, liab::MAGIC, 4);
+        header.version = liab::VERSION;
+        header.settingsOffset = settingsOffset_;
+        header.settingsSize = settingsSize_;
+        header.indexOffset = indexOffset;
+        header.numChunks = static_cast<uint32_t>(index_.size());
+        file_.seekp(0);
+        file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file_.close();
+        return !file_.fail();
+    }
+
+private:
+    std::ofstream file_;
+    uint64_t settingsOffset_ = 0, settingsSize_ = 0;
+    std::vector<liab::ChunkEntry> index_;
+    std::vector<char> buffer_;
+
+    void pad() {
+        static const char zeros[liab::ALIGNMENT] = {};
+        const auto pos = static_cast<size_t>(file_.tellp());
+        const size_t rem = pos % liab::ALIGNMENT;
+        if (rem != 0) file_.write(zeros, static_cast<std::streamsize>(liab::ALIGNMENT - rem));
+    }
+
+    void writeChunk(std::string_view name, liab::Type type, uint32_t stride, size_t firstRow, size_t rows) {
+        pad();
+        liab::ChunkEntry entry{};
+        std::memcpy(entry.column, name.data(), std::min(name.size(), sizeof(entry.column) - 1));
+        entry.type = type;
+        entry.stride = stride;
+        entry.firstRow = firstRow;
+        entry.rows = rows;
+        entry.offset = static_cast<uint64_t>(file_.tellp());
+        file_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        index_.push_back(entry);
+    }
+};
+
+// ================================================================================
+// MappedFile: 読み取り専用のメモリマップ
+// ================================================================================
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) { close(); return false; }
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr) { close(); return false; }
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) return false;
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) { close(); return false; }
+        size_ = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        data_ = (p == MAP_FAILED) ? nullptr : static_cast<const char*>(p);
+#endif
+        if (data_ == nullptr) { close(); return false; }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    [[nodiscard]] const char* data() const noexcept { return data_; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// ================================================================================
+// LiabReader: .liab をマップし、チャンクをコピーせずに参照する
+// ================================================================================
+class LiabReader {
+public:
+    bool open(const std::string& path) {
+        index_ = {};
+        if (!file_.open(path) || file_.size() < sizeof(liab::FileHeader)) return false;
+        std::memcpy(&header_, file_.data(), sizeof(header_));
+        if (std::memcmp(header_.magic, liab::MAGIC, 4) != 0 || header_.version != liab::VERSION) return false;
+        const uint64_t indexBytes = static_cast<uint64_t>(header_.numChunks) * sizeof(liab::ChunkEntry);
+        if (header_.indexOffset + indexBytes > file_.size()) return false;
+        if (header_.settingsOffset + header_.settingsSize > file_.size()) return false;
+
+        const auto* entries = reinterpret_cast<const liab::ChunkEntry*>(file_.data() + header_.indexOffset);
+        index_ = std::span<const liab::ChunkEntry>(entries, header_.numChunks);
+        for (const auto& e : index_) {
+            if (e.offset + e.rows * e.stride * liab::typeSize(e.type) > file_.size()) { index_ = {}; return false; }
+        }
+        return true;
+    }
+
+    void close() {
+        index_ = {};
+        header_ = {};
+        file_.close();
+    }
+
+    [[nodiscard]] std::string_view settings() const noexcept {
+        return { file_.data() + header_.settingsOffset, static_cast<size_t>(header_.settingsSize) };
+    }
+    [[nodiscard]] std::span<const liab::ChunkEntry> chunks() const noexcept { return index_; }
+
+    // 列名の一覧 (出現順)
+    [[nodiscard]] std::vector<std::string> columns() const {
+        std::vector<std::string> names;
+        for (const auto& e : index_) {
+            if (std::find(names.begin(), names.end(), e.column) == names.end()) names.emplace_back(e.column);
+        }
+        return names;
+    }
+
+    [[nodiscard]] const liab::ChunkEntry* find(std::string_view column, uint64_t row) const noexcept {
+        for (const auto& e : index_) {
+            if (column == e.column && e.firstRow <= row && row < e.firstRow + e.rows) return &e;
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] uint64_t rows(std::string_view column) const noexcept {
+        uint64_t n = 0;
+        for (const auto& e : index_) {
+            if (column == e.column) n = std::max(n, e.firstRow + e.rows);
+        }
+        return n;
+    }
+
+    // チャンク本体をコピーせずに参照する (T はチャンクの型と一致していること)
+    template <typename T>
+    [[nodiscard]] std::span<const T> view(const liab::ChunkEntry& e) const noexcept {
+        assert(sizeof(T) == liab::typeSize(e.type));
+        return { reinterpret_cast<const T*>(file_.data() + e.offset), static_cast<size_t>(e.rows * e.stride) };
+    }
+
+    // 列の [first, first + count) 行を double に変換して out に読み出す。読めた行数を返す
+    size_t read(std::string_view column, uint64_t first, size_t count, double* out) const {
+        size_t done = 0;
+        while (done < count) {
+            const auto* e = find(column, first + done);
+            if (e == nullptr) break;
+            const uint64_t begin = first + done - e->firstRow;
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(count - done, e->rows - begin));
+            const size_t elems = n * e->stride;
+            const size_t offset = static_cast<size_t>(begin * e->stride);
+            double* dst = out + done * e->stride;
+            switch (e->type) {
+            case liab::Type::F64: std::memcpy(dst, view<double>(*e).data() + offset, elems * sizeof(double)); break;
+            case liab::Type::F32: { auto s = view<float>(*e).subspan(offset, elems); std::copy(s.begin(), s.end(), dst); break; }
+            case liab::Type::I16: { auto s = view<int16_t>(*e).subspan(offset, elems); std::copy(s.begin(), s.end(), dst); break; }
+            }
+            done += n;
+        }
+        return done;
+    }
+
+private:
+    MappedFile file_;
+    liab::FileHeader header_{};
+    std::span<const liab::ChunkEntry> index_;
+};
+
+// ================================================================================
+// .liab -> CSV 変換: 先頭列と同じ行数を持つ stride 1 の列を CSV の列にする
+// (生波形フレームなどの stride > 1 の列は対象外)
+// ================================================================================
+inline bool liabToCsv(const std::string& liabPath, const std::string& csvPath) {
+    LiabReader reader;
+    if (!reader.open(liabPath)) {
+        std::cerr << "Error: Could not read " << liabPath << "\n";
+        return false;
+    }
+    std::vector<std::string> names;
+    uint64_t rows = 0;
+    for (const auto& name : reader.columns()) {
+        const auto* e = reader.find(name, 0);
+        if (e == nullptr || e->stride != 1) continue;
+        if (names.empty()) rows = reader.rows(name);
+        if (reader.rows(name) == rows) names.push_back(name);
+    }
+
+    std::vector<std::vector<double>> cols(names.size(), std::vector<double>(static_cast<size_t>(rows)));
+    std::string header = "#";
+    for (size_t c = 0; c < names.size(); ++c) {
+        reader.read(names[c], 0, static_cast<size_t>(rows), cols[c].data());
+        header += (c > 0 ? ", " : " ") + names[c];
+    }
+    header += "\n";
+
+    CsvWriter csv(header);
+    for (const auto& col : cols) csv.column([&col](size_t i) { return col[i]; });
+    return csv.write(csvPath, static_cast<size_t>(rows));
+}
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_liabFile() {
+    std::cout << "--- LiabFile Test Start ---" << std::endl;
+
+    const std::string path = "test_liab.liab";
+    const size_t rows = liab::CHUNK_ROWS * 2 + 123; // 複数チャンクにまたがる
+    std::vector<double> t(rows);
+    for (size_t i = 0; i < rows; ++i) t[i] = 2e-3 * i;
+    const int16_t frames[2][4] = { { 1, -2, 3, -4 }, { 5, -6, 7, -8 } };
+    {
+        LiabWriter writer(path, "[Awg]\nch[0].freq=100000\n");
+        assert(writer.ok());
+        writer.addColumn("t", t.data(), rows);
+        writer.addColumn("x1", liab::Type::F32, rows, [](size_t i) { return 0.5 * static_cast<double>(i % 100); });
+        writer.addColumn("frame.ch1", &frames[0][0], 2, 4);
+        assert(writer.close());
+    }
+
+    LiabReader reader;
+    assert(reader.open(path));
+    assert(reader.settings() == "[Awg]\nch[0].freq=100000\n");
+    assert((reader.columns() == std::vector<std::string>{ "t", "x1", "frame.ch1" }));
+    assert(reader.rows("t") == rows && reader.rows("frame.ch1") == 2);
+
+    // 索引によるシークとチャンク境界をまたぐ読み出し
+    std::vector<double> buf(10);
+    assert(reader.read("t", liab::CHUNK_ROWS - 5, 10, buf.data()) == 10);
+    for (size_t i = 0; i < 10; ++i) assert(buf[i] == t[liab::CHUNK_ROWS - 5 + i]);
+    assert(reader.read("x1", 250, 1, buf.data()) == 1 && buf[0] == 25.0);
+    const auto* e = reader.find("frame.ch1", 1);
+    assert(e != nullptr && e->stride == 4 && reader.view<int16_t>(*e)[5] == -6);
+    assert(reinterpret_cast<uintptr_t>(reader.view<double>(reader.chunks()[0]).data()) % liab::ALIGNMENT == 0);
+    std::cout << "  write / mmap read / seek: OK" << std::endl;
+
+    // I16 は四捨五入し、範囲外は端に寄せる
+    {
+        const double values[] = { 1.6, -1.6, 2.5, 40000.0, -40000.0, std::nan("") };
+        int16_t encoded[6];
+        liab::encode(liab::Type::I16, [&values](size_t i) { return values[i]; }, 0, 6, reinterpret_cast<char*>(encoded));
+        const int16_t expected[] = { 2, -2, 3, 32767, -32768, 0 };
+        assert(std::equal(std::begin(encoded), std::end(encoded), std::begin(expected)));
+    }
+
+    assert(liabToCsv(path, "test_liab.csv"));
+    std::ifstream csv("test_liab.csv");
+    std::string line;
+    std::getline(csv, line);
+    assert(line == "# t, x1");
+    std::getline(csv, line);
+    std::getline(csv, line);
+    assert(line == "2.000000e-03,5.000000e-01");
+    csv.close();
+    std::filesystem::remove("test_liab.csv");
+    reader.close();
+    std::filesystem::remove(path);
+    std::cout << "  convert to csv: OK" << std::endl;
+
+    std::cout << "LiabFile Test Passed!" << std::endl;
+}
@@ -0,0 +1,298 @@
+﻿#pragma once
+
+#include <array>
+#include <charconv>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "LiabFile.h"
+
+// ================================================================================
+// NumPy 形式 (.npy / 無圧縮 .npz) の書き出し
+//   .npy: 全列を float64 の2次元配列 (rows, cols) として列優先 (fortran_order) で書く。
+//         各列がファイル上で連続するので np.load(path, mmap_mode='r')[:, k] がコピーなしで読める。
+//         設定は <stem>.meta.npy に別配列として書く。
+//   .npz: 列ごとに "<name>.npy" を格納型 (f8/f4/i2) のまま無圧縮で格納し、設定を "meta" に入れる。
+//   meta は (key, value) の構造化配列 ("Scope.samplingDt" など数値の設定のみ)。
+//     meta = dict((k.decode(), v) for k, v in np.load('ect.npz')['meta'])
+// ================================================================================
+namespace npy {
+    constexpr size_t ALIGNMENT = 64;    // ヘッダを含めたデータ先頭の境界 (numpy の既定と同じ)
+    constexpr size_t CHUNK_ROWS = 65536;
+    constexpr size_t META_KEY_CHARS = 40;
+
+    using Meta = std::vector<std::pair<std::string, double>>;
+
+    inline const char* descr(liab::Type type) noexcept {
+        switch (type) {
+        case liab::Type::F64: return "'<f8'";
+        case liab::Type::F32: return "'<f4'";
+        case liab::Type::I16: return "'<i2'";
+        }
+        return "'<f8'";
+    }
+
+    // magic + version 1.0 + ヘッダ長 + 辞書 (空白で詰めて '\n' で終える)
+    inline std::string header(std::string_view descr, std::string_view shape, bool fortranOrder) {
+        std::string dict = std::format("{{'descr': {}, 'fortran_order': {}, 'shape': {}, }}",
+            descr, fortranOrder ? "True" : "False", shape);
+        const size_t unpadded = 10 + dict.size() + 1;
+        dict.append((ALIGNMENT - unpadded % ALIGNMENT) % ALIGNMENT, ' ');
+        dict += '\n';
+
+        std::string h("\x93NUMPY\x01\x00", 8);
+        const uint16_t len = static_cast<uint16_t>(dict.size());
+        h += static_cast<char>(len & 0xff);
+        h += static_cast<char>(len >> 8);
+        return h + dict;
+    }
+
+    // ini テキストのうち数値として読める値を "Section.key" の組にする
+    inline Meta metaFromIni(std::string_view ini) {
+        Meta meta;
+        std::string section;
+        while (!ini.empty()) {
+            const size_t eol = ini.find('\n');
+            std::string_view line = ini.substr(0, eol);
+            ini = (eol == std::string_view::npos) ? std::string_view() : ini.substr(eol + 1);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.size() > 2 && line.front() == '[' && line.back() == ']') {
+                section = line.substr(1, line.size() - 2);
+                continue;
+            }
+            const size_t eq = line.find('=');
+            if (eq == std::string_view::npos) continue;
+            const std::string_view value = line.substr(eq + 1);
+            double v = 0.0;
+            if (value == "true") v = 1.0;
+            else if (value == "false") v = 0.0;
+            else if (std::from_chars(value.data(), value.data() + value.size(), v).ec != std::errc()) continue;
+            meta.emplace_back(std::format("{}.{}", section, line.substr(0, eq)), v);
+        }
+        return meta;
+    }
+
+    // meta を構造化配列の .npy バイト列にする
+    inline std::string metaArray(const Meta& meta) {
+        std::string out = header(std::format("[('key', '|S{}'), ('value', '<f8')]", META_KEY_CHARS),
+            std::format("({},)", meta.size()), false);
+        for (const auto& [key, value] : meta) {
+            char record[META_KEY_CHARS + 8] = {};
+            std::memcpy(record, key.data(), std::min(key.size(), META_KEY_CHARS));
+            std::memcpy(record + META_KEY_CHARS, &value, 8);
+            out.append(record, sizeof(record));
+        }
+        return out;
+    }
+
+    // CRC-32 (zip と同じ多項式 0xEDB88320)
+    inline uint32_t crc32(uint32_t crc, const char* data, size_t size) noexcept {
+        static constexpr auto TABLE = [] {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                t[i] = c;
+            }
+            return t;
+            }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) crc = TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    inline bool isNpyPath(std::string_view path) noexcept {
+        return path.size() >= 4 && path.substr(path.size() - 4) == ".npy";
+    }
+    inline bool isNpzPath(std::string_view path) noexcept {
+        return path.size() >= 4 && path.substr(path.size() - 4) == ".npz";
+    }
+
+    // ----------------------------------------------------------------
+    // .npy: (rows, cols) の float64 列優先配列 + <stem>.meta.npy
+    // ----------------------------------------------------------------
+    inline bool writeNpy(const std::string& path, const std::vector<liab::Column>& columns, size_t rows, const Meta& meta) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) return false;
+        const std::string h = header("'<f8'", std::format("({}, {})", rows, columns.size()), true);
+        file.write(h.data(), static_cast<std::streamsize>(h.size()));
+        std::vector<char> buffer;
+        for (const auto& c : columns) {
+            for (size_t first = 0; first < rows; first += CHUNK_ROWS) {
+                const size_t count = std::min(CHUNK_ROWS, rows - first);
+                buffer.resize(count * 8);
+                liab::encode(liab::Type::F64, c.get, first, count, buffer.data());
+                file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            }
+        }
+        if (!file) return false;
+
+        std::ofstream metaFile(std::filesystem::path(path).replace_extension(".meta.npy"), std::ios::binary);
+        const std::string m = metaArray(meta);
+        metaFile.write(m.data(), static_cast<std::streamsize>(m.size()));
+        return static_cast<bool>(metaFile);
+    }
+
+    // ----------------------------------------------------------------
+    // .npz: 無圧縮 zip。各エントリはローカルヘッダを仮書きし、
+    //       チャンクごとに CRC を更新しながら書いた後で CRC を書き戻す
+    // ----------------------------------------------------------------
+    class NpzWriter {
+    public:
+        explicit NpzWriter(const std::string& path) : file_(path, std::ios::binary) {}
+
+        [[nodiscard]] bool ok() const { return static_cast<bool>(file_); }
+
+        void add(const liab::Column& column, size_t rows) {
+            const std::string h = header(descr(column.type), std::format("({},)", rows), false);
+            const uint64_t size = h.size() + rows * liab::typeSize(column.type);
+            Entry& e = begin(std::string(column.name) + ".npy", size);
+            append(e, h.data(), h.size());
+            std::vector<char> buffer;
+            for (size_t first = 0; first < rows; first += CHUNK_ROWS) {
+                const size_t count = std::min(CHUNK_ROWS, rows - first);
+                buffer.resize(count * liab::typeSize(column.type));
+                liab::encode(column.type, column.get, first, count, buffer.data());
+                append(e, buffer.data(), buffer.size());
+            }
+            end(e);
+        }
+
+        void add(const std::string& name, const std::string& npyBytes) {
+            Entry& e = begin(name + ".npy", npyBytes.size());
+            append(e, npyBytes.data(), npyBytes.size());
+            end(e);
+        }
+
+        // 中央ディレクトリを書いて閉じる
+        bool close() {
+            if (!file_ || tooLarge_) return false;
+            const uint32_t dirOffset = static_cast<uint32_t>(file_.tellp());
+            for (const auto& e : entries_) {
+                put32(0x02014b50);
+                put16(20); put16(20); put16(0); put16(0); put16(0); put16(0x21); // 作成/展開 version, flag, 無圧縮, 時刻 0:00 1980/1/1
+                put32(e.crc); put32(e.size); put32(e.size);
+                put16(static_cast<uint16_t>(e.name.size())); put16(0); put16(0); put16(0); put16(0);
+                put32(0); put32(e.offset);
+                file_.write(e.name.data(), static_cast<std::streamsize>(e.name.size()));
+            }
+            const uint32_t dirSize = static_cast<uint32_t>(file_.tellp()) - dirOffset;
+            put32(0x06054b50);
+            put16(0); put16(0);
+            put16(static_cast<uint16_t>(entries_.size())); put16(static_cast<uint16_t>(entries_.size()));
+            put32(dirSize); put32(dirOffset); put16(0);
+            file_.close();
+            return !file_.fail();
+        }
+
+    private:
+        struct Entry { std::string name; uint32_t offset = 0, size = 0, crc = 0; };
+        std::ofstream file_;
+        std::vector<Entry> entries_;
+        bool tooLarge_ = false; // zip64 は扱わない (4GB まで)
+
+        void put16(uint16_t v) { const char b[2] = { char(v & 0xff), char(v >> 8) }; file_.write(b, 2); }
+        void put32(uint32_t v) { put16(static_cast<uint16_t>(v & 0xffff)); put16(static_cast<uint16_t>(v >> 16)); }
+
+        Entry& begin(std::string name, uint64_t size) {
+            const uint64_t offset = static_cast<uint64_t>(file_.tellp());
+            if (size > UINT32_MAX || offset + size > UINT32_MAX) tooLarge_ = true;
+            entries_.push_back({ std::move(name), static_cast<uint32_t>(offset), static_cast<uint32_t>(size), 0 });
+            Entry& e = entries_.back();
+            put32(0x04034b50);
+            put16(20); put16(0); put16(0); put16(0); put16(0x21);
+            put32(0); put32(e.size); put32(e.size); // CRC は end() で書き戻す
+            put16(static_cast<uint16_t>(e.name.size())); put16(0);
+            file_.write(e.name.data(), static_cast<std::streamsize>(e.name.size()));
+            return e;
+        }
+        void append(Entry& e, const char* data, size_t size) {
+            e.crc = crc32(e.crc, data, size);
+            file_.write(data, static_cast<std::streamsize>(size));
+        }
+        void end(const Entry& e) {
+            const auto pos = file_.tellp();
+            file_.seekp(e.offset + 14);
+            put32(e.crc);
+            file_.seekp(pos);
+        }
+    };
+
+    inline bool writeNpz(const std::string& path, const std::vector<liab::Column>& columns, size_t rows, const Meta& meta) {
+        NpzWriter npz(path);
+        if (!npz.ok()) return false;
+        for (const auto& c : columns) npz.add(c, rows);
+        npz.add("meta", metaArray(meta));
+        return npz.close();
+    }
+}
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_npyFile() {
+    std::cout << "--- NpyFile Test Start ---" << std::endl;
+
+    assert(npy::crc32(0, "123456789", 9) == 0xCBF43926u);
+    const std::string h = npy::header("'<f8'", "(3, 2)", true);
+    assert(h.size() % npy::ALIGNMENT == 0 && h.back() == '\n');
+    assert(h.find("'fortran_order': True, 'shape': (3, 2), }") != std::string::npos);
+
+    const auto meta = npy::metaFromIni("[Awg]\nch[0].freq=100000\nname=abc\n[Scope]\nflagCh2=true\n");
+    assert(meta.size() == 2 && meta[0].first == "Awg.ch[0].freq" && meta[0].second == 1e5);
+    assert(meta[1].first == "Scope.flagCh2" && meta[1].second == 1.0);
+    std::cout << "  header / crc / meta: OK" << std::endl;
+
+    // .npy: 各列が連続して並ぶこと
+    const size_t rows = npy::CHUNK_ROWS + 5;
+    const std::vector<liab::Column> columns{
+        { "t", liab::Type::F64, [](size_t i) { return 1e-3 * i; } },
+        { "x1", liab::Type::F32, [](size_t i) { return -0.5 * i; } },
+    };
+    assert(npy::writeNpy("test_npy.npy", columns, rows, meta));
+    {
+        std::ifstream file("test_npy.npy", std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        const size_t offset = npy::header("'<f8'", std::format("({}, {})", rows, 2), true).size();
+        assert(bytes.size() == offset + rows * 2 * 8);
+        double v;
+        std::memcpy(&v, bytes.data() + offset + (rows + 3) * 8, 8);
+        assert(v == -1.5);
+    }
+    assert(std::filesystem::exists("test_npy.meta.npy"));
+    std::filesystem::remove("test_npy.npy");
+    std::filesystem::remove("test_npy.meta.npy");
+    std::cout << "  npy column order: OK" << std::endl;
+
+    // .npz: 各エントリの CRC とローカルヘッダ
+    assert(npy::writeNpz("test_npy.npz", columns, rows, meta));
+    {
+        std::ifstream file("test_npy.npz", std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        auto u16 = [&](size_t p) { return static_cast<uint32_t>(static_cast<uint8_t>(bytes[p]) | (static_cast<uint8_t>(bytes[p + 1]) << 8)); };
+        auto u32 = [&](size_t p) { return u16(p) | (u16(p + 2) << 16); };
+        size_t p = 0;
+        int entries = 0;
+        while (u32(p) == 0x04034b50) {
+            const uint32_t crc = u32(p + 14), size = u32(p + 18), nameLen = u16(p + 26);
+            const size_t data = p + 30 + nameLen;
+            assert(npy::crc32(0, bytes.data() + data, size) == crc);
+            p = data + size;
+            ++entries;
+        }
+        assert(entries == 3 && u32(p) == 0x02014b50);
+        assert(u32(bytes.size() - 22) == 0x06054b50 && u16(bytes.size() - 12) == 3);
+    }
+    std::filesystem::remove("test_npy.npz");
+    std::cout << "  npz entries / crc: OK" << std::endl;
+
+    std::cout << "NpyFile Test Passed!" << std::endl;
+}
@@ -60,7 +60,7 @@ inline void MicroFormatter(double value, char* buff, int size, void*) {
 }
 
 // リングバッファの折り返しを考慮して線を描画するヘルパー
-inline auto plotRingBufferLine = [](const char* label, const std::vector<double>& x, const std::vector<double>& y, int startIdx, int size, const ImPlotSpec& spec) {
+inline auto plotRingBufferLine = []<typename T>(const char* label, const std::vector<T>& x, const std::vector<T>& y, int startIdx, int size, const ImPlotSpec& spec) {
     int totalSize = static_cast<int>(x.size());
     if (startIdx + size > totalSize) {
         int firstPartSize = totalSize - startIdx;
@@ -72,6 +72,39 @@ inline auto plotRingBufferLine = [](const char* label, const std::vector<double>
     }
     };
 
+// 非同期保存の進捗 (実行中はプログレスバー、完了後は結果) を Save ボタンの横に表示する
+inline void showExportStatus(const LiaConfig& cfg) {
+    const auto status = cfg.exporter.status();
+    if (status.running || status.queued > 0) {
+        ImGui::SameLine();
+        const float fraction = (status.total > 0) ? (float)status.done / (float)status.total : 0.0f;
+        ImGui::ProgressBar(fraction, ImVec2(150.0f * cfg.window.monitorScale, 0.0f), status.current.c_str());
+    }
+    else if (status.completed > 0) {
+        ImGui::SameLine();
+        if (status.lastOk) ImGui::TextDisabled("%s: %s", status.last.c_str(), status.message.c_str());
+        else ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s: %s", status.last.c_str(), status.message.c_str());
+    }
+}
+
+// リングバッファの時刻列と値列を古い順に描画するヘルパー
+// double 格納時は生ポインタ + Offset、float 格納時は getter 経由で時刻を復元する
+template <typename RingBufferT, typename T>
+inline void plotRingBufferTimeLine(const char* label, const RingBufferT& rb, const std::vector<T>& values, ImPlotSpec spec) {
+    if constexpr (std::is_same_v<T, double> && decltype(rb.times)::IS_PLAIN) {
+        spec.Offset = rb.writeIdx;
+        ImPlot::PlotLine(label, rb.times.data(), values.data(), rb.size, spec);
+    }
+    else {
+        struct Context { const RingBufferT* rb; const std::vector<T>* values; } ctx{ &rb, &values };
+        ImPlot::PlotLineG(label, [](int idx, void* data) {
+            const auto* c = static_cast<const Context*>(data);
+            const int p = c->rb->toPhysical(idx);
+            return ImPlotPoint(c->rb->times[p], static_cast<double>((*c->values)[p]));
+            }, &ctx, rb.size, spec);
+    }
+}
+
 
 // ============================================================================
 // Class Declarations (クラス宣言部)
@@ -193,12 +226,12 @@ inline void RawPlotWindow::show() {
             ImGui::SameLine();
             if (ImGui::Button("Save")) {
                 std::string timestamp = cfg.getCurrentTimestamp();
-                cfg.saveRawData(std::format("raw_{}.csv", timestamp));
                 cfg.scope.calculateFFT(cfg.scope.ch[1].enable, cfg.awg.ch[0].freq);
-                cfg.saveFftData(std::format("fft_{}.csv", timestamp));
+                cfg.saveScopeAsync(cfg.save.fileName("raw_" + timestamp), cfg.save.fileName("fft_" + timestamp));
                 button = ButtonType::RawSave;
                 value = 1.0f;
             }
+            showExportStatus(cfg);
             // Tabs
             if (ImGui::BeginTabBar("Raw")) {
                 bool useMv = (cfg.plot.rawLimit <= MILI_VOLT);
@@ -215,7 +248,7 @@ inline void RawPlotWindow::show() {
             }
             // Command Logging
             if (button != ButtonType::NON) {
-                cfg.cmds.push_back({ (float)cfg.timer.elapsedSec(), (float)button, value, 0.0f, 0.0f, 0.0f });
+                cfg.recordCmd(button, value);
             }
         }
         ImGui::End();
@@ -303,7 +336,7 @@ inline void TimeChartWindow::calculateXYPlotIndices() {
     }
 
     // リングバッファの終端側を検索（ラップアラウンド時）
-    if (!found && cfg.ringBuffer.size < cfg.ringBuffer.nofm) {
+    if (!found && static_cast<uint64_t>(cfg.ringBuffer.size) < cfg.ringBuffer.nofm) {
         for (int idx = cfg.ringBuffer.size - 1; cfg.ringBuffer.latestIdx < idx; idx--) {
             double diffMin = std::abs(cfg.ringBuffer.times[idx] - cfg.pause.selectArea.X.Min);
             double diffMax = std::abs(cfg.ringBuffer.times[idx] - cfg.pause.selectArea.X.Max);
@@ -342,8 +375,9 @@ inline void TimeChartWindow::show() {
 
             ImGui::SameLine();
             if (ImGui::Button("Save")) {
-                cfg.saveResultsToFile(std::format("ect_{}.csv", cfg.getCurrentTimestamp()), cfg.plot.historySec);
+                cfg.saveResultsAsync(cfg.save.fileName("ect_" + cfg.getCurrentTimestamp()), cfg.plot.historySec);
             }
+            showExportStatus(cfg);
 
             ImGui::SameLine();
             if (ImGui::Button(cfg.pause.flag ? "Run" : "Pause")) { cfg.buttonPause(); }
@@ -362,12 +396,9 @@ inline void TimeChartWindow::show() {
                 ImPlot::SetupAxisLimits(ImAxis_Y1, -cfg.plot.limit, cfg.plot.limit, ImGuiCond_Always);
 
                 ImPlotSpec specLine;
-                specLine.Offset = (int)cfg.ringBuffer.writeIdx;
-                int count = (int)cfg.ringBuffer.size;
-
-                ImPlot::PlotLine("Ch1y", &(cfg.ringBuffer.times[0]), &(cfg.ringBuffer.ch[0].y[0]), count, specLine);
+                plotRingBufferTimeLine("Ch1y", cfg.ringBuffer, cfg.ringBuffer.ch[0].y, specLine);
                 if (cfg.scope.ch[1].enable) {
-                    ImPlot::PlotLine("Ch2y", &(cfg.ringBuffer.times[0]), &(cfg.ringBuffer.ch[1].y[0]), count, specLine);
+                    plotRingBufferTimeLine("Ch2y", cfg.ringBuffer, cfg.ringBuffer.ch[1].y, specLine);
                 }
 
                 static bool isFirstPause = true;
@@ -392,7 +423,7 @@ inline void TimeChartWindow::show() {
             ImPlot::PopStyleColor();
             
             if (button != ButtonType::NON) {
-                cfg.cmds.push_back({ (float)cfg.timer.elapsedSec(), (float)button, value, 0.0f, 0.0f, 0.0f });
+                cfg.recordCmd(button, value);
             }
         }
         ImGui::End();
@@ -416,39 +447,42 @@ inline void TimeChartZoomWindow::analyzeSelection() {
     res.x_min_last = area.X.Min;
     res.x_max_last = area.X.Max;
 
-    // 初期化
-    res.vxs[0] = 10.0; res.vxs[1] = -10.0;
-    res.vzs[0] = 10.0; res.vzs[1] = -10.0;
-
-    // 範囲内のMin/Max探索
-    for (int i = 0; i < cfg.ringBuffer.size; i++) {
-        double t = cfg.ringBuffer.times[i];
-        if (t < area.X.Min) continue;
-        if (t > area.X.Max) break;
-
-        double v_x = cfg.ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].y[i];
-        if (res.vxs[0] > v_x) { res.vxs[0] = v_x; res.ts_vx[0] = t; res.vminIdx_vx = i; }
-        if (res.vxs[1] < v_x) { res.vxs[1] = v_x; res.ts_vx[1] = t; res.vmaxIdx_vx = i; }
-
-        double v_z = cfg.ringBuffer.ch[LiaConfigDefaultConsts::CH_VERTICAL].y[i];
-        if (res.vzs[0] > v_z) { res.vzs[0] = v_z; res.ts_vz[0] = t; }
-        if (res.vzs[1] < v_z) { res.vzs[1] = v_z; res.ts_vz[1] = t; }
+    // 範囲内のMin/Max探索 (区間集計インデックスで O(log n))
+    const auto& rb = cfg.ringBuffer;
+    const RangeStats vx = rb.stats(LiaConfigDefaultConsts::CH_HORIZONTAL, LiaConfigDefaultConsts::COMPONENT_Y, area.X.Min, area.X.Max);
+    const RangeStats vz = rb.stats(LiaConfigDefaultConsts::CH_VERTICAL, LiaConfigDefaultConsts::COMPONENT_Y, area.X.Min, area.X.Max);
+    if (vx.count == 0 || vz.count == 0) {
+        res.vxs[0] = res.vxs[1] = 0.0;
+        res.vzs[0] = res.vzs[1] = 0.0;
+        cfg.acfmData.vxpp = 0.0;
+        cfg.acfmData.vpp_vz = 0.0;
+        return;
     }
 
+    res.vxs[0] = vx.min; res.ts_vx[0] = rb.times[vx.minIdx]; res.vminIdx_vx = vx.minIdx;
+    res.vxs[1] = vx.max; res.ts_vx[1] = rb.times[vx.maxIdx]; res.vmaxIdx_vx = vx.maxIdx;
+    res.vzs[0] = vz.min; res.ts_vz[0] = rb.times[vz.minIdx];
+    res.vzs[1] = vz.max; res.ts_vz[1] = rb.times[vz.maxIdx];
+
     // 50% レベルの計算
     res.v50s_vx[0] = res.v50s_vx[1] = (res.vxs[1] + res.vxs[0]) / 2.0;
     res.v50s_vz[0] = res.v50s_vz[1] = (res.vzs[1] + res.vzs[0]) / 2.0;
 
-    // 50% を横切る時間の探索 (vx)
-    auto& vx_y = cfg.ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].y;
-    auto& times = cfg.ringBuffer.times;
+    // 50% を横切る時間の探索 (vx)。折り返しを考慮して論理インデックスで走査する
+    auto& vx_y = rb.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].y;
+    auto& times = rb.times;
+    const int minLogical = rb.toLogical(res.vminIdx_vx);
 
     // 前方探索
-    for (int i = res.vminIdx_vx; i < cfg.ringBuffer.size && times[i] <= area.X.Max; i++) {
+    for (int l = minLogical; l < rb.size; l++) {
+        const int i = rb.toPhysical(l);
+        if (times[i] > area.X.Max) break;
         if (res.v50s_vx[0] <= vx_y[i]) { res.t50s_vx[1] = times[i]; break; }
     }
     // 後方探索
-    for (int i = res.vminIdx_vx; i >= 0 && times[i] >= area.X.Min; i--) {
+    for (int l = minLogical; l >= 0; l--) {
+        const int i = rb.toPhysical(l);
+        if (times[i] < area.X.Min) break;
         if (res.v50s_vx[0] <= vx_y[i]) { res.t50s_vx[0] = times[i]; break; }
     }
 
@@ -476,10 +510,9 @@ inline void TimeChartZoomWindow::show() {
 
         // --- メイン波形のプロット ---
         ImPlotSpec specLine;
-        specLine.Offset = cfg.ringBuffer.writeIdx;
-        ImPlot::PlotLine("Ch1y", cfg.ringBuffer.times.data(), cfg.ringBuffer.ch[0].y.data(), cfg.ringBuffer.size, specLine);
+        plotRingBufferTimeLine("Ch1y", cfg.ringBuffer, cfg.ringBuffer.ch[0].y, specLine);
         if (cfg.scope.ch[1].enable) {
-            ImPlot::PlotLine("Ch2y", cfg.ringBuffer.times.data(), cfg.ringBuffer.ch[1].y.data(), cfg.ringBuffer.size, specLine);
+            plotRingBufferTimeLine("Ch2y", cfg.ringBuffer, cfg.ringBuffer.ch[1].y, specLine);
         }
 
         // --- 解析マーカーのプロット ---
@@ -556,8 +589,7 @@ inline void DeltaTimeChartWindow::show() {
                 ImPlot::SetupAxisLimits(ImAxis_Y1, (cfg.ringBuffer.getDt() - 2e-3) * 1e3, (cfg.ringBuffer.getDt() + 2e-3) * 1e3, ImGuiCond_Always);
 
                 ImPlotSpec specLine;
-                specLine.Offset = cfg.ringBuffer.writeIdx;
-                ImPlot::PlotLine("##dt", &(cfg.ringBuffer.times[0]), &(cfg.ringBuffer.deltaTimes[0]), cfg.ringBuffer.size, specLine);
+                plotRingBufferTimeLine("##dt", cfg.ringBuffer, cfg.ringBuffer.deltaTimes, specLine);
                 ImPlot::EndPlot();
             }
         }
@@ -0,0 +1,294 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CsvWriter.h"
+
+// ================================================================================
+// SpscQueue: 1生産者・1消費者の固定長リングキュー (ロックなし)
+//   - push() は満杯なら false を返す (待たない)
+//   - 容量は 2 のべき乗に切り上げる
+// ================================================================================
+template <class T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : buf_(std::bit_ceil(std::max<size_t>(capacity, 2))), mask_(buf_.size() - 1) {}
+
+    // 生産者スレッドから呼ぶ
+    bool push(const T& value) noexcept {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == buf_.size()) return false;
+        buf_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 消費者スレッドから呼ぶ。最大 max 個を取り出して個数を返す
+    size_t pop(T* out, size_t max) noexcept {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t n = std::min(max, head_.load(std::memory_order_acquire) - tail);
+        for (size_t i = 0; i < n; ++i) out[i] = buf_[(tail + i) & mask_];
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // 消費者スレッドから呼ぶ
+    void clear() noexcept { tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release); }
+
+    [[nodiscard]] size_t size() const noexcept { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    [[nodiscard]] size_t capacity() const noexcept { return buf_.size(); }
+
+private:
+    std::vector<T> buf_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> head_{ 0 }; // 生産者が書く
+    alignas(64) std::atomic<size_t> tail_{ 0 }; // 消費者が書く
+};
+
+// 配信する1点 (バイナリ配信ではこのままの 32 バイトを送る)
+struct StreamPoint {
+    uint64_t seq; // 配信開始からの通し番号 (リングバッファの再配置でも途切れない)
+    double t;
+    float xy[4];  // x1, y1, x2, y2
+};
+static_assert(sizeof(StreamPoint) == 32);
+
+// ================================================================================
+// PointStream: 測定スレッドが確定した点を購読者ごとのキューに配る
+//   - publish() は測定スレッドから1点ごとに呼ぶ。購読者がいなければ atomic の読み出し1回で戻る
+//   - 購読者ごとに間引き比 n (seq % n == 0 の点だけ) を持つ
+//   - キューが満杯なら待たずにその点を捨て、dropped を数える (測定スレッドを止めない)
+// ================================================================================
+class PointStream {
+public:
+    static constexpr int MAX_SUBSCRIBERS = 4;
+    static constexpr size_t QUEUE_CAPACITY = 8192; // dt = 2 ms で約16秒分
+
+    struct Stats {
+        bool active = false;
+        int decimation = 1;
+        uint64_t queued = 0;   // 未送信の点数
+        uint64_t pushed = 0;   // キューに入れた点数
+        uint64_t dropped = 0;  // キューが満杯で捨てた点数
+    };
+
+    PointStream() {
+        for (auto& s : slots_) s.queue = std::make_unique<SpscQueue<StreamPoint>>(QUEUE_CAPACITY);
+    }
+
+    // 空きスロットを確保して購読を始める。空きがなければ -1
+    int subscribe(int decimation = 1) {
+        for (int id = 0; id < MAX_SUBSCRIBERS; ++id) {
+            Slot& s = slots_[id];
+            if (s.used.exchange(true)) continue;
+            s.queue->clear();
+            s.decimation.store(std::max(1, decimation), std::memory_order_relaxed);
+            s.pushed.store(0, std::memory_order_relaxed);
+            s.dropped.store(0, std::memory_order_relaxed);
+            activeMask_.fetch_or(1u << id, std::memory_order_release);
+            return id;
+        }
+        return -1;
+    }
+
+    void unsubscribe(int id) {
+        if (id < 0 || id >= MAX_SUBSCRIBERS) return;
+        activeMask_.fetch_and(~(1u << id), std::memory_order_release);
+        slots_[id].used = false;
+    }
+
+    void setDecimation(int id, int decimation) {
+        slots_[id].decimation.store(std::max(1, decimation), std::memory_order_relaxed);
+    }
+
+    // 測定スレッドから1点ごとに呼ぶ
+    void publish(double t, double x1, double y1, double x2, double y2) noexcept {
+        const uint64_t seq = seq_++;
+        const uint32_t mask = activeMask_.load(std::memory_order_acquire);
+        if (mask == 0) return;
+        const StreamPoint p{ seq, t, { static_cast<float>(x1), static_cast<float>(y1), static_cast<float>(x2), static_cast<float>(y2) } };
+        for (int id = 0; id < MAX_SUBSCRIBERS; ++id) {
+            if ((mask & (1u << id)) == 0) continue;
+            Slot& s = slots_[id];
+            if (seq % static_cast<uint64_t>(s.decimation.load(std::memory_order_relaxed)) != 0) continue;
+            if (!s.queue->push(p)) {
+                s.dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            s.pushed.fetch_add(1, std::memory_order_relaxed);
+            s.signal.fetch_add(1, std::memory_order_release);
+            s.signal.notify_one();
+        }
+    }
+
+    // 購読者スレッドから呼ぶ。点が届くか st が停止するまで待ち、最大 max 点を取り出す
+    size_t read(int id, StreamPoint* out, size_t max, std::stop_token st) {
+        Slot& s = slots_[id];
+        std::stop_callback wake(st, [&s] {
+            s.signal.fetch_add(1, std::memory_order_release);
+            s.signal.notify_all();
+            });
+        while (true) {
+            const uint32_t signal = s.signal.load(std::memory_order_acquire);
+            if (const size_t n = s.queue->pop(out, max); n > 0) return n;
+            if (st.stop_requested()) return 0;
+            s.signal.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    // 購読者スレッドから呼ぶ。待たずに届いている点を最大 max 点取り出す (複数の購読を1スレッドで回すとき)
+    size_t poll(int id, StreamPoint* out, size_t max) noexcept {
+        return slots_[id].queue->pop(out, max);
+    }
+
+    [[nodiscard]] Stats stats(int id) const {
+        if (id < 0 || id >= MAX_SUBSCRIBERS) return {};
+        const Slot& s = slots_[id];
+        return { (activeMask_.load() & (1u << id)) != 0, s.decimation.load(), s.queue->size(), s.pushed.load(), s.dropped.load() };
+    }
+
+    // ----------------------------------------------------------------
+    // 送信用の書式 (先頭の '@' で問い合わせへの応答と区別する)
+    //   テキスト : "@seq,t,x1,y1[,x2,y2]\n" を1点1行
+    //   バイナリ : "@#<n><len>" + StreamPoint の配列 (リトルエンディアン) + "\n"
+    // ----------------------------------------------------------------
+    static void formatText(std::vector<char>& buffer, const StreamPoint* points, size_t n, int numChannels) {
+        const size_t lineChars = 1 + 20 + 1 + (1 + 2 * numChannels) * CsvWriter::MAX_FIELD_CHARS + 1;
+        buffer.resize(n * lineChars);
+        char* p = buffer.data();
+        for (size_t i = 0; i < n; ++i) {
+            *p++ = '@';
+            p = std::to_chars(p, p + 20, points[i].seq).ptr;
+            *p++ = ',';
+            p = CsvWriter::appendScientific(p, points[i].t);
+            for (int k = 0; k < 2 * numChannels; ++k) {
+                *p++ = ',';
+                p = CsvWriter::appendScientific(p, points[i].xy[k]);
+            }
+            *p++ = '\n';
+        }
+        buffer.resize(p - buffer.data());
+    }
+
+    static void formatBlock(std::vector<char>& buffer, const StreamPoint* points, size_t n) {
+        const std::string len = std::to_string(n * sizeof(StreamPoint));
+        const std::string header = "@#" + std::to_string(len.size()) + len;
+        buffer.resize(header.size() + n * sizeof(StreamPoint) + 1);
+        std::memcpy(buffer.data(), header.data(), header.size());
+        std::memcpy(buffer.data() + header.size(), points, n * sizeof(StreamPoint));
+        buffer.back() = '\n';
+    }
+
+private:
+    struct Slot {
+        std::unique_ptr<SpscQueue<StreamPoint>> queue;
+        std::atomic<bool> used{ false };
+        std::atomic<int> decimation{ 1 };
+        std::atomic<uint64_t> pushed{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+        std::atomic<uint32_t> signal{ 0 }; // push のたびに増やして待機中の購読者を起こす
+    };
+    std::array<Slot, MAX_SUBSCRIBERS> slots_;
+    std::atomic<uint32_t> activeMask_{ 0 };
+    uint64_t seq_ = 0; // 測定スレッドのみが更新する
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_pointStream() {
+    std::cout << "--- PointStream Test Start ---" << std::endl;
+
+    {
+        SpscQueue<int> q(5);
+        assert(q.capacity() == 8);
+        for (int i = 0; i < 8; ++i) assert(q.push(i));
+        assert(!q.push(8));
+        int out[8];
+        assert(q.pop(out, 3) == 3 && out[2] == 2);
+        assert(q.size() == 5);
+    }
+    std::cout << "  SpscQueue bounded push/pop: OK" << std::endl;
+
+    // 間引き・取りこぼし・順序
+    {
+        PointStream ps;
+        const int id = ps.subscribe(3);
+        assert(id >= 0);
+        constexpr int N = 300000;
+        std::vector<StreamPoint> received;
+        std::stop_source stop;
+        std::jthread consumer([&] {
+            StreamPoint batch[256];
+            while (true) {
+                const size_t n = ps.read(id, batch, 256, stop.get_token());
+                if (n == 0) break;
+                received.insert(received.end(), batch, batch + n);
+            }
+            });
+        for (int i = 0; i < N; ++i) ps.publish(i * 1e-3, i, -i, 0, 0);
+        while (ps.stats(id).queued > 0) std::this_thread::yield();
+        stop.request_stop();
+        consumer.join();
+
+        const auto s = ps.stats(id);
+        assert(s.pushed + s.dropped == N / 3);
+        assert(received.size() == s.pushed);
+        for (size_t i = 0; i < received.size(); ++i) {
+            assert(received[i].seq % 3 == 0);
+            assert(received[i].xy[0] == static_cast<float>(received[i].seq));
+            if (i > 0) assert(received[i].seq > received[i - 1].seq);
+        }
+        ps.unsubscribe(id);
+        assert(!ps.stats(id).active);
+    }
+    std::cout << "  decimation / ordering / drop accounting: OK" << std::endl;
+
+    // 購読者が読まなければキュー容量を超えた分は捨てられる
+    {
+        PointStream ps;
+        const int id = ps.subscribe();
+        for (int i = 0; i < 10000; ++i) ps.publish(i, 0, 0, 0, 0);
+        const auto s = ps.stats(id);
+        assert(s.pushed == PointStream::QUEUE_CAPACITY && s.dropped == 10000 - PointStream::QUEUE_CAPACITY);
+    }
+    std::cout << "  backpressure (bounded queue, drop counter): OK" << std::endl;
+
+    // 公開から受信までの遅延
+    {
+        PointStream ps;
+        const int id = ps.subscribe();
+        std::stop_source stop;
+        std::atomic<uint64_t> received{ 0 };
+        std::jthread consumer([&] {
+            StreamPoint p;
+            while (ps.read(id, &p, 1, stop.get_token()) > 0) received.store(p.seq + 1, std::memory_order_release);
+            });
+        constexpr int N = 1000;
+        double total = 0.0, worst = 0.0;
+        for (int i = 0; i < N; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            ps.publish(i, 0, 0, 0, 0);
+            while (received.load(std::memory_order_acquire) != static_cast<uint64_t>(i + 1)) std::this_thread::yield();
+            const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            total += us;
+            worst = std::max(worst, us);
+        }
+        stop.request_stop();
+        std::cout << "  publish -> consumer latency: mean " << total / N << " us, max " << worst << " us" << std::endl;
+    }
+
+    std::cout << "PointStream Test Passed!" << std::endl;
+}
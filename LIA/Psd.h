@@ -1,6 +1,7 @@
 ﻿#pragma once
 #include <cmath>
 #include <numbers>
+#include <string_view>
 #include <vector>
 #include <utility>
 #include <cstddef> // size_t
@@ -9,6 +10,21 @@
 
 class Psd
 {
+public:
+    // 参照波に掛ける窓関数。Rect は半周期の整数倍を等しい重みで積算する (測定の既定)
+    // Hann / Blackman は端の重みを下げ、周期に揃わない成分の漏れを抑える (振幅は窓の和で正規化する)
+    enum class Window { Rect, Hann, Blackman };
+
+    // rect / hann / blackman。知らない名前なら false
+    static bool parseWindow(std::string_view name, Window& window) noexcept
+    {
+        if (name == "rect") window = Window::Rect;
+        else if (name == "hann") window = Window::Hann;
+        else if (name == "blackman") window = Window::Blackman;
+        else return false;
+        return true;
+    }
+
 private:
     std::vector<double> sinTable_;
     std::vector<double> cosTable_;
@@ -16,6 +32,7 @@ private:
     double samplingInterval_ = 0.0;
     double currentFreq_ = 0.0;
     size_t sampleSize_ = 0;
+    Window window_ = Window::Rect;
     size_t usableSize_ = 0;
     double invSize_ = 0.0;
 
@@ -36,11 +53,12 @@ public:
         return samplingInterval_;
     }
 
-    void initialize(double frequency, double samplingInterval, size_t sampleSize)
+    void initialize(double frequency, double samplingInterval, size_t sampleSize, Window window = Window::Rect)
     {
         if (currentFreq_ == frequency &&
             samplingInterval_ == samplingInterval &&
-            sampleSize_ == sampleSize)
+            sampleSize_ == sampleSize &&
+            window_ == window)
         {
             return;
         }
@@ -48,6 +66,7 @@ public:
         currentFreq_ = frequency;
         samplingInterval_ = samplingInterval;
         sampleSize_ = sampleSize;
+        window_ = window;
 
         const size_t halfPeriodSamples = static_cast<size_t>(0.5 / (currentFreq_ * samplingInterval_));
         usableSize_ = halfPeriodSamples * (sampleSize_ / halfPeriodSamples);
@@ -57,22 +76,28 @@ public:
             return;
         }
 
-        invSize_ = 1.0 / static_cast<double>(usableSize_);
-
         sinTable_.resize(usableSize_);
         cosTable_.resize(usableSize_);
 
         const double angularFreq = 2.0 * std::numbers::pi * currentFreq_;
+        const double windowStep = 2.0 * std::numbers::pi / static_cast<double>(usableSize_);
 
         double* pSin = sinTable_.data();
         double* pCos = cosTable_.data();
 
+        double windowSum = 0.0;
         for (size_t i = 0; i < usableSize_; ++i)
         {
+            double w = 1.0;
+            if (window_ == Window::Hann) w = 0.5 - 0.5 * std::cos(windowStep * i);
+            else if (window_ == Window::Blackman) w = 0.42 - 0.5 * std::cos(windowStep * i) + 0.08 * std::cos(2.0 * windowStep * i);
+            windowSum += w;
+
             double wt = angularFreq * i * samplingInterval_;
-            pSin[i] = 2.0 * std::sin(wt);
-            pCos[i] = 2.0 * std::cos(wt);
+            pSin[i] = 2.0 * w * std::sin(wt);
+            pCos[i] = 2.0 * w * std::cos(wt);
         }
+        invSize_ = 1.0 / windowSum;
     }
 
     auto calculate(const double* __restrict rawData) const noexcept -> std::pair<double, double>
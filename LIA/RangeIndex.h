@@ -0,0 +1,177 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// ================================================================================
+// RangeStats: 区間集計値 (min/argmin/max/argmax/sum/sumsq)
+// ================================================================================
+struct RangeStats {
+    int count = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    int minIdx = -1;    // 物理インデックス (リングバッファ上の位置)
+    int maxIdx = -1;
+    double sum = 0.0;
+    double sumSq = 0.0;
+
+    inline void add(double v, int idx) noexcept {
+        if (v < min) { min = v; minIdx = idx; }
+        if (v > max) { max = v; maxIdx = idx; }
+        sum += v;
+        sumSq += v * v;
+        ++count;
+    }
+
+    inline void merge(const RangeStats& other) noexcept {
+        if (other.count == 0) return;
+        if (other.min < min) { min = other.min; minIdx = other.minIdx; }
+        if (other.max > max) { max = other.max; maxIdx = other.maxIdx; }
+        sum += other.sum;
+        sumSq += other.sumSq;
+        count += other.count;
+    }
+
+    [[nodiscard]] double mean() const noexcept { return count > 0 ? sum / count : 0.0; }
+    [[nodiscard]] double stddev() const noexcept {
+        if (count < 2) return 0.0;
+        const double m = mean();
+        return std::sqrt(std::max(0.0, sumSq / count - m * m));
+    }
+    [[nodiscard]] double peakToPeak() const noexcept { return count > 0 ? max - min : 0.0; }
+};
+
+// ================================================================================
+// RangeIndex: リングバッファ1列分の区間集計インデックス
+//   BLOCK_SIZE 点ごとのブロック集計をセグメント木で保持する。
+//   値そのものはリングバッファ側にあるため、木はブロック数分だけで済む
+//   (10分/2ms = 300k点でも 1列あたり約450KB)。
+//   更新: 書き込み位置のブロックを再集計し、根まで伝搬 O(BLOCK_SIZE + log n)
+//   問い合わせ: 端の半端ブロックは直接走査、それ以外は木を引く O(BLOCK_SIZE + log n)
+// ================================================================================
+class RangeIndex {
+public:
+    static constexpr int BLOCK_SIZE = 64;
+
+    void resize(int capacity) {
+        capacity_ = std::max(0, capacity);
+        numBlocks_ = (capacity_ + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        tree_.assign(2 * static_cast<size_t>(numBlocks_), RangeStats());
+    }
+
+    [[nodiscard]] int capacity() const noexcept { return capacity_; }
+
+    // idx を含むブロックを再集計する (idx への書き込み直後に呼ぶ)
+    template <typename Column>
+    void update(const Column& data, int idx) noexcept {
+        if (idx < 0 || idx >= capacity_) return;
+        const int block = idx / BLOCK_SIZE;
+        int node = block + numBlocks_;
+        tree_[node] = scan(data, block * BLOCK_SIZE, std::min(capacity_, (block + 1) * BLOCK_SIZE));
+        for (node >>= 1; node >= 1; node >>= 1) {
+            tree_[node] = tree_[2 * node];
+            tree_[node].merge(tree_[2 * node + 1]);
+        }
+    }
+
+    // 全ブロックを再構築する (リサイズや並べ替えの後に呼ぶ)
+    template <typename Column>
+    void rebuild(const Column& data) {
+        for (int b = 0; b < numBlocks_; ++b) {
+            tree_[b + numBlocks_] = scan(data, b * BLOCK_SIZE, std::min(capacity_, (b + 1) * BLOCK_SIZE));
+        }
+        for (int node = numBlocks_ - 1; node >= 1; --node) {
+            tree_[node] = tree_[2 * node];
+            tree_[node].merge(tree_[2 * node + 1]);
+        }
+    }
+
+    // 物理インデックス [first, last) の集計 (折り返しは呼び出し側で分割すること)
+    template <typename Column>
+    [[nodiscard]] RangeStats query(const Column& data, int first, int last) const noexcept {
+        RangeStats result;
+        first = std::max(first, 0);
+        last = std::min(last, capacity_);
+        if (first >= last) return result;
+
+        const int firstBlock = (first + BLOCK_SIZE - 1) / BLOCK_SIZE; // 完全に含まれる最初のブロック
+        const int lastBlock = last / BLOCK_SIZE;                       // 完全に含まれるブロックの終端 (排他)
+        if (firstBlock >= lastBlock) {
+            return scan(data, first, last);
+        }
+
+        result = scan(data, first, firstBlock * BLOCK_SIZE);
+        // ブロック [firstBlock, lastBlock) をボトムアップで集計
+        for (int l = firstBlock + numBlocks_, r = lastBlock + numBlocks_; l < r; l >>= 1, r >>= 1) {
+            if (l & 1) result.merge(tree_[l++]);
+            if (r & 1) result.merge(tree_[--r]);
+        }
+        result.merge(scan(data, lastBlock * BLOCK_SIZE, last));
+        return result;
+    }
+
+private:
+    int capacity_ = 0;
+    int numBlocks_ = 0;
+    std::vector<RangeStats> tree_;
+
+    template <typename Column>
+    static RangeStats scan(const Column& data, int first, int last) noexcept {
+        RangeStats s;
+        for (int i = first; i < last; ++i) {
+            s.add(static_cast<double>(data[i]), i);
+        }
+        return s;
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_rangeIndex() {
+    std::cout << "--- RangeIndex Test Start ---" << std::endl;
+
+    const int capacity = 1000;
+    std::vector<double> data(capacity);
+    for (int i = 0; i < capacity; ++i) {
+        data[i] = std::sin(i * 0.37) * (1.0 + (i % 17));
+    }
+
+    RangeIndex index;
+    index.resize(capacity);
+    index.rebuild(data);
+
+    auto bruteForce = [&](int first, int last) {
+        RangeStats s;
+        for (int i = first; i < last; ++i) s.add(data[i], i);
+        return s;
+    };
+
+    // 端の半端ブロックと木をまたぐ様々な区間で総当たりと比較
+    const int ranges[][2] = { {0, 1000}, {0, 1}, {5, 60}, {63, 65}, {64, 128}, {10, 990}, {500, 501}, {129, 777} };
+    for (const auto& r : ranges) {
+        RangeStats a = index.query(data, r[0], r[1]);
+        RangeStats b = bruteForce(r[0], r[1]);
+        assert(a.count == b.count);
+        assert(a.min == b.min && a.max == b.max);
+        assert(data[a.minIdx] == b.min && data[a.maxIdx] == b.max);
+        assert(std::abs(a.sum - b.sum) < 1e-9);
+        assert(std::abs(a.sumSq - b.sumSq) < 1e-9);
+    }
+    std::cout << "  query vs brute force: OK" << std::endl;
+
+    // 点更新後の整合性
+    data[700] = 1e3;
+    index.update(data, 700);
+    data[3] = -1e3;
+    index.update(data, 3);
+    RangeStats all = index.query(data, 0, capacity);
+    assert(all.maxIdx == 700 && all.minIdx == 3);
+    std::cout << "  point update: OK" << std::endl;
+
+    std::cout << "RangeIndex Test Passed!" << std::endl;
+}
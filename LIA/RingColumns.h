@@ -0,0 +1,135 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+// ================================================================================
+// リングバッファの格納精度
+//   LIA_RINGBUFFER_FLOAT32 を定義すると X/Y を float で保持する。
+//   値は 16bit ADC 由来なので float の有効桁 (24bit) で足り、メモリと帯域は半分になる。
+//   時刻は「ブロックの double 基準値 + float オフセット」で保持し、
+//   基準値からの経過時間 (2ms x 1024点 = 約2s) に対して 1e-7 s 以下の分解能を保つ。
+// ================================================================================
+#ifdef LIA_RINGBUFFER_FLOAT32
+using RingSample = float;
+#else
+using RingSample = double;
+#endif
+
+// X/Y 列の組 (LiaConfig::XYs の要素型可変版)
+template <typename T>
+struct XYsT {
+    std::vector<T> x;
+    std::vector<T> y;
+    void resize(size_t newSize) { x.resize(newSize); y.resize(newSize); }
+};
+
+// ================================================================================
+// TimeColumn: 時刻列
+//   T = double: 従来通り double の配列 (data() で生ポインタを渡せる)
+//   T = float : BLOCK_SIZE 点ごとの double 基準値 + float オフセット
+//   書き込みはブロック先頭から順に行う前提。リングが一周してブロックを上書きしている
+//   途中は、まだ上書きされていない点を1周前の基準値で読む (基準値はブロックごとに2つ)
+// ================================================================================
+template <typename T>
+class TimeColumn {
+public:
+    using value_type = T;
+    static constexpr int BLOCK_SIZE = 1024;
+    static constexpr bool IS_PLAIN = std::is_same_v<T, double>;
+
+    void resize(size_t newSize) {
+        values_.resize(newSize);
+        if constexpr (!IS_PLAIN) blocks_.assign((newSize + BLOCK_SIZE - 1) / BLOCK_SIZE, Block());
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return values_.size(); }
+
+    [[nodiscard]] double operator[](size_t idx) const noexcept {
+        if constexpr (IS_PLAIN) return values_[idx];
+        else {
+            const Block& b = blocks_[idx / BLOCK_SIZE];
+            return (idx % BLOCK_SIZE < b.filled ? b.base : b.prevBase) + static_cast<double>(values_[idx]);
+        }
+    }
+
+    void set(size_t idx, double t) noexcept {
+        if constexpr (IS_PLAIN) {
+            values_[idx] = t;
+        }
+        else {
+            Block& b = blocks_[idx / BLOCK_SIZE];
+            const size_t pos = idx % BLOCK_SIZE;
+            if (pos == 0) {
+                b.prevBase = b.base;
+                b.base = t;
+            }
+            values_[idx] = static_cast<T>(t - b.base);
+            b.filled = pos + 1;
+        }
+    }
+
+    // double 格納時のみ生ポインタを公開する (ImPlot にそのまま渡す用途)
+    [[nodiscard]] const double* data() const noexcept requires IS_PLAIN { return values_.data(); }
+
+private:
+    struct Block {
+        double base = 0.0;     // 今の周回の基準値 (ブロック先頭の時刻)
+        double prevBase = 0.0; // 1周前の基準値 (filled 以降の点に使う)
+        size_t filled = 0;     // 今の周回で書き込んだ点数
+    };
+    std::vector<T> values_;
+    std::vector<Block> blocks_; // float 格納時のみ使用
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_ringColumns() {
+    std::cout << "--- RingColumns Test Start ---" << std::endl;
+
+    // 長時間測定 (約10時間) 後の時刻でも 2ms 刻みが十分な精度で復元できること
+    const int capacity = 3000;
+    const double t0 = 36000.0, dt = 2e-3;
+    TimeColumn<float> times;
+    times.resize(capacity);
+    for (int n = 0; n < 2 * capacity; ++n) {
+        times.set(n % capacity, t0 + n * dt);
+    }
+    double maxErr = 0.0;
+    for (int i = 0; i < capacity; ++i) {
+        const double expected = t0 + (capacity + i) * dt;
+        maxErr = std::max(maxErr, std::abs(times[i] - expected));
+    }
+    assert(maxErr < 1e-6);
+    std::cout << "  float time column max error: " << maxErr << " s" << std::endl;
+
+    // ブロックの途中まで上書きした状態: 古い点も正しい時刻で、リング順に単調増加
+    const int written = capacity + capacity / 2 + 7;
+    TimeColumn<float> partial;
+    partial.resize(capacity);
+    for (int n = 0; n < written; ++n) partial.set(n % capacity, n * dt);
+    maxErr = 0.0;
+    double prev = -1.0;
+    for (int k = 0; k < capacity; ++k) {
+        const int n = written - capacity + k; // 古い順
+        const double t = partial[n % capacity];
+        assert(t > prev);
+        prev = t;
+        maxErr = std::max(maxErr, std::abs(t - n * dt));
+    }
+    assert(maxErr < 1e-6);
+    std::cout << "  partially overwritten ring: monotonic, max error " << maxErr << " s" << std::endl;
+
+    TimeColumn<double> plain;
+    plain.resize(4);
+    plain.set(3, t0);
+    assert(plain[3] == t0 && plain.data()[3] == t0);
+    std::cout << "  double time column: OK" << std::endl;
+
+    std::cout << "RingColumns Test Passed!" << std::endl;
+}
@@ -0,0 +1,153 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+// ================================================================================
+// SeqNotifier: 測定点の通し番号 (seq) と、それを待つスレッドの起床
+//   - advance() は測定スレッドから1点ごとに呼ぶ。待つ側がいなければ atomic の読み出し2回で戻る
+//   - 待つ側が登録した最小の目標 seq に届いたときだけ起こす (1点ごとには起こさない)
+//   - seq 以外の状態 (設定の適用・測定の開始/終了など) を変えた側は notifyAll() を呼ぶ
+//   - interrupt() は待っているスレッドをすべて false で戻す (終了処理用)
+// ================================================================================
+class SeqNotifier {
+public:
+    static constexpr uint64_t NO_TARGET = std::numeric_limits<uint64_t>::max(); // seq に依らない条件
+
+    // これまでに確定した点の数 (次の点の seq)
+    [[nodiscard]] uint64_t seq() const noexcept { return seq_.load(); }
+
+    // 測定スレッドから1点ごとに呼ぶ (点のデータを書き終えてから)
+    void advance() noexcept {
+        const uint64_t s = seq_.fetch_add(1) + 1;
+        if (waiters_.load() != 0 && s >= wakeAt_.load()) notifyAll();
+    }
+
+    void notifyAll() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            wakeAt_.store(NO_TARGET); // 起きた側が目標を登録し直す
+            ++wakeups_;
+        }
+        cv_.notify_all();
+    }
+
+    void interrupt() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            ++epoch_;
+        }
+        notifyAll();
+    }
+
+    // pred() が true になるまで待つ。timeoutSec < 0 なら時間切れなし
+    // target は pred() が true になり得る最小の seq (seq に依らない条件なら NO_TARGET)
+    // 時間切れ・interrupt() なら false
+    template <class Pred>
+    bool wait(Pred&& pred, uint64_t target = NO_TARGET, double timeoutSec = -1.0) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(std::max(timeoutSec, 0.0)));
+        std::unique_lock<std::mutex> lock(mtx_);
+        const uint64_t epoch = epoch_;
+        waiters_.fetch_add(1);
+        bool ok = false;
+        while (true) {
+            // 目標を登録してから条件を見る (advance() は seq を進めてから目標を見るので取りこぼさない)
+            for (uint64_t w = wakeAt_.load(); target < w && !wakeAt_.compare_exchange_weak(w, target); ) {}
+            if (pred()) { ok = true; break; }
+            if (epoch_ != epoch) break;
+            if (timeoutSec < 0.0) cv_.wait(lock);
+            else if (cv_.wait_until(lock, deadline) == std::cv_status::timeout) { ok = pred(); break; }
+        }
+        waiters_.fetch_sub(1);
+        return ok;
+    }
+
+    bool waitUntilSeq(uint64_t s, double timeoutSec = -1.0) {
+        return wait([&] { return seq() >= s; }, s, timeoutSec);
+    }
+
+    // 今から n 点が新たに確定するまで待つ
+    bool waitForPoints(uint64_t n, double timeoutSec = -1.0) {
+        return waitUntilSeq(seq() + n, timeoutSec);
+    }
+
+    // 待っているスレッドを起こした回数
+    [[nodiscard]] uint64_t wakeups() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return wakeups_;
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::atomic<uint64_t> seq_{ 0 };
+    std::atomic<uint64_t> wakeAt_{ NO_TARGET }; // 待っている側の最小の目標 seq
+    std::atomic<int> waiters_{ 0 };
+    uint64_t epoch_ = 0;   // interrupt() のたびに増える
+    uint64_t wakeups_ = 0;
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_seqNotifier() {
+    std::cout << "--- SeqNotifier Test Start ---" << std::endl;
+
+    // 目標 seq ちょうどで起きる。途中の点では起こさない
+    {
+        SeqNotifier n;
+        constexpr uint64_t POINTS = 2000, TARGET = 1500;
+        std::atomic<uint64_t> seenAt{ 0 };
+        std::jthread waiter([&] {
+            assert(n.waitUntilSeq(TARGET, 10.0));
+            seenAt = n.seq();
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(5)); // 待ち始めてから進める (間に合わなくても結果は同じ)
+        for (uint64_t i = 0; i < POINTS; ++i) {
+            n.advance();
+            if (i % 64 == 0) std::this_thread::yield();
+        }
+        waiter.join();
+        assert(seenAt >= TARGET);
+        assert(n.wakeups() <= 1); // 目標に届いたときの1回だけ
+        std::cout << "  waitUntilSeq(" << TARGET << "): woke at seq " << seenAt << " after " << n.wakeups()
+            << " notification(s) for " << POINTS << " points" << std::endl;
+    }
+
+    // 時間切れ・interrupt()・seq 以外の条件
+    {
+        SeqNotifier n;
+        const auto t0 = std::chrono::steady_clock::now();
+        assert(!n.waitForPoints(1, 0.02));
+        assert(std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(20));
+
+        std::atomic<bool> waiting{ false };
+        std::jthread waiter([&] {
+            waiting = true;
+            assert(!n.waitForPoints(1, 10.0)); // interrupt() で時間切れより先に戻る
+            });
+        while (!waiting) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        n.interrupt();
+        waiter.join();
+
+        std::atomic<bool> flag{ false };
+        std::jthread setter([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            flag = true;
+            n.notifyAll();
+            });
+        assert(n.wait([&] { return flag.load(); }, SeqNotifier::NO_TARGET, 10.0));
+    }
+    std::cout << "  timeout, interrupt, predicate: OK" << std::endl;
+
+    std::cout << "SeqNotifier Test Passed!" << std::endl;
+}
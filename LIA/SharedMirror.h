@@ -0,0 +1,354 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ================================================================================
+// SharedMemoryRegion: 名前付き共有メモリの作成 (読み書き) と参照 (読み取り専用)
+//   Windows: CreateFileMapping / OpenFileMapping (名前はそのまま)
+//   POSIX  : shm_open ("/" + 名前) + mmap。作成側が破棄時に shm_unlink する
+// ================================================================================
+class SharedMemoryRegion {
+public:
+    SharedMemoryRegion() = default;
+    SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+    SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+    ~SharedMemoryRegion() { close(); }
+
+    bool create(const std::string& name, size_t bytes) {
+        close();
+#ifdef _WIN32
+        handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            static_cast<DWORD>(static_cast<uint64_t>(bytes) >> 32), static_cast<DWORD>(bytes), name.c_str());
+        if (handle_ == nullptr) return false;
+        if (GetLastError() == ERROR_ALREADY_EXISTS) { // 他の LIA が使用中
+            close();
+            return false;
+        }
+        data_ = MapViewOfFile(handle_, FILE_MAP_WRITE, 0, 0, bytes);
+#else
+        const std::string path = "/" + name;
+        shm_unlink(path.c_str()); // 異常終了した前回の残り
+        const int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) return false;
+        unlinkPath_ = path;
+        void* p = (ftruncate(fd, static_cast<off_t>(bytes)) == 0) ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        data_ = (p == MAP_FAILED) ? nullptr : p;
+#endif
+        size_ = bytes;
+        if (data_ == nullptr) close();
+        return data_ != nullptr;
+    }
+
+    bool openReadOnly(const std::string& name) {
+        close();
+#ifdef _WIN32
+        handle_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+        if (handle_ == nullptr) return false;
+        data_ = MapViewOfFile(handle_, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info{};
+        if (data_ != nullptr && VirtualQuery(data_, &info, sizeof(info)) != 0) size_ = info.RegionSize;
+#else
+        const int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st {};
+        void* p = (fstat(fd, &st) == 0 && st.st_size > 0) ? mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        data_ = (p == MAP_FAILED) ? nullptr : p;
+        size_ = static_cast<size_t>(st.st_size);
+#endif
+        if (data_ == nullptr) close();
+        return data_ != nullptr;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (handle_ != nullptr) CloseHandle(handle_);
+        handle_ = nullptr;
+#else
+        if (data_ != nullptr) munmap(data_, size_);
+        if (!unlinkPath_.empty()) shm_unlink(unlinkPath_.c_str());
+        unlinkPath_.clear();
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    [[nodiscard]] void* data() const { return data_; }
+    [[nodiscard]] size_t size() const { return size_; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE handle_ = nullptr;
+#else
+    std::string unlinkPath_;
+#endif
+};
+
+// ================================================================================
+// 共有メモリ上の配置 (リトルエンディアン、他言語から読むためオフセットを固定する)
+//    0: magic "LIAMIRR\0"      8: version (u32)     12: headerBytes (u32)
+//   16: capacity (u64)        24: numColumns (u32)
+//   64: sequence (u64, seqlock)
+//   headerBytes から double の列 t, x1, y1, x2, y2 を capacity 点ずつ並べる
+//   通し番号 n の点は各列の n % capacity 番目
+//
+// sequence は点を書く前に奇数、書いた後に偶数へ進める (書き終えた点数 = sequence / 2)
+// 読み出し側は sequence → 列 → sequence の順に読み、2回目の値 s から
+// (s + 1) / 2 - capacity 番より古い点は上書き中の可能性があるとして捨てる
+// ================================================================================
+struct SharedMirrorHeader {
+    static constexpr char MAGIC[8] = "LIAMIRR";
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t NUM_COLUMNS = 5;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    uint64_t capacity;
+    uint32_t numColumns;
+    uint32_t reserved;
+    alignas(64) std::atomic<uint64_t> sequence;
+
+    // 通し番号 [oldestValid(s), s / 2) の点が読める
+    static uint64_t oldestValid(uint64_t s, uint64_t capacity) {
+        const uint64_t begun = (s + 1) / 2;
+        return (begun > capacity) ? begun - capacity : 0;
+    }
+};
+static_assert(offsetof(SharedMirrorHeader, capacity) == 16 && offsetof(SharedMirrorHeader, sequence) == 64);
+static_assert(sizeof(SharedMirrorHeader) == 128 && std::atomic<uint64_t>::is_always_lock_free);
+
+// ================================================================================
+// SharedMirrorWriter: 測定点を共有メモリへ書く (測定スレッドから1点ごとに publish)
+//   システムコールもロックもなく、他プロセスの読み出しを待たない
+// ================================================================================
+class SharedMirrorWriter {
+public:
+    SharedMirrorWriter(const std::string& name, size_t capacity) {
+        capacity_ = std::bit_ceil(std::max<size_t>(capacity, 2));
+        const size_t bytes = sizeof(SharedMirrorHeader) + SharedMirrorHeader::NUM_COLUMNS * capacity_ * sizeof(double);
+        if (!region_.create(name, bytes)) {
+            std::cerr << "Error: Could not create shared memory " << name << "\n";
+            return;
+        }
+        header_ = new (region_.data()) SharedMirrorHeader{};
+        header_->version = SharedMirrorHeader::VERSION;
+        header_->headerBytes = sizeof(SharedMirrorHeader);
+        header_->capacity = capacity_;
+        header_->numColumns = SharedMirrorHeader::NUM_COLUMNS;
+        header_->sequence.store(0, std::memory_order_relaxed);
+        columns_ = reinterpret_cast<double*>(static_cast<char*>(region_.data()) + sizeof(SharedMirrorHeader));
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header_->magic, SharedMirrorHeader::MAGIC, sizeof(header_->magic)); // 最後に書いて準備完了を示す
+    }
+
+    [[nodiscard]] bool valid() const { return header_ != nullptr; }
+    [[nodiscard]] size_t capacity() const { return capacity_; }
+
+    void publish(double t, double x1, double y1, double x2, double y2) noexcept {
+        const double values[SharedMirrorHeader::NUM_COLUMNS] = { t, x1, y1, x2, y2 };
+        const size_t slot = static_cast<size_t>(sequence_ / 2) & (capacity_ - 1);
+        header_->sequence.store(sequence_ + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // 奇数の sequence が列より先に見える
+        for (size_t c = 0; c < SharedMirrorHeader::NUM_COLUMNS; ++c) {
+            std::atomic_ref<double>(columns_[c * capacity_ + slot]).store(values[c], std::memory_order_relaxed);
+        }
+        sequence_ += 2;
+        header_->sequence.store(sequence_, std::memory_order_release);
+    }
+
+private:
+    SharedMemoryRegion region_;
+    SharedMirrorHeader* header_ = nullptr;
+    double* columns_ = nullptr;
+    size_t capacity_ = 0;
+    uint64_t sequence_ = 0; // 測定スレッドのみが更新する
+};
+
+// ================================================================================
+// SharedMirrorReader: 参照実装の読み出し側 (別プロセスから読み取り専用で開く)
+//   read() はカーソル以降の点を行単位 (t, x1, y1, x2, y2) で写す。読み出しにシステムコールは使わない
+// ================================================================================
+class SharedMirrorReader {
+public:
+    bool open(const std::string& name) {
+        header_ = nullptr;
+        if (!region_.openReadOnly(name) || region_.size() < sizeof(SharedMirrorHeader)) return false;
+        const auto* h = static_cast<const SharedMirrorHeader*>(region_.data());
+        if (std::memcmp(h->magic, SharedMirrorHeader::MAGIC, sizeof(h->magic)) != 0 || h->version != SharedMirrorHeader::VERSION ||
+            h->numColumns != SharedMirrorHeader::NUM_COLUMNS ||
+            region_.size() < h->headerBytes + h->numColumns * h->capacity * sizeof(double)) {
+            region_.close();
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        header_ = h;
+        columns_ = reinterpret_cast<const double*>(static_cast<const char*>(region_.data()) + h->headerBytes);
+        return true;
+    }
+
+    [[nodiscard]] bool valid() const { return header_ != nullptr; }
+    [[nodiscard]] uint64_t capacity() const { return header_->capacity; }
+    // 書き終えた点数 (次に書かれる点の通し番号)
+    [[nodiscard]] uint64_t written() const { return header_->sequence.load(std::memory_order_acquire) / 2; }
+
+    // cursor 以降の点を最大 maxPoints 点 out (1点 NUM_COLUMNS 個) に写し、点数を返す
+    // 上書きされて読めなかった点は飛ばし、その数を skipped に足す
+    size_t read(uint64_t& cursor, double* out, size_t maxPoints, uint64_t* skipped = nullptr) const {
+        constexpr size_t C = SharedMirrorHeader::NUM_COLUMNS;
+        const uint64_t capacity = header_->capacity;
+        while (true) {
+            const uint64_t s1 = header_->sequence.load(std::memory_order_acquire);
+            const uint64_t begin = std::max(cursor, SharedMirrorHeader::oldestValid(s1, capacity));
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(maxPoints, s1 / 2 - std::min(begin, s1 / 2)));
+            for (size_t i = 0; i < n; ++i) {
+                const size_t slot = static_cast<size_t>((begin + i) & (capacity - 1));
+                for (size_t c = 0; c < C; ++c) {
+                    out[i * C + c] = std::atomic_ref<double>(const_cast<double&>(columns_[c * capacity + slot])).load(std::memory_order_relaxed);
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint64_t s2 = header_->sequence.load(std::memory_order_relaxed);
+            if (begin < SharedMirrorHeader::oldestValid(s2, capacity)) continue; // 写している間に追い越された
+            if (skipped != nullptr) *skipped += begin - std::min(cursor, begin);
+            cursor = begin + n;
+            return n;
+        }
+    }
+
+private:
+    SharedMemoryRegion region_;
+    const SharedMirrorHeader* header_ = nullptr;
+    const double* columns_ = nullptr;
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_sharedMirror() {
+    std::cout << "--- SharedMirror Test Start ---" << std::endl;
+    const std::string name = "LIA_mirror_test";
+
+    {
+        SharedMirrorWriter writer(name, 1000);
+        assert(writer.valid() && writer.capacity() == 1024);
+        SharedMirrorReader reader;
+        assert(reader.open(name) && reader.capacity() == 1024);
+
+        for (int i = 0; i < 3000; ++i) writer.publish(i, i, -i, 2 * i, 0);
+        std::vector<double> rows(2048 * SharedMirrorHeader::NUM_COLUMNS);
+        uint64_t cursor = 0, skipped = 0;
+        assert(reader.read(cursor, rows.data(), 2048, &skipped) == 1024);
+        assert(skipped == 3000 - 1024 && cursor == 3000);
+        assert(rows[0] == 3000 - 1024 && rows[2] == -(3000 - 1024.0) && rows[1023 * 5 + 3] == 2 * 2999.0);
+        assert(reader.read(cursor, rows.data(), 2048) == 0);
+        writer.publish(3000, 0, 0, 0, 0);
+        assert(reader.read(cursor, rows.data(), 2048) == 1 && rows[0] == 3000.0);
+    }
+    {
+        SharedMirrorReader reader;
+        assert(!reader.open(name)); // 書き込み側の破棄で消える
+    }
+    std::cout << "  layout / cursor / overwrite accounting: OK" << std::endl;
+
+    // 書き込み中の読み出しで、破れた行・重複・順序の乱れが起きない
+    {
+        SharedMirrorWriter writer(name, 256);
+        SharedMirrorReader reader;
+        assert(reader.open(name));
+        constexpr uint64_t N = 2000000;
+        std::jthread producer([&] {
+            for (uint64_t i = 0; i < N; ++i) writer.publish(static_cast<double>(i), i * 0.5, -static_cast<double>(i), i + 1.0, i * 2.0);
+            });
+        std::vector<double> rows(64 * SharedMirrorHeader::NUM_COLUMNS);
+        uint64_t cursor = 0, skipped = 0, received = 0;
+        double last = -1.0;
+        while (cursor < N) {
+            const size_t n = reader.read(cursor, rows.data(), 64, &skipped);
+            for (size_t i = 0; i < n; ++i) {
+                const double* r = &rows[i * 5];
+                assert(r[1] == r[0] * 0.5 && r[2] == -r[0] && r[3] == r[0] + 1.0 && r[4] == r[0] * 2.0);
+                assert(r[0] > last);
+                last = r[0];
+            }
+            received += n;
+        }
+        assert(received + skipped == N);
+    }
+    std::cout << "  concurrent seqlock reads (no torn rows): OK" << std::endl;
+
+    std::cout << "SharedMirror Test Passed!" << std::endl;
+}
+
+// 書き込み (publish) から別マッピングの読み出し側が観測するまでの遅延
+void bench_sharedMirror(int points = 20000) {
+    const std::string name = "LIA_mirror_bench";
+    SharedMirrorWriter writer(name, 65536);
+    SharedMirrorReader reader;
+    if (!writer.valid() || !reader.open(name)) return;
+
+    // 1点ずつ書き、読み出し側が観測した時刻との差を記録する
+    using Clock = std::chrono::steady_clock;
+    const auto origin = Clock::now();
+    auto now = [origin] { return std::chrono::duration<double>(Clock::now() - origin).count(); };
+    std::vector<double> latencies(points);
+    std::atomic<uint64_t> observed{ 0 };
+    std::jthread consumer([&] {
+        uint64_t cursor = 0;
+        double row[SharedMirrorHeader::NUM_COLUMNS];
+        while (cursor < static_cast<uint64_t>(points)) {
+            if (reader.read(cursor, row, 1) == 0) { // 他プロセスと同じく sequence を見て回る
+                std::this_thread::yield();
+                continue;
+            }
+            latencies[cursor - 1] = now() - row[0];
+            observed.store(cursor, std::memory_order_release);
+        }
+        });
+    for (int i = 0; i < points; ++i) {
+        writer.publish(now(), i, 0, 0, 0);
+        while (observed.load(std::memory_order_acquire) != static_cast<uint64_t>(i + 1)) std::this_thread::yield();
+    }
+    consumer.join();
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double l : latencies) sum += l;
+    std::cout << "  SharedMirror publish -> observe latency: mean " << sum / points * 1e6 << " us, p99 "
+        << latencies[points * 99 / 100] * 1e6 << " us, max " << latencies.back() * 1e6 << " us" << std::endl;
+
+    // 他プロセスが満杯のリングを一括で読む速さ
+    for (size_t i = points; i < writer.capacity(); ++i) writer.publish(static_cast<double>(i), 0, 0, 0, 0);
+    std::vector<double> rows(writer.capacity() * SharedMirrorHeader::NUM_COLUMNS);
+    const auto start = Clock::now();
+    size_t total = 0;
+    for (int r = 0; r < 20; ++r) {
+        uint64_t cursor = 0;
+        total += reader.read(cursor, rows.data(), writer.capacity());
+    }
+    const double sec = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "  SharedMirror bulk read: " << total / sec / 1e6 << " M points/s" << std::endl;
+}
@@ -0,0 +1,402 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numbers>
+#include <tuple>
+#include <vector>
+
+// ================================================================================
+// SignalSynth: 負荷試験用の合成波形 (参照信号に同期した正弦波 + 高調波・DC・雑音・ドリフト・欠陥・ADC)
+//   - 正弦波は LANES 本の回転子を並べた漸化式で作り (1サンプル = 乗算4・加算2)、sin/cos は
+//     フレームごとに LANES 回だけ呼ぶ。内側のループは LANES 幅の配列演算なのでコンパイラが SIMD 化する
+//   - 白色雑音は レーンごとの xorshift128 (32bit) から作る近似ガウス分布 (16bit 一様乱数4個の和)
+//   - 1/f 雑音は白色雑音を Paul Kellet のフィルタに通したもの。フレームを LANES 本の連続区間に分け、
+//     区間ごとのフィルタを並べて回す (区間の境目はつながらないが、フィルタの時定数は区間より短い)
+//   - 振幅・位相の変化 (ドリフト・欠陥) はフレームの時刻で1回だけ評価する (フレーム内では一定)
+//   - generate() は1つのスレッドから呼ぶ
+// ================================================================================
+class SignalSynth {
+public:
+    static constexpr int LANES = 8;
+
+    struct Harmonic {
+        int order = 2;
+        double rel = 0.0;        // 基本波の振幅に対する比
+        double phaseDeg = 0.0;
+    };
+
+    // 時刻 t を中心とする幅 width (s) の窓 (raised cosine) で振幅と位相を変える (プローブが欠陥を通過する)
+    struct Defect {
+        double t = 0.0;
+        double width = 0.2;
+        double ampRel = 0.0;     // 中心での振幅の相対変化
+        double phaseDeg = 0.0;   // 中心での位相の変化
+    };
+
+    struct Channel {
+        double gain = 1.0;              // 参照信号の振幅に対する比 (1: W1 → CH1 の直結)
+        double phaseDeg = 0.0;
+        double offset = 0.0;            // DC (V)
+        std::vector<Harmonic> harmonics;
+        double noiseRms = 0.0;          // 白色雑音 (V rms)
+        double pinkRms = 0.0;           // 1/f 雑音 (V rms)
+        double gainDriftPerSec = 0.0;   // 振幅の相対変化 (/s)
+        double phaseDriftDegPerSec = 0.0;
+        double offsetDriftPerSec = 0.0; // V/s
+        std::vector<Defect> defects;
+        double range = 0.0;             // ±range で飽和させる (0 でしない)
+        int adcBits = 0;                // 2 x range を 2^adcBits 段に量子化する (0 でしない)
+    };
+
+    struct Params {
+        std::array<Channel, 2> ch;
+        uint64_t seed = 1;
+    };
+
+    // 参照信号 (AWG の設定)
+    struct Reference {
+        double amp = 1.0;
+        double freq = 100e3;
+        double phaseDeg = 0.0;
+    };
+
+    SignalSynth() : SignalSynth(Params{}) {}
+    explicit SignalSynth(const Params& params) { setParams(params); }
+
+    [[nodiscard]] const Params& params() const noexcept { return params_; }
+
+    void setParams(const Params& params) {
+        params_ = params;
+        for (int c = 0; c < 2; ++c) {
+            auto& st = state_[c];
+            uint64_t z = params.seed * 2 + c;
+            for (int l = 0; l < LANES; ++l) {
+                for (auto& w : st.x) w[l] = static_cast<uint32_t>(splitmix(z)) | 1u; // 全ゼロにしない
+            }
+            // 1/f 雑音を 1 V rms にする係数 (実際に流して測る)
+            std::vector<double> pink(1 << 16, 0.0), white(pink.size());
+            st.pinkScale = 1.0;
+            addPink(st, pink.data(), white.data(), static_cast<int>(pink.size()), 1.0);
+            double sum2 = 0.0;
+            for (double v : pink) sum2 += v * v;
+            st.pinkScale = 1.0 / std::sqrt(sum2 / pink.size());
+        }
+    }
+
+    // チャンネル c の時刻 t のフレームを n 点 out に書く (先頭のサンプルが参照信号の位相 0)
+    void generate(int c, double t, const Reference& ref, double samplingDt, double* __restrict out, int n) {
+        const Channel& ch = params_.ch[c];
+        auto& st = state_[c];
+
+        double amp = ref.amp * ch.gain * (1.0 + ch.gainDriftPerSec * t);
+        double phaseDeg = ref.phaseDeg + ch.phaseDeg + ch.phaseDriftDegPerSec * t;
+        for (const auto& d : ch.defects) {
+            const double x = (t - d.t) / d.width;
+            if (std::abs(x) >= 0.5) continue;
+            const double w = 0.5 * (1.0 + std::cos(2.0 * std::numbers::pi * x));
+            amp *= 1.0 + d.ampRel * w;
+            phaseDeg += d.phaseDeg * w;
+        }
+
+        std::fill(out, out + n, ch.offset + ch.offsetDriftPerSec * t);
+        const double phase = phaseDeg * (std::numbers::pi / 180.0);
+        const double dphi = 2.0 * std::numbers::pi * ref.freq * samplingDt;
+        addTone(out, n, amp, phase, dphi);
+        for (const auto& h : ch.harmonics) {
+            if (h.order * dphi >= std::numbers::pi) continue; // ナイキスト周波数以上
+            addTone(out, n, amp * h.rel, h.order * phase + h.phaseDeg * (std::numbers::pi / 180.0), h.order * dphi);
+        }
+
+        if (ch.noiseRms > 0.0 || ch.pinkRms > 0.0) {
+            scratch_.resize(n);
+            if (ch.noiseRms > 0.0) {
+                gaussian(st, scratch_.data(), n);
+                addScaled(out, scratch_.data(), n, ch.noiseRms);
+            }
+            if (ch.pinkRms > 0.0) addPink(st, out, scratch_.data(), n, ch.pinkRms);
+        }
+
+        if (ch.range > 0.0) {
+            const double step = (ch.adcBits > 0) ? 2.0 * ch.range / static_cast<double>(uint64_t{ 1 } << ch.adcBits) : 0.0;
+            adc(out, n, step, ch.range);
+        }
+    }
+
+private:
+    struct State {
+        alignas(32) uint32_t x[4][LANES] = {};       // xorshift128 の状態 (レーンごと)
+        alignas(32) double pink[3][LANES] = {};      // 1/f フィルタの状態 (区間ごと)
+        double pinkScale = 1.0;
+    };
+
+    Params params_;
+    std::array<State, 2> state_;
+    std::vector<double> scratch_;
+
+    static uint64_t splitmix(uint64_t& x) noexcept {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // out[i] += a sin(phase + i dphi)
+    static void addTone(double* __restrict out, int n, double a, double phase, double dphi) {
+        alignas(32) double c[LANES], s[LANES];
+        for (int l = 0; l < LANES; ++l) {
+            c[l] = a * std::cos(phase + l * dphi);
+            s[l] = a * std::sin(phase + l * dphi);
+        }
+        const double rc = std::cos(LANES * dphi), rs = std::sin(LANES * dphi);
+        const int blocks = n / LANES;
+        for (int b = 0; b < blocks; ++b) {
+            double* __restrict o = out + b * LANES;
+            for (int l = 0; l < LANES; ++l) {
+                o[l] += s[l];
+                const double cn = c[l] * rc - s[l] * rs;
+                s[l] = s[l] * rc + c[l] * rs;
+                c[l] = cn;
+            }
+        }
+        for (int l = 0; l < n - blocks * LANES; ++l) out[blocks * LANES + l] += s[l];
+    }
+
+    static void addScaled(double* __restrict out, const double* __restrict z, int n, double k) {
+        for (int i = 0; i < n; ++i) out[i] += k * z[i];
+    }
+
+    // step 刻みに丸めて ±range で飽和させる (step = 0 なら飽和だけ)
+    static void adc(double* __restrict out, int n, double step, double range) {
+        if (step > 0.0) {
+            const double inv = 1.0 / step;
+            for (int i = 0; i < n; ++i) out[i] = std::min(std::max(std::floor(out[i] * inv + 0.5) * step, -range), range);
+        }
+        else {
+            for (int i = 0; i < n; ++i) out[i] = std::min(std::max(out[i], -range), range);
+        }
+    }
+
+    // 平均 0・分散 1 の近似ガウス乱数 (16bit 一様乱数4個の和。裾は ±3.46σ で切れる)
+    // out[b * LANES + l] はレーン l の b 番目の値
+    static void gaussian(State& st, double* __restrict out, int n) {
+        constexpr double SCALE = 1.7320508075688772 / 65536.0; // sqrt(3) / 2^16 (一様乱数4個の和の分散は 4/12)
+        alignas(32) uint32_t x[4][LANES]; // レジスタに置けるよう局所変数で回す
+        std::copy(&st.x[0][0], &st.x[0][0] + 4 * LANES, &x[0][0]);
+        auto step = [&x](int l) {
+            const uint32_t t = x[0][l] ^ (x[0][l] << 11);
+            x[0][l] = x[1][l];
+            x[1][l] = x[2][l];
+            x[2][l] = x[3][l];
+            x[3][l] = x[3][l] ^ (x[3][l] >> 19) ^ t ^ (t >> 8);
+            return x[3][l];
+            };
+        const int blocks = (n + LANES - 1) / LANES;
+        alignas(32) double last[LANES];
+        for (int b = 0; b < blocks; ++b) {
+            double* __restrict o = (b + 1) * LANES <= n ? out + b * LANES : last;
+            for (int l = 0; l < LANES; ++l) {
+                const uint32_t r1 = step(l), r2 = step(l);
+                const int32_t sum = static_cast<int32_t>((r1 & 0xFFFF) + (r1 >> 16) + (r2 & 0xFFFF) + (r2 >> 16));
+                o[l] = (sum - 131070) * SCALE; // 平均 4 x 32767.5
+            }
+        }
+        for (int i = (n / LANES) * LANES; i < n; ++i) out[i] = last[i % LANES];
+        std::copy(&x[0][0], &x[0][0] + 4 * LANES, &st.x[0][0]);
+    }
+
+    // out += k x 1/f 雑音。z は作業領域 (n 点)
+    // 区間 l = out[l * m, (l + 1) * m) をレーン l のフィルタで作る (端数は最後の区間に続ける)
+    static void addPink(State& st, double* __restrict out, double* __restrict z, int n, double k) {
+        gaussian(st, z, n); // z[j * LANES + l] が区間 l の j 番目の入力
+        const int m = n / LANES;
+        alignas(32) double b0[LANES], b1[LANES], b2[LANES];
+        std::copy(st.pink[0], st.pink[0] + LANES, b0);
+        std::copy(st.pink[1], st.pink[1] + LANES, b1);
+        std::copy(st.pink[2], st.pink[2] + LANES, b2);
+        for (int j = 0; j < m; ++j) {
+            double* __restrict w = z + j * LANES;
+            for (int l = 0; l < LANES; ++l) {
+                b0[l] = 0.99765 * b0[l] + w[l] * 0.0990460;
+                b1[l] = 0.96300 * b1[l] + w[l] * 0.2965164;
+                b2[l] = 0.57000 * b2[l] + w[l] * 1.0526913;
+                w[l] = b0[l] + b1[l] + b2[l] + w[l] * 0.1848;
+            }
+        }
+        const double kk = k * st.pinkScale;
+        for (int l = 0; l < LANES; ++l) {
+            double* __restrict o = out + l * m;
+            for (int j = 0; j < m; ++j) o[j] += kk * z[j * LANES + l];
+        }
+        constexpr int L = LANES - 1;
+        for (int i = m * LANES; i < n; ++i) {
+            const double w = z[i];
+            b0[L] = 0.99765 * b0[L] + w * 0.0990460;
+            b1[L] = 0.96300 * b1[L] + w * 0.2965164;
+            b2[L] = 0.57000 * b2[L] + w * 1.0526913;
+            out[i] += kk * (b0[L] + b1[L] + b2[L] + w * 0.1848);
+        }
+        std::copy(b0, b0 + LANES, st.pink[0]);
+        std::copy(b1, b1 + LANES, st.pink[1]);
+        std::copy(b2, b2 + LANES, st.pink[2]);
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+namespace signal_synth_test {
+    // out と sin(phase + i dphi) の相関から振幅と位相を求める (整数周期のとき正確)
+    inline std::pair<double, double> demodulate(const std::vector<double>& v, double dphi) {
+        double x = 0.0, y = 0.0;
+        for (size_t i = 0; i < v.size(); ++i) {
+            x += v[i] * std::sin(i * dphi);
+            y += v[i] * std::cos(i * dphi);
+        }
+        x *= 2.0 / v.size();
+        y *= 2.0 / v.size();
+        return { std::hypot(x, y), std::atan2(y, x) * 180.0 / std::numbers::pi };
+    }
+
+    inline double rms(const std::vector<double>& v, double mean = 0.0) {
+        double s = 0.0;
+        for (double x : v) s += (x - mean) * (x - mean);
+        return std::sqrt(s / v.size());
+    }
+}
+
+void test_signalSynth() {
+    std::cout << "--- SignalSynth Test Start ---" << std::endl;
+    using namespace signal_synth_test;
+    constexpr int N = 10000;
+    constexpr double DT = 1e-8;                    // 100 MHz
+    const SignalSynth::Reference ref{ 1.0, 100e3, 0.0 }; // 1フレームにちょうど10周期
+    const double dphi = 2.0 * std::numbers::pi * ref.freq * DT;
+    std::vector<double> v(N);
+
+    // 漸化式の正弦波は sin() と一致する
+    {
+        SignalSynth synth;
+        synth.generate(0, 0.0, { 0.7, 123.4e3, 30.0 }, DT, v.data(), N - 3); // LANES の倍数でない長さ
+        double err = 0.0;
+        for (int i = 0; i < N - 3; ++i) err = std::max(err, std::abs(v[i] - 0.7 * std::sin(30.0 * std::numbers::pi / 180.0 + i * 2.0 * std::numbers::pi * 123.4e3 * DT)));
+        assert(err < 1e-9);
+        std::cout << "  oscillator vs std::sin: max error " << err << std::endl;
+    }
+
+    // 高調波・DC・ドリフト・欠陥
+    {
+        SignalSynth::Params p;
+        p.ch[0].gain = 0.5;
+        p.ch[0].offset = 0.1;
+        p.ch[0].harmonics = { { 3, 0.2, 0.0 } };
+        p.ch[0].phaseDriftDegPerSec = 10.0;
+        p.ch[0].defects = { { 5.0, 1.0, 0.5, 40.0 } };
+        SignalSynth synth(p);
+
+        synth.generate(0, 2.0, ref, DT, v.data(), N); // 欠陥の窓の外
+        double mean = 0.0;
+        for (double x : v) mean += x / N;
+        auto [a1, ph1] = demodulate(v, dphi);
+        auto [a3, ph3] = demodulate(v, 3.0 * dphi);
+        assert(std::abs(mean - 0.1) < 1e-9 && std::abs(a1 - 0.5) < 1e-9 && std::abs(a3 - 0.1) < 1e-9);
+        assert(std::abs(ph1 - 20.0) < 1e-6); // 10 deg/s x 2 s
+
+        synth.generate(0, 5.0, ref, DT, v.data(), N); // 欠陥の中心
+        std::tie(a1, ph1) = demodulate(v, dphi);
+        assert(std::abs(a1 - 0.75) < 1e-9 && std::abs(ph1 - 90.0) < 1e-6);
+    }
+    std::cout << "  harmonics, offset, drift, defect: OK" << std::endl;
+
+    // 雑音の大きさ
+    {
+        SignalSynth::Params p;
+        p.ch[0].gain = 0.0;
+        p.ch[0].noiseRms = 0.01;
+        p.ch[1].gain = 0.0;
+        p.ch[1].pinkRms = 0.01;
+        SignalSynth synth(p);
+        double white = 0.0, pink = 0.0, mean = 0.0;
+        constexpr int FRAMES = 20;
+        for (int k = 0; k < FRAMES; ++k) {
+            synth.generate(0, 0.0, ref, DT, v.data(), N);
+            for (double x : v) mean += x / (N * FRAMES);
+            white += rms(v) / FRAMES;
+            synth.generate(1, 0.0, ref, DT, v.data(), N);
+            pink += rms(v) * rms(v) / FRAMES;
+        }
+        pink = std::sqrt(pink);
+        assert(std::abs(white - 0.01) < 3e-4 && std::abs(mean) < 1e-4);
+        assert(std::abs(pink - 0.01) < 2e-3); // 低周波成分が大きいので短い区間ではばらつく
+        std::cout << "  noise rms: white " << white << " V, pink " << pink << " V (0.01 V set)" << std::endl;
+    }
+
+    // ADC の量子化と飽和
+    {
+        SignalSynth::Params p;
+        p.ch[0].gain = 2.0;
+        p.ch[0].range = 1.0;
+        p.ch[0].adcBits = 8;
+        SignalSynth synth(p);
+        synth.generate(0, 0.0, ref, DT, v.data(), N);
+        const double step = 2.0 / 256;
+        const auto [lo, hi] = std::minmax_element(v.begin(), v.end());
+        assert(*lo == -1.0 && *hi == 1.0);
+        for (double x : v) assert(std::abs(x / step - std::round(x / step)) < 1e-9);
+    }
+    std::cout << "  ADC quantization and clipping: OK" << std::endl;
+
+    std::cout << "SignalSynth Test Passed!" << std::endl;
+}
+
+// 2ch x 10000 点のフレームを作る時間: std::sin で作る場合と比べ、2 ms 周期の何倍速か
+void bench_signalSynth() {
+    constexpr int N = 10000, FRAMES = 500;
+    constexpr double DT = 1e-8, PERIOD = 2e-3;
+    std::cout << "--- SignalSynth Benchmark (2ch x " << N << " samples/frame) ---" << std::endl;
+    std::vector<double> ch1(N), ch2(N);
+    volatile double sink = 0.0; // 最適化で消されないように使う
+    auto measure = [&](auto&& makeFrame) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int k = 0; k < FRAMES; ++k) {
+            makeFrame(k * PERIOD);
+            sink = sink + ch1[k % N] + ch2[k % N];
+        }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / FRAMES;
+        };
+
+    const double legacy = measure([&](double t) {
+        const double phaseShift = 2.0 * std::numbers::pi * t / 60.0;
+        for (int i = 0; i < N; ++i) {
+            const double wt = 2.0 * std::numbers::pi * 100e3 * i * DT;
+            ch1[i] = std::sin(wt - phaseShift);
+            ch2[i] = 0.5 * std::sin(wt - 0.3);
+        }
+        });
+
+    SignalSynth::Params p;
+    p.ch[0].phaseDriftDegPerSec = -6.0;
+    p.ch[0].harmonics = { { 2, 0.01, 0.0 }, { 3, 0.02, 0.0 } };
+    p.ch[0].defects = { { 0.5, 0.2, 0.3, 20.0 } };
+    for (auto& ch : p.ch) {
+        ch.offset = 1e-3;
+        ch.noiseRms = 1e-3;
+        ch.pinkRms = 1e-3;
+        ch.range = 2.5;
+        ch.adcBits = 14;
+    }
+    SignalSynth synth(p);
+    const double full = measure([&](double t) {
+        synth.generate(0, t, { 1.0, 100e3, 0.0 }, DT, ch1.data(), N);
+        synth.generate(1, t, { 0.5, 100e3, -0.3 }, DT, ch2.data(), N);
+        });
+
+    std::cout << "  std::sin (clean)              : " << legacy * 1e6 << " us/frame (" << PERIOD / legacy << "x real time)" << std::endl;
+    std::cout << "  SignalSynth (noise, pink, harmonics, defect, ADC): " << full * 1e6 << " us/frame (" << PERIOD / full << "x real time)" << std::endl;
+    if (PERIOD / full < 10.0) std::cout << "  warning: below 10x real time" << std::endl;
+}
@@ -0,0 +1,641 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#include "pipe.h"
+
+// ================================================================================
+// ソケットの OS 差分
+// ================================================================================
+namespace net {
+#ifdef _WIN32
+    using Socket = SOCKET;
+    constexpr Socket INVALID = INVALID_SOCKET;
+    inline void closeSocket(Socket s) { closesocket(s); }
+    inline int pollSockets(pollfd* fds, size_t n, int timeoutMs) { return WSAPoll(fds, static_cast<ULONG>(n), timeoutMs); }
+    inline void setNonBlocking(Socket s) {
+        u_long mode = 1;
+        ioctlsocket(s, FIONBIO, &mode);
+    }
+    inline bool wouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+    constexpr int SHUTDOWN_SEND = SD_SEND;
+#else
+    using Socket = int;
+    constexpr Socket INVALID = -1;
+    inline void closeSocket(Socket s) { ::close(s); }
+    inline int pollSockets(pollfd* fds, size_t n, int timeoutMs) { return ::poll(fds, static_cast<nfds_t>(n), timeoutMs); }
+    inline void setNonBlocking(Socket s) { fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK); }
+    inline bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+    constexpr int SHUTDOWN_SEND = SHUT_WR;
+#endif
+#ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL; // 切断済みの相手への送信で SIGPIPE を出さない
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+
+    // 全て送るまで繰り返す (ブロッキングソケット用)。失敗なら false
+    inline bool sendAll(Socket s, const char* data, size_t size) {
+        while (size > 0) {
+            const int n = ::send(s, data, static_cast<int>(std::min<size_t>(size, 1 << 30)), SEND_FLAGS);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // 破棄時に閉じるソケット
+    class SocketHandle {
+    public:
+        SocketHandle() = default;
+        explicit SocketHandle(Socket s) : s_(s) {}
+        SocketHandle(SocketHandle&& other) noexcept : s_(std::exchange(other.s_, INVALID)) {}
+        SocketHandle& operator=(SocketHandle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                s_ = std::exchange(other.s_, INVALID);
+            }
+            return *this;
+        }
+        ~SocketHandle() { reset(); }
+        void reset() {
+            if (s_ != INVALID) closeSocket(s_);
+            s_ = INVALID;
+        }
+        [[nodiscard]] Socket get() const { return s_; }
+        [[nodiscard]] bool valid() const { return s_ != INVALID; }
+    private:
+        Socket s_ = INVALID;
+    };
+
+    // poll ループを他のスレッドから起こす (WSAPoll はパイプを待てないので、ループバックの接続の組で作る)
+    class Wakeup {
+    public:
+        bool open() {
+            SocketHandle listener(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            if (!listener.valid() || ::bind(listener.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+                ::listen(listener.get(), 1) != 0 || getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &len) != 0) return false;
+            SocketHandle writer(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+            if (!writer.valid() || ::connect(writer.get(), reinterpret_cast<const sockaddr*>(&addr), len) != 0) return false;
+            SocketHandle reader(::accept(listener.get(), nullptr, nullptr));
+            if (!reader.valid()) return false;
+            setNonBlocking(reader.get());
+            setNonBlocking(writer.get());
+            reader_ = std::move(reader);
+            writer_ = std::move(writer);
+            return true;
+        }
+        [[nodiscard]] Socket socket() const { return reader_.get(); }
+        // 起こす (既に起こしてあれば何もしない)
+        void notify() {
+            if (!pending_.exchange(true)) {
+                const char c = 0;
+                ::send(writer_.get(), &c, 1, SEND_FLAGS);
+            }
+        }
+        // poll ループが起きたら読み捨てる
+        void drain() {
+            pending_ = false;
+            char buffer[64];
+            while (::recv(reader_.get(), buffer, sizeof(buffer), 0) > 0) {}
+        }
+    private:
+        SocketHandle reader_, writer_;
+        std::atomic<bool> pending_{ false };
+    };
+
+    // 送信キュー: 書き込み側 (コマンド・配信スレッド) が積み、poll ループがノンブロッキングで送る
+    //   limit を超えて積もうとした側は空くまで待つ。stallTimeout の間まったく送れなければ失敗にする
+    class SendQueue {
+    public:
+        SendQueue(Wakeup& wakeup, size_t limit, std::chrono::milliseconds stallTimeout)
+            : wakeup_(wakeup), limit_(std::max<size_t>(limit, 1)), stallTimeout_(stallTimeout) {
+        }
+
+        // 積む。失敗・終了後なら false
+        bool push(const char* data, size_t size) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            while (size > 0) {
+                if (failed_ || finished_) return false;
+                if (data_.size() >= limit_) {
+                    wakeup_.notify();
+                    cv_.wait_until(lock, lastProgress_ + stallTimeout_);
+                    if (!data_.empty() && std::chrono::steady_clock::now() >= lastProgress_ + stallTimeout_) fail(lock);
+                    continue;
+                }
+                if (data_.empty()) lastProgress_ = std::chrono::steady_clock::now();
+                const size_t n = std::min(size, limit_ - data_.size());
+                data_.append(data, n);
+                data += n;
+                size -= n;
+            }
+            wakeup_.notify();
+            return true;
+        }
+
+        // 送れるだけ送る (poll ループから呼ぶ)。切断・詰まりなら false
+        bool send(Socket s) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            size_t sent = 0;
+            while (!failed_ && sent < data_.size()) {
+                const int n = ::send(s, data_.data() + sent, static_cast<int>(std::min<size_t>(data_.size() - sent, 1 << 30)), SEND_FLAGS);
+                if (n > 0) sent += n;
+                else if (n < 0 && wouldBlock()) break;
+                else fail(lock);
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (sent > 0) {
+                data_.erase(0, sent);
+                lastProgress_ = now;
+                cv_.notify_all();
+            }
+            else if (!data_.empty() && now >= lastProgress_ + stallTimeout_) fail(lock);
+            return !failed_;
+        }
+
+        // 以降の書き込みを捨てる (積んである分は送る)
+        void finish() {
+            std::lock_guard<std::mutex> lock(mtx_);
+            finished_ = true;
+            cv_.notify_all();
+        }
+        // 積んである分も捨て、待っている書き込み側を起こす
+        void fail() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            fail(lock);
+        }
+
+        [[nodiscard]] bool failed() const { return failed_; }
+        [[nodiscard]] bool empty() const {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return data_.empty();
+        }
+
+    private:
+        Wakeup& wakeup_;
+        const size_t limit_;
+        const std::chrono::milliseconds stallTimeout_;
+        mutable std::mutex mtx_;
+        std::condition_variable cv_;
+        std::string data_;
+        std::chrono::steady_clock::time_point lastProgress_{};
+        bool finished_ = false;
+        std::atomic<bool> failed_{ false }; // failed() はロックなしで読む
+
+        void fail(std::unique_lock<std::mutex>&) {
+            failed_ = true;
+            data_.clear();
+            cv_.notify_all();
+        }
+    };
+
+    // std::ostream の出力を送信キューに積む (flush またはバッファが満杯のとき)
+    class SocketStreamBuf : public std::streambuf {
+    public:
+        explicit SocketStreamBuf(SendQueue& queue) : queue_(queue), buffer_(16 * 1024) {
+            setp(buffer_.data(), buffer_.data() + buffer_.size());
+        }
+
+    protected:
+        int_type overflow(int_type ch) override {
+            if (!flushBuffer()) return traits_type::eof();
+            if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(ch);
+                pbump(1);
+            }
+            return traits_type::not_eof(ch);
+        }
+        // バッファに収まらない書き込み (バイナリブロックなど) は直接キューに積む
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            if (n <= epptr() - pptr()) {
+                std::memcpy(pptr(), s, static_cast<size_t>(n));
+                pbump(static_cast<int>(n));
+                return n;
+            }
+            if (!flushBuffer() || !queue_.push(s, static_cast<size_t>(n))) return 0;
+            return n;
+        }
+        int sync() override { return flushBuffer() ? 0 : -1; }
+
+    private:
+        SendQueue& queue_;
+        std::vector<char> buffer_;
+
+        bool flushBuffer() {
+            const size_t n = static_cast<size_t>(pptr() - pbase());
+            setp(buffer_.data(), buffer_.data() + buffer_.size());
+            return n == 0 ? !queue_.failed() : queue_.push(buffer_.data(), n);
+        }
+    };
+}
+
+// ================================================================================
+// SocketServer: TCP / Unix ドメインソケットで SCPI コマンドを受け付ける
+//   - 1本のスレッドの poll ループで接続受付と全クライアントの送受信を行う (ソケットはノンブロッキング)
+//   - クライアントごとに CommandProcessor とコマンドスレッドを持つ (エラー、format:data、data:stream などは接続ごと)
+//     *opc? や data:wait のように待つコマンドも、そのクライアントのスレッドだけが待つ
+//   - 応答は接続ごとの送信キューに積み、poll ループが POLLOUT で送る。sendTimeoutMs の間まったく送れないクライアントは切断する
+//   - 認証はないので、既定では 127.0.0.1 でのみ待ち受ける
+// ================================================================================
+class SocketServer {
+public:
+    struct Options {
+        int port = -1;                         // TCP ポート (0 で OS が割り当て、負で TCP を使わない)
+        std::string bindAddress = "127.0.0.1";
+        std::string unixPath;                  // 空なら Unix ドメインソケットを使わない
+        int maxClients = 8;
+        int sendTimeoutMs = 2000;
+        size_t sendQueueBytes = 1 << 20;       // 接続ごとの送信キュー。満杯なら書き込み側が待つ
+        size_t maxLineBytes = 64 * 1024;       // 改行のないまま超えたら切断する。未実行の行がこれを超えたら受信を止める
+    };
+
+    SocketServer(LiaConfig* config, Options options) : pCfg(config), options_(std::move(options)) {
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    }
+    ~SocketServer() {
+        stop();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    // 待ち受けを開始する。どのソケットも開けなければ false
+    bool start() {
+        if (!wakeup_.open()) return false;
+        if (options_.port >= 0) openTcp();
+        if (!options_.unixPath.empty()) openUnix();
+        if (listeners_.empty()) return false;
+        worker_ = std::jthread([this](std::stop_token st) { run(st); });
+        return true;
+    }
+
+    void stop() {
+        if (worker_.joinable()) {
+            worker_.request_stop();
+            worker_.join();
+        }
+        listeners_.clear();
+        if (!options_.unixPath.empty()) {
+            std::error_code ec;
+            std::filesystem::remove(options_.unixPath, ec);
+        }
+    }
+
+    // 実際に待ち受けている TCP ポート (port = 0 の場合に使う)
+    [[nodiscard]] int port() const { return boundPort_; }
+    [[nodiscard]] int clientCount() const { return clientCount_; }
+
+private:
+    struct Session {
+        net::SocketHandle socket;      // 最後に閉じる (他のメンバーより先に宣言)
+        net::SendQueue sendQueue;
+        net::SocketStreamBuf outBuf;
+        std::ostream out;
+        std::istringstream in;         // 未使用 (入力は受信した行を handleLine で渡す)
+        CommandProcessor processor;    // コマンドスレッドの次に破棄され、data:stream の配信スレッドを止める
+        std::string pending;           // 改行待ちの受信データ (poll ループだけが触る)
+        bool inputClosed = false;      // 相手が送信を閉じた (poll ループだけが触る)
+
+        // 受信した行: poll ループが積み、コマンドスレッドが実行する
+        std::mutex lineMtx;
+        std::condition_variable_any lineCv;
+        std::deque<std::string> lines;
+        size_t lineBytes = 0;
+        bool endOfInput = false;       // 積んだ行を実行し終えたら終わる
+        std::atomic<bool> finished{ false };
+        std::jthread commandThread;    // 最初に破棄する (停止要求して join)
+
+        Session(net::SocketHandle s, LiaConfig* cfg, net::Wakeup& wakeup, const Options& options)
+            : socket(std::move(s)), sendQueue(wakeup, options.sendQueueBytes, std::chrono::milliseconds(options.sendTimeoutMs)),
+            outBuf(sendQueue), out(&outBuf), processor(cfg, in, out) {
+            commandThread = std::jthread([this, &wakeup](std::stop_token st) { serve(st, wakeup); });
+        }
+        ~Session() { sendQueue.fail(); } // 送信キューで待っている配信スレッドを解放する
+
+        // 行を積んでコマンドスレッドに渡す
+        void pushLine(std::string_view line) {
+            {
+                std::lock_guard<std::mutex> lock(lineMtx);
+                lines.emplace_back(line);
+                lineBytes += line.size();
+            }
+            lineCv.notify_one();
+        }
+        // 入力の終わり (積んだ行は実行する)
+        void endInput() {
+            {
+                std::lock_guard<std::mutex> lock(lineMtx);
+                endOfInput = true;
+            }
+            lineCv.notify_one();
+        }
+        // 未実行の行が limit を超えて溜まっているか (超えている間は受信しない)
+        bool backlogged(size_t limit) {
+            std::lock_guard<std::mutex> lock(lineMtx);
+            return lineBytes > limit;
+        }
+
+    private:
+        // コマンドスレッド: 行を順に実行する。exit・送信失敗・入力の終わりで終了する
+        void serve(std::stop_token st, net::Wakeup& wakeup) {
+            std::string line;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(lineMtx);
+                    if (!lineCv.wait(lock, st, [&] { return !lines.empty() || endOfInput; }) || lines.empty()) break;
+                    line = std::move(lines.front());
+                    lines.pop_front();
+                    lineBytes -= line.size();
+                }
+                if (!processor.handleLine(line) || sendQueue.failed()) break;
+            }
+            sendQueue.finish(); // 以降の配信は捨て、積んである応答を送り終えたら閉じる
+            finished = true;
+            wakeup.notify();
+        }
+    };
+
+    LiaConfig* pCfg;
+    Options options_;
+    net::Wakeup wakeup_;               // セッションより先に宣言する (コマンドスレッドが使う)
+    std::vector<net::SocketHandle> listeners_;
+    std::vector<std::unique_ptr<Session>> sessions_;
+    int boundPort_ = -1;
+    std::atomic<int> clientCount_{ 0 };
+    std::jthread worker_;
+
+    void openTcp() {
+        net::SocketHandle s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        if (!s.valid()) return;
+        const int yes = 1;
+        setsockopt(s.get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(options_.port));
+        if (inet_pton(AF_INET, options_.bindAddress.c_str(), &addr.sin_addr) != 1 ||
+            ::bind(s.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(s.get(), SOMAXCONN) != 0) {
+            std::cerr << std::format("Error: Could not listen on {}:{}\n", options_.bindAddress, options_.port);
+            return;
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(s.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+        boundPort_ = ntohs(addr.sin_port);
+        listeners_.push_back(std::move(s));
+    }
+
+    void openUnix() {
+        sockaddr_un addr{};
+        if (options_.unixPath.size() >= sizeof(addr.sun_path)) return;
+        net::SocketHandle s(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (!s.valid()) return;
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, options_.unixPath.c_str(), options_.unixPath.size() + 1);
+        std::error_code ec;
+        std::filesystem::remove(options_.unixPath, ec); // 前回の残り
+        if (::bind(s.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(s.get(), SOMAXCONN) != 0) {
+            std::cerr << "Error: Could not listen on " << options_.unixPath << "\n";
+            return;
+        }
+        listeners_.push_back(std::move(s));
+    }
+
+    void run(std::stop_token st) {
+        std::vector<pollfd> fds;
+        char buffer[4096];
+        while (!st.stop_requested()) {
+            fds.clear();
+            fds.push_back({ wakeup_.socket(), POLLIN, 0 });
+            for (const auto& l : listeners_) fds.push_back({ l.get(), POLLIN, 0 });
+            for (const auto& c : sessions_) {
+                short events = 0;
+                if (!c->inputClosed && !c->backlogged(options_.maxLineBytes)) events |= POLLIN;
+                if (!c->sendQueue.empty()) events |= POLLOUT;
+                fds.push_back({ c->socket.get(), events, 0 });
+            }
+            if (net::pollSockets(fds.data(), fds.size(), 100) < 0) continue; // 停止要求と送信の詰まりの確認のため 100 ms で戻る
+            if (fds[0].revents != 0) wakeup_.drain();
+
+            // 送受信 (受信した行はコマンドスレッドが実行する)
+            const size_t first = 1 + listeners_.size();
+            for (size_t i = 0; i < sessions_.size(); ++i) {
+                Session& c = *sessions_[i];
+                const short events = fds[first + i].revents;
+                if ((events & POLLIN) != 0) {
+                    const int n = ::recv(c.socket.get(), buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        if (!receive(c, std::string_view(buffer, n))) c.sendQueue.fail();
+                    }
+                    else if (n == 0) { // 相手が送信を閉じた: 受け取った行を実行し、応答を送り終えてから閉じる
+                        c.inputClosed = true;
+                        c.endInput();
+                    }
+                    else if (!net::wouldBlock()) c.sendQueue.fail();
+                }
+                else if ((events & (POLLERR | POLLHUP | POLLNVAL)) != 0) c.sendQueue.fail();
+                if (!c.sendQueue.empty()) c.sendQueue.send(c.socket.get()); // 詰まったままなら失敗にする
+                if (c.sendQueue.failed()) c.commandThread.request_stop();
+            }
+
+            // コマンドスレッドが終わり、応答を送り終えた (または送れない) セッションを閉じる
+            std::erase_if(sessions_, [](const auto& c) { return c->finished && (c->sendQueue.failed() || c->sendQueue.empty()); });
+
+            // 接続受付
+            for (size_t i = 0; i < listeners_.size(); ++i) {
+                if ((fds[1 + i].revents & POLLIN) == 0) continue;
+                net::SocketHandle s(::accept(listeners_[i].get(), nullptr, nullptr));
+                if (!s.valid() || static_cast<int>(sessions_.size()) >= options_.maxClients) continue;
+                const int yes = 1;
+                setsockopt(s.get(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&yes), sizeof(yes)); // Unix ソケットでは失敗するが無害
+                net::setNonBlocking(s.get());
+                sessions_.push_back(std::make_unique<Session>(std::move(s), pCfg, wakeup_, options_));
+            }
+            clientCount_ = static_cast<int>(sessions_.size());
+        }
+        sessions_.clear();
+        clientCount_ = 0;
+    }
+
+    // 受信データを行に分けてコマンドスレッドに渡す。改行のないまま長すぎれば false
+    bool receive(Session& c, std::string_view data) {
+        c.pending.append(data);
+        size_t begin = 0;
+        for (size_t pos; (pos = c.pending.find('\n', begin)) != std::string::npos; begin = pos + 1) {
+            c.pushLine(std::string_view(c.pending).substr(begin, pos - begin));
+        }
+        c.pending.erase(0, begin);
+        return c.pending.size() <= options_.maxLineBytes;
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_socketServer() {
+    std::cout << "--- SocketServer Test Start ---" << std::endl;
+
+    LiaConfig cfg;
+    SocketServer::Options options;
+    options.port = 0; // ループバックの空きポート
+#ifndef _WIN32
+    options.unixPath = "lia_test.sock";
+#endif
+    SocketServer server(&cfg, options);
+    assert(server.start() && server.port() > 0);
+
+    auto connectTcp = [&] {
+        net::SocketHandle s(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(server.port()));
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        assert(::connect(s.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+        return s;
+        };
+    // コマンドを送り、lines 行の応答を受け取る
+    auto query = [](const net::SocketHandle& s, const std::string& commands, int lines) {
+        assert(net::sendAll(s.get(), commands.data(), commands.size()));
+        std::string reply;
+        char c;
+        while (lines > 0 && ::recv(s.get(), &c, 1, 0) == 1) {
+            reply += c;
+            if (c == '\n') --lines;
+        }
+        return reply;
+        };
+
+    // 接続ごとに独立した状態 (format:data) を持ち、測定データは共有する
+    {
+        const auto a = connectTcp();
+        const auto b = connectTcp();
+        assert(query(a, "format:data real,32\nformat:data?\n", 1) == "real,32\n");
+        assert(query(b, "format:data?\n", 1) == "ascii\n");
+        assert(query(b, "bogus?;*idn?\n", 2) == "Error: 'bogus?'\nNo DAQ is connected.\n");
+        assert(query(a, "w1:amp 0.25\n:w1:amp?\n", 1) == "0.25\n");
+        assert(query(b, "w1:amp?\n", 1) == "0.25\n");
+        assert(server.clientCount() == 2);
+
+        // 大きな応答 (バイナリブロック) も欠けずに届く
+        size_t columns = 1;
+        for (size_t c = 0; c < std::size(cfg.scope.ch); ++c) {
+            if (c == 0 || cfg.scope.ch[c].enable) ++columns;
+        }
+        const std::string len = std::to_string(cfg.scope.ch[0].waveform.size() * columns * sizeof(float));
+        const std::string header = std::format("#{}{}", len.size(), len);
+        const size_t total = header.size() + std::stoul(len) + 1;
+        assert(net::sendAll(a.get(), "data:raw?\n", 10));
+        std::string block;
+        while (block.size() < total) {
+            char buf[4096];
+            const int n = ::recv(a.get(), buf, static_cast<int>(std::min(sizeof(buf), total - block.size())), 0);
+            assert(n > 0);
+            block.append(buf, n);
+        }
+        assert(block.starts_with(header) && block.back() == '\n');
+    }
+    std::cout << "  TCP: per-client sessions, shared data, binary blocks: OK" << std::endl;
+
+    // 待つコマンド (測定中の設定変更後の問い合わせ) を実行中のクライアントがいても、他のクライアントはすぐ答えを受け取る
+    {
+        const auto a = connectTcp();
+        const auto b = connectTcp();
+        cfg.setStatus(cfg.statusMeasurement, true); // 測定スレッドがないので設定変更は waitControls のタイムアウト (1秒) まで適用されない
+        const std::string set = "w1:amp 0.25;w1:amp?\n";
+        assert(net::sendAll(a.get(), set.data(), set.size()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        const auto t0 = std::chrono::steady_clock::now();
+        assert(query(b, "*idn?\n", 1) == "No DAQ is connected.\n");
+        assert(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(500));
+        assert(query(a, "", 1) == "0.25\n");
+        cfg.setStatus(cfg.statusMeasurement, false);
+        cfg.applyControls();
+    }
+    std::cout << "  blocking command does not stall other clients: OK" << std::endl;
+
+    // data:stream の配信は接続ごと。切断で購読も解除される
+    {
+        const auto c = connectTcp();
+        assert(query(c, "data:stream on 2;data:stream?\n", 1) == "on\n");
+        for (int i = 0; i < 10; ++i) cfg.pointStream.publish(i, i, 0, 0, 0);
+        const std::string lines = query(c, "", 5);
+        assert(lines.starts_with("@") && std::count(lines.begin(), lines.end(), '@') == 5);
+    }
+    for (int i = 0; i < 100 && server.clientCount() > 0; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(cfg.pointStream.subscribe() == 0); // 切断したセッションのスロットが空いている
+    cfg.pointStream.unsubscribe(0);
+    std::cout << "  data:stream per connection: OK" << std::endl;
+
+    // 切断したクライアントは片付けられる
+    for (int i = 0; i < 100 && server.clientCount() > 0; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(server.clientCount() == 0);
+    {
+        const auto c = connectTcp();
+        assert(query(c, "exit\n", 0).empty());
+        char ch;
+        assert(::recv(c.get(), &ch, 1, 0) == 0); // exit でサーバー側から閉じる
+    }
+    {
+        // 送信を閉じても、それまでに送った行の応答を受け取ってから閉じられる
+        const auto c = connectTcp();
+        assert(net::sendAll(c.get(), "*idn?\n", 6));
+        ::shutdown(c.get(), net::SHUTDOWN_SEND);
+        assert(query(c, "", 1) == "No DAQ is connected.\n");
+        char ch;
+        assert(::recv(c.get(), &ch, 1, 0) == 0);
+    }
+    std::cout << "  disconnect / exit: OK" << std::endl;
+
+#ifndef _WIN32
+    {
+        net::SocketHandle s(::socket(AF_UNIX, SOCK_STREAM, 0));
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, options.unixPath.c_str());
+        assert(::connect(s.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+        assert(query(s, "w1:amp?\n", 1) == "0.25\n");
+    }
+    std::cout << "  Unix domain socket: OK" << std::endl;
+#endif
+
+    server.stop();
+    std::cout << "SocketServer Test Passed!" << std::endl;
+}
@@ -1,124 +1,353 @@
-#pragma once
+﻿#pragma once
 
-#include <thread>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
 #include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#ifdef _WIN32
 #include <windows.h>
 #include <mmsystem.h>
 #pragma comment (lib, "winmm.lib")
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Windows 10 1803 以降
+#endif
+#else
+#include <cerrno>
+#include <time.h>
+#endif
+
+// ================================================================================
+// timer_backend: 単調時計 (ns) と、その時刻まで OS で眠る待ち
+//   - Windows: QueryPerformanceCounter と高分解能の待機可能タイマー (なければ通常の待機可能タイマー)
+//   - それ以外: CLOCK_MONOTONIC と clock_nanosleep(TIMER_ABSTIME)
+// ================================================================================
+namespace timer_backend {
+#ifdef _WIN32
+    inline int64_t nowNs() noexcept {
+        static const int64_t freq = [] {
+            LARGE_INTEGER f;
+            QueryPerformanceFrequency(&f);
+            return static_cast<int64_t>(f.QuadPart);
+            }();
+        LARGE_INTEGER c;
+        QueryPerformanceCounter(&c);
+        return static_cast<int64_t>(c.QuadPart / freq * 1000000000 + c.QuadPart % freq * 1000000000 / freq);
+    }
+
+    class Sleeper {
+    public:
+        Sleeper() {
+            handle_ = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            highResolution_ = (handle_ != nullptr);
+            if (!handle_) handle_ = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+        }
+        ~Sleeper() { if (handle_) CloseHandle(handle_); }
+        Sleeper(const Sleeper&) = delete;
+        Sleeper& operator=(const Sleeper&) = delete;
+
+        [[nodiscard]] bool highResolution() const noexcept { return highResolution_; }
+
+        void sleepUntil(int64_t deadlineNs) const noexcept {
+            const int64_t rest = deadlineNs - nowNs();
+            if (rest <= 0) return;
+            if (!handle_) { Sleep(static_cast<DWORD>(rest / 1000000)); return; }
+            LARGE_INTEGER due;
+            due.QuadPart = -(rest / 100); // 負の値は相対時間 (100 ns 単位)
+            if (SetWaitableTimer(handle_, &due, 0, nullptr, nullptr, FALSE)) WaitForSingleObject(handle_, INFINITE);
+        }
+
+    private:
+        HANDLE handle_ = nullptr;
+        bool highResolution_ = false;
+    };
+#else
+    inline int64_t nowNs() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    class Sleeper {
+    public:
+        [[nodiscard]] bool highResolution() const noexcept { return true; }
+
+        void sleepUntil(int64_t deadlineNs) const noexcept {
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(deadlineNs / 1000000000);
+            ts.tv_nsec = static_cast<long>(deadlineNs % 1000000000);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+        }
+    };
+#endif
+}
+
+// ================================================================================
+// Timer: 測定周期の時刻合わせ
+//   - sleepUntil() は期限の spinMargin 前まで OS で眠り、残りを時計を見ながら回る
+//     (margin を大きくすると正確になるが CPU を使う。負なら最初から回る)
+//   - 待つたびに遅れ (起きた時刻 - 期限) を記録し、stats() で CPU 使用と精度の兼ね合いを確かめられる
+//   - 仮想時計 (setVirtual) では待たずに時刻だけ期限へ進める。装置のない source (シミュレーション・再生) を
+//     同じ測定ループのまま CPU の許す限り速く回し、時刻を実時間によらず決める (回帰試験・ベンチマーク用)
+//   - sleepUntil() は1つのスレッドから呼ぶ。stats() と setSpinMargin() はどのスレッドからも呼べる
+// ================================================================================
 class Timer
 {
+public:
+    static constexpr double DEFAULT_SPIN_MARGIN = 500e-6; // 高分解能タイマーでも起床は数百 us 遅れ得る
+
+    struct Stats {
+        uint64_t waits = 0;
+        uint64_t overruns = 0;     // 呼ばれた時点で期限を過ぎていた回数 (遅れの統計には入れない)
+        double meanLateUs = 0.0;   // 遅れの平均
+        double p99LateUs = 0.0;    // 遅れの 99% 点 (2 のべきの区間の上端。max を超えない)
+        double maxLateUs = 0.0;
+        double spinRatio = 0.0;    // 待ち時間のうち回っていた割合 (CPU を使った割合)
+        bool highResolution = false;
+    };
+
+    Timer()
+    {
+#ifdef _WIN32
+        if (numTimers++ == 0) timeBeginPeriod(1);
+#endif
+        start();
+    }
+
+    ~Timer()
+    {
+#ifdef _WIN32
+        if (--numTimers == 0) timeEndPeriod(1);
+#endif
+    }
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    static void sleepFor(const double sec)
+    {	// sec秒Sleepする
+        if (sec <= 0) return;
+        auto us = static_cast<long long>(sec * 1e6);
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+
+    void start()
+    {	// カウンタスタート (仮想時計は 0 に戻す)
+        virtualNs.store(0, std::memory_order_relaxed);
+        startAt(nowNs());
+    }
+
+    // 単調時計の時刻 epochNs (now()) を 0 として数える。複数の Timer の時間軸をそろえる (仮想時計は start() と同じ)
+    void startAt(int64_t epochNs)
+    {
+        if (isVirtual()) epochNs = 0;
+        startNs = epochNs;
+        previousNs = startNs;
+        lastElapsedNs = startNs;
+    }
+    [[nodiscard]] static int64_t now() noexcept { return timer_backend::nowNs(); }
+    [[nodiscard]] int64_t epoch() const noexcept { return startNs; }
+
+    // 仮想時計に切り替える (start() の前に呼ぶ)
+    void setVirtual(bool on) noexcept { isVirtual_.store(on, std::memory_order_relaxed); }
+    [[nodiscard]] bool isVirtual() const noexcept { return isVirtual_.load(std::memory_order_relaxed); }
+
+    void stop()
+    {
+
+    }
+
+    // start() から theTimeSec 秒後まで待ち、起きた時刻 (start() からの秒) を返す
+    double sleepUntil(const double theTimeSec)
+    {
+        return toSec(waitUntil(startNs + toNs(theTimeSec)) - startNs);
+    }
+
+    // 前回の期限から sec 秒後まで待つ
+    double sleepFromPreviousFor(const double sec)
+    {
+        previousNs += toNs(sec);
+        return toSec(waitUntil(previousNs) - startNs);
+    }
+
+    double elapsedSec() const
+    {
+        return toSec(nowNs() - startNs);
+    }
+
+    double elapsedFromPreviousSec()
+    {
+        const int64_t now = nowNs();
+        const double ret = toSec(now - lastElapsedNs);
+        lastElapsedNs = now;
+        return ret;
+    }
+
+    [[nodiscard]] double spinMargin() const noexcept { return spinMarginNs.load(std::memory_order_relaxed) * 1e-9; }
+    void setSpinMargin(double sec) noexcept { spinMarginNs.store(toNs(std::clamp(sec, -1.0, 1.0)), std::memory_order_relaxed); }
+
+    [[nodiscard]] Stats stats() const
+    {
+        Stats s;
+        s.highResolution = sleeper.highResolution();
+        s.waits = waits.load(std::memory_order_relaxed);
+        s.overruns = overruns.load(std::memory_order_relaxed);
+        const uint64_t timed = s.waits - s.overruns;
+        s.maxLateUs = maxLateNs.load(std::memory_order_relaxed) * 1e-3;
+        if (timed > 0) {
+            s.meanLateUs = lateNs.load(std::memory_order_relaxed) * 1e-3 / static_cast<double>(timed);
+            uint64_t below = 0;
+            for (size_t i = 0; i < LATE_BUCKETS; ++i) {
+                below += lateHistogram[i].load(std::memory_order_relaxed);
+                if (below * 100 >= timed * 99) { s.p99LateUs = std::min(static_cast<double>(uint64_t{ 1 } << i), s.maxLateUs); break; }
+            }
+        }
+        const double slept = static_cast<double>(sleptNs.load(std::memory_order_relaxed));
+        const double spun = static_cast<double>(spunNs.load(std::memory_order_relaxed));
+        if (slept + spun > 0.0) s.spinRatio = spun / (slept + spun);
+        return s;
+    }
+
+    void resetStats()
+    {
+        waits.store(0);
+        overruns.store(0);
+        lateNs.store(0);
+        maxLateNs.store(0);
+        sleptNs.store(0);
+        spunNs.store(0);
+        for (auto& b : lateHistogram) b.store(0);
+    }
+
 private:
-	static inline LARGE_INTEGER qpf = [] {
-		LARGE_INTEGER f;
-		QueryPerformanceFrequency(&f);
-		return f;
-		}();
+    static constexpr size_t LATE_BUCKETS = 24; // 区間 i は遅れ [2^(i-1), 2^i) us (最後は 2^23 us 以上)
 
-	LARGE_INTEGER qpc_start{};
-	LARGE_INTEGER qpc_previous{};
+    int64_t startNs = 0;
+    int64_t previousNs = 0;
+    int64_t lastElapsedNs = 0; // elapsedFromPreviousSec() の前回 (インスタンスごと)
+    timer_backend::Sleeper sleeper;
+    std::atomic<bool> isVirtual_{ false };
+    std::atomic<int64_t> virtualNs{ 0 }; // 仮想時計の現在時刻 (sleepUntil() を呼ぶスレッドだけが進める)
+    std::atomic<int64_t> spinMarginNs{ toNs(DEFAULT_SPIN_MARGIN) };
 
-	static inline int numTimers = 0;
+    std::atomic<uint64_t> waits{ 0 };
+    std::atomic<uint64_t> overruns{ 0 };
+    std::atomic<uint64_t> lateNs{ 0 };
+    std::atomic<uint64_t> maxLateNs{ 0 };
+    std::atomic<uint64_t> sleptNs{ 0 };
+    std::atomic<uint64_t> spunNs{ 0 };
+    std::array<std::atomic<uint64_t>, LATE_BUCKETS> lateHistogram{};
 
-public:
-	Timer()
-	{
-		this->numTimers++;
-		if (this->numTimers == 1)
-			timeBeginPeriod(1);
-		this->start();
-	}
-
-	~Timer()
-	{
-		this->numTimers--;
-		if (this->numTimers == 0)
-			timeEndPeriod(1);
-	}
-
-	static void sleepFor(const double sec)
-	{	// secbSleep
-		if (sec <= 0) return;
-		auto us = static_cast<long long>(sec * 1e6);
-		std::this_thread::sleep_for(std::chrono::microseconds(us));
-	}
-
-	void start()
-	{	// JE^X^[g
-		QueryPerformanceCounter(&this->qpc_start);
-		qpc_previous.QuadPart = qpc_start.QuadPart;
-	}
-
-	void stop()
-	{
-
-	}
-
-	double sleepUntil(const double theTimeSec)
-	{
-		LARGE_INTEGER qpc_now;
-		auto qpc_next_QuadPart = (LONGLONG)(theTimeSec * this->qpf.QuadPart + this->qpc_start.QuadPart);
-		while (true)
-		{
-			QueryPerformanceCounter(&qpc_now);
-			if (qpc_next_QuadPart <= qpc_now.QuadPart)
-			{
-				break;
-			}
-			//std::this_thread::sleep_for(std::chrono::microseconds(100));
-		}
-		return (double)(qpc_now.QuadPart - this->qpc_start.QuadPart)
-			/ (double)this->qpf.QuadPart;
-	}
-
-	double sleepFromPreviousFor(const double sec)
-	{
-		LARGE_INTEGER qpc_next, qpc_now;
-		qpc_next.QuadPart = (LONGLONG)(sec * this->qpf.QuadPart + this->qpc_previous.QuadPart);
-		if (10e-3 < sec)
-		{
-			while (1)
-			{
-				QueryPerformanceCounter(&qpc_now);
-				if (qpc_next.QuadPart <= qpc_now.QuadPart)
-				{
-					break;
-				}
-				//std::this_thread::sleep_for(std::chrono::microseconds(100));
-			}
-		}
-		else
-		{
-			while (1)
-			{
-				QueryPerformanceCounter(&qpc_now);
-				if (qpc_next.QuadPart <= qpc_now.QuadPart)
-				{
-					break;
-				}
-			}
-		}
-		
-		this->qpc_previous.QuadPart = qpc_next.QuadPart;
-		return (double)(qpc_now.QuadPart - this->qpc_start.QuadPart)
-			/ (double)this->qpf.QuadPart;
-	}
-
-	double elapsedSec()
-	{
-		LARGE_INTEGER qpc_now;
-		QueryPerformanceCounter(&qpc_now);
-		return (double)(qpc_now.QuadPart - this->qpc_start.QuadPart)
-			/ (double)this->qpf.QuadPart;
-	}
-
-	double elapsedFromPreviousSec()
-	{
-		static LARGE_INTEGER static_qpc_previous = qpc_start;
-		LARGE_INTEGER qpc_now;
-		QueryPerformanceCounter(&qpc_now);
-		double ret = (double)(qpc_now.QuadPart - static_qpc_previous.QuadPart)
-			/ (double)this->qpf.QuadPart;
-		static_qpc_previous = qpc_now;
-		return ret;
-	}
+#ifdef _WIN32
+    static inline std::atomic<int> numTimers{ 0 }; // timeBeginPeriod はプロセス全体なので数だけ共有する (どのスレッドで作ってもよい)
+#endif
+
+    static constexpr int64_t toNs(double sec) noexcept { return static_cast<int64_t>(sec * 1e9); }
+    static constexpr double toSec(int64_t ns) noexcept { return static_cast<double>(ns) * 1e-9; }
+
+    int64_t nowNs() const noexcept
+    {
+        return isVirtual() ? virtualNs.load(std::memory_order_relaxed) : timer_backend::nowNs();
+    }
+
+    int64_t waitUntil(const int64_t deadlineNs)
+    {
+        if (isVirtual()) {
+            const int64_t begin = virtualNs.load(std::memory_order_relaxed);
+            const int64_t now = std::max(begin, deadlineNs);
+            virtualNs.store(now, std::memory_order_relaxed);
+            record(begin, now, now, deadlineNs);
+            return now;
+        }
+        const int64_t begin = timer_backend::nowNs();
+        const int64_t wakeNs = deadlineNs - spinMarginNs.load(std::memory_order_relaxed);
+        if (wakeNs <= deadlineNs && begin < wakeNs) sleeper.sleepUntil(wakeNs); // 負の margin では眠らない (期限を越えて眠ってしまう)
+        const int64_t spinFrom = timer_backend::nowNs();
+        int64_t now = spinFrom;
+        while (now < deadlineNs) now = timer_backend::nowNs();
+        record(begin, spinFrom, now, deadlineNs);
+        return now;
+    }
+
+    // 統計は sleepUntil() を呼ぶスレッドだけが書く (読む側は relaxed で十分)
+    void record(int64_t begin, int64_t spinFrom, int64_t now, int64_t deadlineNs)
+    {
+        waits.fetch_add(1, std::memory_order_relaxed);
+        if (begin >= deadlineNs) {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const uint64_t late = static_cast<uint64_t>(now - deadlineNs);
+        lateNs.fetch_add(late, std::memory_order_relaxed);
+        if (late > maxLateNs.load(std::memory_order_relaxed)) maxLateNs.store(late, std::memory_order_relaxed);
+        lateHistogram[std::min<size_t>(std::bit_width(late / 1000), LATE_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+        sleptNs.fetch_add(static_cast<uint64_t>(spinFrom - begin), std::memory_order_relaxed);
+        spunNs.fetch_add(static_cast<uint64_t>(now - spinFrom), std::memory_order_relaxed);
+    }
 };
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_timer() {
+    std::cout << "--- Timer Test Start ---" << std::endl;
+    constexpr int PERIODS = 100;
+    constexpr double DT = 2e-3;
+
+    // 回るだけ・既定の margin・眠るだけ・負の margin (最初から回る) で 2 ms 周期を刻み、遅れと CPU の使い方を比べる
+    struct Case { const char* name; double margin; };
+    for (const Case c : { Case{ "spin only", 1.0 }, Case{ "hybrid", Timer::DEFAULT_SPIN_MARGIN }, Case{ "sleep only", 0.0 }, Case{ "negative", -1e-3 } }) {
+        Timer timer;
+        timer.setSpinMargin(c.margin);
+        double tNext = DT, last = 0.0;
+        for (int i = 0; i < PERIODS; ++i, tNext += DT) {
+            const double t = timer.sleepUntil(tNext);
+            assert(t >= tNext - 1e-9 && t >= last); // 期限より前には戻らない (ns への丸めの分だけ許す)
+            last = t;
+        }
+        const auto s = timer.stats();
+        assert(s.waits == PERIODS);
+        if (c.margin >= DT || c.margin < 0.0) assert(s.spinRatio > 0.9);
+        if (c.margin == 0.0) assert(s.spinRatio < 0.5);
+        std::cout << "  " << c.name << " (margin " << c.margin * 1e6 << " us): late mean " << s.meanLateUs << " us, p99 <= "
+            << s.p99LateUs << " us, max " << s.maxLateUs << " us, spinning " << 100.0 * s.spinRatio << " % of the wait, "
+            << s.overruns << " overruns" << std::endl;
+    }
+
+    // 期限を過ぎてから呼ばれたら待たずに戻り、遅れの統計には入れない
+    {
+        Timer timer;
+        Timer::sleepFor(5e-3);
+        timer.sleepUntil(1e-3);
+        const auto s = timer.stats();
+        assert(s.waits == 1 && s.overruns == 1 && s.maxLateUs == 0.0);
+    }
+    std::cout << "  overrun: OK" << std::endl;
+
+    // 仮想時計: 待たずに期限ちょうどの時刻になり、start() で 0 に戻る。期限を過ぎた呼び出しでは進まない
+    {
+        Timer timer;
+        timer.setVirtual(true);
+        timer.start();
+        const auto t0 = std::chrono::steady_clock::now();
+        for (int i = 1; i <= 100000; ++i) {
+            const double t = timer.sleepUntil(i * DT);
+            assert(std::abs(t - i * DT) < 1e-9);
+        }
+        const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        assert(wall < 100000 * DT / 100 && std::abs(timer.elapsedSec() - 100000 * DT) < 1e-9);
+        timer.sleepUntil(1.0);
+        assert(std::abs(timer.elapsedSec() - 100000 * DT) < 1e-9);
+        const auto s = timer.stats();
+        assert(s.waits == 100001 && s.overruns == 1 && s.maxLateUs == 0.0 && s.spinRatio == 0.0);
+        timer.start();
+        assert(timer.elapsedSec() == 0.0);
+        std::cout << "  virtual clock: " << 100000 * DT << " s in " << wall * 1e3 << " ms" << std::endl;
+    }
+
+    std::cout << "Timer Test Passed!" << std::endl;
+}
@@ -0,0 +1,327 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "RangeIndex.h"
+
+// ================================================================================
+// TrendStore: 長期監視用の多段ダウンサンプリング (1s / 10s / 1min)
+//   - 測定点を 1s ビンに集計し、閉じたビンを 10s、さらに 1min へ合成する
+//     (sum/sumSq で保持するので合成しても mean/std は厳密)
+//   - 各段は独自の保持期間を持つ固定長リング。閉じたビンは書き込みスレッドが CSV に追記する
+//     (測定スレッドは書式化もファイル I/O もしない)
+//   - 問い合わせは二分探索 + 要求点数に合わせた段の選択で、期間に依らず数ms以内。
+//     ロックはチャンクごとに短く持つだけなので、測定スレッドのビンの確定を長く待たせない
+//   - メモリ上のビンはその測定の間だけ。再起動時に以前の trend_*.csv は読み込まない
+// ================================================================================
+class TrendStore {
+public:
+    static constexpr int NUM_SERIES = 4;  // x1, y1, x2, y2
+    static constexpr int NUM_TIERS = 3;
+    static constexpr std::array<double, NUM_TIERS> PERIODS = { 1.0, 10.0, 60.0 };
+    static constexpr std::array<const char*, NUM_TIERS> NAMES = { "1s", "10s", "1min" };
+    static constexpr size_t MAX_PENDING_BINS = 1 << 16; // 書き込み待ちの上限 (1s 段で約18時間分)。超えた分は CSV に書かない
+
+    struct Bin {
+        double t = 0.0;                  // ビン開始時刻 (s)
+        RangeStats s[NUM_SERIES];
+    };
+
+    TrendStore() : writer_([this](std::stop_token st) { run(st); }) {}
+    ~TrendStore() {
+        writer_.request_stop();
+        cv_.notify_all();
+        writer_ = std::jthread(); // join
+        flush();
+    }
+
+    // retentionSec[i] 秒分のビンを各段に確保し、dir/trend_<name>.csv への追記を開始する
+    void open(const std::string& dir, const std::array<double, NUM_TIERS>& retentionSec) {
+        std::lock_guard<std::mutex> fileLock(fileMtx_);
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (int i = 0; i < NUM_TIERS; ++i) {
+            Tier& tier = tiers_[i];
+            tier.capacity = std::max(1, static_cast<int>(retentionSec[i] / PERIODS[i]));
+            tier.bins.assign(tier.capacity, Bin());
+            tier.count = 0;
+            tier.accOpen = false;
+            tier.file = std::ofstream(std::format("./{}/trend_{}.csv", dir, NAMES[i]), std::ios::app);
+            if (tier.file) {
+                tier.file << "# t(s), n";
+                for (const char* name : { "x1", "y1", "x2", "y2" }) {
+                    tier.file << std::format(", {0}min(V), {0}max(V), {0}mean(V), {0}std(V)", name);
+                }
+                tier.file << "\n";
+            }
+        }
+    }
+
+    // 測定スレッドから1点ごとに呼ぶ (numChannels == 1 なら x2/y2 は集計しない)
+    void add(double t, int numChannels, double x1, double y1, double x2, double y2) noexcept {
+        Tier& tier = tiers_[0];
+        if (tier.capacity == 0) return;
+        openBin(0, t);
+        tier.acc.s[0].add(x1, 0);
+        tier.acc.s[1].add(y1, 0);
+        if (numChannels > 1) {
+            tier.acc.s[2].add(x2, 0);
+            tier.acc.s[3].add(y2, 0);
+        }
+    }
+
+    // 書き込み待ちのビンを書いてファイルを flush する (呼び出し元で完了を待つ)
+    void flush() { writePending(); }
+
+    // 書き込みが追いつかず CSV に書かなかったビンの数 (メモリ上の段には残る)
+    [[nodiscard]] uint64_t droppedBins() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    struct TierInfo { double period; int size; int capacity; double oldest; double latest; };
+    [[nodiscard]] TierInfo info(int tierIdx) const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        const Tier& tier = tiers_[tierIdx];
+        const int size = tier.size();
+        return { PERIODS[tierIdx], size, tier.capacity,
+            size > 0 ? tier.at(0).t : 0.0, size > 0 ? tier.at(size - 1).t : 0.0 };
+    }
+
+    // [t0, t1] のビンを最大 maxPoints 点で返す。
+    // t0 を保持している最も細かい段のうち、点数が maxPoints 以下になる段を選び、
+    // それでも超える場合は隣接ビンを合成して間引く。使用した段の周期を period に返す
+    //   合成は CHUNK_BINS ビンずつロックを取り直して行い、その間に上書きされたビンは飛ばす
+    std::vector<Bin> query(double t0, double t1, int maxPoints, double& period) const {
+        constexpr int64_t CHUNK_BINS = 4096;
+        std::vector<Bin> result;
+        maxPoints = std::max(1, maxPoints);
+
+        int tierIdx = NUM_TIERS - 1;
+        int64_t first = 0, last = 0; // ビンの通し番号 (count 基準)
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (int i = 0; i < NUM_TIERS; ++i) {
+                const Tier& tier = tiers_[i];
+                const bool covers = tier.size() > 0 && (tier.count <= tier.capacity || tier.at(0).t <= t0);
+                if (covers && (t1 - t0) / PERIODS[i] <= maxPoints) { tierIdx = i; break; }
+            }
+            const Tier& tier = tiers_[tierIdx];
+            const int64_t oldest = tier.count - tier.size();
+            first = oldest + tier.lowerBound(t0);
+            last = oldest + tier.lowerBound(std::nextafter(t1, t1 + 1.0));
+        }
+        period = PERIODS[tierIdx];
+        if (first >= last) return result;
+
+        const int64_t step = (last - first + maxPoints - 1) / maxPoints;
+        period *= static_cast<double>(step);
+        result.reserve(static_cast<size_t>((last - first + step - 1) / step));
+        const Tier& tier = tiers_[tierIdx];
+        for (int64_t i = first; i < last;) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            const int64_t oldest = tier.count - tier.size();
+            for (const int64_t chunkEnd = std::min(last, i + std::max(step, CHUNK_BINS)); i < chunkEnd; i += step) {
+                Bin b;
+                bool any = false;
+                for (int64_t j = std::max(i, oldest); j < std::min(i + step, last); ++j) {
+                    const Bin& src = tier.bins[j % tier.capacity];
+                    if (!any) b = src;
+                    else for (int k = 0; k < NUM_SERIES; ++k) b.s[k].merge(src.s[k]);
+                    any = true;
+                }
+                if (any) result.push_back(b);
+            }
+        }
+        return result;
+    }
+
+private:
+    struct Tier {
+        int capacity = 0;
+        std::vector<Bin> bins;
+        int64_t count = 0;      // これまでに閉じたビン数
+        Bin acc;                // 集計中のビン (測定スレッドのみ)
+        bool accOpen = false;
+        std::ofstream file;     // 書き込みスレッドのみ (fileMtx_)
+
+        [[nodiscard]] int size() const noexcept { return static_cast<int>(std::min<int64_t>(count, capacity)); }
+        // 論理インデックス (0 = 最古) のビン
+        [[nodiscard]] const Bin& at(int logical) const noexcept {
+            return bins[(count - size() + logical) % capacity];
+        }
+        [[nodiscard]] int lowerBound(double t) const noexcept {
+            int lo = 0, hi = size();
+            while (lo < hi) {
+                const int mid = lo + (hi - lo) / 2;
+                if (at(mid).t < t) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+    };
+    std::array<Tier, NUM_TIERS> tiers_;
+    mutable std::mutex mtx_;                      // bins / count と pending_
+    std::mutex fileMtx_;                          // ファイル操作
+    std::condition_variable_any cv_;
+    std::vector<std::pair<int, Bin>> pending_;    // 閉じて書き込み待ちのビン (段, ビン)
+    std::vector<std::pair<int, Bin>> writing_;    // 書き込みスレッドが書式化中 (fileMtx_)
+    std::atomic<uint64_t> dropped_{ 0 };
+    uint64_t droppedReported_ = 0;                // fileMtx_
+    std::jthread writer_; // 他のメンバーより後に構築・先に破棄する
+
+    void run(std::stop_token st) {
+        while (!st.stop_requested()) {
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, st, [this] { return !pending_.empty(); });
+            }
+            writePending();
+        }
+    }
+
+    void writePending() {
+        std::lock_guard<std::mutex> fileLock(fileMtx_);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            writing_.swap(pending_); // 測定スレッドはすぐに次を積める
+        }
+        for (const auto& [tierIdx, bin] : writing_) {
+            std::ofstream& file = tiers_[tierIdx].file;
+            if (!file) continue;
+            file << std::format("{:e},{}", bin.t, bin.s[0].count);
+            for (const auto& s : bin.s) {
+                if (s.count > 0) file << std::format(",{:e},{:e},{:e},{:e}", s.min, s.max, s.mean(), s.stddev());
+                else file << ",0,0,0,0";
+            }
+            file << "\n";
+        }
+        writing_.clear();
+        for (auto& tier : tiers_) {
+            if (tier.file) tier.file.flush();
+        }
+        if (const uint64_t dropped = dropped_.load(std::memory_order_relaxed); dropped != droppedReported_) {
+            std::cerr << std::format("Trend: {} bins were not written to trend_*.csv (writer fell behind)", dropped - droppedReported_) << std::endl;
+            droppedReported_ = dropped;
+        }
+    }
+
+    // 時刻 t を含むビンを集計中にする (前のビンが終わっていれば閉じる)
+    void openBin(int tierIdx, double t) noexcept {
+        Tier& tier = tiers_[tierIdx];
+        const double binStart = std::floor(t / PERIODS[tierIdx]) * PERIODS[tierIdx];
+        if (tier.accOpen && binStart != tier.acc.t) closeBin(tierIdx);
+        if (!tier.accOpen) {
+            tier.acc = Bin();
+            tier.acc.t = binStart;
+            tier.accOpen = true;
+        }
+    }
+
+    void closeBin(int tierIdx) noexcept {
+        Tier& tier = tiers_[tierIdx];
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            tier.bins[tier.count % tier.capacity] = tier.acc;
+            ++tier.count;
+            if (pending_.size() < MAX_PENDING_BINS) pending_.emplace_back(tierIdx, tier.acc);
+            else dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+        tier.accOpen = false;
+        cv_.notify_one();
+
+        // 上位の段へ合成
+        if (tierIdx + 1 < NUM_TIERS) {
+            openBin(tierIdx + 1, tier.acc.t);
+            Tier& upper = tiers_[tierIdx + 1];
+            for (int k = 0; k < NUM_SERIES; ++k) upper.acc.s[k].merge(tier.acc.s[k]);
+        }
+    }
+};
+
+// ============================================================
+// テストコード
+// ============================================================
+void test_trendStore() {
+    std::cout << "--- TrendStore Test Start ---" << std::endl;
+
+    const std::string dir = "trend_test";
+    std::filesystem::create_directory(dir);
+    TrendStore store;
+    store.open(dir, { 3600.0, 6 * 3600.0, 24 * 3600.0 });
+
+    // 約2ms 周期で 2 時間分 (ビン境界で丸め誤差が出ないよう 1/512 s 刻み)
+    const double dt = 1.0 / 512;
+    const int n = static_cast<int>(2 * 3600 / dt);
+    for (int i = 0; i < n; ++i) {
+        const double t = i * dt;
+        const double v = std::sin(2.0 * 3.141592653589793 * t / 600.0);
+        store.add(t, 2, v, -v, 0.5 * v, 1.0);
+    }
+
+    // 1s 段は1時間分で上書きされ、10s/1min 段は全期間を保持する
+    assert(store.info(0).size == 3600);
+    assert(store.info(1).size == 2 * 360 - 1);
+    assert(store.info(2).size == 2 * 60 - 1);
+
+    // 直近の区間は 1s 段から、全期間は 1min 段から返る
+    double period = 0.0;
+    auto recent = store.query(6000.0, 6100.0, 1000, period);
+    assert(period == 1.0 && recent.size() == 101);
+    assert(recent[0].s[0].count == 512);
+    assert(std::abs(recent[0].s[3].mean() - 1.0) < 1e-12);
+
+    auto all = store.query(0.0, 7200.0, 200, period);
+    assert(period == 60.0 && all.size() == 119);
+    for (const auto& b : all) {
+        assert(b.s[0].count == 60 * 512);
+        assert(std::abs(b.s[0].mean() + b.s[1].mean()) < 1e-12);
+    }
+
+    // 要求点数に合わせた合成
+    auto coarse = store.query(0.0, 7200.0, 10, period);
+    assert(period == 720.0 && coarse.size() == 10);
+
+    // data:trend? の既定の範囲 (0 から最新の 1s ビン) は 1min 段ではなく点数の収まる段から返る
+    const double latest = store.info(0).latest;
+    auto whole = store.query(0.0, latest, 1000, period);
+    assert(latest == 7198.0 && period == 10.0 && whole.size() == 719);
+    std::cout << "  tier selection / merge: OK" << std::endl;
+
+    // 測定スレッドが追加している最中の問い合わせ: 時刻は昇順で、1s 段のビンは欠けない
+    {
+        std::atomic<bool> adding{ true };
+        std::jthread producer([&] {
+            for (int i = n; i < n + static_cast<int>(600 / dt); ++i) store.add(i * dt, 2, 0.0, 0.0, 0.0, 1.0);
+            adding = false;
+            });
+        int queries = 0;
+        while (adding || queries == 0) {
+            const auto bins = store.query(7000.0, 7900.0, 2000, period);
+            for (size_t i = 1; i < bins.size(); ++i) assert(bins[i].t == bins[i - 1].t + 1.0);
+            ++queries;
+        }
+        std::cout << "  " << queries << " queries during add: OK" << std::endl;
+    }
+
+    store.flush();
+    std::ifstream file(std::format("./{}/trend_1min.csv", dir));
+    int lines = 0;
+    for (std::string line; std::getline(file, line);) ++lines;
+    assert(lines == 1 + 129); // 2 時間 + 10 分
+    file.close();
+    std::filesystem::remove_all(dir);
+    std::cout << "  incremental csv: OK" << std::endl;
+
+    std::cout << "TrendStore Test Passed!" << std::endl;
+}
@@ -82,17 +82,23 @@ void offsetHistory(LiaConfig::XYs& history, const Point& basePoint) {
 // AWG 制御・測定
 // ============================================================
 
-// AWGの設定を適用し、指定時間だけ待機する
+// AWGの設定を適用し、変更後の点が指定時間分そろうまで待機する
 void applyAwgSettingsAndWait(LiaConfig* cfg, const PolarVectorDeg& ch0, const PolarVectorDeg& ch1, const int record_ms) {
-    cfg->awg.ch[0].amp = (float)ch0.amplitude;
-    cfg->awg.ch[0].phase = (float)ch0.phaseDeg;
-    cfg->awg.ch[1].amp = (float)ch1.amplitude;
-    cfg->awg.ch[1].phase = (float)ch1.phaseDeg;
-    cfg->awgStart();
+    using Op = ControlCommand::Op;
+    uint64_t ticket = 0;
+    for (const ControlCommand& cmd : { ControlCommand{ Op::AwgAmp, 0, ch0.amplitude }, ControlCommand{ Op::AwgPhase, 0, ch0.phaseDeg },
+        ControlCommand{ Op::AwgAmp, 1, ch1.amplitude }, ControlCommand{ Op::AwgPhase, 1, ch1.phaseDeg } }) {
+        ticket = cfg->submitWait(cmd);
+        if (ticket == 0) break;
+    }
+    if (ticket == 0 || !cfg->waitControls(ticket)) { // 適用された seq から点を数える
+        std::cerr << "W2 autosetup: AWG settings were not applied in time." << std::endl;
+    }
 
-    // 安定化のための待機時間(ms) + 記録時間(ms)
+    // 安定化のための待機時間(ms) + 記録時間(ms) を点数に換算して待つ
     constexpr int STABILIZE_WAIT_MS = 100;
-    std::this_thread::sleep_for(std::chrono::milliseconds(STABILIZE_WAIT_MS + record_ms));
+    const auto points = static_cast<uint64_t>(std::ceil((STABILIZE_WAIT_MS + record_ms) / 1000.0 / cfg->ringBuffer.getDt()));
+    cfg->waitPointsAfterControls(points);
 }
 
 // リングバッファから最新の指定時間分のデータを履歴バッファに抽出する
@@ -116,25 +122,24 @@ void extractRingBufferToHistory(const LiaConfig::RingBuffer& ringBuffer, LiaConf
     }
 }
 
-// 履歴データをCSVに出力する
-void exportHistoryToCsv(const LiaConfig* cfg) {
-    const std::string filepath = std::format("./{}/autosetupw2history.csv", cfg->dirName);
-    std::ofstream file(filepath);
-
-    if (!file) {
+// 履歴データを保存形式 (csv / liab) で出力する
+void exportHistory(const LiaConfig* cfg) {
+    const std::string filepath = std::format("./{}/{}", cfg->dirName, cfg->save.fileName("autosetupw2history"));
+    const auto& w1 = cfg->autoSetupHistoryW1;
+    const auto& w2 = cfg->autoSetupHistoryW2;
+    const double dt = cfg->ringBuffer.getDt();
+
+    const std::vector<LiaConfig::ExportColumn> columns{
+        { "t", liab::Type::F64, [dt](size_t i) { return dt * i; } },
+        { "w1x", liab::Type::F64, [&](size_t i) { return w1.x[i]; } },
+        { "w1y", liab::Type::F64, [&](size_t i) { return w1.y[i]; } },
+        { "w2x", liab::Type::F64, [&](size_t i) { return w2.x[i]; } },
+        { "w2y", liab::Type::F64, [&](size_t i) { return w2.y[i]; } },
+    };
+    if (!LiaConfig::writeColumns(filepath, cfg->toIni().toString(), "# t(s),w1x(V),w1y(V),w2x(V),w2y(V)\n", columns, w1.x.size())) {
         std::cerr << "Error: Could not open file " << filepath << std::endl;
         return;
     }
-
-    std::stringstream ss;
-    ss << "# t(s),w1x(V),w1y(V),w2x(V),w2y(V)\n";
-    for (size_t i = 0; i < cfg->autoSetupHistoryW1.x.size(); ++i) {
-        ss << std::format("{:e},{:e},{:e},{:e},{:e}\n",
-            cfg->ringBuffer.getDt() * i,
-            cfg->autoSetupHistoryW1.x[i], cfg->autoSetupHistoryW1.y[i],
-            cfg->autoSetupHistoryW2.x[i], cfg->autoSetupHistoryW2.y[i]);
-    }
-    file << ss.str();
 }
 
 // ============================================================
@@ -157,8 +162,12 @@ void autosetupW2(LiaConfig* cfg) {
 		// W2をOFFにしてW1のみの状態で測定し、最新の点を基準にしてW2の振幅と位相を調整する
         applyAwgSettingsAndWait(cfg, { original_amp, 0.0 }, { 0.0, 0.0 }, 100);
 
-        double x_ = cfg->ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].x[cfg->ringBuffer.latestIdx];
-		double y_ = cfg->ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].y[cfg->ringBuffer.latestIdx];
+        double x_, y_;
+        {
+            const auto ringLock = cfg->lockRingBuffer();
+            x_ = cfg->ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].x[cfg->ringBuffer.latestIdx];
+            y_ = cfg->ringBuffer.ch[LiaConfigDefaultConsts::CH_HORIZONTAL].y[cfg->ringBuffer.latestIdx];
+        }
 
 		// 位相オフセット前の座標に変換
         const double phase_ = -cfg->post.offset[LiaConfigDefaultConsts::CH_HORIZONTAL].phase * std::numbers::pi / 180.0;
@@ -181,7 +190,10 @@ void autosetupW2(LiaConfig* cfg) {
         // ステップ1: W1の測定 (W1=ON, W2=OFF)
         // ------------------------------------------------------------
         applyAwgSettingsAndWait(cfg, { original_amp, 0.0 }, { 0.0, 0.0 }, RECORD_MS);
-        extractRingBufferToHistory(cfg->ringBuffer, cfg->autoSetupHistoryW1, RECORD_MS);
+        {
+            const auto ringLock = cfg->lockRingBuffer();
+            extractRingBufferToHistory(cfg->ringBuffer, cfg->autoSetupHistoryW1, RECORD_MS);
+        }
 
         auto [w1p1, w1p2] = findMaxDistancePoints(cfg->autoSetupHistoryW1.x, cfg->autoSetupHistoryW1.y);
         offsetHistory(cfg->autoSetupHistoryW1, w1p1); // W1は点1をベースにオフセット
@@ -193,7 +205,10 @@ void autosetupW2(LiaConfig* cfg) {
         // ステップ2: W2の測定 (W1=OFF, W2=ON)
         // ------------------------------------------------------------
         applyAwgSettingsAndWait(cfg, { 0.0, 0.0 }, { original_amp, 0.0 }, RECORD_MS);
-        extractRingBufferToHistory(cfg->ringBuffer, cfg->autoSetupHistoryW2, RECORD_MS);
+        {
+            const auto ringLock = cfg->lockRingBuffer();
+            extractRingBufferToHistory(cfg->ringBuffer, cfg->autoSetupHistoryW2, RECORD_MS);
+        }
 
         auto [w2p1, w2p2] = findMaxDistancePoints(cfg->autoSetupHistoryW2.x, cfg->autoSetupHistoryW2.y);
         offsetHistory(cfg->autoSetupHistoryW2, w2p2); // W2は点2をベースにオフセット
@@ -211,7 +226,7 @@ void autosetupW2(LiaConfig* cfg) {
         // 結果の保存
         cfg->flagAutoSetupW2History = true;
 
-        exportHistoryToCsv(cfg);
+        exportHistory(cfg);
     }
     // ステータス更新
     cfg->flagAutoOffset = true;
@@ -293,15 +308,14 @@ void autosetupW2_new(LiaConfig* pCfg) {
 
 FftResult analyzeFft(LiaConfig* pCfg, const double historySec) {
     int chIdx = 0;
-    double t = pCfg->ringBuffer.times[pCfg->ringBuffer.latestIdx];
     static std::vector<double> xs, ys;
     static std::vector<std::complex<double>> xfft, yfft, fft;
 
-    while (t + historySec > pCfg->ringBuffer.times[pCfg->ringBuffer.latestIdx]) {
-        pCfg->timer.sleepFor(0.1);
-    }
+    // historySec 分の新しい点がそろうまで待つ
+    pCfg->waitForPoints(static_cast<uint64_t>(std::ceil(historySec / pCfg->ringBuffer.getDt())));
+    auto ringLock = pCfg->lockRingBuffer(); // 取り出し終わるまで再配置を待たせる
     int latestIdx = pCfg->ringBuffer.latestIdx;
-    t = pCfg->ringBuffer.times[latestIdx];
+    double t = pCfg->ringBuffer.times[latestIdx];
 
     int bufferSize = (int)(historySec / pCfg->ringBuffer.getDt());
     static double inv_historySec = 0;
@@ -321,6 +335,7 @@ FftResult analyzeFft(LiaConfig* pCfg, const double historySec) {
         xs[i] = pCfg->ringBuffer.ch[chIdx].x[idx];
         ys[i] = pCfg->ringBuffer.ch[chIdx].y[idx];
     }
+    ringLock.unlock();
 
     pocketfft::r2c(
         { (size_t)bufferSize }, { sizeof(double) }, { sizeof(std::complex<double>) }, { 0 }, pocketfft::FORWARD, xs.data(), xfft.data(), 1.0
@@ -346,21 +361,19 @@ FftResult analyzeFft(LiaConfig* pCfg, const double historySec) {
     printf("\r%s", std::format("Max frequency: {} Hz, {}V\n", index * inv_historySec, maxVal).c_str());
 
     std::string timestamp = pCfg->getCurrentTimestamp();
-    std::ofstream fileBuffer(std::format("./{}/autosetup_ect_{}.csv", pCfg->dirName, timestamp));
-    if (fileBuffer) {
-        fileBuffer << "Time(s), x(V), y(V)\n";
-        for (int i = 0; i < xs.size(); ++i) {
-            fileBuffer << std::format("{:e},{:e},{:e}\n", i * pCfg->ringBuffer.getDt(), xs[i], ys[i]);
-        }
-        fileBuffer.close();
-    }
-    std::ofstream fileFft(std::format("./{}/autosetup_fft_{}.csv", pCfg->dirName, timestamp));
-    fileFft << "Freq(Hz), x(V), y(V)\n";
-    if (fileFft) {
-        for (int i = 0; i < fft.size(); ++i) {
-            fileFft << std::format("{:e},{:e},{:e}\n", i * inv_historySec, fft[i].real(), fft[i].imag());
-        }
-        fileFft.close();
-    }
+    const std::string settings = pCfg->toIni().toString();
+    const double dt = pCfg->ringBuffer.getDt();
+    LiaConfig::writeColumns(std::format("./{}/{}", pCfg->dirName, pCfg->save.fileName("autosetup_ect_" + timestamp)), settings,
+        "Time(s), x(V), y(V)\n", {
+            { "t", liab::Type::F64, [dt](size_t i) { return i * dt; } },
+            { "x", liab::Type::F64, [&](size_t i) { return xs[i]; } },
+            { "y", liab::Type::F64, [&](size_t i) { return ys[i]; } },
+        }, xs.size());
+    LiaConfig::writeColumns(std::format("./{}/{}", pCfg->dirName, pCfg->save.fileName("autosetup_fft_" + timestamp)), settings,
+        "Freq(Hz), x(V), y(V)\n", {
+            { "f", liab::Type::F64, [](size_t i) { return i * inv_historySec; } },
+            { "x", liab::Type::F64, [&](size_t i) { return fft[i].real(); } },
+            { "y", liab::Type::F64, [&](size_t i) { return fft[i].imag(); } },
+        }, fft.size());
     return { index * inv_historySec, fft[index]};
 }
\ No newline at end of file
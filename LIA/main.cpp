@@ -9,27 +9,50 @@
 #include <stop_token>
 #include <numbers>
 #include <cmath>
+#include <filesystem>
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <ranges>
+#include <charconv>
 
 #define NOMINMAX
+#include <WinSock2.h> // Windows.h より先に (winsock.h との衝突を避ける)
 #include <Windows.h>
 
 // プロジェクト固有のヘッダー
 #include <Daq_wf.h>
 #include "pipe.h"
+#include "DataSource.h"
+#include "DeviceArray.h"
 #include "Psd.h"
 #include "Gui.h"
 #include "LiaConfig.h"
 #include "GuiSub.h"
+#include "SocketServer.h"
 
 // --- 定数・構造体 ---
 struct LaunchOptions {
     bool useGui = true;
     bool usePipe = false;
+    int serverPort = 0;     // server [port]: 0 なら設定ファイルの [Server] port に従う
+    std::string shmName;    // shm [name]: 測定点を共有メモリへ書く
+    std::string liabInput;  // liab2csv: 変換して終了
+    std::string csvOutput;
+    bool simulate = false;  // sim [profile.ini] [fast [frames]]: 装置があってもシミュレーションで測定する
+    std::string simProfile;
+    bool simFast = false;   // 仮想時計で実時間を待たずに流す (frames > 0 ならそのフレーム数で終える)
+    uint64_t simFrames = 0;
+    std::string playback;   // play file.liab [max]: 記録した生波形を再生する
+    bool playbackMaxSpeed = false;
+    std::string arrayDevices; // array sn1,sn2,...|all|simN [pin]: 複数の装置を並列に測る (GUI なし)
+    bool arrayPin = false;    // 装置ごとの測定スレッドを2コアずつに固定する
 };
 
 // --- 関数プロトタイプ ---
-void runMeasurement(std::stop_token st, LiaConfig* cfg);
-void runSimulatedMeasurement(std::stop_token st, LiaConfig* cfg);
+std::unique_ptr<IDataSource> makeDataSource(const LaunchOptions& options);
+int runDeviceArray(const LaunchOptions& options);
 void fftLoop(std::stop_token st, LiaConfig* pCfg);
 LaunchOptions parseArguments(int argc, char* argv[]);
 
@@ -46,6 +69,43 @@ LaunchOptions parseArguments(int argc, char* argv[]) {
             options.useGui = false;
             options.usePipe = true; // headless時は通常pipeを有効化
         }
+        else if (arg == "server") {
+            options.serverPort = LiaConfigDefaultConsts::SERVER_PORT;
+            if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) options.serverPort = std::atoi(argv[++i]);
+        }
+        else if (arg == "shm") {
+            options.shmName = LiaConfigDefaultConsts::SHARED_MIRROR_NAME;
+            constexpr std::string_view KEYWORDS[] = { "pipe", "nogui", "headless", "server", "liab2csv", "sim", "play", "array" };
+            if (i + 1 < argc && std::ranges::find(KEYWORDS, std::string_view(argv[i + 1])) == std::end(KEYWORDS)) options.shmName = argv[++i];
+        }
+        else if (arg == "liab2csv" && i + 1 < argc) {
+            options.liabInput = argv[++i];
+            if (i + 1 < argc) options.csvOutput = argv[++i];
+            else options.csvOutput = std::filesystem::path(options.liabInput).replace_extension(".csv").string();
+        }
+        else if (arg == "sim") {
+            options.simulate = true;
+            if (i + 1 < argc && std::filesystem::path(argv[i + 1]).extension() == ".ini") options.simProfile = argv[++i];
+            if (i + 1 < argc && std::string_view(argv[i + 1]) == "fast") {
+                options.simFast = true;
+                ++i;
+                if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0]))) options.simFrames = std::stoull(argv[++i]);
+            }
+        }
+        else if (arg == "array" && i + 1 < argc) {
+            options.arrayDevices = argv[++i];
+            if (i + 1 < argc && std::string_view(argv[i + 1]) == "pin") {
+                options.arrayPin = true;
+                ++i;
+            }
+        }
+        else if (arg == "play" && i + 1 < argc) {
+            options.playback = argv[++i];
+            if (i + 1 < argc && std::string_view(argv[i + 1]) == "max") {
+                options.playbackMaxSpeed = true;
+                ++i;
+            }
+        }
     }
     return options;
 }
@@ -56,8 +116,38 @@ int main(int argc, char* argv[]) {
 #ifdef TEST
     try {
         test_psd();
+        test_rangeIndex();
+        test_frameHistory();
+        test_ringColumns();
+        test_trendStore();
+        test_csvWriter();
+        bench_csvWriter();
+        test_exportWorker();
+        test_journal();
+        test_pointStream();
+        test_controlQueue();
+        test_framePipeline();
+        test_seqNotifier();
+        test_timer();
+        test_liabFile();
+        test_npyFile();
         test_pipe();
+        test_signalSynth();
+        test_dataSource();
+        test_virtualClock();
+        test_deviceArray();
+        test_socketServer();
+        test_sharedMirror();
+        bench_sharedMirror();
+        bench_signalSynth();
+        bench_dataSource();
+        bench_deviceArray();
+        bench_pipeData();
+        bench_commandParser();
         test_w2autosetup();
+#ifdef LIA_FAKE_DWF
+        test_daqReconfigure();
+#endif
     }
     catch (const std::exception& e) {
         std::cerr << "Test failed with exception: " << e.what() << std::endl;
@@ -68,12 +158,16 @@ int main(int argc, char* argv[]) {
     std::ios::sync_with_stdio(false);
     std::cin.tie(nullptr);
     const auto options = parseArguments(argc, argv);
+    if (!options.liabInput.empty()) {
+        return liabToCsv(options.liabInput, options.csvOutput) ? 0 : 1;
+    }
+    if (!options.arrayDevices.empty()) {
+        return runDeviceArray(options);
+    }
 
     static LiaConfig settings;
-    const int adIdx = Daq_dwf::getIdxFirstEnabledDevice();
-    const bool isDeviceConnected = (adIdx != -1);
-
-    std::cout << (isDeviceConnected ? "Analog Discovery detected." : "DAQ not connected.") << std::endl;
+    static const auto source = makeDataSource(options); // 測定終了後も settings.pDaq から使うので静的に持つ
+    std::cout << "Source: " << source->name() << std::endl;
 
     // 1. GUI初期化
     std::unique_ptr<GuiSub> guiSub;
@@ -100,19 +194,43 @@ int main(int argc, char* argv[]) {
     std::unique_ptr<std::jthread> pipeThread;
     if (options.usePipe) {
         pipeThread = std::make_unique<std::jthread>(pipe, &settings);
-        while (!settings.statusPipe); // 通信準備完了待機
+        settings.events.wait([&] { return settings.statusPipe.load(); }); // 通信準備完了待機
+    }
+
+    // 2'. ソケットサーバー開始 (起動引数が設定ファイルより優先)
+    std::unique_ptr<SocketServer> server;
+    {
+        SocketServer::Options serverOptions;
+        const int port = (options.serverPort > 0) ? options.serverPort : settings.server.port;
+        serverOptions.port = (port > 0) ? port : -1;
+        serverOptions.unixPath = settings.server.unixSocket;
+        serverOptions.bindAddress = settings.server.bindAddress;
+        if (serverOptions.port > 0 || !serverOptions.unixPath.empty()) {
+            server = std::make_unique<SocketServer>(&settings, serverOptions);
+            if (server->start() && server->port() > 0) {
+                std::cout << std::format("Listening on {}:{}", serverOptions.bindAddress, server->port()) << std::endl;
+            }
+        }
+    }
+
+    if (!options.shmName.empty() && !settings.sharedMirror && settings.openSharedMirror(options.shmName)) {
+        std::cout << "Shared memory: " << options.shmName << std::endl;
     }
 
     // 3. 測定スレッド開始
-    auto measurementFunc = isDeviceConnected ? runMeasurement : runSimulatedMeasurement;
-    std::jthread measurementThread(measurementFunc, &settings);
+    std::atomic<bool> measurementEnded{ false };
+    std::jthread measurementThread([&](std::stop_token st) {
+        runMeasurement(st, settings, *source);
+        measurementEnded = true;
+        settings.events.notifyAll();
+        });
 
     // スレッド優先度の設定
     if (!SetThreadPriority(measurementThread.native_handle(), THREAD_PRIORITY_HIGHEST)) {
         std::cerr << "Warning: Failed to set thread priority.\n";
     }
 
-    while (!settings.statusMeasurement); // 測定開始待機
+    settings.events.wait([&] { return settings.statusMeasurement.load() || measurementEnded.load(); }); // 測定開始待機 (開始できなければ終了)
     std::cout << std::flush;
 
     // 4. メインループ
@@ -132,82 +250,160 @@ int main(int argc, char* argv[]) {
     }
     else {
         // Headlessモード: 測定終了かパイプ切断まで待機
-        while (settings.statusMeasurement) {
-            if (pipeThread && !settings.statusPipe) break;
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        }
+        settings.events.wait([&] { return !settings.statusMeasurement || (pipeThread && !settings.statusPipe); });
     }
 
     // 5. 終了処理 (jthreadのデストラクタが自動でjoinを呼ぶが、明示的にstopを要求)
+    settings.events.interrupt(); // data:wait などで待っているクライアントを戻す
     measurementThread.request_stop();
     if (pipeThread) pipeThread->request_stop();
+    if (server) server->stop();
 #endif // !TEST
     return 0;
 }
 
 // --- 測定処理の実装 ---
 
-void runMeasurement(std::stop_token st, LiaConfig* pCfg) {
-    static Daq_dwf daq;
-
-    // DAQ初期設定
-    daq.powerSupply(5.0);
-    const auto& ch0 = pCfg->awg.ch[0];
-    const auto& ch1 = pCfg->awg.ch[1];
-    daq.awg.start(ch0.freq, ch0.amp, ch0.phase, ch0.func, ch1.freq, ch1.amp, ch1.phase, ch1.func);
-
-    daq.scope.open(pCfg->scope.ch[0].range, pCfg->scope.ch[1].range, pCfg->scope.bufferSize, 1.0 / pCfg->scope.samplingDt);
-    daq.scope.trigger();
-
-    pCfg->pDaq = &daq;
-    pCfg->device_sn = daq.device.sn;
-    pCfg->timer.sleepFor(1.0); // 安定待ち
-
-    daq.scope.start();
-    pCfg->timer.start();
-    pCfg->statusMeasurement = true;
-
-    for (size_t nloop = 0; !st.stop_requested(); ++nloop) {
-        double t = pCfg->timer.sleepUntil(nloop * pCfg->ringBuffer.getDt());
+// 起動引数と装置の有無から測定の source を選ぶ
+std::unique_ptr<IDataSource> makeDataSource(const LaunchOptions& options) {
+    if (!options.playback.empty()) {
+        return std::make_unique<PlaybackSource>(options.playback, !options.playbackMaxSpeed);
+    }
+    if (options.simulate) {
+        auto sim = std::make_unique<SimulatedSource>();
+        if (!options.simProfile.empty() && !sim->loadProfile(options.simProfile)) {
+            std::cerr << "Failed to load simulation profile: " << options.simProfile << std::endl;
+        }
+        sim->setVirtualClock(options.simFast);
+        sim->setFrameLimit(options.simFrames);
+        return sim;
+    }
+    const bool isDeviceConnected = (Daq_dwf::getIdxFirstEnabledDevice() != -1);
+    std::cout << (isDeviceConnected ? "Analog Discovery detected." : "DAQ not connected.") << std::endl;
+    if (isDeviceConnected) return std::make_unique<DwfSource>();
+    return std::make_unique<SimulatedSource>();
+}
 
-        if (pCfg->pause.flag) continue;
+// 複数の装置を装置ごとのスレッドで並列に測り、共通の時間軸でまとめた行を <先頭の装置の保存先>/array.csv に書く
+//   devices: シリアルナンバー・all (開かれていない全装置)・simN (シミュレーション N 台) をカンマで並べる
+//   Enter で終了する (source が尽きる装置だけなら、すべて終わったときにも終了する)
+int runDeviceArray(const LaunchOptions& options) {
+    const auto usage = [](std::string_view reason) {
+        std::cerr << "array: " << reason << "\n"
+            << std::format("usage: array sn1,sn2,...|all|simN [pin]  (N = 1 to {})", DeviceArray::MAX_DEVICES) << std::endl;
+        return 1;
+    };
+    std::vector<std::string> entries;
+    for (const auto part : std::views::split(std::string_view(options.arrayDevices), ',')) {
+        const std::string item(part.begin(), part.end());
+        if (item.empty()) continue;
+        if (item == "all") {
+            const auto sns = Daq_dwf::getSerialNumbers();
+            entries.insert(entries.end(), sns.begin(), sns.end());
+        }
+        else if (item.starts_with("sim")) {
+            // sim の後は省略 (1台) か 1 以上の整数だけ (sim0, sim-3, simx は受け付けない)
+            const std::string_view digits = std::string_view(item).substr(3);
+            size_t n = 1;
+            if (!digits.empty()) {
+                const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), n);
+                if (ec != std::errc() || end != digits.data() + digits.size() || n == 0 || n > DeviceArray::MAX_DEVICES) {
+                    return usage(std::format("invalid simulation count '{}'", item));
+                }
+            }
+            entries.insert(entries.end(), n, "sim");
+        }
+        else entries.push_back(item);
+    }
+    if (entries.empty() || entries.size() > DeviceArray::MAX_DEVICES) {
+        return usage(std::format("1 to {} devices are needed ({} given)", DeviceArray::MAX_DEVICES, entries.size()));
+    }
 
-        if (pCfg->scope.ch[1].enable) {
-            daq.scope.record(pCfg->scope.ch[0].waveform.data(), pCfg->scope.ch[1].waveform.data());
+    DeviceArray array;
+    const unsigned cores = std::thread::hardware_concurrency();
+    int sims = 0;
+    for (size_t k = 0; k < entries.size(); ++k) {
+        std::string name;
+        std::unique_ptr<IDataSource> source;
+        if (entries[k] == "sim") {
+            auto params = SimulatedSource::defaultParams();
+            params.seed = k + 1;
+            source = std::make_unique<SimulatedSource>(params);
+            name = std::format("sim{}", sims++);
         }
         else {
-            daq.scope.record(pCfg->scope.ch[0].waveform.data());
+            source = std::make_unique<DwfSource>(entries[k]);
+            name = "AD";
+            for (const char c : entries[k]) {
+                if (std::isalnum(static_cast<unsigned char>(c))) name += c; // "SN:..." の ':' はファイル名に使えない
+            }
         }
-
-        pCfg->update(t);
+        const uint64_t mask = (options.arrayPin && cores >= 2 * (k + 1)) ? (uint64_t{ 3 } << (2 * k)) : 0;
+        try { array.add(name, std::move(source), mask); }
+        catch (const std::invalid_argument& e) { // dt (lia_<name>.ini の [RingBuffer]) が先の装置と違う
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << std::format("Device {}: {} ({})", k, name, array.source(k).name()) << (mask ? std::format(", cores {:#x}", mask) : "") << std::endl;
     }
-    pCfg->statusMeasurement = false;
-}
-
-void runSimulatedMeasurement(std::stop_token st, LiaConfig* pCfg) {
-    pCfg->timer.start();
-    pCfg->statusMeasurement = true;
-
-    for (size_t nloop = 0; !st.stop_requested(); ++nloop) {
-        double t = pCfg->timer.sleepUntil(nloop * pCfg->ringBuffer.getDt());
-
-        if (pCfg->pause.flag) continue;
-
-        // シミュレーション波形の生成
-        const double phaseShift = 2.0 * std::numbers::pi * t / 60.0;
-        const auto& ch0 = pCfg->awg.ch[0];
-        const auto& ch1 = pCfg->awg.ch[1];
-
-        for (size_t i = 0; i < pCfg->scope.ch[0].waveform.size(); ++i) {
-            double wt = 2.0 * std::numbers::pi * ch0.freq * i * pCfg->scope.samplingDt;
-            pCfg->scope.ch[0].waveform[i] = ch0.amp * std::sin(wt - phaseShift);
-
-            if (pCfg->scope.ch[1].enable) {
-                pCfg->scope.ch[1].waveform[i] = ch1.amp * std::sin(wt - ch1.phase);
+    const size_t started = array.start();
+    std::cout << std::format("Array: {} of {} devices started, dt = {} s", started, array.size(), array.dt()) << std::endl;
+    if (started == 0) return 1;
+
+    const std::string path = std::format("./{}/array.csv", array.config(0).dirName);
+    std::ofstream ofs(path);
+    ofs << "# t(s)";
+    for (size_t k = 0; k < array.size(); ++k) {
+        const std::string& name = array.config(k).instance();
+        ofs << std::format(", {0}.x1(V), {0}.y1(V), {0}.x2(V), {0}.y2(V)", name);
+    }
+    ofs << "\n";
+    std::vector<DeviceArray::Row> rows;
+    uint64_t written = 0, complete = 0;
+    auto write = [&] {
+        std::vector<char> line((1 + 4 * DeviceArray::MAX_DEVICES) * (CsvWriter::MAX_FIELD_CHARS + 1) + 1);
+        for (const auto& row : rows) {
+            char* p = CsvWriter::appendScientific(line.data(), row.t);
+            for (size_t k = 0; k < array.size(); ++k) {
+                for (const float v : row.xy[k]) {
+                    *p++ = ',';
+                    if (row.mask & (1u << k)) p = CsvWriter::appendScientific(p, v);
+                }
             }
+            *p++ = '\n';
+            ofs.write(line.data(), p - line.data());
+            if (row.mask == (1u << array.size()) - 1) ++complete;
+        }
+        written += rows.size();
+        rows.clear();
+        };
+
+    static std::atomic<bool> quit{ false }; // 入力待ちのスレッドは終了時に待たない (detach)
+    std::thread([] {
+        std::string line;
+        if (std::getline(std::cin, line)) quit = true;
+        }).detach();
+    std::cout << "Recording " << path << " (press Enter to stop)" << std::endl;
+
+    auto lastReport = std::chrono::steady_clock::now();
+    while (!quit && array.running()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        array.collect(rows);
+        write();
+        if (std::chrono::steady_clock::now() - lastReport >= std::chrono::seconds(1)) {
+            lastReport = std::chrono::steady_clock::now();
+            std::string report = std::format("t = {:.1f} s, {} rows ({} complete)", array.config(0).timer.elapsedSec(), written, complete);
+            for (size_t k = 0; k < array.size(); ++k) {
+                const auto s = array.stats(k);
+                report += std::format(" | {}: {} frames, {} stalls, {:.0f}% busy", array.config(k).instance(), s.pipeline.frames,
+                    s.pipeline.stalls, 100.0 * std::max(s.pipeline.acquireLoad, s.pipeline.processLoad));
+            }
+            std::cout << report << std::endl;
         }
-
-        pCfg->update(t);
     }
-    pCfg->statusMeasurement = false;
-}
\ No newline at end of file
+    array.stop();
+    array.collect(rows, true);
+    write();
+    std::cout << std::format("Array: {} rows ({} complete) written to {}", written, complete, path) << std::endl;
+    return 0;
+}
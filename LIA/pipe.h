@@ -1,16 +1,29 @@
 ﻿#pragma once
 #include "LiaConfig.h"
+#include "DataSource.h"
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <format>
 #include <functional>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <thread>
-#include <regex>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 // ============================================================
 // 定数定義
@@ -19,18 +32,41 @@ const std::vector<std::string> HELPS = {
     "Available commands:",
     "  reset or *rst                : Reset all settings to default values",
     "  *idn?                        : Identify connected DAQ device",
+    "  *opc?                        : Reply 1 once this client's settings changes are applied and a point measured with them exists",
     "  error?                       : Show last error message",
     "  end, exit, quit or close     : Exit the program",
     "  pause or stop                : Pause data acquisition",
     "  run                          : Resume data acquisition",
-    "  data:raw:save [filename]     : Save raw data to file (optional filename)",
+    "  data:raw:save [filename]     : Save raw data to file (optional filename; .liab/.npy/.npz select the format)",
     "  data:raw:size?               : Get size of raw data buffer",
-    "  data:raw?                    : Output raw data (time, ch1 [, ch2, ch3])",
+    "  data:raw?                    : Output raw data (time, ch1 [, ch2, ch3]) in the format:data format",
     "  data:fft:save [filename]     : Save FFT data to file (optional filename)",
     "  data:fft:size?               : Get size of FFT data buffer",
-    "  data:fft?                    : Output FFT data (frequency, ch1 [, ch2, ch3])",
-    "  data:txy? [seconds]          : Output time and XY data for specified seconds (default all)",
+    "  data:fft?                    : Output FFT data (frequency, ch1 [, ch2, ch3]) in the format:data format",
+    "  data:txy? [seconds]          : Output time and XY data for specified seconds (default all; count line only in ascii)",
+    "  data:txy:since <cursor> [max]: Output points from cursor (at most max rows): 'count,next cursor,skipped', then rows",
+    "                                 skipped is 'reset' (rows restart at the oldest point) for a cursor from before a buffer re-layout",
+    "  data:txy:cursor?             : Current cursor (buffer generation << 40 | number of measured points)",
+    "  data:txy:decim [n] [pick|mean|minmax|?] : Decimate data:txy? / since by n (minmax: 2 rows per n points)",
+    "  format:data [ascii|real,64|real,32|int,16|?] : Data query format. Binary formats reply #<n><len><rows x columns little-endian>",
+    "                                 int,16 omits the time/frequency column and first replies 'x0,dx,V per count'",
+    "  data:txy:save [sec] [file]   : Save time and XY data in background (see export:status?)",
     "  data:xy?                     : Output latest XY data point",
+    "  data:wait <n> [timeout]      : Wait for n points measured after this client's last settings change (or from now);",
+    "                                 replies the data:txy:since cursor of the first of them, or -1 on timeout / stop / buffer re-layout",
+    "  data:stream [on [n]|off|?]   : Push every (n-th) new point as '@seq,t,x1,y1[,x2,y2]' lines (binary format:data: '@#<n><len>' blocks of 32-byte records)",
+    "  data:stream:decim [n|?]      : Set or query the streaming decimation ratio",
+    "  data:stream:stats?           : Streaming state: on|off,decim,sent,dropped,queued",
+    "  data:stats? [sec | t0 t1]    : Output min,tmin,max,tmax,mean,std per x/y (default all)",
+    "  data:trend? [t0 t1 [points]] : Output 1s/10s/1min trend (count,period, then t,n,min,max,mean,std per x/y; default 0 to the latest bin)",
+    "  data:trend:tiers?            : Trend tiers: period,bins,capacity,oldest t,latest t",
+    "  data:history?                : Raw frame history: frames,capacity,oldest t,latest t,MB,rejected",
+    "  data:history:redemod t0 t1 [harmonic] [phase1] [phase2] [rect|hann|blackman] : Re-demodulate stored raw frames in background",
+    "  data:history:status?         : Re-demodulation state: running|done,processed,total,frames/s",
+    "  data:history:result?         : Output re-demodulated data (count, then t,x1,y1[,x2,y2])",
+    "  buffer:dt [value|?]          : Set or query ring buffer sample period in s (re-layouts history)",
+    "  buffer:sec [value|?]         : Set or query ring buffer length in s (re-layouts history)",
+    "  buffer:relayout?             : Query whether a ring buffer re-layout is in progress (busy|idle)",
     "  plot:raw:limit <val>         : Set raw window limit",
     "  plot:xy:limit <val>          : Set XY window limit",
     "  acfm|disp [on|off|?]         : Enable/disable or query ACFM window display state",
@@ -44,249 +80,445 @@ const std::vector<std::string> HELPS = {
     "  post:hpf:freq [value|?]      : Set or query high-pass filter frequency (0 to 50 Hz)",
     "  post:lpf:freq [value|?]      : Set or query low-pass filter frequency (10 to 100 Hz)",
     "  post[n]:offset:phase [val|?] : Set or query calculation offset phase in degrees",
+    "  control:stats?               : Settings changes applied at frame boundaries: submitted,applied,queued,rejected,last/mean/max apply latency in us",
+    "  pipeline:stats?              : Acquisition/processing threads: on|off,frames,stalls,acquire %,process %,acquire/process us per frame",
+    "  timer:stats?                 : Frame pacing: waits,overruns,mean/p99/max lateness in us,spinning % of the wait",
+    "  timer:margin [us|?]          : Set or query how early the pacing wait wakes up to spin (negative: spin only)",
+    "  export:status?               : Background save state: running|idle,done,total,queued,completed,last file,ok|error,message",
+    "  export:format [csv|liab|npy|npz|?] : Set or query file format for saves without an explicit file name",
     "  help? or ?                   : Show this help message",
+    "  help:size?                   : Number of help lines",
+    "  Several commands can be sent on one line separated by ';' (e.g. w1:freq 1000;w1:amp 0.5)",
 };
 
 // ============================================================
-// ユーティリティ
+// ユーティリティ (行バッファを指す string_view で扱い、確保しない)
 // ============================================================
 namespace utils {
-    inline std::vector<std::string> split(const std::string& str, char delimiter = ':') {
-        std::vector<std::string> tokens;
-        if (str.empty()) return tokens;
-        std::string token;
-        std::istringstream tokenStream(str);
-        while (std::getline(tokenStream, token, delimiter)) {
-            if (!token.empty()) {
-                tokens.push_back(token);
-            }
+    // delimiter で区切った空でない要素を out に入れる (out の容量は再利用される)
+    inline void split(std::string_view str, char delimiter, std::vector<std::string_view>& out) {
+        out.clear();
+        while (!str.empty()) {
+            const size_t pos = str.find(delimiter);
+            const std::string_view token = str.substr(0, pos);
+            if (!token.empty()) out.push_back(token);
+            if (pos == std::string_view::npos) break;
+            str.remove_prefix(pos + 1);
         }
-        return tokens;
     }
 
     inline void toLower(std::string& str) {
         std::transform(str.begin(), str.end(), str.begin(), ::tolower);
     }
 
-    inline std::pair<std::string, int> parseIndex(const std::string& s) {
-        std::regex re("([a-z]+)([0-9]+)");
-        std::smatch match;
-        if (std::regex_match(s, match, re)) {
-            return { match[1].str(), std::stoi(match[2].str()) };
+    // 先頭の数値を読む (std::stod などと同様に後続の文字は無視する)。読めなければ false で value は変えない
+    template <class T>
+    inline bool parseNumber(std::string_view s, T& value) noexcept {
+        if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+        return std::from_chars(s.data(), s.data() + s.size(), value).ec == std::errc();
+    }
+
+    // "chan2" -> { "chan", 2 }。英小文字 + 数字の形でなければ { s, -1 }
+    inline std::pair<std::string_view, int> parseIndex(std::string_view s) noexcept {
+        size_t digits = s.size();
+        while (digits > 0 && s[digits - 1] >= '0' && s[digits - 1] <= '9') --digits;
+        if (digits == 0 || digits == s.size()) return { s, -1 };
+        if (!std::all_of(s.begin(), s.begin() + digits, [](char c) { return c >= 'a' && c <= 'z'; })) return { s, -1 };
+        int index = -1;
+        parseNumber(s.substr(digits), index);
+        return { s.substr(0, digits), index };
+    }
+
+    // コンパイル時に引くコマンド表のハッシュ (FNV-1a)
+    constexpr uint32_t hashName(std::string_view s) noexcept {
+        uint32_t h = 2166136261u;
+        for (const char c : s) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 16777619u;
         }
-        return { s, -1 };
+        return h;
     }
+
+    // コンパイル時に構築する開番地法のハッシュ表 (名前の重複はコンパイルエラー)
+    template <class Entry, size_t N>
+    class NameTable {
+    public:
+        static constexpr size_t SLOTS = std::bit_ceil(N * 4); // 負荷率 1/4 以下で探索はほぼ1回
+
+        consteval explicit NameTable(const std::array<Entry, N>& entries) : entries_(entries) {
+            for (size_t i = 0; i < N; ++i) {
+                for (size_t j = 0; j < i; ++j) {
+                    if (entries[i].name == entries[j].name) throw "duplicate command name";
+                }
+                size_t k = hashName(entries[i].name) & (SLOTS - 1);
+                while (slots_[k] != 0) k = (k + 1) & (SLOTS - 1);
+                slots_[k] = static_cast<uint8_t>(i + 1);
+            }
+        }
+
+        constexpr const Entry* find(std::string_view name) const noexcept {
+            for (size_t k = hashName(name) & (SLOTS - 1); slots_[k] != 0; k = (k + 1) & (SLOTS - 1)) {
+                const Entry& e = entries_[slots_[k] - 1];
+                if (e.name == name) return &e;
+            }
+            return nullptr;
+        }
+
+    private:
+        std::array<Entry, N> entries_;
+        std::array<uint8_t, SLOTS> slots_{}; // entries_ の添字 + 1 (0 は空き)
+    };
 }
 
+// データ問い合わせ (data:raw? など) の応答形式
+enum class DataFormat { Ascii, Real64, Real32, Int16 };
+
+// data:txy? / data:txy:since の間引き方
+enum class DecimMode { Pick, Mean, MinMax };
+
 // ============================================================
 // コマンド処理クラス
+//   1行は ';' で区切った複数のコマンドを含められる (各コマンドは独立に解釈する)
+//   行は再利用する行バッファに読み、以降は string_view で分割・照合するので定常状態では確保しない
 // ============================================================
 class CommandProcessor {
 public:
-    explicit CommandProcessor(LiaConfig* config) : pCfg(config) {
-        registerCommands();
+    // in からコマンドを読み、応答を out に書く (既定は標準入出力)
+    explicit CommandProcessor(LiaConfig* config, std::istream& input = std::cin, std::ostream& output = std::cout)
+        : pCfg(config), in(input), out(output) {
     }
+    ~CommandProcessor() { stopStream(); }
 
     void processStream(std::stop_token st) {
-        pCfg->statusPipe = true;
+        pCfg->setStatus(pCfg->statusPipe, true);
 
+        std::string line;
         while (!st.stop_requested()) {
-            std::string line;
-            if (!std::getline(std::cin, line)) {
+            if (!std::getline(in, line)) {
                 break;
             }
+            if (!handleLine(line)) break;
+        }
 
-            std::string original_line = line;
-            utils::toLower(line);
-
-            std::istringstream iss(line);
-            std::string commandPart, argumentPart;
-            iss >> commandPart;
-
-            if (commandPart == "end" || commandPart == "exit" || commandPart == "quit" || commandPart == "close") {
-                break;
-            }
-
-            iss >> argumentPart;
-            float value = 0.0f;
-            try {
-                if (!argumentPart.empty()) {
-                    value = std::stof(argumentPart);
-                }
-            }
-            catch (...) {
-                value = 0.0f;
-            }
-
-            if (!commandPart.empty() && commandPart.front() == ':') {
-                commandPart.erase(0, 1);
-            }
-
-            auto tokens = utils::split(commandPart, ':');
-            bool success = dispatchCommand(commandPart, tokens, argumentPart, value);
+        stopStream();
+        pCfg->setStatus(pCfg->statusPipe, false);
+    }
 
-            if (!success) {
-                lastErrorCmd = original_line;
-                if (commandPart.find('?') != std::string::npos) {
-                    std::cout << std::format("Error: '{}'\n", lastErrorCmd);
-                    lastErrorCmd.clear();
-                }
-            }
+    // 1行を実行して応答を out に書く。終了コマンド (end, exit, quit, close) なら false
+    // (processStream のほか、ソケットサーバーの接続ごとのコマンドスレッドが受信した行ごとに呼ぶ)
+    bool handleLine(std::string& line) {
+        if (streamThread.joinable() && streamThread.get_stop_token().stop_requested()) stopStream(); // data:stream off の後始末
 
-            if (awgUpdateRequired && pCfg->pDaq != nullptr) {
-                const auto& ch0 = pCfg->awg.ch[0];
-                const auto& ch1 = pCfg->awg.ch[1];
-                pCfg->pDaq->awg.start(
-                    ch0.freq, ch0.amp, ch0.phase, ch0.func,
-                    ch1.freq, ch1.amp, ch1.phase, ch1.func
-                );
-                awgUpdateRequired = false;
-            }
+        std::lock_guard<std::mutex> lock(outMtx); // 配信スレッドの出力と混ざらないようにする
+        if (!processLine(line)) return false;
+        out << std::flush;
+        return true;
+    }
 
-            std::cout << std::flush;
+private:
+    // 1行 (';' 区切りで複数可) を実行する。終了コマンドなら false
+    bool processLine(std::string& line) {
+        originalLine.assign(line); // エラー表示用に大文字小文字を保つ
+        utils::toLower(line);
+        std::string_view rest = line;
+        while (true) {
+            const size_t pos = rest.find(';');
+            const std::string_view text = rest.substr(0, pos);
+            const size_t offset = static_cast<size_t>(text.data() - line.data());
+            if (!executeCommand(text, std::string_view(originalLine).substr(offset, text.size()))) return false;
+            if (pos == std::string_view::npos) return true;
+            rest.remove_prefix(pos + 1);
         }
-
-        pCfg->statusPipe = false;
     }
 
-private:
+    // 解析済みの1コマンド (各 string_view は行バッファを指す)
+    struct Command {
+        std::string_view header;                 // 先頭の ':' を除いたコマンド部 (例: "w1:freq?")
+        std::span<const std::string_view> nodes; // header を ':' で分けたもの
+        std::string_view arg;                    // 第1引数 (無ければ空)
+        float value = 0.0f;                      // arg を数値として読んだ値 (読めなければ 0)
+        int ch = -1;                             // nodes[0] の番号を 0 始まりにしたもの (chan2 -> 1)。無ければ -1
+    };
+    using Handler = bool (CommandProcessor::*)(const Command&);
+    struct CommandEntry {
+        std::string_view name;
+        Handler handler;
+        bool prefix; // true なら nodes[0] の英字部分 (w1 -> w) で照合する
+    };
+
     LiaConfig* pCfg;
+    std::istream& in;
+    std::ostream& out;
+    DataFormat dataFormat = DataFormat::Ascii;
+    std::vector<char> blockBuffer; // バイナリ応答の再利用バッファ
+    int txyDecimation = 1;         // 1 なら間引かない
+    DecimMode txyDecimMode = DecimMode::Pick;
+    std::vector<double> txyTable;  // mean / minmax の集計結果
     std::string lastErrorCmd;
-    bool awgUpdateRequired = false;
-
-    // ★ ハンドラの型に channel index (int) を追加
-    using CommandHandler = std::function<bool(int, const std::vector<std::string>&, const std::string&, float)>;
+    uint64_t pendingControl = 0;             // 最後に積んだ設定変更の通し番号 (問い合わせの前に適用を待つ)
+    uint64_t waitedControl = 0;              // *opc? / data:wait で変更後の点まで待ち終えた pendingControl
+    std::string originalLine;                // 小文字化前の行
+    std::vector<std::string_view> nodes;     // 現在のコマンドの ':' 区切り
+    std::vector<std::string_view> arguments; // 現在のコマンドの全引数 (複数引数を取るコマンド用)
+
+    // data:stream: 配信スレッドは PointStream の購読キューから読み、outMtx を取って書く
+    std::mutex outMtx;
+    int streamId = -1;
+    std::atomic<uint64_t> streamSent{ 0 };
+    std::jthread streamThread;
 
-    std::map<std::string, CommandHandler> exactMatchHandlers;
-    std::map<std::string, CommandHandler> prefixMatchHandlers;
+    // ============================================================
+    // コマンド表 (コンパイル時に構築)
+    // ============================================================
+    static const CommandEntry* findCommand(std::string_view name) noexcept {
+        using P = CommandProcessor;
+        static constexpr utils::NameTable table(std::to_array<CommandEntry>({
+            // --- システム・基本操作 ---
+            { "reset", &P::cmdReset, false },
+            { "*rst", &P::cmdReset, false },
+            { "*idn?", &P::handleIdn, false },
+            { "*opc?", &P::cmdOpc, false },
+            { "error?", &P::handleError, false },
+            { "pause", &P::cmdPause, false },
+            { "stop", &P::cmdPause, false },
+            { "run", &P::cmdRun, false },
+            { "help?", &P::cmdHelp, false },
+            { "?", &P::cmdHelp, false },
+            { "help:size?", &P::cmdHelpSize, false },
+            { "export:status?", &P::cmdExportStatus, false },
+            { "export:format", &P::cmdExportFormat, false },
+            { "export:format?", &P::cmdExportFormat, false },
+            { "format:data", &P::cmdFormatData, false },
+            { "format:data?", &P::cmdFormatData, false },
+            { "acfm:disp", &P::cmdAcfmDisp, false },
+            { "acfm:disp?", &P::cmdAcfmDisp, false },
+            { "control:stats?", &P::cmdControlStats, false },
+            { "pipeline:stats?", &P::cmdPipelineStats, false },
+            { "timer:stats?", &P::cmdTimerStats, false },
+            { "timer:margin", &P::cmdTimerMargin, false },
+            { "timer:margin?", &P::cmdTimerMargin, false },
+            // --- プレフィックス(階層型)コマンド ---
+            { "data", &P::handleData, true },
+            { "plot", &P::handlePlot, true },
+            { "buffer", &P::handleBuffer, true },
+            { "w", &P::handleAwg, true },
+            { "post", &P::handlePost, true },
+            { "calc", &P::handlePost, true },
+            { "chan", &P::handleChan, true },
+            }));
+        return table.find(name);
+    }
 
     // ============================================================
-    // コマンド登録
+    // 解析・ディスパッチ
     // ============================================================
-    void registerCommands() {
-        // --- システム・基本操作 ---
-        auto resetHandler = [this](int, auto&, auto&, auto) {
-            pCfg->reset();
-            lastErrorCmd.clear();
-            awgUpdateRequired = true;
-            return true;
-            };
-        exactMatchHandlers["reset"] = resetHandler;
-        exactMatchHandlers["*rst"] = resetHandler;
+    // 1コマンドを解析して実行する。終了コマンドなら false
+    bool executeCommand(std::string_view text, std::string_view original) {
+        constexpr std::string_view SPACES = " \t\r\n";
+        arguments.clear();
+        std::string_view header;
+        while (true) {
+            const size_t begin = text.find_first_not_of(SPACES);
+            if (begin == std::string_view::npos) break;
+            text.remove_prefix(begin);
+            const std::string_view word = text.substr(0, text.find_first_of(SPACES));
+            if (header.empty()) header = word;
+            else arguments.push_back(word);
+            text.remove_prefix(word.size());
+        }
+        if (header.empty()) return true;
+        if (header == "end" || header == "exit" || header == "quit" || header == "close") return false;
+        if (header.front() == ':') header.remove_prefix(1);
+
+        utils::split(header, ':', nodes);
+        Command cmd{ header, nodes };
+        if (!arguments.empty()) {
+            cmd.arg = arguments[0];
+            utils::parseNumber(cmd.arg, cmd.value);
+        }
 
-        exactMatchHandlers["*idn?"] = [this](int, auto&, auto&, auto) { return handleIdn(); };
-        exactMatchHandlers["error?"] = [this](int, auto&, auto&, auto) { return handleError(); };
-        exactMatchHandlers["pause"] = [this](int, auto&, auto&, auto) { pCfg->pause.flag = true; return true; };
-        exactMatchHandlers["stop"] = [this](int, auto&, auto&, auto) { pCfg->pause.flag = true; return true; };
-        exactMatchHandlers["run"] = [this](int, auto&, auto&, auto) { pCfg->pause.flag = false; return true; };
+        // 自分が積んだ設定変更がフレーム境界で適用されてから答える
+        if (header.find('?') != std::string_view::npos && pCfg->controls.applied() < pendingControl) pCfg->waitControls(pendingControl);
 
-        auto helpHandler = [this](int, auto&, auto&, auto) {
-            for (const auto& line : HELPS) std::cout << line << "\n";
-            return true;
-            };
-        exactMatchHandlers["help?"] = helpHandler;
-        exactMatchHandlers["?"] = helpHandler;
-        exactMatchHandlers["help"] = [this](int, const auto& tokens, auto&, auto) {
-            if (tokens.size() > 1 && tokens[1] == "size?") {
-                std::cout << HELPS.size() << "\n";
-                return true;
+        bool success = false;
+        if (const CommandEntry* e = findCommand(header); e != nullptr && !e->prefix) {
+            success = (this->*(e->handler))(cmd);
+        }
+        else if (!nodes.empty()) {
+            // "chan1", "w2", "post3" などからベースコマンドとインデックスを分離
+            const auto [baseCmd, index] = utils::parseIndex(nodes[0]);
+            cmd.ch = (index > 0) ? (index - 1) : -1; // 0ベースインデックスに変換 (例: chan1 -> 0)
+            if (const CommandEntry* p = findCommand(baseCmd); p != nullptr && p->prefix) {
+                success = (this->*(p->handler))(cmd);
             }
-            return false;
-            };
-
-        exactMatchHandlers["acfm:disp"] = [this](int, auto&, const std::string& a, auto) { return handleToggle(a, pCfg->window.acfmWindow); };
-        exactMatchHandlers["acfm:disp?"] = [this](int, auto&, auto&, auto) { std::cout << (pCfg->window.acfmWindow ? "on\n" : "off\n"); return true; };
+        }
 
-        // --- プレフィックス(階層型)コマンド ---
-        prefixMatchHandlers["data"] = [this](int ch, auto& t, auto& a, auto v) { return handleData(t, a, v); }; // dataはchIndexを使わない
-        prefixMatchHandlers["plot"] = [this](int ch, auto& t, auto& a, auto v) { return handlePlot(t, a, v); };
-        prefixMatchHandlers["w"] = [this](int ch, auto& t, auto& a, auto v) { return handleAwg(ch, t, a, v); };
-        prefixMatchHandlers["post"] = [this](int ch, auto& t, auto& a, auto v) { return handlePost(ch, t, a, v); };;
-        prefixMatchHandlers["chan"] = [this](int ch, auto& t, auto& a, auto v) { return handleChan(ch, t, a, v); };
+        if (!success) {
+            lastErrorCmd.assign(original.substr(original.find_first_not_of(SPACES)));
+            if (header.find('?') != std::string_view::npos) {
+                out << std::format("Error: '{}'\n", lastErrorCmd);
+                lastErrorCmd.clear();
+            }
+        }
+        return true;
     }
 
     // ============================================================
-    // ディスパッチ処理
+    // 基本コマンド
     // ============================================================
-    bool dispatchCommand(const std::string& commandPart, const std::vector<std::string>& tokens, const std::string& arg, float val) {
-        if (auto it = exactMatchHandlers.find(commandPart); it != exactMatchHandlers.end()) {
-            return it->second(-1, tokens, arg, val);
+    bool cmdReset(const Command&) {
+        lastErrorCmd.clear();
+        return submitControl(ControlCommand::Op::Reset);
+    }
+    // 設定変更を測定スレッドへ積む (キューが満杯ならエラー)
+    bool submitControl(ControlCommand::Op op, int ch = 0, double value = 0.0) {
+        const uint64_t ticket = pCfg->submit({ op, ch, value });
+        if (ticket == 0) return false;
+        pendingControl = ticket;
+        return true;
+    }
+    // 自分が積んだ設定変更の後 (待ち終えていれば今) から n 点確定するまで待つ。base はその最初の点の seq
+    bool waitFresh(uint64_t n, double timeoutSec, uint64_t& base) {
+        if (pendingControl <= waitedControl) {
+            base = pCfg->events.seq();
+            return pCfg->waitUntilSeq(base + n, timeoutSec);
         }
+        if (!pCfg->waitControls(pendingControl)) return false;
+        waitedControl = pendingControl;
+        const auto first = pCfg->waitPointsAfterControls(n, timeoutSec);
+        base = first.value_or(0);
+        return first.has_value();
+    }
+    bool cmdOpc(const Command&) {
+        uint64_t base = 0;
+        if (pendingControl > waitedControl && !waitFresh(1, -1.0, base)) return false;
+        out << "1\n";
+        return true;
+    }
+    bool cmdPipelineStats(const Command&) {
+        const auto s = pCfg->pipeline.stats();
+        out << std::format("{},{},{},{:.1f},{:.1f},{:.1f},{:.1f}\n", s.running ? "on" : "off", s.frames, s.stalls,
+            100.0 * s.acquireLoad, 100.0 * s.processLoad, s.acquireUs, s.processUs);
+        return true;
+    }
+    bool cmdTimerStats(const Command&) {
+        const auto s = pCfg->timer.stats();
+        out << std::format("{},{},{:.1f},{:.0f},{:.1f},{:.1f}\n", s.waits, s.overruns, s.meanLateUs, s.p99LateUs, s.maxLateUs, 100.0 * s.spinRatio);
+        return true;
+    }
+    bool cmdTimerMargin(const Command& cmd) {
+        if (cmd.header.back() == '?' || cmd.arg == "?") { out << pCfg->timing.spinMarginUs << "\n"; return true; }
+        float us = 0.0f;
+        if (!utils::parseNumber(cmd.arg, us)) return false;
+        pCfg->setSpinMargin(us);
+        return true;
+    }
+    bool cmdControlStats(const Command&) {
+        const auto s = pCfg->controls.stats();
+        out << std::format("{},{},{},{},{:.1f},{:.1f},{:.1f}\n", s.submitted, s.applied, s.queued, s.rejected, s.lastUs, s.meanUs, s.maxUs);
+        return true;
+    }
+    bool cmdPause(const Command&) { pCfg->pause.flag = true; return true; }
+    bool cmdRun(const Command&) { pCfg->pause.flag = false; return true; }
 
-        if (!tokens.empty()) {
-            // "chan1", "w2", "calc3" などからベースコマンドとインデックスを分離
-            auto [baseCmd, index] = utils::parseIndex(tokens[0]);
+    bool cmdHelp(const Command&) {
+        for (const auto& line : HELPS) out << line << "\n";
+        return true;
+    }
+    bool cmdHelpSize(const Command&) {
+        out << HELPS.size() << "\n";
+        return true;
+    }
 
-            // 0ベースインデックスに変換 (例: chan1 -> 0, chan2 -> 1, chan3 -> 2)
-            int chIndex = (index > 0) ? (index - 1) : -1;
+    bool cmdExportStatus(const Command&) {
+        const auto s = pCfg->exporter.status();
+        out << std::format("{},{},{},{},{},{},{},{}\n", s.running ? "running" : "idle", s.done, s.total, s.queued,
+            s.completed, s.running ? s.current : s.last, s.lastOk ? "ok" : "error", s.message);
+        return true;
+    }
 
-            if (auto it = prefixMatchHandlers.find(baseCmd); it != prefixMatchHandlers.end()) {
-                return it->second(chIndex, tokens, arg, val);
-            }
-        }
-        return false;
+    bool cmdExportFormat(const Command& cmd) {
+        if (cmd.header.back() == '?' || cmd.arg == "?") { out << pCfg->save.format << "\n"; return true; }
+        return pCfg->setSaveFormat(std::string(cmd.arg));
+    }
+
+    bool cmdFormatData(const Command& cmd) {
+        if (cmd.header.back() == '?' || cmd.arg == "?") return handleFormatQuery();
+        static constexpr std::pair<std::string_view, DataFormat> FORMATS[] = {
+            { "ascii", DataFormat::Ascii }, { "real,64", DataFormat::Real64 },
+            { "real,32", DataFormat::Real32 }, { "int,16", DataFormat::Int16 },
+        };
+        const auto it = std::find_if(std::begin(FORMATS), std::end(FORMATS), [&cmd](const auto& f) { return f.first == cmd.arg; });
+        if (it == std::end(FORMATS)) return false;
+        dataFormat = it->second;
+        return true;
+    }
+
+    bool cmdAcfmDisp(const Command& cmd) {
+        if (cmd.header.back() == '?') { out << (pCfg->window.acfmWindow ? "on\n" : "off\n"); return true; }
+        return handleToggle(cmd.arg, pCfg->window.acfmWindow);
     }
 
     // ============================================================
     // 個別ハンドラの実装
     // ============================================================
-    bool handleIdn() {
+    bool handleIdn(const Command&) {
         if (pCfg->pDaq == nullptr) {
-            std::cout << "No DAQ is connected.\n";
+            out << "No DAQ is connected.\n";
         }
         else {
             const auto& dev = pCfg->pDaq->device;
-            std::cout << std::format("{},{},{},{}\n", dev.manufacturer, dev.name, dev.sn, dev.version);
+            out << std::format("{},{},{},{}\n", dev.manufacturer, dev.name, dev.sn, dev.version);
         }
         return true;
     }
 
-    bool handleError() {
+    bool handleError(const Command&) {
         if (lastErrorCmd.empty()) {
-            std::cout << "No error.\n";
+            out << "No error.\n";
         }
         else {
-            std::cout << std::format("Last error: '{}'\n", lastErrorCmd);
+            out << std::format("Last error: '{}'\n", lastErrorCmd);
             lastErrorCmd.clear();
         }
         return true;
     }
 
-    bool handleToggle(const std::string& arg, bool& stateFlag) {
+    bool handleToggle(std::string_view arg, bool& stateFlag) {
         if (arg == "on") { stateFlag = true; return true; }
         if (arg == "off") { stateFlag = false; return true; }
         return false;
     }
 
     // ★ チャンネル処理 (chan[n]:range, chan[n]:disp)
-    bool handleChan(int chIndex, const std::vector<std::string>& tokens, const std::string& arg, float val) {
+    bool handleChan(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const std::string_view arg = cmd.arg;
+        const float val = cmd.value;
+        const int chIndex = cmd.ch;
         if (tokens.size() < 2 || chIndex < 0 || chIndex >= pCfg->scope.ch.size()) return false;
 
-        std::string subCmd = tokens[1];
+        std::string_view subCmd = tokens[1];
         bool isQuery = (subCmd.back() == '?');
-        if (isQuery) subCmd.pop_back();
+        if (isQuery) subCmd.remove_suffix(1);
 
         if (subCmd == "range") {
             if (isQuery) {
-                std::cout << pCfg->scope.ch[chIndex].range << "\n";
+                out << pCfg->scope.ch[chIndex].range << "\n";
             }
             else {
-                pCfg->scope.ch[chIndex].range = val;
-                pCfg->scope.setMaxRange();
-
-                pCfg->pDaq->scope.open(pCfg->scope.ch[0].range, pCfg->scope.ch[1].range, pCfg->scope.bufferSize, 1.0 / pCfg->scope.samplingDt);
-                pCfg->pDaq->scope.trigger();
-                pCfg->pDaq->scope.start();
+                return submitControl(ControlCommand::Op::ScopeRange, chIndex, val);
             }
             return true;
         }
 
         if (subCmd == "disp") {
             if (isQuery) {
-                std::cout << (pCfg->scope.ch[chIndex].enable ? "on\n" : "off\n");
+                out << (pCfg->scope.ch[chIndex].enable ? "on\n" : "off\n");
             }
             else {
-                return handleToggle(arg, pCfg->scope.ch[chIndex].enable);
+                bool enable = false;
+                return handleToggle(arg, enable) && submitControl(ControlCommand::Op::ChEnable, chIndex, enable ? 1.0 : 0.0);
             }
             return true;
         }
@@ -294,31 +526,185 @@ private:
         return false;
     }
 
+    bool handleFormatQuery() {
+        static constexpr const char* NAMES[] = { "ascii", "real,64", "real,32", "int,16" };
+        out << NAMES[static_cast<int>(dataFormat)] << "\n";
+        return true;
+    }
+
+    // rows 行 x cols 列 (0 列目は時刻または周波数) を dataFormat で出力する
+    //   ascii  : 1行ずつ "{:e}" の CSV
+    //   real,* : IEEE 488.2 の確定長ブロック #<n><len><bytes> (行優先・リトルエンディアン) + 改行
+    //   int,16 : 0 列目を除いた値を共通の係数で int16 にしたブロック。直前に "x0,dx,係数(V/count)" の行を出す
+    void writeTable(size_t rows, size_t cols, const std::function<double(size_t, size_t)>& get) {
+        if (dataFormat == DataFormat::Ascii) {
+            CsvWriter csv;
+            for (size_t c = 0; c < cols; ++c) csv.column([&get, c](size_t r) { return get(r, c); });
+            const std::string_view text = csv.format(rows);
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+            return;
+        }
+
+        const size_t firstCol = (dataFormat == DataFormat::Int16) ? 1 : 0;
+        const size_t elemSize = (dataFormat == DataFormat::Real64) ? 8 : (dataFormat == DataFormat::Real32) ? 4 : 2;
+        const size_t payload = rows * (cols - firstCol) * elemSize;
+        const std::string len = std::to_string(payload);
+        const std::string header = std::format("#{}{}", len.size(), len);
+
+        double lsb = 1.0;
+        if (dataFormat == DataFormat::Int16) {
+            double maxAbs = 0.0;
+            for (size_t r = 0; r < rows; ++r) {
+                for (size_t c = 1; c < cols; ++c) maxAbs = std::max(maxAbs, std::abs(get(r, c)));
+            }
+            if (maxAbs > 0.0) lsb = maxAbs / 32767.0;
+            const double x0 = (rows > 0) ? get(0, 0) : 0.0;
+            const double dx = (rows > 1) ? (get(rows - 1, 0) - x0) / static_cast<double>(rows - 1) : 0.0;
+            out << std::format("{:e},{:e},{:e}\n", x0, dx, lsb);
+        }
+
+        // ヘッダ・本体・改行を1つのバッファにまとめて1回で書く
+        blockBuffer.resize(header.size() + payload + 1);
+        std::memcpy(blockBuffer.data(), header.data(), header.size());
+        char* p = blockBuffer.data() + header.size();
+        for (size_t r = 0; r < rows; ++r) {
+            for (size_t c = firstCol; c < cols; ++c) {
+                const double v = get(r, c);
+                switch (dataFormat) {
+                case DataFormat::Real64: std::memcpy(p, &v, 8); break;
+                case DataFormat::Real32: { const float f = static_cast<float>(v); std::memcpy(p, &f, 4); break; }
+                default: { const int16_t i = static_cast<int16_t>(std::lround(v / lsb)); std::memcpy(p, &i, 2); break; }
+                }
+                p += elemSize;
+            }
+        }
+        *p = '\n';
+        out.write(blockBuffer.data(), static_cast<std::streamsize>(blockBuffer.size()));
+    }
+
+    // seq 範囲 [first, first + blocks * n) を n = txyDecimation 点ずつのブロックにして出力する
+    //   pick   : 各ブロックの先頭の点
+    //   mean   : 各ブロックの平均 (時刻はブロックの中央)
+    //   minmax : 各ブロック2行 (先頭時刻と各列の最小値, 末尾時刻と各列の最大値)。区間集計インデックスで O(log n)
+    // seq [first, first + blocks * txyDecimation) はバッファに残っていること
+    void writeTxy(uint64_t first, int blocks) {
+        const auto& rb = pCfg->ringBuffer;
+        const uint64_t capacity = static_cast<uint64_t>(rb.getMeasurementSize());
+        const int numChannels = pCfg->scope.ch[1].enable ? 2 : 1;
+        const size_t cols = 1 + 2 * numChannels;
+        const int n = txyDecimation;
+        if (n == 1 || txyDecimMode == DecimMode::Pick) {
+            writeTable(blocks, cols, [&](size_t r, size_t c) {
+                const size_t p = (first + r * n) % capacity;
+                if (c == 0) return rb.times[p];
+                const auto& xy = rb.ch[(c - 1) / 2];
+                return static_cast<double>((c % 2 == 1) ? xy.x[p] : xy.y[p]);
+                });
+            return;
+        }
+
+        const bool minMax = (txyDecimMode == DecimMode::MinMax);
+        const size_t rowsPerBlock = minMax ? 2 : 1;
+        txyTable.resize(blocks * rowsPerBlock * cols);
+        for (int b = 0; b < blocks; ++b) {
+            const uint64_t s0 = first + static_cast<uint64_t>(b) * n;
+            double* row = &txyTable[b * rowsPerBlock * cols];
+            const double t0 = rb.times[s0 % capacity];
+            const double t1 = rb.times[(s0 + n - 1) % capacity];
+            row[0] = minMax ? t0 : 0.5 * (t0 + t1);
+            if (minMax) row[cols] = t1;
+            for (size_t c = 1; c < cols; ++c) {
+                const int comp = (c % 2 == 1) ? LiaConfigDefaultConsts::COMPONENT_X : LiaConfigDefaultConsts::COMPONENT_Y;
+                const RangeStats st = rb.statsBySeq(static_cast<int>(c - 1) / 2, comp, s0, s0 + n);
+                if (minMax) {
+                    row[c] = st.min;
+                    row[cols + c] = st.max;
+                }
+                else {
+                    row[c] = st.mean();
+                }
+            }
+        }
+        writeTable(blocks * rowsPerBlock, cols, [this, cols](size_t r, size_t c) { return txyTable[r * cols + c]; });
+    }
+
+    // data:txy:decim [n] [pick|mean|minmax|?]
+    bool handleTxyDecim(std::string_view subCmd) {
+        static constexpr const char* MODES[] = { "pick", "mean", "minmax" };
+        if (subCmd == "decim?" || (arguments.size() == 1 && arguments[0] == "?")) {
+            out << std::format("{},{}\n", txyDecimation, MODES[static_cast<int>(txyDecimMode)]);
+            return true;
+        }
+        if (arguments.empty()) return false;
+        int n = txyDecimation;
+        DecimMode mode = txyDecimMode;
+        for (const auto& a : arguments) {
+            const auto it = std::find(std::begin(MODES), std::end(MODES), a);
+            if (it != std::end(MODES)) {
+                mode = static_cast<DecimMode>(it - std::begin(MODES));
+                continue;
+            }
+            if (!utils::parseNumber(a, n) || n < 1) return false;
+        }
+        txyDecimation = n;
+        txyDecimMode = mode;
+        return true;
+    }
+
     // ★ Data 処理
-    bool handleData(const std::vector<std::string>& tokens, const std::string& arg, float val) {
+    bool handleData(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const std::string_view arg = cmd.arg;
+        const float val = cmd.value;
         if (tokens.size() < 2) return false;
-        const std::string& subCmd = tokens[1];
+        const std::string_view subCmd = tokens[1];
 
         if (subCmd == "raw") {
             if (tokens.size() > 2) {
-                if (tokens[2] == "save")  return arg.empty() ? pCfg->saveRawData() : pCfg->saveRawData(arg.c_str());
-                if (tokens[2] == "size?") { std::cout << pCfg->scope.ch[0].waveform.size() << "\n"; return true; }
+                if (tokens[2] == "save")  return pCfg->saveRawData(arg.empty() ? pCfg->save.fileName("raw") : std::string(arg));
+                if (tokens[2] == "size?") { out << pCfg->scope.ch[0].waveform.size() << "\n"; return true; }
             }
             return false;
         }
 
+        if (subCmd == "wait" && tokens.size() == 2) {
+            int n = 0;
+            double timeoutSec = -1.0; // 既定は LiaConfig::waitUntilSeq の見積もり
+            if (arguments.empty() || !utils::parseNumber(arguments[0], n) || n < 1) return false;
+            if (arguments.size() > 1 && !utils::parseNumber(arguments[1], timeoutSec)) return false;
+            int generation = 0;
+            {
+                const auto ringLock = pCfg->lockRingBuffer();
+                generation = pCfg->ringBuffer.generation;
+            }
+            uint64_t base = 0;
+            if (!waitFresh(static_cast<uint64_t>(n), timeoutSec, base)) {
+                out << "-1\n";
+                return true;
+            }
+            // events.seq() (再配置でも戻らない) で数えた点数を、リングバッファの seq に直してカーソルにする
+            // seq を先に読むので、読む間に1点進んでも変更前の点は含まない
+            const uint64_t fresh = pCfg->events.seq() - base;
+            const auto ringLock = pCfg->lockRingBuffer();
+            const auto& rb = pCfg->ringBuffer;
+            const uint64_t last = rb.committed();
+            if (rb.generation != generation || fresh > last) { // 待つ間に再配置された: 変更後の点の seq は失われた
+                out << "-1\n";
+                return true;
+            }
+            out << rb.cursorOf(last - fresh) << "\n";
+            return true;
+        }
+
         if (subCmd == "raw?") {
             const double dt = pCfg->scope.samplingDt;
-            const auto& w0 = pCfg->scope.ch[0].waveform;
-            for (size_t i = 0; i < w0.size(); ++i) {
-                std::cout << std::format("{:e},{:e}", dt * i, w0[i]);
-                for (int c = 1; c < pCfg->scope.ch.size(); ++c) {
-                    if (pCfg->scope.ch[c].enable) {
-                        std::cout << std::format(",{:e}", pCfg->scope.ch[c].waveform[i]);
-                    }
-                }
-                std::cout << "\n";
+            std::vector<const std::vector<double>*> columns;
+            for (const auto& ch : pCfg->scope.ch) {
+                if (columns.empty() || ch.enable) columns.push_back(&ch.waveform);
             }
+            writeTable(columns[0]->size(), columns.size() + 1, [&](size_t r, size_t c) {
+                return (c == 0) ? dt * r : (*columns[c - 1])[r];
+                });
             return true;
         }
 
@@ -326,10 +712,10 @@ private:
             if (tokens.size() > 2) {
                 if (tokens[2] == "save") {
                     pCfg->scope.calculateFFT(pCfg->scope.ch[1].enable, pCfg->awg.ch[0].freq);
-                    return arg.empty() ? pCfg->saveFftData() : pCfg->saveFftData(arg.c_str());
+                    return pCfg->saveFftData(arg.empty() ? pCfg->save.fileName("fft") : std::string(arg));
                 }
                 if (tokens[2] == "size?") {
-                    std::cout << pCfg->scope.freqs.size() << "\n";
+                    out << pCfg->scope.freqs.size() << "\n";
                     return true;
                 }
             }
@@ -339,73 +725,289 @@ private:
         if (subCmd == "fft?") {
             pCfg->scope.calculateFFT(pCfg->scope.ch[1].enable, pCfg->awg.ch[0].freq);
             const auto& freqs = pCfg->scope.freqs;
-            for (size_t i = 0; i < freqs.size(); ++i) {
-                std::cout << std::format("{:e},{:e}", freqs[i], pCfg->scope.ch[0].fftAbs[i]);
-                for (int c = 1; c < pCfg->scope.ch.size(); ++c) {
-                    if (pCfg->scope.ch[c].enable) {
-                        std::cout << std::format(",{:e}", pCfg->scope.ch[c].fftAbs[i]);
-                    }
-                }
-                std::cout << "\n";
+            std::vector<const std::vector<double>*> columns;
+            for (const auto& ch : pCfg->scope.ch) {
+                if (columns.empty() || ch.enable) columns.push_back(&ch.fftAbs);
             }
+            writeTable(freqs.size(), columns.size() + 1, [&](size_t r, size_t c) {
+                return (c == 0) ? freqs[r] : (*columns[c - 1])[r];
+                });
             return true;
         }
 
-        if (subCmd == "txy?") {
-            int size = pCfg->ringBuffer.size;
-            if (val > 0) {
-                size = static_cast<int>(val / pCfg->ringBuffer.getDt());
-                size = std::min(size, pCfg->ringBuffer.size);
-            }
+        if (subCmd == "txy" && tokens.size() > 2 && tokens[2] == "save") {
+            double sec = 0.0;
+            if (!arguments.empty() && !utils::parseNumber(arguments[0], sec)) return false;
+            const std::string filename = (arguments.size() > 1) ? std::string(arguments[1]) : pCfg->save.fileName("ect_" + pCfg->getCurrentTimestamp());
+            const auto ringLock = pCfg->lockRingBuffer(); // 保存範囲を決める間
+            pCfg->saveResultsAsync(filename, sec);
+            return true;
+        }
 
-            int idx = pCfg->ringBuffer.writeIdx >= size ? pCfg->ringBuffer.writeIdx - size : 0;
-            if (pCfg->ringBuffer.writeIdx < size) {
-                if (pCfg->ringBuffer.nofm <= static_cast<int>(pCfg->ringBuffer.getMeasurementSize())) {
-                    idx = 0;
-                    size = pCfg->ringBuffer.writeIdx;
-                }
-                else {
-                    idx = pCfg->ringBuffer.writeIdx - size + pCfg->ringBuffer.getMeasurementSize();
-                }
+        if (subCmd == "txy" && tokens.size() > 2) {
+            const auto ringLock = pCfg->lockRingBuffer(); // 読む間に再配置で入れ替えられないように
+            const auto& rb = pCfg->ringBuffer;
+            if (tokens[2] == "cursor?") {
+                out << rb.cursorOf(rb.committed()) << "\n";
+                return true;
+            }
+            if (tokens[2] == "decim" || tokens[2] == "decim?") return handleTxyDecim(tokens[2]);
+            if (tokens[2] != "since" || arguments.empty()) return false;
+
+            uint64_t cursor = 0;
+            int maxRows = std::numeric_limits<int>::max();
+            if (!utils::parseNumber(arguments[0], cursor)) return false;
+            if (arguments.size() > 1 && !utils::parseNumber(arguments[1], maxRows)) return false;
+            if (maxRows < 1) return false;
+
+            // seq をバッファに残っている範囲 [oldest, last] に収めてから物理位置にする
+            // 次の書き込み先 (nofm - capacity) は書き込み中の可能性があるので含めない
+            const uint64_t last = rb.committed();
+            const uint64_t oldest = last - std::min<uint64_t>(rb.size, rb.getMeasurementSize() - 1);
+            const uint64_t seq = cursor & LiaConfig::RingBuffer::CURSOR_SEQ_MASK;
+            uint64_t first = seq, skipped = 0;
+            const bool reset = (cursor >> LiaConfig::RingBuffer::CURSOR_SEQ_BITS) != static_cast<uint64_t>(rb.generation) || seq > last;
+            if (reset) { // 再配置前のカーソル: 別の点を指しているので最古の点からやり直させる
+                first = oldest;
             }
+            else if (seq < oldest) {
+                skipped = oldest - seq;
+                first = oldest;
+            }
+            // 揃わない端数は次の問い合わせに回す
+            const int rowsPerBlock = (txyDecimation > 1 && txyDecimMode == DecimMode::MinMax) ? 2 : 1;
+            const int blocks = static_cast<int>(std::min<uint64_t>((last - first) / txyDecimation, std::max(1, maxRows / rowsPerBlock)));
+            const uint64_t next = rb.cursorOf(first + static_cast<uint64_t>(blocks) * txyDecimation);
+            if (reset) out << std::format("{},{},reset\n", blocks * rowsPerBlock, next);
+            else out << std::format("{},{},{}\n", blocks * rowsPerBlock, next, skipped);
+            writeTxy(first, blocks);
+            return true;
+        }
 
-            std::cout << size << "\n";
+        if (subCmd == "txy?") {
+            const auto ringLock = pCfg->lockRingBuffer();
             const auto& rb = pCfg->ringBuffer;
-            for (size_t i = 0; i < size; ++i) {
-                std::cout << std::format("{:e},{:e},{:e}", rb.times[idx], rb.ch[0].x[idx], rb.ch[0].y[idx]);
-                for (int c = 1; c < pCfg->scope.ch.size(); ++c) {
-                    if (pCfg->scope.ch[c].enable) {
-                        std::cout << std::format(",{:e},{:e}", rb.ch[c].x[idx], rb.ch[c].y[idx]);
+            int size = rb.size;
+            if (val > 0) size = std::min(static_cast<int>(val / rb.getDt()), rb.size);
+
+            // 最新の点で終わるようにブロックを揃える
+            const int blocks = size / txyDecimation;
+            const int rowsPerBlock = (txyDecimation > 1 && txyDecimMode == DecimMode::MinMax) ? 2 : 1;
+            if (dataFormat == DataFormat::Ascii) out << blocks * rowsPerBlock << "\n";
+            writeTxy(rb.nofm - blocks * txyDecimation, blocks);
+            return true;
+        }
+
+        if (subCmd == "stats?") {
+            const auto ringLock = pCfg->lockRingBuffer();
+            const auto& rb = pCfg->ringBuffer;
+            double t0 = -std::numeric_limits<double>::infinity();
+            double t1 = std::numeric_limits<double>::infinity();
+            if (arguments.size() >= 2) {
+                if (!utils::parseNumber(arguments[0], t0) || !utils::parseNumber(arguments[1], t1)) return false;
+            }
+            else if (arguments.size() == 1 && rb.size > 0) {
+                double sec = 0.0;
+                if (!utils::parseNumber(arguments[0], sec)) return false;
+                t1 = rb.times[rb.latestIdx];
+                t0 = t1 - sec;
+            }
+            if (t0 > t1) return false;
+
+            const int first = rb.lowerBound(t0);
+            const int last = rb.lowerBound(std::nextafter(t1, std::numeric_limits<double>::infinity()));
+            out << std::max(0, last - first) << "\n";
+            for (size_t c = 0; c < pCfg->scope.ch.size(); ++c) {
+                if (c > 0 && !pCfg->scope.ch[c].enable) continue;
+                for (int comp : { LiaConfigDefaultConsts::COMPONENT_X, LiaConfigDefaultConsts::COMPONENT_Y }) {
+                    const RangeStats st = rb.statsByLogical(static_cast<int>(c), comp, first, last);
+                    if (st.count == 0) {
+                        out << "0,0,0,0,0,0\n";
+                        continue;
                     }
+                    out << std::format("{:e},{:e},{:e},{:e},{:e},{:e}\n",
+                        st.min, rb.times[st.minIdx], st.max, rb.times[st.maxIdx], st.mean(), st.stddev());
                 }
-                std::cout << "\n";
-                idx = (idx + 1) % rb.getMeasurementSize();
             }
             return true;
         }
 
+        if (subCmd == "trend?") {
+            // 範囲を省くと測定開始から最新の 1s ビンまで (段は実際の長さで選ぶ)
+            double t0 = 0.0, t1 = pCfg->trendStore.info(0).latest;
+            int maxPoints = 1000;
+            if (arguments.size() >= 2 && (!utils::parseNumber(arguments[0], t0) || !utils::parseNumber(arguments[1], t1))) return false;
+            if (arguments.size() >= 3 && !utils::parseNumber(arguments[2], maxPoints)) return false;
+            if (t0 > t1 || maxPoints < 1) return false;
+
+            double period = 0.0;
+            const auto bins = pCfg->trendStore.query(t0, t1, maxPoints, period);
+            const int numSeries = pCfg->scope.ch[1].enable ? TrendStore::NUM_SERIES : 2;
+            out << std::format("{},{:e}\n", bins.size(), period);
+            for (const auto& b : bins) {
+                out << std::format("{:e},{}", b.t, b.s[0].count);
+                for (int k = 0; k < numSeries; ++k) {
+                    const auto& st = b.s[k];
+                    if (st.count > 0) out << std::format(",{:e},{:e},{:e},{:e}", st.min, st.max, st.mean(), st.stddev());
+                    else out << ",0,0,0,0";
+                }
+                out << "\n";
+            }
+            return true;
+        }
+
+        if (subCmd == "trend" && tokens.size() > 2 && tokens[2] == "tiers?") {
+            for (int i = 0; i < TrendStore::NUM_TIERS; ++i) {
+                const auto info = pCfg->trendStore.info(i);
+                out << std::format("{:e},{},{},{:e},{:e}\n", info.period, info.size, info.capacity, info.oldest, info.latest);
+            }
+            return true;
+        }
+
+        if (subCmd == "history?") {
+            const auto& h = pCfg->frameHistory;
+            out << std::format("{},{},{:e},{:e},{:.1f},{}\n", h.size(), h.capacity(), h.oldestTime(), h.latestTime(), h.megaBytes(), h.rejectedFrames());
+            return true;
+        }
+
+        if (subCmd == "history" && tokens.size() > 2) {
+            if (tokens[2] == "redemod") {
+                if (arguments.size() < 2) return false;
+                Redemodulator::Params params;
+                bool ok = utils::parseNumber(arguments[0], params.t0) && utils::parseNumber(arguments[1], params.t1);
+                if (arguments.size() > 2) ok = ok && utils::parseNumber(arguments[2], params.harmonic);
+                if (arguments.size() > 3) ok = ok && utils::parseNumber(arguments[3], params.phaseDeg[0]);
+                params.phaseDeg[1] = params.phaseDeg[0];
+                if (arguments.size() > 4) ok = ok && utils::parseNumber(arguments[4], params.phaseDeg[1]);
+                if (arguments.size() > 5) ok = ok && Psd::parseWindow(arguments[5], params.window);
+                if (!ok) return false;
+                if (params.t0 > params.t1 || params.harmonic < 1) return false;
+                return pCfg->redemodulator.start(pCfg->frameHistory, params);
+            }
+            if (tokens[2] == "status?") {
+                const auto& r = pCfg->redemodulator;
+                const double fps = r.isRunning() ? 0.0 : r.result().framesPerSec;
+                out << std::format("{},{},{},{:.1f}\n", r.isRunning() ? "running" : "done", r.processedFrames(), r.totalFrames(), fps);
+                return true;
+            }
+            if (tokens[2] == "result?") {
+                if (pCfg->redemodulator.isRunning()) return false;
+                const auto res = pCfg->redemodulator.result();
+                out << res.t.size() << "\n";
+                for (size_t i = 0; i < res.t.size(); ++i) {
+                    out << std::format("{:e},{:e},{:e}", res.t[i], res.x[0][i], res.y[0][i]);
+                    if (res.numChannels > 1) out << std::format(",{:e},{:e}", res.x[1][i], res.y[1][i]);
+                    out << "\n";
+                }
+                return true;
+            }
+            return false;
+        }
+
+        if (subCmd == "stream" || subCmd == "stream?") return handleStream(tokens, arg);
+
         if (subCmd == "xy?") {
+            const auto ringLock = pCfg->lockRingBuffer();
             const size_t idx = pCfg->ringBuffer.latestIdx;
             const auto& rb = pCfg->ringBuffer;
-            std::cout << std::format("{:e},{:e}", rb.ch[0].x[idx], rb.ch[0].y[idx]);
-            for (int c = 1; c < pCfg->scope.ch.size(); ++c) {
+            out << std::format("{:e},{:e}", rb.ch[0].x[idx], rb.ch[0].y[idx]);
+            for (size_t c = 1; c < pCfg->scope.ch.size(); ++c) {
                 if (pCfg->scope.ch[c].enable) {
-                    std::cout << std::format(",{:e},{:e}", rb.ch[c].x[idx], rb.ch[c].y[idx]);
+                    out << std::format(",{:e},{:e}", rb.ch[c].x[idx], rb.ch[c].y[idx]);
                 }
             }
-            std::cout << "\n";
+            out << "\n";
+            return true;
+        }
+
+        return false;
+    }
+
+    // ★ data:stream (on [n] | off | ?), data:stream:decim, data:stream:stats?
+    //   コマンド処理中は outMtx を保持しているので、ここでは停止要求だけ出して join しない
+    bool handleStream(std::span<const std::string_view> tokens, std::string_view arg) {
+        auto& ps = pCfg->pointStream;
+        const bool on = (streamId >= 0 && !streamThread.get_stop_token().stop_requested());
+        auto parseDecimation = [](std::string_view s, int& n) { return utils::parseNumber(s, n) && n >= 1; };
+
+        if (tokens[1] == "stream?" || (tokens.size() == 2 && arg == "?")) {
+            out << (on ? "on\n" : "off\n");
+            return true;
+        }
+        if (tokens.size() == 2) {
+            if (arg == "off") {
+                if (streamThread.joinable()) streamThread.request_stop();
+                return true;
+            }
+            if (arg != "on") return false;
+            int n = 1;
+            if (arguments.size() > 1 && !parseDecimation(arguments[1], n)) return false;
+            if (on) {
+                ps.setDecimation(streamId, n);
+                return true;
+            }
+            streamId = ps.subscribe(n);
+            if (streamId < 0) return false;
+            streamSent = 0;
+            streamThread = std::jthread([this](std::stop_token st) { streamLoop(st); });
             return true;
         }
 
+        if (tokens[2] == "decim" || tokens[2] == "decim?") {
+            if (tokens[2] == "decim?" || arg == "?") {
+                out << ps.stats(streamId).decimation << "\n";
+                return true;
+            }
+            int n = 1;
+            if (!on || !parseDecimation(arg, n)) return false;
+            ps.setDecimation(streamId, n);
+            return true;
+        }
+        if (tokens[2] == "stats?") {
+            const auto s = ps.stats(streamId);
+            out << std::format("{},{},{},{},{}\n", on ? "on" : "off", s.decimation, streamSent.load(), s.dropped, s.queued);
+            return true;
+        }
         return false;
     }
 
-    bool handlePlot(const std::vector<std::string>& tokens, const std::string& arg, float val) {
+    void streamLoop(std::stop_token st) {
+        constexpr size_t MAX_BATCH = 1024;
+        std::vector<StreamPoint> batch(MAX_BATCH);
+        std::vector<char> buffer;
+        while (true) {
+            const size_t n = pCfg->pointStream.read(streamId, batch.data(), MAX_BATCH, st);
+            if (n == 0) break;
+            std::lock_guard<std::mutex> lock(outMtx);
+            if (st.stop_requested()) break; // off の応答より後には書かない
+            if (dataFormat == DataFormat::Ascii) PointStream::formatText(buffer, batch.data(), n, pCfg->scope.ch[1].enable ? 2 : 1);
+            else PointStream::formatBlock(buffer, batch.data(), n);
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            out.flush();
+            streamSent += n;
+        }
+    }
+
+    // outMtx を保持していないときに呼ぶ
+    void stopStream() {
+        if (streamThread.joinable()) {
+            streamThread.request_stop();
+            streamThread.join();
+        }
+        if (streamId >= 0) {
+            pCfg->pointStream.unsubscribe(streamId);
+            streamId = -1;
+        }
+    }
+
+    bool handlePlot(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const float val = cmd.value;
         if (tokens.size() < 2) return false;
 
-        std::string subCmd = tokens[1];
+        std::string_view subCmd = tokens[1];
         bool isQuery = (subCmd.back() == '?');
-        if (isQuery) subCmd.pop_back();
+        if (isQuery) subCmd.remove_suffix(1);
 
         // plot:raw:limit または plot:xy:limit
         if (tokens.size() >= 3 && tokens[2] == "limit") {
@@ -422,30 +1024,61 @@ private:
         return false;
     }
 
+    // ★ buffer (buffer:dt, buffer:sec)
+    bool handleBuffer(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const std::string_view arg = cmd.arg;
+        if (tokens.size() < 2) return false;
+
+        std::string_view subCmd = tokens[1];
+        bool isQuery = (subCmd.back() == '?');
+        if (isQuery) subCmd.remove_suffix(1);
+
+        const auto& rb = pCfg->ringBuffer;
+        if (subCmd == "relayout" && isQuery) {
+            out << (pCfg->relayout.busy ? "busy\n" : "idle\n");
+            return true;
+        }
+        if (subCmd != "dt" && subCmd != "sec") return false;
+        if (isQuery) {
+            out << std::format("{:e}\n", subCmd == "dt" ? rb.getDt() : rb.sec);
+            return true;
+        }
+
+        double newValue = 0.0;
+        if (!utils::parseNumber(arg, newValue)) return false;
+        return (subCmd == "dt")
+            ? pCfg->requestRingBufferRelayout(newValue, rb.sec)
+            : pCfg->requestRingBufferRelayout(rb.getDt(), newValue);
+    }
+
     // ★ awg (w[n]:amp, w[n]:freq など)
-    bool handleAwg(int chIndex, const std::vector<std::string>& tokens, const std::string& arg, float val) {
+    bool handleAwg(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const std::string_view arg = cmd.arg;
+        const float val = cmd.value;
+        const int chIndex = cmd.ch;
         if (tokens.size() < 2 || chIndex < 0 || chIndex >= pCfg->awg.ch.size()) return false;
 
         auto& ch = pCfg->awg.ch[chIndex];
-        std::string subCmd = tokens[1];
+        std::string_view subCmd = tokens[1];
         bool isQuery = (subCmd.back() == '?');
-        if (isQuery) subCmd.pop_back();
+        if (isQuery) subCmd.remove_suffix(1);
 
         if (subCmd == "phase") {
-            if (isQuery) { std::cout << ch.phase << "\n"; }
-            else { ch.phase = val; awgUpdateRequired = true; }
+            if (isQuery) { out << ch.phase << "\n"; }
+            else return submitControl(ControlCommand::Op::AwgPhase, chIndex, val);
             return true;
         }
 
         if (subCmd == "freq" || subCmd == "frequency") {
             if (isQuery) {
-                if (arg == "min")      std::cout << pCfg->scope.lowLimitFreq << "\n";
-                else if (arg == "max") std::cout << pCfg->scope.highLimitFreq << "\n";
-                else                   std::cout << ch.freq << "\n";
+                if (arg == "min")      out << pCfg->scope.lowLimitFreq << "\n";
+                else if (arg == "max") out << pCfg->scope.highLimitFreq << "\n";
+                else                   out << ch.freq << "\n";
             }
             else if (val >= pCfg->scope.lowLimitFreq && val <= pCfg->scope.highLimitFreq) {
-                ch.freq = val;
-                awgUpdateRequired = true;
+                return submitControl(ControlCommand::Op::AwgFreq, chIndex, val);
             }
             else return false;
             return true;
@@ -453,13 +1086,12 @@ private:
 
         if (subCmd == "volt" || subCmd == "voltage" || subCmd == "amp" || subCmd == "amplitude") {
             if (isQuery) {
-                if (arg == "min")      std::cout << pCfg->awg.AWG_AMP_MIN << "\n";
-                else if (arg == "max") std::cout << pCfg->awg.AWG_AMP_MAX << "\n";
-                else                   std::cout << ch.amp << "\n";
+                if (arg == "min")      out << pCfg->awg.AWG_AMP_MIN << "\n";
+                else if (arg == "max") out << pCfg->awg.AWG_AMP_MAX << "\n";
+                else                   out << ch.amp << "\n";
             }
             else if (val >= pCfg->awg.AWG_AMP_MIN && val <= pCfg->awg.AWG_AMP_MAX) {
-                ch.amp = val;
-                awgUpdateRequired = true;
+                return submitControl(ControlCommand::Op::AwgAmp, chIndex, val);
             }
             else return false;
             return true;
@@ -467,17 +1099,18 @@ private:
 
         if (subCmd == "func" || subCmd == "function") {
             if (isQuery) {
-                if (ch.func == 1)      std::cout << "sine\n";
-                else if (ch.func == 2) std::cout << "square\n";
-                else if (ch.func == 3) std::cout << "triangle\n";
-                else                   std::cout << "unknown\n";
+                if (ch.func == 1)      out << "sine\n";
+                else if (ch.func == 2) out << "square\n";
+                else if (ch.func == 3) out << "triangle\n";
+                else                   out << "unknown\n";
             }
             else {
-                if (arg == "sine" || arg == "sin")          ch.func = 1;
-                else if (arg == "square" || arg == "sq")    ch.func = 2;
-                else if (arg == "triangle" || arg == "tri") ch.func = 3;
+                int func;
+                if (arg == "sine" || arg == "sin")          func = 1;
+                else if (arg == "square" || arg == "sq")    func = 2;
+                else if (arg == "triangle" || arg == "tri") func = 3;
                 else return false;
-                awgUpdateRequired = true;
+                return submitControl(ControlCommand::Op::AwgFunc, chIndex, func);
             }
             return true;
         }
@@ -486,13 +1119,17 @@ private:
     }
 
     // ★ 後処理 (post[n]:offset:phase, post:hpf など)
-    bool handlePost(int chIndex, const std::vector<std::string>& tokens, const std::string& arg, float val) {
+    bool handlePost(const Command& cmd) {
+        const auto& tokens = cmd.nodes;
+        const std::string_view arg = cmd.arg;
+        const float val = cmd.value;
+        const int chIndex = cmd.ch;
         if (tokens.size() < 2) return false;
 
         if (tokens[1] == "offset" && tokens.size() > 2) {
-            std::string subCmd = tokens[2];
+            std::string_view subCmd = tokens[2];
             bool isQuery = (subCmd.back() == '?');
-            if (isQuery) subCmd.pop_back();
+            if (isQuery) subCmd.remove_suffix(1);
 
             if (subCmd == "auto" && tokens.size() > 3 && tokens[3] == "once") {
                 pCfg->flagAutoOffset = true;
@@ -504,14 +1141,11 @@ private:
                     return true;
                 }
                 if (arg == "off") {
-                    for (int i = 0; i < pCfg->post.offset.size(); ++i) {
-                        pCfg->post.offset[i] = { 0, 0, pCfg->post.offset[i].phase };
-                    }
                     pCfg->flagAutoOffset = false;
-                    return true;
+                    return submitControl(ControlCommand::Op::OffsetClear);
                 }
                 if (isQuery) {
-                    std::cout << (pCfg->flagAutoOffset ? "on\n" : "off\n");
+                    out << (pCfg->flagAutoOffset ? "on\n" : "off\n");
                     return true;
                 }
             }
@@ -519,41 +1153,41 @@ private:
             // calc[n]:offset:phase の処理
             if (subCmd == "phase" && chIndex >= 0 && chIndex < pCfg->post.offset.size()) {
                 if (isQuery) {
-                    std::cout << pCfg->post.offset[chIndex].phase << "\n";
+                    out << pCfg->post.offset[chIndex].phase << "\n";
                 }
                 else {
-                    pCfg->post.offset[chIndex].phase = val;
+                    return submitControl(ControlCommand::Op::OffsetPhase, chIndex, val);
                 }
                 return true;
             }
         }
 
         if (tokens[1] == "hpf" && tokens.size() > 2) {
-            std::string subCmd = tokens[2];
+            std::string_view subCmd = tokens[2];
             bool isQuery = (subCmd.back() == '?');
-            if (isQuery) subCmd.pop_back();
+            if (isQuery) subCmd.remove_suffix(1);
 
             if (subCmd == "freq" || subCmd == "frequency") {
                 if (isQuery) {
-                    std::cout << pCfg->post.hpFreq << "\n";
+                    out << pCfg->post.hpFreq << "\n";
                 }
                 else if (val >= LiaConfigDefaultConsts::POST_HPF_MIN && val <= LiaConfigDefaultConsts::POST_HPF_MAX) {
-                    pCfg->post.hpFreq = val;
+                    return submitControl(ControlCommand::Op::HpfFreq, 0, val);
                 }
                 else return false;
                 return true;
             }
         }
 		else if (tokens[1] == "lpf" && tokens.size() > 2) {
-			std::string subCmd = tokens[2];
+			std::string_view subCmd = tokens[2];
 			bool isQuery = (subCmd.back() == '?');
-			if (isQuery) subCmd.pop_back();
+			if (isQuery) subCmd.remove_suffix(1);
 			if (subCmd == "freq" || subCmd == "frequency") {
 				if (isQuery) {
-					std::cout << pCfg->post.lpFreq << "\n";
+					out << pCfg->post.lpFreq << "\n";
 				}
 				else if (val >= LiaConfigDefaultConsts::POST_LPF_MIN && val <= LiaConfigDefaultConsts::POST_LPF_MAX) {
-					pCfg->post.lpFreq = val;
+					return submitControl(ControlCommand::Op::LpfFreq, 0, val);
 				}
 				else return false;
 				return true;
@@ -567,6 +1201,10 @@ private:
 // エントリーポイント
 // ============================================================
 void pipe(std::stop_token st, LiaConfig* pCfg) {
+#ifdef _WIN32
+    // バイナリブロックの 0x0A が CRLF に変換されないようにする
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
     CommandProcessor processor(pCfg);
     processor.processStream(st);
 }
@@ -630,5 +1268,304 @@ void test_pipe() {
     }
 
     std::cin.rdbuf(oldCinBuffer);
+
+    std::cout << "[Test] Binary block (format:data real,32)..." << std::endl;
+    {
+        std::stringstream input("format:data real,32\ndata:raw?\nformat:data?\n"), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+        const std::string reply = output.str();
+        const auto& w0 = cfg.scope.ch[0].waveform;
+        const std::string len = std::to_string(w0.size() * (cfg.scope.ch[1].enable ? 3 : 2) * sizeof(float));
+        const std::string header = std::format("#{}{}", len.size(), len);
+        assert(reply.starts_with(header));
+        float ch1;
+        std::memcpy(&ch1, reply.data() + header.size() + sizeof(float), sizeof(float)); // 1行目の ch1
+        assert(ch1 == static_cast<float>(w0[0]));
+        assert(reply.size() == header.size() + std::stoul(len) + 1 + std::string("real,32\n").size());
+        assert(reply.ends_with("\nreal,32\n"));
+    }
+
+    std::cout << "[Test] Cursor fetch and decimation (data:txy:since / decim)..." << std::endl;
+    {
+        cfg.scope.ch[1].enable = false;
+        auto& rb = cfg.ringBuffer;
+        const uint64_t base = rb.nofm;
+        for (int i = 0; i < 100; ++i) {
+            rb.ch[0].x[rb.writeIdx] = static_cast<RingSample>(i);
+            rb.ch[0].y[rb.writeIdx] = static_cast<RingSample>(-i);
+            rb.commit(i * rb.getDt());
+        }
+        assert(rb.size == 100);
+        std::stringstream input(std::format(
+            "data:txy:since {} 30\ndata:txy:decim 10 minmax\ndata:txy:since {} 3\ndata:txy:decim mean\ndata:txy? 1\ndata:txy:decim?\n",
+            base + 90, base + 40)), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(output, line); ) lines.push_back(line);
+        auto value = [&lines](size_t line, size_t col) {
+            std::vector<std::string_view> fields;
+            utils::split(lines[line], ',', fields);
+            double v = 0.0;
+            utils::parseNumber(fields[col], v);
+            return v;
+            };
+        // since: 新しい10点と次のカーソル
+        assert(lines[0] == std::format("10,{},0", base + 100));
+        assert(value(1, 1) == 90.0 && value(10, 1) == 99.0);
+        // minmax: 10点を2行に (max 3 行なので1ブロックだけ返し、カーソルはブロック末尾まで進む)
+        assert(lines[11] == std::format("2,{},0", base + 50));
+        assert(value(12, 1) == 40.0 && value(12, 2) == -49.0);
+        assert(value(13, 1) == 49.0 && value(13, 2) == -40.0);
+        // mean: 直近 1 s (500点) のうち有効な 100 点を 10 ブロックに
+        assert(lines[14] == "10");
+        assert(value(15, 1) == 4.5 && value(24, 1) == 94.5);
+        assert(lines[25] == "10,mean");
+    }
+
+    std::cout << "[Test] Parser (';' batches, numbers, errors)..." << std::endl;
+    {
+        assert(utils::parseIndex("chan2") == std::make_pair(std::string_view("chan"), 2));
+        assert(utils::parseIndex("w").second == -1 && utils::parseIndex("2").second == -1);
+        std::stringstream input("w1:amp 0.75; :W1:AMP?;post2:offset:phase +12.5\nbogus?;help:size?\n"), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+        assert(cfg.awg.ch[0].amp == 0.75f && cfg.post.offset[1].phase == 12.5f);
+        assert(output.str() == std::format("0.75\nError: 'bogus?'\n{}\n", HELPS.size()));
+    }
+
+    std::cout << "[Test] Display / offset changes applied at the frame boundary..." << std::endl;
+    {
+        cfg.scope.ch[1].enable = true;
+        cfg.post.offset[0] = { 5.0, 0.1, 0.2 };
+        cfg.setStatus(cfg.statusMeasurement, true); // 測定スレッドの代わりに applyControls を呼ぶまで適用されない
+        std::stringstream input("chan2:disp off;post1:offset:phase 7;post:offset:state off\n"), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+        assert(cfg.scope.ch[1].enable && cfg.post.offset[0].phase == 5.0 && cfg.post.offset[0].x == 0.1);
+        cfg.applyControls();
+        assert(!cfg.scope.ch[1].enable && cfg.post.offset[0].phase == 7.0);
+        assert(cfg.post.offset[0].x == 0.0 && cfg.post.offset[0].y == 0.0); // 位相は残す
+        cfg.setStatus(cfg.statusMeasurement, false);
+        assert(output.str().empty());
+    }
+
+    std::cout << "[Test] Waiting for fresh points (*opc? / data:wait)..." << std::endl;
+    {
+        // 測定スレッドの代わり: フレーム境界で設定を適用し、t = 通し番号 の点を1つずつ確定する
+        auto& rb = cfg.ringBuffer;
+        cfg.awg.ch[1].phase = 0.0f;
+        std::atomic<int> changedAt{ -1 }; // W2 の位相が変わってから最初の点
+        std::jthread feeder([&cfg, &changedAt](std::stop_token st) {
+            cfg.setStatus(cfg.statusMeasurement, true);
+            for (int i = 0; !st.stop_requested(); ++i) {
+                cfg.applyControls();
+                if (cfg.awg.ch[1].phase == 33.0f && changedAt < 0) changedAt = i;
+                cfg.AddPoint(i, 0.0, 0.0);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            cfg.setStatus(cfg.statusMeasurement, false);
+            });
+        cfg.events.wait([&cfg] { return cfg.statusMeasurement.load(); });
+        assert(cfg.waitForPoints(3, 10.0));
+
+        std::stringstream input("w2:phase 33\ndata:wait 5 10\n*opc?\ndata:wait 3 10\n"), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+        feeder.request_stop();
+        feeder.join();
+
+        uint64_t cursor = 0, next = 0;
+        std::string opc;
+        output >> cursor >> opc >> next;
+        auto timeAt = [&rb](uint64_t seq) { return static_cast<int>(rb.times[seq % rb.getMeasurementSize()]); };
+        // 返したカーソルは変更後の最初の点 (応答の間に1点進むと次の点)
+        assert(changedAt > 0 && rb.nofm >= cursor + 5);
+        assert(timeAt(cursor) - changedAt == 0 || timeAt(cursor) - changedAt == 1);
+        assert(opc == "1" && next >= cursor + 5); // 変更は待ち終えているので、2回目は問い合わせた時点から
+
+        // 測定が止まっていれば待たずに -1
+        std::stringstream idleInput("data:wait 1\n"), idleOutput;
+        CommandProcessor idle(&cfg, idleInput, idleOutput);
+        idle.processStream(std::stop_token());
+        assert(idleOutput.str() == "-1\n");
+    }
+
+    std::cout << "[Test] data:wait across a ring buffer re-layout..." << std::endl;
+    {
+        // 待つ間に再配置されると、変更後の点の seq は新しいバッファにないので -1
+        LiaConfig rcfg;
+        std::atomic<int> frames{ 0 };
+        std::jthread feeder([&rcfg, &frames](std::stop_token st) {
+            rcfg.setStatus(rcfg.statusMeasurement, true);
+            for (int i = 0; !st.stop_requested(); ++i) {
+                rcfg.applyControls();
+                rcfg.applyRingBufferRelayout();
+                if (i == 50) rcfg.requestRingBufferRelayout(2 * rcfg.ringBuffer.getDt(), rcfg.ringBuffer.sec);
+                rcfg.AddPoint(i, 0.0, 0.0);
+                ++frames;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            rcfg.setStatus(rcfg.statusMeasurement, false);
+            });
+        rcfg.events.wait([&rcfg] { return rcfg.statusMeasurement.load(); });
+        std::stringstream input("data:wait 200 10\n"), output;
+        CommandProcessor processor(&rcfg, input, output);
+        processor.processStream(std::stop_token());
+        feeder.request_stop();
+        feeder.join();
+        while (rcfg.relayout.busy) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(frames > 50 && rcfg.ringBuffer.generation == 1 && output.str() == "-1\n");
+    }
+
+    std::cout << "[Test] Simulated source through the acquisition/processing pipeline..." << std::endl;
+    {
+        // 変更の前に取り込んだフレームの点は、変更後の点に数えない
+        SimulatedSource sim;
+        FramePipeline::Frame stale;
+        stale.tag = cfg.controls.applied();
+        sim.acquire(cfg, stale);
+        stale.valid = true;
+        const uint64_t ticket = cfg.submit({ ControlCommand::Op::AwgAmp, 1, 0.25 }); // 測定していないのでその場で適用
+        assert(cfg.controls.applied() >= ticket && cfg.controlsSeq == cfg.events.seq());
+        cfg.processFrame(stale);
+        assert(cfg.controlsSeq == cfg.events.seq());
+        FramePipeline::Frame fresh;
+        fresh.tag = cfg.controls.applied();
+        sim.acquire(cfg, fresh);
+        fresh.valid = true;
+        cfg.processFrame(fresh);
+        assert(cfg.controlsSeq + 1 == cfg.events.seq());
+
+        // ch2 を有効にする前に取り込んだフレームは ch1 だけで復調する (ch2 の波形は前のフレームのまま)
+        const bool ch2 = cfg.scope.ch[1].enable;
+        cfg.scope.ch[1].enable = false;
+        FramePipeline::Frame ch1Only;
+        ch1Only.tag = cfg.controls.applied();
+        sim.acquire(cfg, ch1Only);
+        ch1Only.valid = true;
+        cfg.scope.ch[1].enable = true;
+        cfg.processFrame(ch1Only);
+        FrameHistory::FrameInfo info;
+        std::vector<double> w1, w2;
+        assert(cfg.frameHistory.read(cfg.frameHistory.totalFrames() - 1, info, w1, w2) && info.numChannels == 1);
+        cfg.scope.ch[1].enable = ch2;
+
+        std::jthread measurement([&cfg, &sim](std::stop_token st) { runMeasurement(st, cfg, sim); });
+        cfg.events.wait([&cfg] { return cfg.statusMeasurement.load(); });
+        const uint64_t nofm = cfg.ringBuffer.nofm;
+        std::stringstream input("w1:amp 0.5\ntimer:margin 300\ndata:wait 20 10\n*opc?\npipeline:stats?\ntimer:margin?\ntimer:stats?\n"), output;
+        CommandProcessor processor(&cfg, input, output);
+        processor.processStream(std::stop_token());
+        measurement.request_stop();
+        measurement.join();
+
+        uint64_t cursor = 0;
+        std::string opc, stats, margin, timerStats;
+        output >> cursor >> opc >> stats >> margin >> timerStats;
+        std::vector<std::string_view> fields;
+        utils::split(stats, ',', fields);
+        uint64_t frames = 0;
+        assert(cursor >= nofm && opc == "1" && fields.size() == 7 && fields[0] == "on");
+        assert(utils::parseNumber(fields[1], frames) && frames >= 20 && cfg.ringBuffer.nofm - nofm >= 20);
+        assert(cfg.awg.ch[0].amp == 0.5f && !cfg.pipeline.stats().running);
+        utils::split(timerStats, ',', fields);
+        uint64_t waits = 0;
+        assert(margin == "300" && cfg.timer.spinMargin() > 299e-6 && cfg.timer.spinMargin() < 301e-6);
+        assert(fields.size() == 6 && utils::parseNumber(fields[0], waits) && waits >= 20);
+        cfg.setSpinMargin(LiaConfigDefaultConsts::TIMER_SPIN_MARGIN_US);
+        std::cout << "  pipeline:stats? " << stats << ", timer:stats? " << timerStats << std::endl;
+    }
+
+    std::cout << "[Test] Ring buffer re-layout (buffer:dt averages, size bound)..." << std::endl;
+    {
+        LiaConfig rcfg;
+        auto& rb = rcfg.ringBuffer;
+        const double dt = rb.getDt();
+        constexpr int N = 1000;
+        for (int n = 0; n < N; ++n) {
+            rb.ch[0].x[rb.writeIdx] = static_cast<RingSample>(n);
+            rb.ch[0].y[rb.writeIdx] = static_cast<RingSample>(-n);
+            rb.commit(n * dt);
+        }
+        assert(!rcfg.requestRingBufferRelayout(1e-3, 43200.0)); // 12 時間 x 1 ms はメモリの上限を超える
+        std::stringstream input(std::format("buffer:dt {:e}\n", 2 * dt)), output;
+        CommandProcessor processor(&rcfg, input, output);
+        processor.processStream(std::stop_token());
+        assert(output.str().empty());
+        while (rcfg.relayout.busy) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // 2点ずつの平均。時刻は各周期の最初の点
+        const auto lock = rcfg.lockRingBuffer();
+        assert(rb.getDt() == 2 * dt && rb.nofm == N / 2 && rb.generation == 1);
+        for (int k = 0; k < N / 2; ++k) {
+            assert(rb.ch[0].x[k] == 2 * k + 0.5 && rb.ch[0].y[k] == -(2 * k + 0.5));
+            assert(std::abs(rb.times[k] - 2 * k * dt) < 1e-6);
+        }
+        std::cout << "  " << N << " points -> " << rb.nofm << " means" << std::endl;
+
+        // 再配置前のカーソルは reset を返し、最古の点からやり直す
+        std::stringstream since(std::format("data:txy:cursor?\ndata:txy:since {} 5\ndata:txy:since {} 5\n", N - 10, rb.cursorOf(N / 2 - 5))), sinceOutput;
+        CommandProcessor sinceProcessor(&rcfg, since, sinceOutput);
+        sinceProcessor.processStream(std::stop_token());
+        std::string cursor, stale, fresh;
+        std::getline(sinceOutput, cursor);
+        assert(cursor == std::to_string((uint64_t{ 1 } << LiaConfig::RingBuffer::CURSOR_SEQ_BITS) + N / 2));
+        std::getline(sinceOutput, stale);
+        assert(stale == std::format("5,{},reset", rb.cursorOf(5)));
+        for (int r = 0; r < 5; ++r) std::getline(sinceOutput, fresh); // reset で返した最古の 5 点
+        std::getline(sinceOutput, fresh);
+        assert(fresh == std::format("5,{},0", rb.cursorOf(N / 2)));
+    }
     std::cout << "--- Test Passed ---" << std::endl;
 }
+
+// data:txy? の応答時間: ascii と real,64 / int,16 の比較 (リングバッファ全体)
+void bench_pipeData() {
+    std::cout << "--- Pipe data:txy? Benchmark ---" << std::endl;
+    LiaConfig cfg;
+    auto& rb = cfg.ringBuffer;
+    for (int i = 0; i < rb.getMeasurementSize(); ++i) {
+        for (int c = 0; c < 2; ++c) {
+            rb.ch[c].x[rb.writeIdx] = static_cast<RingSample>(std::sin(1e-3 * i) * (c + 1));
+            rb.ch[c].y[rb.writeIdx] = static_cast<RingSample>(std::cos(1e-3 * i) * (c + 1));
+        }
+        rb.commit(rb.getDt() * i);
+    }
+    for (const char* format : { "ascii", "real,64", "real,32", "int,16" }) {
+        std::stringstream input(std::format("format:data {}\ndata:txy?\n", format)), output;
+        CommandProcessor processor(&cfg, input, output);
+        const auto start = std::chrono::steady_clock::now();
+        processor.processStream(std::stop_token());
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("  {:8s}: {} rows, {:.1f} MB, {:.1f} ms\n", format, rb.size, output.str().size() / 1e6, sec * 1e3);
+    }
+}
+
+// コマンド処理のスループット (commands/s): 設定・問い合わせ・';' でまとめた行
+void bench_commandParser(size_t lines = 200000) {
+    std::cout << "--- Command Parser Benchmark ---" << std::endl;
+    LiaConfig cfg;
+    struct Case { const char* name; std::string line; int commands; };
+    const Case cases[] = {
+        { "set", "w1:freq 100000", 1 },
+        { "query", ":w1:freq?", 1 },
+        { "batch", "w1:freq 100000;w1:amp 0.5;post1:offset:phase 10;w2:phase 0", 4 },
+    };
+    for (const auto& c : cases) {
+        std::string script;
+        script.reserve(lines * (c.line.size() + 1));
+        for (size_t i = 0; i < lines; ++i) {
+            script += c.line;
+            script += '\n';
+        }
+        std::stringstream input(script), output;
+        CommandProcessor processor(&cfg, input, output);
+        const auto start = std::chrono::steady_clock::now();
+        processor.processStream(std::stop_token());
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::format("  {}: {:.0f} commands/s ({})\n", c.name, lines * c.commands / sec, c.line);
+    }
+}